@@ -0,0 +1,351 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Converted image cache for DisplayBMP
+//
+//  The visible part of an image, converted and scaled for one screen
+//  mode, is kept in a sidecar file next to the image so that showing
+//  it again is a plain read of BLT pixels.  The cache is keyed by the
+//  size, modification time and a hash of the image file and by the
+//  mode and scaling it was laid out for.
+//
+//  License: BSD License
+//
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/ShellLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+#include "Cache.h"
+
+
+#define FNV_OFFSET_BASIS     0xcbf29ce484222325ULL
+#define FNV_PRIME            0x00000100000001b3ULL
+
+#define CACHE_KEY_SIZE       OFFSET_OF(IMAGE_CACHE_HEADER, DestX)
+
+
+//
+// FNV-1a over a buffer
+//
+static UINT64
+HashBuffer( UINT64 Hash,
+            UINT8 *Buffer,
+            UINTN Size)
+{
+    for (UINTN i = 0; i < Size; i++) {
+        Hash ^= Buffer[i];
+        Hash *= FNV_PRIME;
+    }
+
+    return Hash;
+}
+
+
+//
+// Hash up to IMAGE_CACHE_HASH_SIZE bytes of the file at Offset
+//
+static EFI_STATUS
+HashFileRange( SHELL_FILE_HANDLE FileHandle,
+               UINT64 Offset,
+               UINT8 *Buffer,
+               UINT64 *Hash)
+{
+    EFI_STATUS Status;
+    UINTN Size = IMAGE_CACHE_HASH_SIZE;
+
+    Status = ShellSetFilePosition(FileHandle, Offset);
+    if (!EFI_ERROR(Status)) {
+        Status = ShellReadFile(FileHandle, &Size, Buffer);
+    }
+    if (!EFI_ERROR(Status)) {
+        *Hash = HashBuffer(*Hash, Buffer, Size);
+    }
+
+    return Status;
+}
+
+
+//
+// Build the lookup key for an image shown on the current mode.  Only
+// the start of the file (header, palette and first rows) and its end
+// are hashed; hashing all of it would mean reading the whole image on
+// every display, which is what the cache is there to avoid.
+//
+EFI_STATUS
+CacheMakeKey( SHELL_FILE_HANDLE FileHandle,
+              EFI_FILE_INFO *FileInfo,
+              EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+              UINTN Scaling,
+              BOOLEAN Bilinear,
+              IMAGE_CACHE_HEADER *Key)
+{
+    EFI_STATUS Status;
+    UINT8 *Buffer;
+    UINT64 Hash = FNV_OFFSET_BASIS;
+
+    Buffer = AllocatePool(IMAGE_CACHE_HASH_SIZE);
+    if (Buffer == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    Status = HashFileRange(FileHandle, 0, Buffer, &Hash);
+    if (!EFI_ERROR(Status) && FileInfo->FileSize > IMAGE_CACHE_HASH_SIZE) {
+        Status = HashFileRange( FileHandle,
+                                MAX(FileInfo->FileSize - IMAGE_CACHE_HASH_SIZE, IMAGE_CACHE_HASH_SIZE),
+                                Buffer, &Hash);
+    }
+    FreePool(Buffer);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    ZeroMem(Key, sizeof(IMAGE_CACHE_HEADER));
+    Key->Signature = IMAGE_CACHE_SIGNATURE;
+    Key->HeaderSize = sizeof(IMAGE_CACHE_HEADER);
+    Key->FileSize = FileInfo->FileSize;
+    CopyMem(&Key->ModificationTime, &FileInfo->ModificationTime, sizeof(EFI_TIME));
+    Key->Hash = Hash;
+    Key->ScreenWidth = Gop->Mode->Info->HorizontalResolution;
+    Key->ScreenHeight = Gop->Mode->Info->VerticalResolution;
+    Key->Scaling = (UINT32)Scaling;
+    Key->Bilinear = Bilinear;
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Open the sidecar file if it was made from the same image for the
+// same mode and scaling
+//
+EFI_STATUS
+CacheOpen( CHAR16 *CacheName,
+           IMAGE_CACHE_HEADER *Key,
+           IMAGE_CACHE *Cache)
+{
+    EFI_STATUS Status;
+    IMAGE_CACHE_HEADER *Header = &Cache->Header;
+    UINT64 FileSize;
+    UINTN Size;
+
+    ZeroMem(Cache, sizeof(IMAGE_CACHE));
+
+    Status = ShellOpenFileByName(CacheName, &Cache->FileHandle, EFI_FILE_MODE_READ, 0);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    Size = sizeof(IMAGE_CACHE_HEADER);
+    Status = ShellGetFileSize(Cache->FileHandle, &FileSize);
+    if (!EFI_ERROR(Status)) {
+        Status = ShellReadFile(Cache->FileHandle, &Size, Header);
+    }
+    if (EFI_ERROR(Status) ||
+        Size != sizeof(IMAGE_CACHE_HEADER) ||
+        CompareMem(Header, Key, CACHE_KEY_SIZE) != 0 ||
+        Header->Width == 0 || Header->Height == 0 ||
+        Header->DestX > Header->ScreenWidth ||
+        Header->Width > Header->ScreenWidth - Header->DestX ||
+        Header->DestY > Header->ScreenHeight ||
+        Header->Height > Header->ScreenHeight - Header->DestY ||
+        FileSize != sizeof(IMAGE_CACHE_HEADER) +
+                    (UINT64)Header->Width * Header->Height * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL)) {
+        ShellCloseFile(&Cache->FileHandle);
+        ZeroMem(Cache, sizeof(IMAGE_CACHE));
+        return EFI_NOT_FOUND;
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// One write at the current position.  A short write is an error too.
+//
+static EFI_STATUS
+CacheWrite( IMAGE_CACHE *Cache,
+            VOID *Data,
+            UINTN Size)
+{
+    EFI_STATUS Status;
+    UINTN Length = Size;
+
+    Status = ShellWriteFile(Cache->FileHandle, &Length, Data);
+    if (!EFI_ERROR(Status) && Length != Size) {
+        Status = EFI_DEVICE_ERROR;
+    }
+
+    return Status;
+}
+
+
+//
+// Start a new sidecar file, replacing any stale one.  The header is
+// only written by CacheClose once all the rows are in, so a cache
+// left behind half written never matches.
+//
+EFI_STATUS
+CacheCreate( CHAR16 *CacheName,
+             IMAGE_CACHE_HEADER *Key,
+             IMAGE_CACHE *Cache)
+{
+    EFI_STATUS Status;
+    EFI_FILE_INFO *FileInfo;
+    IMAGE_CACHE_HEADER Empty;
+
+    ZeroMem(Cache, sizeof(IMAGE_CACHE));
+
+    Status = ShellOpenFileByName(CacheName, &Cache->FileHandle,
+                                 EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE, 0);
+    if (EFI_ERROR(Status)) {
+        ZeroMem(Cache, sizeof(IMAGE_CACHE));
+        return Status;
+    }
+
+    // a stale cache is truncated, not overwritten at the start
+    FileInfo = ShellGetFileInfo(Cache->FileHandle);
+    if (FileInfo == NULL) {
+        Status = EFI_DEVICE_ERROR;
+    } else {
+        if (FileInfo->FileSize != 0) {
+            FileInfo->FileSize = 0;
+            Status = ShellSetFileInfo(Cache->FileHandle, FileInfo);
+        }
+        FreePool(FileInfo);
+    }
+
+    if (!EFI_ERROR(Status)) {
+        ZeroMem(&Empty, sizeof(Empty));
+        Status = CacheWrite(Cache, &Empty, sizeof(Empty));
+    }
+    if (EFI_ERROR(Status)) {
+        ShellDeleteFile(&Cache->FileHandle);
+        ZeroMem(Cache, sizeof(IMAGE_CACHE));
+        return Status;
+    }
+
+    CopyMem(&Cache->Header, Key, sizeof(IMAGE_CACHE_HEADER));
+    Cache->Writing = TRUE;
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Store Count visible rows starting at visible row Y.  Delta is the
+// distance between rows in Rows, in pixels.
+//
+EFI_STATUS
+CacheWriteRows( IMAGE_CACHE *Cache,
+                EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Rows,
+                UINTN Delta,
+                UINTN Y,
+                UINTN Count)
+{
+    EFI_STATUS Status;
+    UINTN RowSize = Cache->Header.Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL);
+
+    Status = ShellSetFilePosition(Cache->FileHandle, sizeof(IMAGE_CACHE_HEADER) + (UINT64)Y * RowSize);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    // rows are contiguous when the band is exactly the visible width
+    if (Delta == Cache->Header.Width) {
+        return CacheWrite(Cache, Rows, RowSize * Count);
+    }
+
+    for (UINTN i = 0; i < Count; i++) {
+        Status = CacheWrite(Cache, Rows + i * Delta, RowSize);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Read Count visible rows starting at visible row Y into Rows, which
+// may be the frame buffer itself.  Delta is the distance between rows
+// in Rows, in pixels.
+//
+EFI_STATUS
+CacheReadRows( IMAGE_CACHE *Cache,
+               VOID *Rows,
+               UINTN Delta,
+               UINTN Y,
+               UINTN Count)
+{
+    EFI_STATUS Status;
+    UINTN RowSize = Cache->Header.Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL);
+    UINTN Size;
+
+    Status = ShellSetFilePosition(Cache->FileHandle, sizeof(IMAGE_CACHE_HEADER) + (UINT64)Y * RowSize);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    // one read for the lot when the rows are contiguous
+    if (Delta == Cache->Header.Width) {
+        Size = RowSize * Count;
+        Status = ShellReadFile(Cache->FileHandle, &Size, Rows);
+        if (!EFI_ERROR(Status) && Size != RowSize * Count) {
+            Status = EFI_END_OF_FILE;
+        }
+        return Status;
+    }
+
+    for (UINTN i = 0; i < Count; i++) {
+        Size = RowSize;
+        Status = ShellReadFile( Cache->FileHandle,
+                                &Size,
+                                (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)Rows + i * Delta);
+        if (!EFI_ERROR(Status) && Size != RowSize) {
+            Status = EFI_END_OF_FILE;
+        }
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Close the sidecar file.  A cache being written is completed by
+// writing its header if Commit is TRUE, and deleted otherwise.
+//
+VOID
+CacheClose( IMAGE_CACHE *Cache,
+            BOOLEAN Commit)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+
+    if (Cache->FileHandle == NULL) {
+        return;
+    }
+
+    if (Cache->Writing) {
+        if (Commit) {
+            Status = ShellSetFilePosition(Cache->FileHandle, 0);
+            if (!EFI_ERROR(Status)) {
+                Status = CacheWrite(Cache, &Cache->Header, sizeof(IMAGE_CACHE_HEADER));
+            }
+        }
+        if (!Commit || EFI_ERROR(Status)) {
+            ShellDeleteFile(&Cache->FileHandle);
+            ZeroMem(Cache, sizeof(IMAGE_CACHE));
+            return;
+        }
+    }
+
+    ShellCloseFile(&Cache->FileHandle);
+    ZeroMem(Cache, sizeof(IMAGE_CACHE));
+}
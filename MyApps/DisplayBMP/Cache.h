@@ -0,0 +1,83 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Converted image cache for DisplayBMP
+//
+//  License: BSD License
+//
+
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <Library/ShellLib.h>
+#include <Protocol/GraphicsOutput.h>
+
+#define IMAGE_CACHE_SIGNATURE    SIGNATURE_32('B', 'L', 'T', 'C')
+#define IMAGE_CACHE_SUFFIX       L".blt"
+#define IMAGE_CACHE_HASH_SIZE    (64 * 1024)
+
+//
+// Sidecar file header.  The visible part of the image follows it as
+// Width x Height BLT pixels, top row first.  Everything up to DestX
+// is the key the cache is looked up by.
+//
+typedef struct {
+    UINT32    Signature;
+    UINT32    HeaderSize;
+    UINT64    FileSize;          // of the image file
+    EFI_TIME  ModificationTime;  // of the image file
+    UINT64    Hash;              // of the start and end of the image file
+    UINT32    ScreenWidth;       // mode the image was laid out for
+    UINT32    ScreenHeight;
+    UINT32    Scaling;
+    UINT32    Bilinear;
+    UINT32    DestX;             // where the pixels go on the screen
+    UINT32    DestY;
+    UINT32    Width;
+    UINT32    Height;
+} IMAGE_CACHE_HEADER;
+
+typedef struct {
+    SHELL_FILE_HANDLE  FileHandle;
+    IMAGE_CACHE_HEADER Header;
+    BOOLEAN            Writing;  // being filled in by CacheWriteRows
+} IMAGE_CACHE;
+
+
+EFI_STATUS
+CacheMakeKey( SHELL_FILE_HANDLE FileHandle,
+              EFI_FILE_INFO *FileInfo,
+              EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+              UINTN Scaling,
+              BOOLEAN Bilinear,
+              IMAGE_CACHE_HEADER *Key);
+
+EFI_STATUS
+CacheOpen( CHAR16 *CacheName,
+           IMAGE_CACHE_HEADER *Key,
+           IMAGE_CACHE *Cache);
+
+EFI_STATUS
+CacheCreate( CHAR16 *CacheName,
+             IMAGE_CACHE_HEADER *Key,
+             IMAGE_CACHE *Cache);
+
+EFI_STATUS
+CacheWriteRows( IMAGE_CACHE *Cache,
+                EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Rows,
+                UINTN Delta,
+                UINTN Y,
+                UINTN Count);
+
+EFI_STATUS
+CacheReadRows( IMAGE_CACHE *Cache,
+               VOID *Rows,
+               UINTN Delta,
+               UINTN Y,
+               UINTN Count);
+
+VOID
+CacheClose( IMAGE_CACHE *Cache,
+            BOOLEAN Commit);
+
+#endif
@@ -1,7 +1,7 @@
 //
 //  Copyright (c) 2015  Finnbarr P. Murphy.   All rights reserved.
 //
-//  Display a BMP image (Similar to the old LoadBMP utility) 
+//  Display a BMP or PNG image (Similar to the old LoadBMP utility) 
 //
 //  License: BSD License
 //
@@ -16,157 +16,1516 @@
 #include <Library/MemoryAllocationLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/PrintLib.h>
+#include <Library/TimerLib.h>
 
 #include <Protocol/EfiShell.h>
 #include <Protocol/LoadedImage.h>
 #include <Protocol/SimpleFileSystem.h>
 #include <Protocol/GraphicsOutput.h>
 
-#include "Image.h"
+#include <Library/BmpLib.h>
+#include <Library/PngLib.h>
+#include <Library/GopModeLib.h>
 
+#include "FrameBuffer.h"
+#include "Scale.h"
+#include "Cache.h"
 
+
+#define BMP_BAND_SIZE        (256 * 1024)    // converted pixels per band
+#define BMP_CHUNK_SIZE       (64 * 1024)     // compressed data per read
+#define BMP_MAX_INFO_SIZE    1024
+#define BMP_SUFFIX           L".bmp"
+#define PNG_SUFFIX           L".png"
+
+
+static VOID
+PressKey(BOOLEAN DisplayText)
+{
+
+    EFI_INPUT_KEY Key;
+    /* EFI_STATUS    Status; */
+    UINTN         EventIndex;
+
+    if (DisplayText) {
+        Print(L"\nPress any key to continue ....\n\n");
+    }
+
+    gBS->WaitForEvent (1, &gST->ConIn->WaitForKey, &EventIndex);
+    /* Status = */ gST->ConIn->ReadKeyStroke (gST->ConIn, &Key);
+}
+
+
+static VOID
+AsciiToUnicodeSize( CHAR8 *String,
+                    UINT8 length,
+                    CHAR16 *UniString)
+{
+    int len = length;
+
+    while (*String != '\0' && len > 0) {
+        *(UniString++) = (CHAR16) *(String++);
+        len--;
+    }
+    *UniString = '\0';
+}
+
+
+//
+// Image being displayed.  Only the header and palette are kept in
+// memory; pixel data is read from the file in chunks as rows are
+// needed.  Rows are produced in the order they are stored in the
+// file.  PNG images are decoded by PngLib, which reads the file
+// itself.
+//
+typedef struct {
+    SHELL_FILE_HANDLE FileHandle;
+    PNG_DECODER *Png;            // NULL for BMP images
+    BMP_IMAGE_HEADER *Header;    // header and palette
+    BMP_IMAGE_INFO Info;         // what BmpParse made of Header
+    UINTN    Width;
+    UINTN    Height;
+    UINTN    RowSize;
+    UINTN    NextRow;            // rows produced so far
+    BOOLEAN  TopDown;
+    BOOLEAN  Compressed;
+    UINT8   *Data;               // pixel data read from the file
+    UINTN    DataSize;           // size of Data
+    UINTN    DataStart;          // first unused byte in Data
+    UINTN    DataEnd;            // end of valid bytes in Data
+    UINT64   DataLeft;           // pixel data not yet read from the file
+    BMP_RLE_DECODER Rle;
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL Lut[BMP_LUT_ENTRIES];
+} BMP_SOURCE;
+
+
+static VOID
+CloseSource( BMP_SOURCE *Source)
+{
+    if (Source->Header != NULL) {
+        FreePool(Source->Header);
+    }
+    if (Source->Data != NULL) {
+        FreePool(Source->Data);
+    }
+    if (Source->Png != NULL) {
+        PngClose(Source->Png);
+    }
+    ZeroMem(Source, sizeof(BMP_SOURCE));
+}
+
+
+static EFI_STATUS
+EFIAPI
+ReadSourceFile( VOID *Context,
+                VOID *Buffer,
+                UINTN *Size)
+{
+    return ShellReadFile((SHELL_FILE_HANDLE)Context, Size, Buffer);
+}
+
+
+static EFI_STATUS
+OpenPngSource( BMP_SOURCE *Source)
+{
+    EFI_STATUS Status;
+
+    ShellSetFilePosition(Source->FileHandle, 0);
+    Status = PngOpen(ReadSourceFile, Source->FileHandle, &Source->Png);
+    if (Status == EFI_OUT_OF_RESOURCES) {
+        Print(L"ERROR: PNG decoder. No memory resources\n");
+        return Status;
+    }
+    if (EFI_ERROR(Status)) {
+        Print(L"ERROR: Unsupported or corrupt PNG image [%r]\n", Status);
+        return Status;
+    }
+
+    Source->Width = Source->Png->Width;
+    Source->Height = Source->Png->Height;
+    Source->TopDown = TRUE;
+
+    return EFI_SUCCESS;
+}
+
+
+static EFI_STATUS
+OpenSource( BMP_SOURCE *Source,
+            SHELL_FILE_HANDLE FileHandle,
+            UINT64 FileSize)
+{
+    BMP_IMAGE_HEADER Header;
+    BMP_IMAGE_HEADER *BmpHeader;
+    EFI_STATUS Status;
+    UINTN   HeaderSize;
+    UINTN   Size;
+
+    ZeroMem(Source, sizeof(BMP_SOURCE));
+    Source->FileHandle = FileHandle;
+
+    Size = sizeof(Header);
+    ShellSetFilePosition(FileHandle, 0);
+    Status = ShellReadFile(FileHandle, &Size, &Header);
+    if (!EFI_ERROR(Status) && PngIsImage(&Header, Size)) {
+        return OpenPngSource(Source);
+    }
+    if (EFI_ERROR(Status) || Size != sizeof(Header) ||
+        Header.CharB != 'B' || Header.CharM != 'M' ||
+        Header.ImageOffset > FileSize || Header.HeaderSize > BMP_MAX_INFO_SIZE) {
+        Print(L"ERROR: Unsupported image format\n"); 
+        return EFI_UNSUPPORTED;
+    }
+
+    // keep the header and the palette, which ends before the pixel data
+    HeaderSize = BMP_FILE_HEADER_SIZE + Header.HeaderSize + BMP_LUT_ENTRIES * sizeof(UINT32);
+    HeaderSize = MAX(MIN(HeaderSize, Header.ImageOffset), sizeof(Header));
+    BmpHeader = AllocatePool(HeaderSize);
+    if (BmpHeader == NULL) {
+        Print(L"ERROR: Header buffer. No memory resources\n");
+        return EFI_OUT_OF_RESOURCES;
+    }
+    Source->Header = BmpHeader;
+
+    Size = HeaderSize;
+    ShellSetFilePosition(FileHandle, 0);
+    Status = ShellReadFile(FileHandle, &Size, BmpHeader);
+    if (EFI_ERROR(Status) || Size != HeaderSize) {
+        Print(L"ERROR: Could not read image header\n");
+        return EFI_DEVICE_ERROR;
+    }
+
+    Status = BmpParse(BmpHeader, HeaderSize, FileSize, &Source->Info);
+    if (Status == EFI_UNSUPPORTED) {
+        Print(L"ERROR: %d bits per pixel with compression type %d is not supported\n",
+              BmpHeader->BitPerPixel, BmpHeader->CompressionType);
+        return Status;
+    }
+    if (EFI_ERROR(Status)) {
+        Print(L"ERROR: Image header is corrupt or the data is truncated\n");
+        return Status;
+    }
+
+    Source->Width = Source->Info.Width;
+    Source->Height = Source->Info.Height;
+    Source->TopDown = Source->Info.TopDown;
+    Source->RowSize = Source->Info.RowSize;
+    Source->Compressed = (Source->Info.CompressionType != BMP_RGB);
+    Source->DataLeft = Source->Info.ImageSize;
+
+    // compressed data is streamed in, so the decoder starts with none
+    if (Source->Compressed) {
+        BmpRleInit(&Source->Info, NULL, &Source->Rle);
+    }
+    BmpBuildLut(&Source->Info, Source->Lut);
+
+    // room for a band of rows, or a chunk of compressed data
+    if (Source->Compressed) {
+        Source->DataSize = BMP_CHUNK_SIZE;
+    } else {
+        Source->DataSize = MAX(BMP_BAND_SIZE / Source->RowSize, 1) * Source->RowSize;
+    }
+    Source->Data = AllocatePool(Source->DataSize);
+    if (Source->Data == NULL) {
+        Print(L"ERROR: Data buffer. No memory resources\n");
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    ShellSetFilePosition(FileHandle, BmpHeader->ImageOffset);
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Move unused data to the start of the buffer and read more after it
+//
+static EFI_STATUS
+FillSource( BMP_SOURCE *Source)
+{
+    EFI_STATUS Status;
+    UINTN Size;
+
+    CopyMem(Source->Data, Source->Data + Source->DataStart, Source->DataEnd - Source->DataStart);
+    Source->DataEnd -= Source->DataStart;
+    Source->DataStart = 0;
+
+    Size = (UINTN)MIN(Source->DataSize - Source->DataEnd, Source->DataLeft);
+    if (Size == 0) {
+        return EFI_SUCCESS;
+    }
+    Status = ShellReadFile(Source->FileHandle, &Size, Source->Data + Source->DataEnd);
+    if (EFI_ERROR(Status)) {
+        Print(L"ERROR: Could not read image data [%r]\n", Status);
+        return Status;
+    }
+    if (Size == 0) {
+        // file is shorter than the header says
+        Source->DataLeft = 0;
+    }
+    Source->DataEnd += Size;
+    Source->DataLeft -= Size;
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Image row the next stored row is displayed on
+//
+static UINTN
+NextSourceY( BMP_SOURCE *Source)
+{
+    return Source->TopDown ? Source->NextRow : Source->Height - 1 - Source->NextRow;
+}
+
+
+//
+// Convert the next stored row into Row
+//
+static EFI_STATUS
+ReadSourceRow( BMP_SOURCE *Source,
+               EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Row)
+{
+    EFI_STATUS Status;
+    UINT8 *NewData;
+
+    Source->NextRow++;
+
+    if (Source->Png != NULL) {
+        Status = PngDecodeRow(Source->Png, Row);
+        if (EFI_ERROR(Status)) {
+            Print(L"ERROR: PNG image data is corrupt\n");
+        }
+        return Status;
+    }
+
+    if (!Source->Compressed) {
+        if (Source->DataEnd - Source->DataStart < Source->RowSize) {
+            Status = FillSource(Source);
+            if (EFI_ERROR(Status)) {
+                return Status;
+            }
+            if (Source->DataEnd < Source->RowSize) {
+                Print(L"ERROR: Image data is truncated\n");
+                return EFI_END_OF_FILE;
+            }
+        }
+        BmpConvertRow( Source->Data + Source->DataStart,
+                       Source->Width,
+                       Source->Info.BitPerPixel,
+                       Source->Lut,
+                       Row);
+        Source->DataStart += Source->RowSize;
+        return EFI_SUCCESS;
+    }
+
+    for (;;) {
+        Source->Rle.Data = Source->Data + Source->DataStart;
+        Source->Rle.End = Source->Data + Source->DataEnd;
+        Status = BmpRleDecodeRow(&Source->Rle, Source->Lut, Row);
+        if (Status != EFI_BUFFER_TOO_SMALL) {
+            break;
+        }
+        if (Source->DataLeft == 0) {
+            Status = EFI_END_OF_FILE;
+            break;
+        }
+        // a single row needs more than the whole buffer
+        if (Source->DataStart == 0 && Source->DataEnd == Source->DataSize) {
+            NewData = ReallocatePool(Source->DataSize, Source->DataSize * 2, Source->Data);
+            if (NewData == NULL) {
+                Print(L"ERROR: Data buffer. No memory resources\n");
+                return EFI_OUT_OF_RESOURCES;
+            }
+            Source->Data = NewData;
+            Source->DataSize *= 2;
+        }
+        Status = FillSource(Source);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+    }
+    if (EFI_ERROR(Status)) {
+        Print(L"ERROR: Compressed image data is corrupt\n");
+        return Status;
+    }
+    Source->DataStart = Source->Rle.Data - Source->Data;
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Where the (possibly scaled) image goes on the screen
+//
+typedef struct {
+    UINTN    DestX;              // screen position of the visible part
+    UINTN    DestY;
+    UINTN    CropX;              // first visible image column and row
+    UINTN    CropY;
+    UINTN    Width;              // visible size
+    UINTN    Height;
+} IMAGE_VIEW;
+
+
+//
+// Size the image is scaled to, and the part of it that is visible
+//
+static VOID
+LayoutImage( UINTN Width,
+             UINTN Height,
+             UINTN ScreenWidth,
+             UINTN ScreenHeight,
+             UINTN Scaling,
+             UINTN *ScaledWidth,
+             UINTN *ScaledHeight,
+             IMAGE_VIEW *View)
+{
+    UINTN W = Width;
+    UINTN H = Height;
+    BOOLEAN Wider = (UINT64)Width * ScreenHeight >= (UINT64)Height * ScreenWidth;
+
+    if (Scaling == SCALE_STRETCH) {
+        W = ScreenWidth;
+        H = ScreenHeight;
+    } else if ((Scaling == SCALE_FIT && Wider) || (Scaling == SCALE_FILL && !Wider)) {
+        W = ScreenWidth;
+        H = MAX((UINTN)DivU64x64Remainder((UINT64)Height * ScreenWidth, Width, NULL), 1);
+    } else if (Scaling == SCALE_FIT || Scaling == SCALE_FILL) {
+        H = ScreenHeight;
+        W = MAX((UINTN)DivU64x64Remainder((UINT64)Width * ScreenHeight, Height, NULL), 1);
+    }
+
+    // centre, cropping the middle when scaled and the top left if not
+    ZeroMem(View, sizeof(IMAGE_VIEW));
+    if (W < ScreenWidth) {
+        View->DestX = (ScreenWidth - W) / 2;
+        View->Width = W;
+    } else {
+        View->CropX = (Scaling == SCALE_NONE) ? 0 : (W - ScreenWidth) / 2;
+        View->Width = ScreenWidth;
+    }
+    if (H < ScreenHeight) {
+        View->DestY = (ScreenHeight - H) / 2;
+        View->Height = H;
+    } else {
+        View->CropY = (Scaling == SCALE_NONE) ? 0 : (H - ScreenHeight) / 2;
+        View->Height = ScreenHeight;
+    }
+
+    *ScaledWidth = W;
+    *ScaledHeight = H;
+}
+
+
+//
+// Composite Rows rows of Width pixels of Image, whose row pitch is
+// Delta pixels, over the screen at X, Y.  Only the rectangle around
+// the pixels that are not fully transparent is read back into Under
+// and written out again.
+//
+static EFI_STATUS
+BlendBand( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop, 
+           FRAME_BUFFER *Fb,
+           EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Image,
+           UINTN Delta,
+           UINTN X,
+           UINTN Y,
+           UINTN Width,
+           UINTN Rows,
+           EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Under)
+{
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Row;
+    EFI_STATUS Status;
+    UINTN Left = Width;
+    UINTN Right = 0;
+    UINTN Top = Rows;
+    UINTN Bottom = 0;
+    UINTN x;
+
+    for (UINTN y = 0; y < Rows; y++) {
+        Row = Image + y * Delta;
+        for (x = 0; x < Width && Row[x].Reserved == 0; x++);
+        if (x == Width) {
+            continue;
+        }
+        Left = MIN(Left, x);
+        for (x = Width; Row[x - 1].Reserved == 0; x--);
+        Right = MAX(Right, x);
+        Top = MIN(Top, y);
+        Bottom = y + 1;
+    }
+    if (Top >= Bottom) {
+        return EFI_SUCCESS;
+    }
+    Width = Right - Left;
+    Rows = Bottom - Top;
+
+    Status = Gop->Blt( Gop,
+                       Under,
+                       EfiBltVideoToBltBuffer,
+                       X + Left, Y + Top,
+                       0, 0,
+                       Width, Rows,
+                       0);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    for (UINTN y = 0; y < Rows; y++) {
+        AlphaBlendRow(Image + (Top + y) * Delta + Left, Under + y * Width, Width);
+    }
+
+    if (Fb == NULL) {
+        return Gop->Blt( Gop,
+                         Under,
+                         EfiBltBufferToVideo,
+                         0, 0,
+                         X + Left, Y + Top,
+                         Width, Rows,
+                         0);
+    }
+    for (UINTN y = 0; y < Rows; y++) {
+        FrameBufferWriteRow(Fb, Under + y * Width, X + Left, Y + Top + y, Width);
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Draw the visible part of Rows image rows starting at image row
+// FirstY, and keep a copy of it in Cache if that is not NULL.  Delta
+// is the width of Band in pixels.  If Under is not NULL the rows are
+// alpha blended onto the screen, using Under to hold what they cover.
+//
+static EFI_STATUS
+DrawBand( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop, 
+          FRAME_BUFFER *Fb,
+          IMAGE_CACHE *Cache,
+          IMAGE_VIEW *View,
+          EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Band,
+          UINTN Delta,
+          UINTN FirstY,
+          UINTN Rows,
+          EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Under)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    UINTN Top = MAX(FirstY, View->CropY);
+    UINTN Bottom = MIN(FirstY + Rows, View->CropY + View->Height);
+
+    if (Top >= Bottom) {
+        return EFI_SUCCESS;
+    }
+
+    if (Under != NULL) {
+        Status = BlendBand( Gop, Fb,
+                            Band + (Top - FirstY) * Delta + View->CropX,
+                            Delta,
+                            View->DestX, View->DestY + Top - View->CropY,
+                            View->Width, Bottom - Top,
+                            Under);
+    } else if (Fb == NULL) {
+        Status = Gop->Blt( Gop,
+                           Band,
+                           EfiBltBufferToVideo,
+                           View->CropX, Top - FirstY,
+                           View->DestX, View->DestY + Top - View->CropY,
+                           View->Width, Bottom - Top, 
+                           Delta * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+    } else {
+        for (UINTN y = Top; y < Bottom; y++) {
+            FrameBufferWriteRow( Fb,
+                                 Band + (y - FirstY) * Delta + View->CropX,
+                                 View->DestX,
+                                 View->DestY + y - View->CropY,
+                                 View->Width);
+        }
+    }
+
+    if (!EFI_ERROR(Status) && Cache != NULL) {
+        Status = CacheWriteRows( Cache,
+                                 Band + (Top - FirstY) * Delta + View->CropX,
+                                 Delta,
+                                 Top - View->CropY,
+                                 Bottom - Top);
+        if (EFI_ERROR(Status)) {
+            Print(L"ERROR: Could not write image cache [%r]\n", Status);
+        }
+    }
+
+    return Status;
+}
+
+
+//
+// Source rows already scaled horizontally, for the vertical pass
+//
 typedef struct {
-    CHAR8  CharB;
-    CHAR8  CharM;
-    UINT32 Size;
-    UINT16 Reserved[2];
-    UINT32 ImageOffset;
-    UINT32 HeaderSize;
-    UINT32 PixelWidth;
-    UINT32 PixelHeight;
-    UINT16 Planes;
-    UINT16 BitPerPixel;
-    UINT32 CompressionType;
-    UINT32 ImageSize;
-    UINT32 XPixelsPerMeter;
-    UINT32 YPixelsPerMeter;
-    UINT32 NumberOfColors;
-    UINT32 ImportantColors;
-} __attribute__((__packed__)) BMP_IMAGE_HEADER;
+    BMP_SOURCE *Source;
+    SCALE_AXIS Horz;
+    SCALE_AXIS Vert;
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Row;        // one source row
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Cache[2];   // scaled rows
+    UINTN      CacheY[2];
+    UINTN      Older;                          // slot to replace next
+} SCALER;
+
+
+//
+// Return image row Y scaled horizontally.  Rows are requested in file
+// order, so Y is either in the cache or still ahead in the file.
+//
+static EFI_STATUS
+ScaledSourceRow( SCALER *Scaler,
+                 UINTN Y,
+                 EFI_GRAPHICS_OUTPUT_BLT_PIXEL **Row)
+{
+    EFI_STATUS Status;
+    UINTN Next;
+    UINTN Slot;
+
+    for (Slot = 0; Slot < 2; Slot++) {
+        if (Scaler->CacheY[Slot] == Y) {
+            Scaler->Older = 1 - Slot;
+            *Row = Scaler->Cache[Slot];
+            return EFI_SUCCESS;
+        }
+    }
+
+    while (Scaler->Source->NextRow < Scaler->Source->Height) {
+        Next = NextSourceY(Scaler->Source);
+        Status = ReadSourceRow(Scaler->Source, Scaler->Row);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+        if (Next == Y) {
+            Slot = Scaler->Older;
+            ScaleRow(&Scaler->Horz, Scaler->Row, Scaler->Cache[Slot]);
+            Scaler->CacheY[Slot] = Y;
+            Scaler->Older = 1 - Slot;
+            *Row = Scaler->Cache[Slot];
+            return EFI_SUCCESS;
+        }
+    }
+
+    return EFI_NOT_FOUND;
+}
+
+
+//
+// Scale the image to ScaledWidth x ScaledHeight while it is read.
+// Only the visible part of each output row is computed, from at most
+// two horizontally scaled source rows.  Alpha is scaled with the
+// colours, so a blended image keeps its edges.
+//
+static EFI_STATUS
+DisplayScaled( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop, 
+               FRAME_BUFFER *Fb,
+               IMAGE_CACHE *Cache,
+               BMP_SOURCE *Source,
+               IMAGE_VIEW *View,
+               UINTN ScaledWidth,
+               UINTN ScaledHeight,
+               BOOLEAN Bilinear,
+               BOOLEAN Blend)
+{
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Band = NULL;
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Under = NULL;
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Upper;
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Lower;
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Out;
+    EFI_STATUS Status;
+    IMAGE_VIEW BandView = *View;
+    SCALER  Scaler;
+    UINTN   Width = View->Width;
+    UINTN   BandRows;
+    UINTN   Rows;
+    UINTN   FirstY;
+    UINTN   Y;
+
+    ZeroMem(&Scaler, sizeof(Scaler));
+    Scaler.Source = Source;
+    Scaler.CacheY[0] = Scaler.CacheY[1] = MAX_UINTN;
+
+    Status = ScaleAxisInit(&Scaler.Horz, Source->Width, ScaledWidth, View->CropX, Width, Bilinear);
+    if (!EFI_ERROR(Status)) {
+        Status = ScaleAxisInit(&Scaler.Vert, Source->Height, ScaledHeight, View->CropY, View->Height, Bilinear);
+    }
+    BandRows = MAX(BMP_BAND_SIZE / (Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL)), 1);
+    Scaler.Row = AllocatePool(Source->Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+    Scaler.Cache[0] = AllocatePool(Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+    Scaler.Cache[1] = AllocatePool(Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+    Band = AllocatePool(BandRows * Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+    if (Blend) {
+        Under = AllocatePool(BandRows * Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+    }
+    if (EFI_ERROR(Status) || Scaler.Row == NULL || Scaler.Cache[0] == NULL ||
+        Scaler.Cache[1] == NULL || Band == NULL || (Blend && Under == NULL)) {
+        Print(L"ERROR: Scaling buffers. No memory resources\n");
+        Status = EFI_OUT_OF_RESOURCES;
+        goto Done;
+    }
+
+    // the band holds visible rows only
+    BandView.CropX = 0;
+    BandView.CropY = 0;
+
+    // output rows are made in file order, bottom up for most images
+    for (UINTN Made = 0; Made < View->Height; Made += Rows) {
+        Rows = MIN(BandRows, View->Height - Made);
+        FirstY = Source->TopDown ? Made : View->Height - Made - Rows;
+        for (UINTN i = 0; i < Rows; i++) {
+            Y = Source->TopDown ? FirstY + i : FirstY + Rows - 1 - i;
+            Out = Band + (Y - FirstY) * Width;
+            if (Scaler.Vert.Weight[Y] == 0) {
+                Status = ScaledSourceRow(&Scaler, Scaler.Vert.Index[Y], &Upper);
+                if (!EFI_ERROR(Status)) {
+                    CopyMem(Out, Upper, Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+                }
+            } else if (Source->TopDown) {
+                Status = ScaledSourceRow(&Scaler, Scaler.Vert.Index[Y], &Upper);
+                if (!EFI_ERROR(Status)) {
+                    Status = ScaledSourceRow(&Scaler, Scaler.Vert.Index[Y] + 1, &Lower);
+                }
+            } else {
+                Status = ScaledSourceRow(&Scaler, Scaler.Vert.Index[Y] + 1, &Lower);
+                if (!EFI_ERROR(Status)) {
+                    Status = ScaledSourceRow(&Scaler, Scaler.Vert.Index[Y], &Upper);
+                }
+            }
+            if (EFI_ERROR(Status)) {
+                goto Done;
+            }
+            if (Scaler.Vert.Weight[Y] != 0) {
+                BlendRows(Upper, Lower, Scaler.Vert.Weight[Y], Width, Out);
+            }
+        }
+        Status = DrawBand(Gop, Fb, Cache, &BandView, Band, Width, FirstY, Rows, Under);
+        if (EFI_ERROR(Status)) {
+            goto Done;
+        }
+    }
+
+Done:
+    ScaleAxisFree(&Scaler.Horz);
+    ScaleAxisFree(&Scaler.Vert);
+    if (Scaler.Row != NULL) {
+        FreePool(Scaler.Row);
+    }
+    if (Scaler.Cache[0] != NULL) {
+        FreePool(Scaler.Cache[0]);
+    }
+    if (Scaler.Cache[1] != NULL) {
+        FreePool(Scaler.Cache[1]);
+    }
+    if (Band != NULL) {
+        FreePool(Band);
+    }
+    if (Under != NULL) {
+        FreePool(Under);
+    }
+
+    return Status;
+}
+
+
+//
+// Display a 1, 4, 8, 24 or 32-bit image, an RLE8 or RLE4 image, or a
+// PNG image, centred on the screen and scaled as asked.  The image is converted a
+// band of rows at a time and each band is drawn with Blt, or streamed
+// straight to the frame buffer if Fb is not NULL, so memory use does
+// not depend on the size of the image.  What is drawn is also written
+// to Cache if that is not NULL.  With Blend a 32-bit BMP image is
+// alpha composited onto what is already on the screen, using the
+// fourth byte of each pixel as its alpha.
+//
+EFI_STATUS
+DisplayImage( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop, 
+              FRAME_BUFFER *Fb,
+              IMAGE_CACHE *Cache,
+              SHELL_FILE_HANDLE FileHandle,
+              UINT64 FileSize,
+              UINTN Scaling,
+              BOOLEAN Bilinear,
+              BOOLEAN Blend)
+{
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Band = NULL;
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Under = NULL;
+    EFI_STATUS Status = EFI_SUCCESS;
+    BMP_SOURCE Source;
+    IMAGE_VIEW View;
+    UINTN   ScaledWidth;
+    UINTN   ScaledHeight;
+    UINTN   BandRows;
+    UINTN   Rows;
+    UINTN   FirstY;
+    UINTN   Y;
+
+    Status = OpenSource(&Source, FileHandle, FileSize);
+    if (EFI_ERROR(Status)) {
+        goto Done;
+    }
+    if (Blend && (Source.Png != NULL || Source.Info.BitPerPixel != 32)) {
+        Print(L"ERROR: Blending needs a 32-bit BMP image\n");
+        Status = EFI_UNSUPPORTED;
+        goto Done;
+    }
+
+    LayoutImage( Source.Width, Source.Height,
+                 Gop->Mode->Info->HorizontalResolution,
+                 Gop->Mode->Info->VerticalResolution,
+                 Scaling, &ScaledWidth, &ScaledHeight, &View);
+
+    if (Cache != NULL) {
+        Cache->Header.DestX = (UINT32)View.DestX;
+        Cache->Header.DestY = (UINT32)View.DestY;
+        Cache->Header.Width = (UINT32)View.Width;
+        Cache->Header.Height = (UINT32)View.Height;
+    }
+
+    if (ScaledWidth != Source.Width || ScaledHeight != Source.Height) {
+        Status = DisplayScaled(Gop, Fb, Cache, &Source, &View, ScaledWidth, ScaledHeight, Bilinear, Blend);
+        goto Flush;
+    }
+
+    BandRows = MAX(BMP_BAND_SIZE / (Source.Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL)), 1);
+    Band = AllocatePool( sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL) * Source.Width * BandRows);
+    if (Blend) {
+        Under = AllocatePool( sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL) * View.Width * BandRows);
+    }
+    if (Band == NULL || (Blend && Under == NULL)) {
+        Print(L"ERROR: Band buffer. No memory resources\n");
+        Status = EFI_OUT_OF_RESOURCES;
+        goto Done;
+    }
+
+    // bands follow the file order, so bottom up images are drawn upwards
+    for (UINTN Converted = 0; Converted < Source.Height; Converted += Rows) {
+        Rows = MIN(BandRows, Source.Height - Converted);
+        FirstY = Source.TopDown ? Converted : Source.Height - Converted - Rows;
+        for (UINTN i = 0; i < Rows; i++) {
+            Y = NextSourceY(&Source);
+            Status = ReadSourceRow(&Source, Band + (Y - FirstY) * Source.Width);
+            if (EFI_ERROR(Status)) {
+                goto Done;
+            }
+        }
+        Status = DrawBand(Gop, Fb, Cache, &View, Band, Source.Width, FirstY, Rows, Under);
+        if (EFI_ERROR(Status)) {
+            goto Done;
+        }
+    }
+
+Flush:
+    if (Fb != NULL) {
+        FrameBufferFlush(Fb);
+    }
+
+Done:
+    if (Band != NULL) {
+        FreePool(Band);
+    }
+    if (Under != NULL) {
+        FreePool(Under);
+    }
+    CloseSource(&Source);
+
+    return Status;
+}
+
+
+//
+// Display an image from its cache.  When the frame buffer holds BLT
+// pixels the rows are read straight into it, in a single read if the
+// image is as wide as the scan line; otherwise they are read a band
+// at a time and drawn as usual.
+//
+EFI_STATUS
+DisplayCached( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop, 
+               FRAME_BUFFER *Fb,
+               IMAGE_CACHE *Cache)
+{
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Band = NULL;
+    EFI_STATUS Status = EFI_SUCCESS;
+    IMAGE_VIEW View;
+    UINTN   BandRows;
+    UINTN   Rows;
+
+    ZeroMem(&View, sizeof(View));
+    View.DestX = Cache->Header.DestX;
+    View.DestY = Cache->Header.DestY;
+    View.Width = Cache->Header.Width;
+    View.Height = Cache->Header.Height;
+
+    if (Fb != NULL && Fb->PixelFormat == PixelBlueGreenRedReserved8BitPerColor) {
+        Status = CacheReadRows( Cache,
+                                Fb->Base + (View.DestY * Fb->PixelsPerScanLine + View.DestX) * 4,
+                                Fb->PixelsPerScanLine,
+                                0,
+                                View.Height);
+        if (EFI_ERROR(Status)) {
+            Print(L"ERROR: Could not read image cache [%r]\n", Status);
+        }
+        return Status;
+    }
+
+    BandRows = MAX(BMP_BAND_SIZE / (View.Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL)), 1);
+    Band = AllocatePool( sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL) * View.Width * BandRows);
+    if (Band == NULL) {
+        Print(L"ERROR: Band buffer. No memory resources\n");
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    for (UINTN FirstY = 0; FirstY < View.Height; FirstY += Rows) {
+        Rows = MIN(BandRows, View.Height - FirstY);
+        Status = CacheReadRows(Cache, Band, View.Width, FirstY, Rows);
+        if (EFI_ERROR(Status)) {
+            Print(L"ERROR: Could not read image cache [%r]\n", Status);
+            break;
+        }
+        Status = DrawBand(Gop, Fb, NULL, &View, Band, View.Width, FirstY, Rows, NULL);
+        if (EFI_ERROR(Status)) {
+            break;
+        }
+    }
+
+    if (Fb != NULL) {
+        FrameBufferFlush(Fb);
+    }
+    FreePool(Band);
+
+    return Status;
+}
+
+
+//
+// One GOP output for DisplayAll, and the frame shown on it
+//
+typedef struct {
+    EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop;
+    FRAME_BUFFER Fb;             // its frame buffer, if Direct
+    BOOLEAN      Direct;
+    FRAME_BUFFER Frame;          // visible image in the pixel format of Fb, or BLT pixels
+    IMAGE_VIEW   View;
+    UINTN        SameAs;         // output whose Frame is shown here
+    UINT64       DrawTime;
+    UINT64       PresentTime;
+    EFI_STATUS   Status;
+} OUTPUT;
+
+
+//
+// Read the whole image into memory, top row first
+//
+static EFI_STATUS
+DecodeImage( BMP_SOURCE *Source,
+             EFI_GRAPHICS_OUTPUT_BLT_PIXEL **Image)
+{
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Pixels;
+    EFI_STATUS Status;
+    UINTN Y;
+
+    Pixels = AllocatePool(Source->Width * Source->Height * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+    if (Pixels == NULL) {
+        Print(L"ERROR: Image buffer. No memory resources\n");
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    while (Source->NextRow < Source->Height) {
+        Y = NextSourceY(Source);
+        Status = ReadSourceRow(Source, Pixels + Y * Source->Width);
+        if (EFI_ERROR(Status)) {
+            FreePool(Pixels);
+            return Status;
+        }
+    }
+
+    *Image = Pixels;
+    return EFI_SUCCESS;
+}
+
+
+//
+// Lay the visible part of the decoded image out in Frame, scaled to
+// ScaledWidth x ScaledHeight
+//
+static EFI_STATUS
+RenderFrame( EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Image,
+             UINTN Width,
+             UINTN Height,
+             UINTN ScaledWidth,
+             UINTN ScaledHeight,
+             IMAGE_VIEW *View,
+             BOOLEAN Bilinear,
+             FRAME_BUFFER *Frame)
+{
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Upper = NULL;
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Lower = NULL;
+    EFI_STATUS Status;
+    SCALE_AXIS Horz;
+    SCALE_AXIS Vert;
+
+    if (ScaledWidth == Width && ScaledHeight == Height) {
+        for (UINTN y = 0; y < View->Height; y++) {
+            FrameBufferWriteRow(Frame, Image + (View->CropY + y) * Width + View->CropX, 0, y, View->Width);
+        }
+        FrameBufferFlush(Frame);
+        return EFI_SUCCESS;
+    }
+
+    ZeroMem(&Horz, sizeof(Horz));
+    ZeroMem(&Vert, sizeof(Vert));
+    Status = ScaleAxisInit(&Horz, Width, ScaledWidth, View->CropX, View->Width, Bilinear);
+    if (!EFI_ERROR(Status)) {
+        Status = ScaleAxisInit(&Vert, Height, ScaledHeight, View->CropY, View->Height, Bilinear);
+    }
+    Upper = AllocatePool(View->Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+    Lower = AllocatePool(View->Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+    if (EFI_ERROR(Status) || Upper == NULL || Lower == NULL) {
+        Print(L"ERROR: Scaling buffers. No memory resources\n");
+        Status = EFI_OUT_OF_RESOURCES;
+        goto Done;
+    }
+
+    for (UINTN y = 0; y < View->Height; y++) {
+        ScaleRow(&Horz, Image + Vert.Index[y] * Width, Upper);
+        if (Vert.Weight[y] != 0) {
+            ScaleRow(&Horz, Image + (Vert.Index[y] + 1) * Width, Lower);
+            BlendRows(Upper, Lower, Vert.Weight[y], View->Width, Upper);
+        }
+        FrameBufferWriteRow(Frame, Upper, 0, y, View->Width);
+    }
+    FrameBufferFlush(Frame);
+
+Done:
+    ScaleAxisFree(&Horz);
+    ScaleAxisFree(&Vert);
+    if (Upper != NULL) {
+        FreePool(Upper);
+    }
+    if (Lower != NULL) {
+        FreePool(Lower);
+    }
+
+    return Status;
+}
+
 
+//
+// TRUE if the frame drawn for output A can be shown on output B as it is
+//
+static BOOLEAN
+SameFrameFormat( OUTPUT *A,
+                 OUTPUT *B)
+{
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *InfoA = A->Gop->Mode->Info;
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *InfoB = B->Gop->Mode->Info;
 
-static VOID
-PressKey(BOOLEAN DisplayText)
+    if (InfoA->HorizontalResolution != InfoB->HorizontalResolution ||
+        InfoA->VerticalResolution != InfoB->VerticalResolution ||
+        A->Direct != B->Direct) {
+        return FALSE;
+    }
+
+    // Blt takes BLT pixels whatever the mode
+    if (!A->Direct) {
+        return TRUE;
+    }
+
+    return InfoA->PixelFormat == InfoB->PixelFormat &&
+           (InfoA->PixelFormat != PixelBitMask ||
+            CompareMem(&InfoA->PixelInformation, &InfoB->PixelInformation, sizeof(EFI_PIXEL_BITMASK)) == 0);
+}
+
+
+//
+// Show the image on every GOP output.  It is decoded once, at full
+// size, into memory.  Each output then gets it laid out for its own
+// mode and converted to its own pixel format, and it is drawn straight
+// into the frame buffer or with a single Blt.  Outputs with the same
+// mode and pixel format share one converted frame.
+//
+static EFI_STATUS
+DisplayAll( SHELL_FILE_HANDLE FileHandle,
+            UINT64 FileSize,
+            UINTN Scaling,
+            BOOLEAN Bilinear,
+            BOOLEAN UseBlt,
+            BOOLEAN Verbose)
 {
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Info;
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Image = NULL;
+    EFI_HANDLE *HandleBuffer = NULL;
+    EFI_STATUS Status;
+    BMP_SOURCE Source;
+    OUTPUT *Outputs = NULL;
+    OUTPUT *Out;
+    OUTPUT *Same;
+    UINTN HandleCount = 0;
+    UINTN Count = 0;
+    UINTN ScaledWidth;
+    UINTN ScaledHeight;
+    UINT64 StartTime;
+    UINT64 DecodeTime;
 
-    EFI_INPUT_KEY Key;
-    /* EFI_STATUS    Status; */
-    UINTN         EventIndex;
+    ZeroMem(&Source, sizeof(Source));
 
-    if (DisplayText) {
-        Print(L"\nPress any key to continue ....\n\n");
+    Status = gBS->LocateHandleBuffer( ByProtocol,
+                                      &gEfiGraphicsOutputProtocolGuid,
+                                      NULL,
+                                      &HandleCount,
+                                      &HandleBuffer);
+    if (EFI_ERROR (Status)) {
+        Print(L"ERROR: No GOP handles found via LocateHandleBuffer\n");
+        return Status;
     }
 
-    gBS->WaitForEvent (1, &gST->ConIn->WaitForKey, &EventIndex);
-    /* Status = */ gST->ConIn->ReadKeyStroke (gST->ConIn, &Key);
+    Outputs = AllocateZeroPool(HandleCount * sizeof(OUTPUT));
+    if (Outputs == NULL) {
+        Print(L"ERROR: Could not allocate memory\n");
+        Status = EFI_OUT_OF_RESOURCES;
+        goto Done;
+    }
+
+    // the console splitter's GOP just passes drawing on to the real ones
+    for (UINTN i = 0; i < HandleCount; i++) {
+        if (HandleCount > 1 && HandleBuffer[i] == gST->ConsoleOutHandle) {
+            continue;
+        }
+        if (!EFI_ERROR(gBS->HandleProtocol( HandleBuffer[i],
+                                            &gEfiGraphicsOutputProtocolGuid,
+                                            (VOID **)&Outputs[Count].Gop))) {
+            Count++;
+        }
+    }
+
+    StartTime = GetPerformanceCounter();
+    Status = OpenSource(&Source, FileHandle, FileSize);
+    if (!EFI_ERROR(Status)) {
+        Status = DecodeImage(&Source, &Image);
+    }
+    if (EFI_ERROR(Status)) {
+        goto Done;
+    }
+    DecodeTime = GetTimeInNanoSecond(GetPerformanceCounter() - StartTime);
+
+    for (UINTN i = 0; i < Count; i++) {
+        Out = &Outputs[i];
+        Info = Out->Gop->Mode->Info;
+        LayoutImage( Source.Width, Source.Height,
+                     Info->HorizontalResolution,
+                     Info->VerticalResolution,
+                     Scaling, &ScaledWidth, &ScaledHeight, &Out->View);
+        Out->Direct = !UseBlt && !EFI_ERROR(FrameBufferOpen(Out->Gop, &Out->Fb));
+
+        Out->SameAs = i;
+        for (UINTN j = 0; j < i; j++) {
+            if (Outputs[j].SameAs == j && !EFI_ERROR(Outputs[j].Status) &&
+                SameFrameFormat(&Outputs[j], Out)) {
+                Out->SameAs = j;
+                break;
+            }
+        }
+
+        if (Out->SameAs == i) {
+            StartTime = GetPerformanceCounter();
+            if (Out->Direct) {
+                Out->Status = FrameBufferAllocateLike(&Out->Fb, Out->View.Width, Out->View.Height, &Out->Frame);
+            } else {
+                Out->Status = FrameBufferAllocate(Out->View.Width, Out->View.Height, &Out->Frame);
+            }
+            if (!EFI_ERROR(Out->Status)) {
+                Out->Status = RenderFrame( Image, Source.Width, Source.Height,
+                                           ScaledWidth, ScaledHeight,
+                                           &Out->View, Bilinear, &Out->Frame);
+            }
+            Out->DrawTime = GetTimeInNanoSecond(GetPerformanceCounter() - StartTime);
+            if (EFI_ERROR(Out->Status)) {
+                continue;
+            }
+        }
+        Same = &Outputs[Out->SameAs];
+
+        StartTime = GetPerformanceCounter();
+        if (Out->Direct) {
+            FrameBufferCopy(&Out->Fb, Out->View.DestX, Out->View.DestY, &Same->Frame);
+            FrameBufferFlush(&Out->Fb);
+        } else {
+            Out->Status = Out->Gop->Blt( Out->Gop,
+                                         (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)Same->Frame.Base,
+                                         EfiBltBufferToVideo,
+                                         0, 0,
+                                         Out->View.DestX, Out->View.DestY,
+                                         Out->View.Width, Out->View.Height,
+                                         0);
+        }
+        Out->PresentTime = GetTimeInNanoSecond(GetPerformanceCounter() - StartTime);
+    }
+
+    for (UINTN i = 0; i < Count; i++) {
+        if (EFI_ERROR(Outputs[i].Status)) {
+            Status = Outputs[i].Status;
+            break;
+        }
+    }
+
+    if (Verbose) {
+        PressKey(FALSE);
+        Print(L"Decode            : %ld us\n", DecodeTime / 1000);
+        for (UINTN i = 0; i < Count; i++) {
+            Out = &Outputs[i];
+            Info = Out->Gop->Mode->Info;
+            Print(L"Output %d          : %dx%d %s, ", i,
+                  Info->HorizontalResolution, Info->VerticalResolution,
+                  Out->Direct ? L"frame buffer" : L"Blt");
+            if (EFI_ERROR(Out->Status)) {
+                Print(L"failed [%r]\n", Out->Status);
+            } else if (Out->SameAs != i) {
+                Print(L"frame of output %d, present %ld us\n", Out->SameAs, Out->PresentTime / 1000);
+            } else {
+                Print(L"draw %ld us, present %ld us\n", Out->DrawTime / 1000, Out->PresentTime / 1000);
+            }
+        }
+    }
+
+Done:
+    if (Outputs != NULL) {
+        for (UINTN i = 0; i < Count; i++) {
+            FrameBufferFree(&Outputs[i].Frame);
+        }
+        FreePool(Outputs);
+    }
+    if (Image != NULL) {
+        FreePool(Image);
+    }
+    if (HandleBuffer != NULL) {
+        FreePool(HandleBuffer);
+    }
+    CloseSource(&Source);
+
+    return Status;
 }
 
 
-static VOID
-AsciiToUnicodeSize( CHAR8 *String,
-                    UINT8 length,
-                    CHAR16 *UniString)
+//
+// TRUE if Name ends in Suffix (given in lower case), in any case
+//
+static BOOLEAN
+HasSuffix( CHAR16 *Name,
+           CHAR16 *Suffix)
 {
-    int len = length;
+    UINTN Length = StrLen(Name);
+    UINTN SuffixLength = StrLen(Suffix);
+    CHAR16 c;
 
-    while (*String != '\0' && len > 0) {
-        *(UniString++) = (CHAR16) *(String++);
-        len--;
+    if (Length <= SuffixLength) {
+        return FALSE;
     }
-    *UniString = '\0';
+    Name += Length - SuffixLength;
+    for (UINTN i = 0; i < SuffixLength; i++) {
+        c = Name[i];
+        if (c >= L'A' && c <= L'Z') {
+            c += L'a' - L'A';
+        }
+        if (c != Suffix[i]) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
 }
 
 
-#if 0
-EFI_STATUS
-DisplayImage( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop, 
-              EFI_HANDLE *BmpBuffer)
+static BOOLEAN
+IsImageName( CHAR16 *Name)
 {
-    BMP_IMAGE_HEADER *BmpHeader = (BMP_IMAGE_HEADER *) BmpBuffer;
-    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *BltBuffer;
-    EFI_STATUS Status = EFI_SUCCESS;
-    UINT8  *BitmapData;
-    UINT32 *Palette;
-    UINTN   Pixels;
-    UINTN   XIndex;
-    UINTN   YIndex;
-    UINTN   Pos;
-    UINTN   BltPos;
-
-    BitmapData = (UINT8*)BmpBuffer + BmpHeader->ImageOffset;
-    Palette    = (UINT32*) ((UINT8*)BmpBuffer + 0x36);
-
-    Pixels = BmpHeader->PixelWidth * BmpHeader->PixelHeight;
-    BltBuffer = AllocateZeroPool( sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL) * Pixels);
-    if (BltBuffer == NULL) {
-        Print(L"ERROR: BltBuffer. No memory resources\n");
+    return HasSuffix(Name, BMP_SUFFIX) || HasSuffix(Name, PNG_SUFFIX);
+}
+
+
+//
+// Append Dir\Name (or just Name if Dir is NULL) to the slide list
+//
+static EFI_STATUS
+AddSlide( CHAR16 ***Slides,
+          UINTN *SlideCount,
+          CHAR16 *Dir,
+          CHAR16 *Name)
+{
+    CHAR16 **NewSlides;
+    CHAR16 *Path;
+    UINTN PathSize;
+
+    PathSize = StrSize(Name) + (Dir != NULL ? StrSize(Dir) : 0);
+    Path = AllocateZeroPool(PathSize);
+    if (Path == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    if (Dir != NULL) {
+        StrCpyS(Path, PathSize / sizeof(CHAR16), Dir);
+        if (*Dir != L'\0' && Dir[StrLen(Dir) - 1] != L'\\') {
+            StrCatS(Path, PathSize / sizeof(CHAR16), L"\\");
+        }
+    }
+    StrCatS(Path, PathSize / sizeof(CHAR16), Name);
+
+    NewSlides = ReallocatePool( *SlideCount * sizeof(CHAR16 *),
+                                (*SlideCount + 1) * sizeof(CHAR16 *),
+                                *Slides);
+    if (NewSlides == NULL) {
+        FreePool(Path);
         return EFI_OUT_OF_RESOURCES;
     }
+    NewSlides[(*SlideCount)++] = Path;
+    *Slides = NewSlides;
+
+    return EFI_SUCCESS;
+}
+
+
+static VOID
+FreeSlides( CHAR16 **Slides,
+            UINTN SlideCount)
+{
+    for (UINTN i = 0; i < SlideCount; i++) {
+        FreePool(Slides[i]);
+    }
+    if (Slides != NULL) {
+        FreePool(Slides);
+    }
+}
+
+
+//
+// Build the slide list from the command line.  Each name is either an
+// image or a directory, whose BMP and PNG files are shown in name order.
+//
+static EFI_STATUS
+CollectSlides( CHAR16 **Names,
+               UINTN NameCount,
+               CHAR16 ***Slides,
+               UINTN *SlideCount)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    SHELL_FILE_HANDLE DirHandle;
+    EFI_FILE_INFO *FileInfo;
+    BOOLEAN NoFile;
+    CHAR16 *Swap;
+    UINTN First;
+    UINTN j;
 
-    for (YIndex = BmpHeader->PixelHeight; YIndex > 0; YIndex--) {
-        for (XIndex = 0; XIndex < BmpHeader->PixelWidth; XIndex++) {
-            Pos    = (YIndex - 1) * ((BmpHeader->PixelWidth + 3) / 4) * 4 + XIndex;
-            BltPos = (BmpHeader->PixelHeight - YIndex) * BmpHeader->PixelWidth + XIndex;
-            BltBuffer[BltPos].Blue     = (UINT8) BitFieldRead32(Palette[BitmapData[Pos]], 0 , 7 );
-            BltBuffer[BltPos].Green    = (UINT8) BitFieldRead32(Palette[BitmapData[Pos]], 8 , 15);
-            BltBuffer[BltPos].Red      = (UINT8) BitFieldRead32(Palette[BitmapData[Pos]], 16, 23);
-            BltBuffer[BltPos].Reserved = (UINT8) BitFieldRead32(Palette[BitmapData[Pos]], 24, 31);
+    for (UINTN n = 0; n < NameCount && !EFI_ERROR(Status); n++) {
+        Status = ShellOpenFileByName(Names[n], &DirHandle, EFI_FILE_MODE_READ, 0);
+        if (EFI_ERROR(Status)) {
+            Print(L"ERROR: Could not open %s [%r]\n", Names[n], Status);
+            break;
+        }
+        if (ShellIsDirectory(Names[n]) != EFI_SUCCESS) {
+            ShellCloseFile(&DirHandle);
+            Status = AddSlide(Slides, SlideCount, NULL, Names[n]);
+            continue;
+        }
+
+        First = *SlideCount;
+        Status = ShellFindFirstFile(DirHandle, &FileInfo);
+        for (NoFile = EFI_ERROR(Status) || FileInfo == NULL; !NoFile; ) {
+            if (!(FileInfo->Attribute & EFI_FILE_DIRECTORY) && IsImageName(FileInfo->FileName)) {
+                Status = AddSlide(Slides, SlideCount, Names[n], FileInfo->FileName);
+                if (EFI_ERROR(Status)) {
+                    FreePool(FileInfo);
+                    break;
+                }
+            }
+            Status = ShellFindNextFile(DirHandle, FileInfo, &NoFile);
+            if (EFI_ERROR(Status)) {
+                break;
+            }
+        }
+        ShellCloseFile(&DirHandle);
+
+        // directory order is whatever the file system keeps
+        for (UINTN i = First + 1; i < *SlideCount; i++) {
+            Swap = (*Slides)[i];
+            for (j = i; j > First && StrCmp((*Slides)[j - 1], Swap) > 0; j--) {
+                (*Slides)[j] = (*Slides)[j - 1];
+            }
+            (*Slides)[j] = Swap;
         }
     }
 
+    if (EFI_ERROR(Status)) {
+        Print(L"ERROR: Could not list images [%r]\n", Status);
+    } else if (*SlideCount == 0) {
+        Print(L"ERROR: No BMP or PNG files found\n");
+        Status = EFI_NOT_FOUND;
+    }
 
-    Status = Gop->Blt( Gop,
-                       BltBuffer,
-                       EfiBltBufferToVideo,
-                       0, 0,            /* Source X, Y */
-                       50, 50,          /* Dest X, Y */
-                       BmpHeader->PixelWidth, BmpHeader->PixelHeight, 
-                       0);
+    return Status;
+}
+
+
+//
+// Nanoseconds as microseconds, for the slideshow report
+//
+static VOID
+PrintTime( CHAR16 *Label,
+           UINT64 Total,
+           UINT64 Max,
+           UINTN Count)
+{
+    Print(L"%s: %ld us average, %ld us worst\n",
+          Label,
+          Count ? DivU64x64Remainder(Total, Count, NULL) / 1000 : 0,
+          Max / 1000);
+}
+
+
+//
+// Show the images in turn, Interval milliseconds apart, until a key
+// is pressed or Frames frames have been shown (0 for no limit).  The
+// next image is drawn into an off-screen frame while the current one
+// is on the screen, and then shown with a single Blt when the timer
+// fires.  With no interval frames are shown as fast as they can be
+// drawn.
+//
+static EFI_STATUS
+Slideshow( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop, 
+           CHAR16 **Slides,
+           UINTN SlideCount,
+           UINTN Interval,
+           UINTN Frames,
+           UINTN Scaling,
+           BOOLEAN Bilinear)
+{
+    EFI_STATUS Status;
+    EFI_EVENT Events[2] = { NULL, NULL };
+    EFI_INPUT_KEY Key;
+    FRAME_BUFFER Back;
+    SHELL_FILE_HANDLE FileHandle;
+    UINT64 FileSize;
+    UINT64 StartTime;
+    UINT64 ShowTime;
+    UINT64 Time;
+    UINT64 DecodeTime = 0;
+    UINT64 DecodeMax = 0;
+    UINT64 PresentTime = 0;
+    UINT64 PresentMax = 0;
+    UINTN Decoded = 0;
+    UINTN Shown = 0;
+    UINTN Index;
+    UINTN Width = Gop->Mode->Info->HorizontalResolution;
+    UINTN Height = Gop->Mode->Info->VerticalResolution;
 
-    FreePool(BltBuffer);
+    Status = FrameBufferAllocate(Width, Height, &Back);
+    if (EFI_ERROR(Status)) {
+        Print(L"ERROR: Off-screen frame. No memory resources\n");
+        return Status;
+    }
+
+    Events[0] = gST->ConIn->WaitForKey;
+    if (Interval > 0) {
+        Status = gBS->CreateEvent(EVT_TIMER, 0, NULL, NULL, &Events[1]);
+        if (!EFI_ERROR(Status)) {
+            Status = gBS->SetTimer(Events[1], TimerPeriodic, MultU64x32(Interval, 10000));
+        }
+        if (EFI_ERROR(Status)) {
+            Print(L"ERROR: Could not start timer [%r]\n", Status);
+            goto Done;
+        }
+    }
+
+    ShowTime = GetPerformanceCounter();
+    for (UINTN Slide = 0; Frames == 0 || Shown < Frames; Slide = (Slide + 1) % SlideCount) {
+        // draw the next frame off screen
+        StartTime = GetPerformanceCounter();
+        Status = ShellOpenFileByName(Slides[Slide], &FileHandle, EFI_FILE_MODE_READ, 0);
+        if (EFI_ERROR(Status)) {
+            Print(L"ERROR: Could not open %s [%r]\n", Slides[Slide], Status);
+            break;
+        }
+        Status = ShellGetFileSize(FileHandle, &FileSize);
+        if (!EFI_ERROR(Status)) {
+            ZeroMem(Back.Base, Back.Size);
+            Status = DisplayImage(Gop, &Back, NULL, FileHandle, FileSize, Scaling, Bilinear, FALSE);
+        }
+        ShellCloseFile(&FileHandle);
+        if (EFI_ERROR(Status)) {
+            break;
+        }
+        Time = GetTimeInNanoSecond(GetPerformanceCounter() - StartTime);
+        DecodeTime += Time;
+        DecodeMax = MAX(DecodeMax, Time);
+        Decoded++;
+
+        // wait for the timer, stopping on a key press
+        if (Events[1] != NULL) {
+            gBS->WaitForEvent(2, Events, &Index);
+        } else {
+            Index = (gBS->CheckEvent(Events[0]) == EFI_SUCCESS) ? 0 : 1;
+        }
+        if (Index == 0) {
+            gST->ConIn->ReadKeyStroke(gST->ConIn, &Key);
+            break;
+        }
+
+        StartTime = GetPerformanceCounter();
+        Status = Gop->Blt( Gop,
+                           (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)Back.Base,
+                           EfiBltBufferToVideo,
+                           0, 0, 0, 0,
+                           Width, Height, 0);
+        if (EFI_ERROR(Status)) {
+            Print(L"ERROR: Blt [%r]\n", Status);
+            break;
+        }
+        Time = GetTimeInNanoSecond(GetPerformanceCounter() - StartTime);
+        PresentTime += Time;
+        PresentMax = MAX(PresentMax, Time);
+        Shown++;
+    }
+    Time = GetTimeInNanoSecond(GetPerformanceCounter() - ShowTime);
+
+    if (Shown > 0 && Time > 0) {
+        // frames per second to two decimal places
+        Time = DivU64x64Remainder(MultU64x32(Shown, 100000) * 1000000, Time, NULL);
+        Print(L"Frames shown      : %d\n", Shown);
+        Print(L"Frame rate        : %ld.%02ld fps\n", Time / 100, Time % 100);
+        PrintTime(L"Decode            ", DecodeTime, DecodeMax, Decoded);
+        PrintTime(L"Present           ", PresentTime, PresentMax, Shown);
+    }
+
+Done:
+    if (Events[1] != NULL) {
+        gBS->SetTimer(Events[1], TimerCancel, 0);
+        gBS->CloseEvent(Events[1]);
+    }
+    FrameBufferFree(&Back);
 
     return Status;
 }
-#endif
 
 
 //
 // Print the BMP header details
 //
 EFI_STATUS
-PrintBMP( EFI_HANDLE *BmpBuffer)
+PrintBMP( BMP_IMAGE_HEADER *BmpHeader,
+          UINTN HeaderSize,
+          UINT64 FileSize)
 {
-    BMP_IMAGE_HEADER *BmpHeader = (BMP_IMAGE_HEADER *)BmpBuffer;
-    EFI_STATUS Status = EFI_SUCCESS;
+    BMP_IMAGE_INFO Info;
+    EFI_STATUS Status;
     CHAR16 Buffer[100];
 
     // not BMP format
-    if (BmpHeader->CharB != 'B' || BmpHeader->CharM != 'M') {
+    if (HeaderSize < sizeof(BMP_IMAGE_HEADER) ||
+        BmpHeader->CharB != 'B' || BmpHeader->CharM != 'M') {
         Print(L"ERROR: Unsupported image format\n"); 
         return EFI_UNSUPPORTED;
     }
 
-    // BITMAPINFOHEADER format unsupported
-    if (BmpHeader->HeaderSize != sizeof (BMP_IMAGE_HEADER) \
-        - ((UINTN) &(((BMP_IMAGE_HEADER *)0)->HeaderSize))) {
-        Print(L"ERROR: Unsupported BITMAPFILEHEADER\n");
-        return EFI_UNSUPPORTED;
-    }
-
-    // compression type not 0
-    if (BmpHeader->CompressionType != 0) {
-        Print(L"ERROR: Compression type not 0\n");
-        return EFI_UNSUPPORTED;
-    }
-
-    // unsupported bits per pixel
-    if (BmpHeader->BitPerPixel != 4 &&
-        BmpHeader->BitPerPixel != 8 &&
-        BmpHeader->BitPerPixel != 12 &&
-        BmpHeader->BitPerPixel != 24) {
-        Print(L"ERROR: Bits per pixel is not one of 4, 8, 12 or 24\n");
-        return EFI_UNSUPPORTED;
-    }
+    Status = BmpParse(BmpHeader, HeaderSize, FileSize, &Info);
 
     Print(L"\n");
     AsciiToUnicodeSize((CHAR8 *)BmpHeader, 2, Buffer);
@@ -184,16 +1543,129 @@ PrintBMP( EFI_HANDLE *BmpBuffer)
     Print(L"Y Pixels Per Meter: %d\n", BmpHeader->YPixelsPerMeter);
     Print(L"Number of Colors  : %d\n", BmpHeader->NumberOfColors);
     Print(L"Important Colors  : %d\n", BmpHeader->ImportantColors);
+    if (Status == EFI_UNSUPPORTED) {
+        Print(L"Image Data        : Not supported\n");
+    } else if (EFI_ERROR(Status)) {
+        Print(L"Image Data        : Corrupt or truncated\n");
+    } else {
+        Print(L"Row Order         : %s\n", Info.TopDown ? L"Top down" : L"Bottom up");
+        if (Info.CompressionType == BMP_RGB) {
+            Print(L"Row Size          : %d\n", Info.RowSize);
+        }
+    }
+
+    return Status;
+}
+
+
+
+//
+// Print the PNG header details
+//
+EFI_STATUS
+PrintPNG( SHELL_FILE_HANDLE FileHandle)
+{
+    EFI_STATUS Status;
+    PNG_DECODER *Png;
+
+    ShellSetFilePosition(FileHandle, 0);
+    Status = PngOpen(ReadSourceFile, FileHandle, &Png);
+    if (EFI_ERROR(Status)) {
+        Print(L"ERROR: Unsupported or corrupt PNG image [%r]\n", Status);
+        return Status;
+    }
+
+    Print(L"\n");
+    Print(L"PNG Signature     : PNG\n");
+    Print(L"Image Width       : %d\n", Png->Width);
+    Print(L"Image Height      : %d\n", Png->Height);
+    Print(L"Bit Depth         : %d\n", Png->BitDepth);
+    Print(L"Color Type        : %d\n", Png->ColorType);
+    Print(L"Interlace         : %d\n", Png->Interlace);
+    Print(L"Palette Entries   : %d\n", Png->PaletteSize);
+
+    PngClose(Png);
+
+    return EFI_SUCCESS;
+}
+
+
+
+//
+// Width and height of an image file, without decoding it
+//
+static EFI_STATUS
+ImageSize( SHELL_FILE_HANDLE FileHandle,
+           UINT64 FileSize,
+           UINTN *Width,
+           UINTN *Height)
+{
+    BMP_SOURCE Source;
+    EFI_STATUS Status;
+
+    Status = OpenSource(&Source, FileHandle, FileSize);
+    if (!EFI_ERROR(Status)) {
+        *Width = Source.Width;
+        *Height = Source.Height;
+    }
+    CloseSource(&Source);
 
     return Status;
 }
 
 
+//
+// Switch to the mode that best suits an image of Width x Height, or
+// to the largest native mode if both are zero.  Switched is set if
+// the mode was changed and needs to be put back afterwards.
+//
+static EFI_STATUS
+SelectMode( EFI_HANDLE GopHandle,
+            EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+            UINTN Width,
+            UINTN Height,
+            BOOLEAN *Switched,
+            BOOLEAN *Cached,
+            UINT64 *SwitchTime)
+{
+    GOP_MODE_TABLE *Table;
+    EFI_STATUS Status;
+
+    *Switched = FALSE;
+    *SwitchTime = 0;
+
+    Status = GopModeGetTable(GopHandle, Gop, FALSE, &Table, Cached);
+    if (EFI_ERROR(Status)) {
+        Print(L"ERROR: Could not get screen modes [%r]\n", Status);
+        return Status;
+    }
+
+    GopModeRank(Table, (UINT32)Width, (UINT32)Height);
+    if (Table->Modes[0].Mode != Gop->Mode->Mode) {
+        Status = GopModeSet(Gop, Table->Modes[0].Mode, SwitchTime);
+        if (EFI_ERROR(Status)) {
+            Print(L"ERROR: SetMode %d [%r]\n", Table->Modes[0].Mode, Status);
+        } else {
+            *Switched = TRUE;
+        }
+    }
+
+    GopModeFreeTable(Table);
+    return Status;
+}
+
 
 static void
 Usage(void)
 {
-    Print(L"Usage: DisplayBMP [-v | --verbose] [-l | --lowest] BMPfile\n"); 
+    Print(L"Usage: DisplayBMP [-v | --verbose] [-l | --lowest] [-b | --blt] [-c | --cache]\n");
+    Print(L"                  [-m | --mode] [--fit | --fill | --stretch] [--bilinear] imagefile\n");
+    Print(L"       DisplayBMP [-v | --verbose] [-b | --blt] -a | --all\n");
+    Print(L"                  [--fit | --fill | --stretch] [--bilinear] imagefile\n");
+    Print(L"       DisplayBMP [-v | --verbose] [-l | --lowest] [-b | --blt] --blend\n");
+    Print(L"                  [--fit | --fill | --stretch] [--bilinear] imagefile\n");
+    Print(L"       DisplayBMP [-l | --lowest] [-m | --mode] [-i | --interval ms] [--frames count]\n");
+    Print(L"                  [--fit | --fill | --stretch] [--bilinear] imagefile|directory ...\n");
 }
 
 
@@ -205,14 +1677,43 @@ ShellAppMain(UINTN Argc, CHAR16 **Argv)
     EFI_HANDLE *HandleBuffer = NULL;
     UINTN HandleCount = 0;
     EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop;
+    EFI_HANDLE GopHandle;
     SHELL_FILE_HANDLE FileHandle;
     EFI_FILE_INFO *FileInfo = NULL;
-    EFI_HANDLE *FileBuffer = NULL;
+    BMP_IMAGE_HEADER Header;
     BOOLEAN Verbose = FALSE;
-    UINTN FileSize;
-    //int OrgMode, NewMode = 0, Pixels = 0;
-    int Pixels = 0;
+    UINT64 FileSize;
+    UINTN HeaderSize;
+    UINT32 OrgMode;
+    BOOLEAN BestMode = FALSE;
+    BOOLEAN Switched = FALSE;
+    BOOLEAN Cached = FALSE;
+    UINT64 SwitchTime = 0;
+    UINTN ImageWidth = 0;
+    UINTN ImageHeight = 0;
     BOOLEAN LowerHandle = FALSE;
+    BOOLEAN UseBlt = FALSE;
+    BOOLEAN Bilinear = FALSE;
+    UINTN Scaling = SCALE_NONE;
+    BOOLEAN UseCache = FALSE;
+    BOOLEAN Blend = FALSE;
+    BOOLEAN AllOutputs = FALSE;
+    FRAME_BUFFER Fb;
+    IMAGE_CACHE Cache;
+    IMAGE_CACHE *NewCache = NULL;
+    IMAGE_CACHE_HEADER Key;
+    CHAR16 *CacheName = NULL;
+    UINTN CacheNameSize;
+    CHAR16 **Slides = NULL;
+    UINTN SlideCount = 0;
+    BOOLEAN Show;
+    UINTN Interval = 0;
+    UINTN Frames = 0;
+    CHAR16 *FileName;
+    UINT64 StartTime;
+    UINT64 BltTime;
+    UINT64 DirectTime;
+    int i;
 
 
     if (Argc == 1) {
@@ -220,7 +1721,7 @@ ShellAppMain(UINTN Argc, CHAR16 **Argv)
         return Status;
     }
 
-    for (int i = 1; i < Argc - 1; i++) {
+    for (i = 1; i < Argc; i++) {
         if (!StrCmp(Argv[i], L"--verbose") ||
             !StrCmp(Argv[i], L"-v")) {
             Verbose = TRUE;
@@ -232,6 +1733,44 @@ ShellAppMain(UINTN Argc, CHAR16 **Argv)
         } else if (!StrCmp(Argv[i], L"--lowest") ||
             !StrCmp(Argv[i], L"-l")) {
             LowerHandle = TRUE;
+        } else if (!StrCmp(Argv[i], L"--mode") ||
+            !StrCmp(Argv[i], L"-m")) {
+            BestMode = TRUE;
+        } else if (!StrCmp(Argv[i], L"--blt") ||
+            !StrCmp(Argv[i], L"-b")) {
+            UseBlt = TRUE;
+        } else if (!StrCmp(Argv[i], L"--fit")) {
+            Scaling = SCALE_FIT;
+        } else if (!StrCmp(Argv[i], L"--fill")) {
+            Scaling = SCALE_FILL;
+        } else if (!StrCmp(Argv[i], L"--stretch")) {
+            Scaling = SCALE_STRETCH;
+        } else if (!StrCmp(Argv[i], L"--bilinear")) {
+            Bilinear = TRUE;
+        } else if (!StrCmp(Argv[i], L"--blend")) {
+            Blend = TRUE;
+        } else if (!StrCmp(Argv[i], L"--all") ||
+            !StrCmp(Argv[i], L"-a")) {
+            AllOutputs = TRUE;
+        } else if (!StrCmp(Argv[i], L"--cache") ||
+            !StrCmp(Argv[i], L"-c")) {
+            UseCache = TRUE;
+        } else if (!StrCmp(Argv[i], L"--interval") ||
+            !StrCmp(Argv[i], L"-i")) {
+            if (++i >= Argc) {
+                Print(L"ERROR: Invalid interval.\n");
+                Usage();
+                return Status;
+            }
+            Interval = StrDecimalToUintn(Argv[i]);
+        } else if (!StrCmp(Argv[i], L"--frames")) {
+            if (++i >= Argc || (Frames = StrDecimalToUintn(Argv[i])) == 0) {
+                Print(L"ERROR: Invalid frame count.\n");
+                Usage();
+                return Status;
+            }
+        } else if (Argv[i][0] != L'-') {
+            break;
         } else {
             Print(L"ERROR: Unknown option.\n");
             Usage();
@@ -239,8 +1778,14 @@ ShellAppMain(UINTN Argc, CHAR16 **Argv)
         }
     }
 
-    // Open the file ( has to be LAST arguement on command line )
-    Status = ShellOpenFileByName( Argv[Argc - 1], 
+    if (i >= Argc) {
+        Usage();
+        return Status;
+    }
+    FileName = Argv[i];
+
+    // Open the file ( the first name after the options )
+    Status = ShellOpenFileByName( FileName, 
                                   &FileHandle,
                                   EFI_FILE_MODE_READ , 0);
     if (EFI_ERROR (Status)) {
@@ -248,29 +1793,51 @@ ShellAppMain(UINTN Argc, CHAR16 **Argv)
         return Status;
     }            
 
-    // Allocate buffer for file contents
+    // the image is read a band at a time while it is displayed
     FileInfo = ShellGetFileInfo(FileHandle);    
-    FileBuffer = AllocateZeroPool( (UINTN)FileInfo -> FileSize);
-    if (FileBuffer == NULL) {
-        Print(L"ERROR: File buffer. No memory resources\n");
-        return (SHELL_OUT_OF_RESOURCES);   
+    if (FileInfo == NULL) {
+        Print(L"ERROR: Could not get file information\n");
+        Status = EFI_DEVICE_ERROR;
+        goto cleanup;
     }
+    FileSize = FileInfo->FileSize;
 
-    // Read file contents into allocated buffer
-    FileSize = (UINTN) FileInfo->FileSize;
-    Status = ShellReadFile(FileHandle, &FileSize, FileBuffer);
-    if (EFI_ERROR (Status)) {
-        Print(L"ERROR: ShellReadFile failed [%d]\n", Status);
+    // more than one image, or a directory of them, is a slideshow
+    Show = (i < Argc - 1) || (FileInfo->Attribute & EFI_FILE_DIRECTORY);
+    if (Show && Blend) {
+        Print(L"ERROR: Only a single image can be blended\n");
+        Status = EFI_INVALID_PARAMETER;
         goto cleanup;
-    }            
-  
-    ShellCloseFile(&FileHandle);
+    }
+    if (AllOutputs && (Show || Blend)) {
+        Print(L"ERROR: Only a single unblended image can be shown on all outputs\n");
+        Status = EFI_INVALID_PARAMETER;
+        goto cleanup;
+    }
+    if (Show) {
+        Status = CollectSlides(Argv + i, Argc - i, &Slides, &SlideCount);
+        if (EFI_ERROR(Status)) {
+            goto cleanup;
+        }
+    }
 
-    if (Verbose) {
-         PrintBMP(FileBuffer);
+    if (Verbose && !Show) {
+         ZeroMem(&Header, sizeof(Header));
+         HeaderSize = sizeof(Header);
+         ShellReadFile(FileHandle, &HeaderSize, &Header);
+         if (PngIsImage(&Header, HeaderSize)) {
+             PrintPNG(FileHandle);
+         } else {
+             PrintBMP(&Header, HeaderSize, FileSize);
+         }
          PressKey(TRUE); 
     }
 
+    if (AllOutputs) {
+        Status = DisplayAll(FileHandle, FileSize, Scaling, Bilinear, UseBlt, Verbose);
+        goto cleanup;
+    }
+
     // Try locating GOP by handle
     Status = gBS->LocateHandleBuffer( ByProtocol,
                       &gEfiGraphicsOutputProtocolGuid,
@@ -287,7 +1854,8 @@ ShellAppMain(UINTN Argc, CHAR16 **Argv)
         else
             HandleCount--;
 
-        Status = gBS->OpenProtocol( HandleBuffer[HandleCount],
+        GopHandle = HandleBuffer[HandleCount];
+        Status = gBS->OpenProtocol( GopHandle,
                                     &gEfiGraphicsOutputProtocolGuid,
                                     (VOID **)&Gop,
                                     gImageHandle,
@@ -301,86 +1869,126 @@ ShellAppMain(UINTN Argc, CHAR16 **Argv)
         FreePool(HandleBuffer);
     }
 
-    // Figure out maximum resolution and use it
-    //OrgMode = Gop->Mode->Mode;
-    for (int i = 0; i < Gop->Mode->MaxMode; i++) {
-         EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Info;
-         UINTN SizeOfInfo;
+    // switch to the mode that suits the image best, slideshows the largest
+    OrgMode = Gop->Mode->Mode;
+    if (BestMode) {
+        if (!Show) {
+            ImageSize(FileHandle, FileSize, &ImageWidth, &ImageHeight);
+        }
+        Status = SelectMode(GopHandle, Gop, ImageWidth, ImageHeight, &Switched, &Cached, &SwitchTime);
+        if (EFI_ERROR(Status)) {
+            goto cleanup;
+        }
+    }
+
+    if (Show) {
+        Status = Slideshow(Gop, Slides, SlideCount, Interval, Frames, Scaling, Bilinear);
+        goto restore;
+    }
 
-         Status = Gop->QueryMode(Gop, i, &SizeOfInfo, &Info);
-         if (EFI_ERROR(Status) && Status == EFI_NOT_STARTED) {
-             Gop->SetMode(Gop, Gop->Mode->Mode);
-             Status = Gop->QueryMode(Gop, i, &SizeOfInfo, &Info);
-         }
-         if (EFI_ERROR(Status)) {
-             continue;
-         }
-         if (Info->PixelsPerScanLine > Pixels) {
-              Pixels = Info->PixelsPerScanLine;
-              //NewMode = i;
-         }
+    // draw straight into the frame buffer unless the mode has none
+    if (!UseBlt && EFI_ERROR(FrameBufferOpen(Gop, &Fb))) {
+        UseBlt = TRUE;
     }
-   
-#if 0
-    // change screen mode 
-    Status = Gop->SetMode(Gop, NewMode);
-    if (EFI_ERROR (Status)) { 
-        Print(L"ERROR: SetMode [%d]\n, Status");
-        goto cleanup;
+
+    // the converted image is kept next to the image file; a blended
+    // image depends on what was under it, so it is never cached
+    if (UseCache && !Blend) {
+        CacheNameSize = StrSize(FileName) + StrSize(IMAGE_CACHE_SUFFIX);
+        CacheName = AllocateZeroPool(CacheNameSize);
+        if (CacheName == NULL) {
+            Print(L"ERROR: Could not allocate memory\n");
+            Status = EFI_OUT_OF_RESOURCES;
+            goto cleanup;
+        }
+        StrCpyS(CacheName, CacheNameSize / sizeof(CHAR16), FileName);
+        StrCatS(CacheName, CacheNameSize / sizeof(CHAR16), IMAGE_CACHE_SUFFIX);
+
+        Status = CacheMakeKey(FileHandle, FileInfo, Gop, Scaling, Bilinear, &Key);
+        if (EFI_ERROR(Status)) {
+            Print(L"ERROR: Could not read image file [%r]\n", Status);
+            goto cleanup;
+        }
+
+        if (!EFI_ERROR(CacheOpen(CacheName, &Key, &Cache))) {
+            StartTime = GetPerformanceCounter();
+            Status = DisplayCached(Gop, UseBlt ? NULL : &Fb, &Cache);
+            DirectTime = GetTimeInNanoSecond(GetPerformanceCounter() - StartTime);
+            CacheClose(&Cache, FALSE);
+            if (Verbose) {
+                PressKey(FALSE);
+                if (!EFI_ERROR(Status)) {
+                    Print(L"Cached            : %ld us\n", DirectTime / 1000);
+                }
+            }
+            goto restore;
+        }
+
+        if (EFI_ERROR(CacheCreate(CacheName, &Key, &Cache))) {
+            Print(L"WARNING: Could not create %s\n", CacheName);
+        } else {
+            NewCache = &Cache;
+        }
+    }
+
+    if (Verbose && Blend) {
+        // drawing twice would blend the image onto itself
+        StartTime = GetPerformanceCounter();
+        Status = DisplayImage(Gop, UseBlt ? NULL : &Fb, NULL, FileHandle, FileSize, Scaling, Bilinear, TRUE);
+        BltTime = GetTimeInNanoSecond(GetPerformanceCounter() - StartTime);
+        PressKey(FALSE);
+        if (!EFI_ERROR(Status)) {
+            Print(L"Blend             : %ld us\n", BltTime / 1000);
+        }
+    } else if (Verbose) {
+        // draw with both methods and compare
+        StartTime = GetPerformanceCounter();
+        Status = DisplayImage(Gop, NULL, NewCache, FileHandle, FileSize, Scaling, Bilinear, FALSE);
+        BltTime = GetTimeInNanoSecond(GetPerformanceCounter() - StartTime);
+        if (!EFI_ERROR(Status) && !UseBlt) {
+            StartTime = GetPerformanceCounter();
+            Status = DisplayImage(Gop, &Fb, NULL, FileHandle, FileSize, Scaling, Bilinear, FALSE);
+            DirectTime = GetTimeInNanoSecond(GetPerformanceCounter() - StartTime);
+        }
+        PressKey(FALSE);
+        if (!EFI_ERROR(Status)) {
+            Print(L"Blt               : %ld us\n", BltTime / 1000);
+            if (!UseBlt) {
+                Print(L"Frame buffer      : %ld us\n", DirectTime / 1000);
+            } else {
+                Print(L"Frame buffer      : not available\n");
+            }
+        }
+    } else {
+        Status = DisplayImage(Gop, UseBlt ? NULL : &Fb, NewCache, FileHandle, FileSize, Scaling, Bilinear, Blend);
     }
-#endif
-        
-    //DisplayImage(Gop, FileBuffer);
-
-{
- EFI_GRAPHICS_OUTPUT_BLT_PIXEL *mBlt;
- UINTN BltSize;
- UINTN mHeight;
- UINTN mWidth;
- UINTN CoordinateX;
- UINTN CoordinateY;
-
- Status = ConvertBmpToGopBlt(
-            FileBuffer,
-            FileSize,
-            (VOID **)&mBlt,
-            &BltSize,
-            &mHeight,
-            &mWidth
-            );
-  if (EFI_ERROR(Status)) {
-    //free(FileBuffer);
-  }
-  
-  CoordinateX = (Gop->Mode->Info->HorizontalResolution / 2) - (mWidth / 2);
-  CoordinateY = (Gop->Mode->Info->VerticalResolution / 2) - (mHeight / 2);
-
-  //DisplayImageAt((UINTN)CoordinateX, (UINTN)CoordinateY);
-  Gop->Blt(
-                     Gop,
-                     mBlt,
-                     EfiBltBufferToVideo,
-                     0,
-                     0,
-                     CoordinateX,
-                     CoordinateY,
-                     mWidth,
-                     mHeight,
-                     mWidth * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL)
-                     );
-
-}
-
-
-#if 0
-    // reset screen to original mode
-    PressKey(FALSE);
-    Status = Gop->SetMode(Gop, OrgMode);
-#endif
 
+    // only a completely drawn image is kept
+    if (NewCache != NULL) {
+        CacheClose(NewCache, !EFI_ERROR(Status));
+    }
+
+restore:
+
+    // leave the image up until a key is pressed, then put the mode back
+    if (Switched) {
+        PressKey(FALSE);
+        GopModeSet(Gop, OrgMode, NULL);
+        if (Verbose) {
+            Print(L"Mode switch       : %ld us (%s mode table)\n", 
+                  SwitchTime / 1000, Cached ? L"cached" : L"queried");
+        }
+    }
 
 cleanup:
 
-    FreePool(FileBuffer);
+    FreeSlides(Slides, SlideCount);
+    if (CacheName != NULL) {
+        FreePool(CacheName);
+    }
+    if (FileInfo != NULL) {
+        FreePool(FileInfo);
+    }
+    ShellCloseFile(&FileHandle);
     return Status;
 }
@@ -0,0 +1,273 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Direct writes to the GOP linear frame buffer
+//
+//  32-bit BGR and RGB modes are written with non-temporal stores so a
+//  full screen image does not evict the cache on its way to (usually
+//  write combining) video memory.  PixelBitMask modes go through one
+//  lookup table per colour.
+//
+//  License: BSD License
+//
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+#include <emmintrin.h>
+
+#include "FrameBuffer.h"
+
+
+#define SIMD __attribute__((target("sse2")))
+
+
+//
+// Table mapping an 8-bit colour value to its bits in a PixelBitMask pixel
+//
+static VOID
+BuildMaskLut( UINT32 Mask,
+              UINT32 *Lut)
+{
+    UINTN Shift = 0;
+    UINTN Bits = 0;
+
+    if (Mask == 0) {
+        ZeroMem(Lut, 256 * sizeof(UINT32));
+        return;
+    }
+    while (!(Mask & (1U << Shift))) {
+        Shift++;
+    }
+    while (Shift + Bits < 32 && (Mask & (1U << (Shift + Bits)))) {
+        Bits++;
+    }
+
+    for (UINTN v = 0; v < 256; v++) {
+        if (Bits <= 8) {
+            Lut[v] = (UINT32)(v >> (8 - Bits)) << Shift;
+        } else {
+            Lut[v] = (UINT32)(v << (Bits - 8)) << Shift;
+        }
+        Lut[v] &= Mask;
+    }
+}
+
+
+//
+// EFI_UNSUPPORTED if the mode has no frame buffer (PixelBltOnly)
+//
+EFI_STATUS
+FrameBufferOpen( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+                 FRAME_BUFFER *Fb)
+{
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Info = Gop->Mode->Info;
+    EFI_PIXEL_BITMASK *Mask = &Info->PixelInformation;
+
+    ZeroMem(Fb, sizeof(FRAME_BUFFER));
+
+    if (Info->PixelFormat >= PixelBltOnly || Gop->Mode->FrameBufferBase == 0) {
+        return EFI_UNSUPPORTED;
+    }
+
+    Fb->Base = (UINT8 *)(UINTN)Gop->Mode->FrameBufferBase;
+    Fb->Size = Gop->Mode->FrameBufferSize;
+    Fb->PixelsPerScanLine = Info->PixelsPerScanLine;
+    Fb->Width = Info->HorizontalResolution;
+    Fb->Height = Info->VerticalResolution;
+    Fb->PixelFormat = Info->PixelFormat;
+    Fb->BytesPerPixel = 4;
+
+    if (Info->PixelFormat == PixelBitMask) {
+        if (((Mask->RedMask | Mask->GreenMask | Mask->BlueMask | Mask->ReservedMask) & 0xFFFF0000) == 0) {
+            Fb->BytesPerPixel = 2;
+        }
+        BuildMaskLut(Mask->RedMask, Fb->RedLut);
+        BuildMaskLut(Mask->GreenMask, Fb->GreenLut);
+        BuildMaskLut(Mask->BlueMask, Fb->BlueLut);
+    }
+
+    if (Fb->PixelsPerScanLine * Fb->Height * Fb->BytesPerPixel > Fb->Size) {
+        return EFI_UNSUPPORTED;
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Off-screen frame in BLT pixel format, Width x Height, that can be
+// drawn into like the real frame buffer and shown with a single Blt
+//
+EFI_STATUS
+FrameBufferAllocate( UINTN Width,
+                     UINTN Height,
+                     FRAME_BUFFER *Fb)
+{
+    ZeroMem(Fb, sizeof(FRAME_BUFFER));
+
+    Fb->Size = Width * Height * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL);
+    Fb->Base = AllocateZeroPool(Fb->Size);
+    if (Fb->Base == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    Fb->PixelsPerScanLine = Width;
+    Fb->Width = Width;
+    Fb->Height = Height;
+    Fb->PixelFormat = PixelBlueGreenRedReserved8BitPerColor;
+    Fb->BytesPerPixel = 4;
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Off-screen frame, Width x Height, in the pixel format of Like.  It
+// holds pixels ready to be copied to Like with FrameBufferCopy.
+//
+EFI_STATUS
+FrameBufferAllocateLike( FRAME_BUFFER *Like,
+                         UINTN Width,
+                         UINTN Height,
+                         FRAME_BUFFER *Fb)
+{
+    CopyMem(Fb, Like, sizeof(FRAME_BUFFER));
+
+    Fb->Size = Width * Height * Like->BytesPerPixel;
+    Fb->Base = AllocateZeroPool(Fb->Size);
+    if (Fb->Base == NULL) {
+        ZeroMem(Fb, sizeof(FRAME_BUFFER));
+        return EFI_OUT_OF_RESOURCES;
+    }
+    Fb->PixelsPerScanLine = Width;
+    Fb->Width = Width;
+    Fb->Height = Height;
+
+    return EFI_SUCCESS;
+}
+
+
+VOID
+FrameBufferFree( FRAME_BUFFER *Fb)
+{
+    if (Fb->Base != NULL) {
+        FreePool(Fb->Base);
+    }
+    ZeroMem(Fb, sizeof(FRAME_BUFFER));
+}
+
+
+static UINT32
+SwapRedBlue( UINT32 Pixel)
+{
+    return (Pixel & 0xFF00FF00) | ((Pixel >> 16) & 0xFF) | ((Pixel & 0xFF) << 16);
+}
+
+
+//
+// Copy Count BLT pixels to 32-bit video memory, swapping red and blue
+// for RGB modes.  Stores are aligned to 16 bytes so that all but the
+// ends of the row go out as full non-temporal writes.
+//
+static SIMD VOID
+StreamRow( UINT32 *Dst,
+           UINT32 *Src,
+           UINTN Count,
+           BOOLEAN Swap)
+{
+    __m128i GreenReserved = _mm_set1_epi32(0xFF00FF00);
+    __m128i Low = _mm_set1_epi32(0xFF);
+    __m128i Pixels;
+
+    for (; Count > 0 && ((UINTN)Dst & 15) != 0; Count--) {
+        *Dst++ = Swap ? SwapRedBlue(*Src++) : *Src++;
+    }
+
+    for (; Count >= 4; Count -= 4, Dst += 4, Src += 4) {
+        Pixels = _mm_loadu_si128((__m128i *)Src);
+        if (Swap) {
+            Pixels = _mm_or_si128(_mm_and_si128(Pixels, GreenReserved),
+                     _mm_or_si128(_mm_and_si128(_mm_srli_epi32(Pixels, 16), Low),
+                                  _mm_slli_epi32(_mm_and_si128(Pixels, Low), 16)));
+        }
+        _mm_stream_si128((__m128i *)Dst, Pixels);
+    }
+
+    for (; Count > 0; Count--) {
+        *Dst++ = Swap ? SwapRedBlue(*Src++) : *Src++;
+    }
+}
+
+
+//
+// Write Width pixels of Row at (X, Y).  The caller clips to the screen.
+//
+VOID
+FrameBufferWriteRow( FRAME_BUFFER *Fb,
+                     EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Row,
+                     UINTN X,
+                     UINTN Y,
+                     UINTN Width)
+{
+    UINT8 *Dst = Fb->Base + (Y * Fb->PixelsPerScanLine + X) * Fb->BytesPerPixel;
+    UINT32 Pixel;
+
+    switch (Fb->PixelFormat) {
+        case PixelBlueGreenRedReserved8BitPerColor:
+            StreamRow((UINT32 *)Dst, (UINT32 *)Row, Width, FALSE);
+            break;
+        case PixelRedGreenBlueReserved8BitPerColor:
+            StreamRow((UINT32 *)Dst, (UINT32 *)Row, Width, TRUE);
+            break;
+        default:
+            for (UINTN i = 0; i < Width; i++) {
+                Pixel = Fb->RedLut[Row[i].Red] | Fb->GreenLut[Row[i].Green] | Fb->BlueLut[Row[i].Blue];
+                if (Fb->BytesPerPixel == 2) {
+                    ((UINT16 *)Dst)[i] = (UINT16)Pixel;
+                } else {
+                    ((UINT32 *)Dst)[i] = Pixel;
+                }
+            }
+            break;
+    }
+}
+
+
+//
+// Copy all of Src, which has the pixel format of Dst, to (X, Y) in Dst.
+// The caller clips to the screen.
+//
+VOID
+FrameBufferCopy( FRAME_BUFFER *Dst,
+                 UINTN X,
+                 UINTN Y,
+                 FRAME_BUFFER *Src)
+{
+    UINTN Bpp = Src->BytesPerPixel;
+
+    for (UINTN y = 0; y < Src->Height; y++) {
+        if (Bpp == 4) {
+            StreamRow( (UINT32 *)(Dst->Base + ((Y + y) * Dst->PixelsPerScanLine + X) * 4),
+                       (UINT32 *)(Src->Base + y * Src->PixelsPerScanLine * 4),
+                       Src->Width,
+                       FALSE);
+        } else {
+            CopyMem( Dst->Base + ((Y + y) * Dst->PixelsPerScanLine + X) * Bpp,
+                     Src->Base + y * Src->PixelsPerScanLine * Bpp,
+                     Src->Width * Bpp);
+        }
+    }
+}
+
+
+//
+// Make the non-temporal stores visible before anything else touches
+// the frame buffer
+//
+SIMD VOID
+FrameBufferFlush( FRAME_BUFFER *Fb)
+{
+    _mm_sfence();
+}
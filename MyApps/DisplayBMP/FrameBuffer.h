@@ -0,0 +1,63 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Direct writes to the GOP linear frame buffer
+//
+//  License: BSD License
+//
+
+#ifndef __FRAME_BUFFER_H__
+#define __FRAME_BUFFER_H__
+
+#include <Protocol/GraphicsOutput.h>
+
+typedef struct {
+    UINT8    *Base;              // Gop->Mode->FrameBufferBase, or off screen
+    UINTN     Size;
+    UINTN     PixelsPerScanLine;
+    UINTN     Width;             // visible resolution
+    UINTN     Height;
+    UINTN     BytesPerPixel;     // 4, or 2 for 16-bit PixelBitMask modes
+    EFI_GRAPHICS_PIXEL_FORMAT PixelFormat;
+    // PixelBitMask: each colour value already shifted into place
+    UINT32    RedLut[256];
+    UINT32    GreenLut[256];
+    UINT32    BlueLut[256];
+} FRAME_BUFFER;
+
+
+EFI_STATUS
+FrameBufferOpen( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+                 FRAME_BUFFER *Fb);
+
+EFI_STATUS
+FrameBufferAllocate( UINTN Width,
+                     UINTN Height,
+                     FRAME_BUFFER *Fb);
+
+EFI_STATUS
+FrameBufferAllocateLike( FRAME_BUFFER *Like,
+                         UINTN Width,
+                         UINTN Height,
+                         FRAME_BUFFER *Fb);
+
+VOID
+FrameBufferFree( FRAME_BUFFER *Fb);
+
+VOID
+FrameBufferWriteRow( FRAME_BUFFER *Fb,
+                     EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Row,
+                     UINTN X,
+                     UINTN Y,
+                     UINTN Width);
+
+VOID
+FrameBufferCopy( FRAME_BUFFER *Dst,
+                 UINTN X,
+                 UINTN Y,
+                 FRAME_BUFFER *Src);
+
+VOID
+FrameBufferFlush( FRAME_BUFFER *Fb);
+
+#endif
@@ -1 +0,0 @@
-/home/rcpao/Documents/job/enmotus.com/sf.net/syslibforuefi-code/Applications/Bounce/Image.h
\ No newline at end of file
@@ -0,0 +1,250 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Image scaling for DisplayBMP
+//
+//  Sample positions are computed once per axis in 16.16 fixed point,
+//  with pixel centres mapped onto pixel centres.  A row is scaled by
+//  gathering source pixels through the horizontal table; bilinear
+//  mixing of pixel pairs and of whole rows is done with SSE2 on four
+//  pixels at a time.  Alpha compositing uses the same mix, with the
+//  weight of each pixel taken from its own alpha.
+//
+//  License: BSD License
+//
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+#include <emmintrin.h>
+
+#include "Scale.h"
+
+
+#define SIMD __attribute__((target("sse2")))
+
+
+//
+// Fill in the sample positions of destination pixels First to
+// First + Count - 1 when SrcSize pixels are scaled to DstSize
+//
+EFI_STATUS
+ScaleAxisInit( SCALE_AXIS *Axis,
+               UINTN SrcSize,
+               UINTN DstSize,
+               UINTN First,
+               UINTN Count,
+               BOOLEAN Bilinear)
+{
+    UINT64 Step = DivU64x64Remainder(LShiftU64(SrcSize, 16), DstSize, NULL);
+    INT64  Position;
+    UINTN  Index;
+
+    Axis->Count = Count;
+    Axis->Index = AllocatePool(Count * sizeof(UINT32));
+    Axis->Weight = AllocateZeroPool(Count * sizeof(UINT16));
+    if (Axis->Index == NULL || Axis->Weight == NULL) {
+        ScaleAxisFree(Axis);
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    for (UINTN i = 0; i < Count; i++) {
+        // centre of destination pixel in source coordinates
+        Position = (INT64)((First + i) * Step + Step / 2);
+        if (Bilinear) {
+            Position -= 0x8000;
+            if (Position < 0) {
+                Position = 0;
+            }
+            Index = (UINTN)(Position >> 16);
+            if (Index >= SrcSize - 1) {
+                Index = SrcSize - 1;
+            } else {
+                Axis->Weight[i] = (UINT16)((Position & 0xFFFF) >> 8);
+            }
+        } else {
+            Index = MIN((UINTN)(Position >> 16), SrcSize - 1);
+        }
+        Axis->Index[i] = (UINT32)Index;
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+VOID
+ScaleAxisFree( SCALE_AXIS *Axis)
+{
+    if (Axis->Index != NULL) {
+        FreePool(Axis->Index);
+    }
+    if (Axis->Weight != NULL) {
+        FreePool(Axis->Weight);
+    }
+    ZeroMem(Axis, sizeof(SCALE_AXIS));
+}
+
+
+//
+// (A * (256 - W) + B * W) / 256 for each byte, on 16-bit lanes
+//
+static SIMD __m128i
+Mix( __m128i A,
+     __m128i B,
+     __m128i W)
+{
+    __m128i V = _mm_sub_epi16(_mm_set1_epi16(256), W);
+
+    return _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(A, V), _mm_mullo_epi16(B, W)), 8);
+}
+
+
+//
+// Scale one row through the horizontal table
+//
+SIMD VOID
+ScaleRow( SCALE_AXIS *Axis,
+          EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Src,
+          EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Dst)
+{
+    UINT32 *In = (UINT32 *)Src;
+    UINT32 *Out = (UINT32 *)Dst;
+    UINT32 *Index = Axis->Index;
+    UINT16 *Weight = Axis->Weight;
+    UINT32  Left[4];
+    UINT32  Right[4];
+    __m128i Zero = _mm_setzero_si128();
+    __m128i L;
+    __m128i R;
+    __m128i W;
+    UINTN   i = 0;
+
+    for (; i + 4 <= Axis->Count; i += 4) {
+        if ((Weight[i] | Weight[i + 1] | Weight[i + 2] | Weight[i + 3]) == 0) {
+            Out[i]     = In[Index[i]];
+            Out[i + 1] = In[Index[i + 1]];
+            Out[i + 2] = In[Index[i + 2]];
+            Out[i + 3] = In[Index[i + 3]];
+            continue;
+        }
+        // a zero weight never reads past the last source pixel
+        for (UINTN j = 0; j < 4; j++) {
+            Left[j] = In[Index[i + j]];
+            Right[j] = In[Index[i + j] + (Weight[i + j] != 0)];
+        }
+        L = _mm_loadu_si128((__m128i *)Left);
+        R = _mm_loadu_si128((__m128i *)Right);
+        W = _mm_set_epi16(Weight[i + 1], Weight[i + 1], Weight[i + 1], Weight[i + 1],
+                          Weight[i], Weight[i], Weight[i], Weight[i]);
+        L = _mm_packus_epi16(Mix(_mm_unpacklo_epi8(L, Zero), _mm_unpacklo_epi8(R, Zero), W),
+                             Mix(_mm_unpackhi_epi8(L, Zero), _mm_unpackhi_epi8(R, Zero),
+                                 _mm_set_epi16(Weight[i + 3], Weight[i + 3], Weight[i + 3], Weight[i + 3],
+                                               Weight[i + 2], Weight[i + 2], Weight[i + 2], Weight[i + 2])));
+        _mm_storeu_si128((__m128i *)(Out + i), L);
+    }
+
+    for (; i < Axis->Count; i++) {
+        if (Weight[i] == 0) {
+            Out[i] = In[Index[i]];
+        } else {
+            BlendRows(Src + Index[i], Src + Index[i] + 1, Weight[i], 1, Dst + i);
+        }
+    }
+}
+
+
+//
+// Mix two rows, Weight/256 of B into A
+//
+SIMD VOID
+BlendRows( EFI_GRAPHICS_OUTPUT_BLT_PIXEL *A,
+           EFI_GRAPHICS_OUTPUT_BLT_PIXEL *B,
+           UINT16 Weight,
+           UINTN Count,
+           EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Dst)
+{
+    __m128i Zero = _mm_setzero_si128();
+    __m128i W = _mm_set1_epi16(Weight);
+    __m128i PixelA;
+    __m128i PixelB;
+    UINT32  Last[2];
+    UINTN   i = 0;
+
+    for (; i + 4 <= Count; i += 4) {
+        PixelA = _mm_loadu_si128((__m128i *)(A + i));
+        PixelB = _mm_loadu_si128((__m128i *)(B + i));
+        _mm_storeu_si128((__m128i *)(Dst + i),
+            _mm_packus_epi16(Mix(_mm_unpacklo_epi8(PixelA, Zero), _mm_unpacklo_epi8(PixelB, Zero), W),
+                             Mix(_mm_unpackhi_epi8(PixelA, Zero), _mm_unpackhi_epi8(PixelB, Zero), W)));
+    }
+
+    for (; i < Count; i++) {
+        PixelA = _mm_unpacklo_epi8(_mm_cvtsi32_si128(*(UINT32 *)(A + i)), Zero);
+        PixelB = _mm_unpacklo_epi8(_mm_cvtsi32_si128(*(UINT32 *)(B + i)), Zero);
+        _mm_storel_epi64((__m128i *)Last, _mm_packus_epi16(Mix(PixelA, PixelB, W), Zero));
+        *(UINT32 *)(Dst + i) = Last[0];
+    }
+}
+
+
+//
+// Mix weights for two unpacked pixels from their alpha, with 0 to 255
+// mapped onto 0 to 256 so that opaque pixels come out exact
+//
+static SIMD __m128i
+AlphaWeight( __m128i Pixels)
+{
+    __m128i A = _mm_shufflehi_epi16(_mm_shufflelo_epi16(Pixels, _MM_SHUFFLE(3, 3, 3, 3)),
+                                    _MM_SHUFFLE(3, 3, 3, 3));
+
+    return _mm_add_epi16(A, _mm_srli_epi16(A, 7));
+}
+
+
+//
+// Composite Src over Dst, with the alpha of each Src pixel in its
+// Reserved byte.  Runs of four fully transparent or fully opaque
+// pixels are skipped or copied.
+//
+SIMD VOID
+AlphaBlendRow( EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Src,
+               EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Dst,
+               UINTN Count)
+{
+    __m128i Zero = _mm_setzero_si128();
+    __m128i AlphaMask = _mm_set1_epi32((int)0xFF000000);
+    __m128i Alpha;
+    __m128i PixelS;
+    __m128i PixelD;
+    __m128i Low;
+    __m128i High;
+    UINT32  Last[2];
+    UINTN   i = 0;
+
+    for (; i + 4 <= Count; i += 4) {
+        PixelS = _mm_loadu_si128((__m128i *)(Src + i));
+        Alpha = _mm_and_si128(PixelS, AlphaMask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(Alpha, Zero)) == 0xFFFF) {
+            continue;
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(Alpha, AlphaMask)) == 0xFFFF) {
+            _mm_storeu_si128((__m128i *)(Dst + i), PixelS);
+            continue;
+        }
+        PixelD = _mm_loadu_si128((__m128i *)(Dst + i));
+        Low = _mm_unpacklo_epi8(PixelS, Zero);
+        High = _mm_unpackhi_epi8(PixelS, Zero);
+        _mm_storeu_si128((__m128i *)(Dst + i),
+            _mm_packus_epi16(Mix(_mm_unpacklo_epi8(PixelD, Zero), Low, AlphaWeight(Low)),
+                             Mix(_mm_unpackhi_epi8(PixelD, Zero), High, AlphaWeight(High))));
+    }
+
+    for (; i < Count; i++) {
+        PixelS = _mm_unpacklo_epi8(_mm_cvtsi32_si128(*(UINT32 *)(Src + i)), Zero);
+        PixelD = _mm_unpacklo_epi8(_mm_cvtsi32_si128(*(UINT32 *)(Dst + i)), Zero);
+        _mm_storel_epi64((__m128i *)Last, _mm_packus_epi16(Mix(PixelD, PixelS, AlphaWeight(PixelS)), Zero));
+        *(UINT32 *)(Dst + i) = Last[0];
+    }
+}
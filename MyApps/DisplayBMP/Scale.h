@@ -0,0 +1,59 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Image scaling for DisplayBMP
+//
+//  License: BSD License
+//
+
+#ifndef __SCALE_H__
+#define __SCALE_H__
+
+#include <Protocol/GraphicsOutput.h>
+
+#define SCALE_NONE       0           // native size, clipped to the screen
+#define SCALE_FIT        1           // largest size that shows the whole image
+#define SCALE_FILL       2           // smallest size that covers the screen
+#define SCALE_STRETCH    3           // exactly the screen size
+
+//
+// Sampling positions along one axis for a run of destination pixels.
+// Index is the source pixel at or before the sample point and Weight
+// (0 to 255) is how much of the following source pixel is mixed in.
+//
+typedef struct {
+    UINTN     Count;
+    UINT32   *Index;
+    UINT16   *Weight;
+} SCALE_AXIS;
+
+
+EFI_STATUS
+ScaleAxisInit( SCALE_AXIS *Axis,
+               UINTN SrcSize,
+               UINTN DstSize,
+               UINTN First,
+               UINTN Count,
+               BOOLEAN Bilinear);
+
+VOID
+ScaleAxisFree( SCALE_AXIS *Axis);
+
+VOID
+ScaleRow( SCALE_AXIS *Axis,
+          EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Src,
+          EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Dst);
+
+VOID
+BlendRows( EFI_GRAPHICS_OUTPUT_BLT_PIXEL *A,
+           EFI_GRAPHICS_OUTPUT_BLT_PIXEL *B,
+           UINT16 Weight,
+           UINTN Count,
+           EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Dst);
+
+VOID
+AlphaBlendRow( EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Src,
+               EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Dst,
+               UINTN Count);
+
+#endif
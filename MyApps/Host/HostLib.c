@@ -0,0 +1,825 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Host implementations of the UEFI library functions that BmpLib,
+//  PngLib and DisplayBMP call
+//
+//  Files are read into memory when they are opened and written back
+//  when they are closed, so ShellReadFile costs a copy and nothing
+//  else, and benchmarks measure the decoders rather than the disk.
+//  Print understands the UEFI format specifiers the sources use.
+//  Boot services that only the interactive paths need fail with
+//  EFI_UNSUPPORTED.
+//
+//  License: BSD License
+//
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <cpuid.h>
+
+#include <Uefi.h>
+#include <Library/GopModeLib.h>
+
+#include "HostLib.h"
+
+
+EFI_GUID gEfiGraphicsOutputProtocolGuid =
+    { 0x9042a9de, 0x23dc, 0x4a38, { 0x96, 0xfb, 0x7a, 0xde, 0xd0, 0x80, 0x51, 0x6a } };
+
+EFI_HANDLE gImageHandle = NULL;
+
+
+//
+// Boot services and console input
+//
+static EFI_STATUS EFIAPI
+HostCreateEvent( UINT32 Type, EFI_TPL NotifyTpl, EFI_EVENT_NOTIFY NotifyFunction,
+                 VOID *NotifyContext, EFI_EVENT *Event)
+{
+    return EFI_UNSUPPORTED;
+}
+
+static EFI_STATUS EFIAPI
+HostSetTimer( EFI_EVENT Event, EFI_TIMER_DELAY Type, UINT64 TriggerTime)
+{
+    return EFI_UNSUPPORTED;
+}
+
+static EFI_STATUS EFIAPI
+HostWaitForEvent( UINTN NumberOfEvents, EFI_EVENT *Event, UINTN *Index)
+{
+    return EFI_UNSUPPORTED;
+}
+
+static EFI_STATUS EFIAPI
+HostCloseEvent( EFI_EVENT Event)
+{
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI
+HostCheckEvent( EFI_EVENT Event)
+{
+    return EFI_NOT_READY;
+}
+
+static EFI_STATUS EFIAPI
+HostHandleProtocol( EFI_HANDLE Handle, EFI_GUID *Protocol, VOID **Interface)
+{
+    return EFI_UNSUPPORTED;
+}
+
+static EFI_STATUS EFIAPI
+HostOpenProtocol( EFI_HANDLE Handle, EFI_GUID *Protocol, VOID **Interface,
+                  EFI_HANDLE AgentHandle, EFI_HANDLE ControllerHandle, UINT32 Attributes)
+{
+    return EFI_UNSUPPORTED;
+}
+
+static EFI_STATUS EFIAPI
+HostLocateHandleBuffer( EFI_LOCATE_SEARCH_TYPE SearchType, EFI_GUID *Protocol,
+                        VOID *SearchKey, UINTN *NoHandles, EFI_HANDLE **Buffer)
+{
+    return EFI_NOT_FOUND;
+}
+
+static EFI_STATUS EFIAPI
+HostReadKeyStroke( EFI_SIMPLE_TEXT_INPUT_PROTOCOL *This, EFI_INPUT_KEY *Key)
+{
+    return EFI_NOT_READY;
+}
+
+static EFI_BOOT_SERVICES mBootServices = {
+    HostCreateEvent,
+    HostSetTimer,
+    HostWaitForEvent,
+    HostCloseEvent,
+    HostCheckEvent,
+    HostHandleProtocol,
+    HostOpenProtocol,
+    HostLocateHandleBuffer
+};
+
+static EFI_SIMPLE_TEXT_INPUT_PROTOCOL mConIn = {
+    NULL,
+    HostReadKeyStroke,
+    NULL
+};
+
+static EFI_SYSTEM_TABLE mSystemTable = {
+    NULL,
+    &mConIn,
+    NULL
+};
+
+EFI_BOOT_SERVICES *gBS = &mBootServices;
+EFI_SYSTEM_TABLE  *gST = &mSystemTable;
+
+
+//
+// BaseLib
+//
+UINTN EFIAPI
+StrLen( CONST CHAR16 *String)
+{
+    UINTN Length = 0;
+
+    while (String[Length] != 0) {
+        Length++;
+    }
+    return Length;
+}
+
+UINTN EFIAPI
+StrSize( CONST CHAR16 *String)
+{
+    return (StrLen(String) + 1) * sizeof(CHAR16);
+}
+
+INTN EFIAPI
+StrCmp( CONST CHAR16 *FirstString,
+        CONST CHAR16 *SecondString)
+{
+    while (*FirstString != 0 && *FirstString == *SecondString) {
+        FirstString++;
+        SecondString++;
+    }
+    return (INTN)*FirstString - (INTN)*SecondString;
+}
+
+EFI_STATUS EFIAPI
+StrCpyS( CHAR16 *Destination,
+         UINTN DestMax,
+         CONST CHAR16 *Source)
+{
+    if (StrLen(Source) >= DestMax) {
+        return EFI_BUFFER_TOO_SMALL;
+    }
+    CopyMem(Destination, Source, StrSize(Source));
+    return EFI_SUCCESS;
+}
+
+EFI_STATUS EFIAPI
+StrCatS( CHAR16 *Destination,
+         UINTN DestMax,
+         CONST CHAR16 *Source)
+{
+    UINTN Length = StrLen(Destination);
+
+    if (Length >= DestMax) {
+        return EFI_INVALID_PARAMETER;
+    }
+    return StrCpyS(Destination + Length, DestMax - Length, Source);
+}
+
+UINTN EFIAPI
+StrDecimalToUintn( CONST CHAR16 *String)
+{
+    UINTN Value = 0;
+
+    while (*String == L' ') {
+        String++;
+    }
+    while (*String >= L'0' && *String <= L'9') {
+        Value = Value * 10 + (*String++ - L'0');
+    }
+    return Value;
+}
+
+UINT64 EFIAPI
+LShiftU64( UINT64 Operand,
+           UINTN Count)
+{
+    return Operand << Count;
+}
+
+UINT64 EFIAPI
+MultU64x32( UINT64 Multiplicand,
+            UINT32 Multiplier)
+{
+    return Multiplicand * Multiplier;
+}
+
+UINT64 EFIAPI
+DivU64x64Remainder( UINT64 Dividend,
+                    UINT64 Divisor,
+                    UINT64 *Remainder)
+{
+    if (Remainder != NULL) {
+        *Remainder = Dividend % Divisor;
+    }
+    return Dividend / Divisor;
+}
+
+UINT32 EFIAPI
+SwapBytes32( UINT32 Value)
+{
+    return __builtin_bswap32(Value);
+}
+
+UINT16 EFIAPI
+ReadUnaligned16( CONST UINT16 *Buffer)
+{
+    UINT16 Value;
+
+    memcpy(&Value, Buffer, sizeof(Value));
+    return Value;
+}
+
+UINT32 EFIAPI
+ReadUnaligned32( CONST UINT32 *Buffer)
+{
+    UINT32 Value;
+
+    memcpy(&Value, Buffer, sizeof(Value));
+    return Value;
+}
+
+UINT16 EFIAPI
+WriteUnaligned16( UINT16 *Buffer,
+                  UINT16 Value)
+{
+    memcpy(Buffer, &Value, sizeof(Value));
+    return Value;
+}
+
+UINT32 EFIAPI
+WriteUnaligned32( UINT32 *Buffer,
+                  UINT32 Value)
+{
+    memcpy(Buffer, &Value, sizeof(Value));
+    return Value;
+}
+
+UINT32 EFIAPI
+AsmCpuidEx( UINT32 Index,
+            UINT32 SubIndex,
+            UINT32 *Eax,
+            UINT32 *Ebx,
+            UINT32 *Ecx,
+            UINT32 *Edx)
+{
+    UINT32 A, B, C, D;
+
+    __cpuid_count(Index, SubIndex, A, B, C, D);
+    if (Eax != NULL) *Eax = A;
+    if (Ebx != NULL) *Ebx = B;
+    if (Ecx != NULL) *Ecx = C;
+    if (Edx != NULL) *Edx = D;
+    return Index;
+}
+
+UINT32 EFIAPI
+AsmCpuid( UINT32 Index,
+          UINT32 *Eax,
+          UINT32 *Ebx,
+          UINT32 *Ecx,
+          UINT32 *Edx)
+{
+    return AsmCpuidEx(Index, 0, Eax, Ebx, Ecx, Edx);
+}
+
+
+//
+// BaseMemoryLib and MemoryAllocationLib
+//
+VOID * EFIAPI
+CopyMem( VOID *Destination,
+         CONST VOID *Source,
+         UINTN Length)
+{
+    return memmove(Destination, Source, Length);
+}
+
+VOID * EFIAPI
+SetMem( VOID *Buffer,
+        UINTN Length,
+        UINT8 Value)
+{
+    return memset(Buffer, Value, Length);
+}
+
+VOID * EFIAPI
+ZeroMem( VOID *Buffer,
+         UINTN Length)
+{
+    return memset(Buffer, 0, Length);
+}
+
+INTN EFIAPI
+CompareMem( CONST VOID *DestinationBuffer,
+            CONST VOID *SourceBuffer,
+            UINTN Length)
+{
+    return memcmp(DestinationBuffer, SourceBuffer, Length);
+}
+
+VOID * EFIAPI
+AllocatePool( UINTN AllocationSize)
+{
+    return malloc(AllocationSize);
+}
+
+VOID * EFIAPI
+AllocateZeroPool( UINTN AllocationSize)
+{
+    return calloc(1, AllocationSize);
+}
+
+VOID * EFIAPI
+ReallocatePool( UINTN OldSize,
+                UINTN NewSize,
+                VOID *OldBuffer)
+{
+    return realloc(OldBuffer, NewSize);
+}
+
+VOID EFIAPI
+FreePool( VOID *Buffer)
+{
+    free(Buffer);
+}
+
+
+//
+// Print, with the UEFI meaning of the format specifiers: %s is a
+// CHAR16 string, %a a CHAR8 one, %c a CHAR16, %r an EFI_STATUS, and
+// numbers are int sized unless 'l' is given
+//
+static CONST CHAR8 *
+StatusName( EFI_STATUS Status)
+{
+    switch (Status) {
+        case EFI_SUCCESS:             return "Success";
+        case EFI_LOAD_ERROR:          return "Load Error";
+        case EFI_INVALID_PARAMETER:   return "Invalid Parameter";
+        case EFI_UNSUPPORTED:         return "Unsupported";
+        case EFI_BAD_BUFFER_SIZE:     return "Bad Buffer Size";
+        case EFI_BUFFER_TOO_SMALL:    return "Buffer Too Small";
+        case EFI_NOT_READY:           return "Not Ready";
+        case EFI_DEVICE_ERROR:        return "Device Error";
+        case EFI_WRITE_PROTECTED:     return "Write Protected";
+        case EFI_OUT_OF_RESOURCES:    return "Out of Resources";
+        case EFI_VOLUME_CORRUPTED:    return "Volume Corrupt";
+        case EFI_NOT_FOUND:           return "Not Found";
+        case EFI_ACCESS_DENIED:       return "Access Denied";
+        case EFI_END_OF_FILE:         return "End of File";
+        default:                      return "Unknown";
+    }
+}
+
+UINTN EFIAPI
+Print( CONST CHAR16 *Format,
+       ...)
+{
+    va_list Marker;
+    CHAR8  Spec[32];
+    CHAR8  Text[64];
+    UINTN  Count = 0;
+    UINTN  SpecLength;
+    BOOLEAN Long;
+    CONST CHAR16 *String16;
+    CONST CHAR8 *String8;
+
+    va_start(Marker, Format);
+
+    for (; *Format != 0; Format++) {
+        if (*Format != L'%') {
+            putchar(*Format < 0x80 ? (int)*Format : '?');
+            Count++;
+            continue;
+        }
+
+        // flags, width and precision carry over to the host printf
+        Spec[0] = '%';
+        SpecLength = 1;
+        Format++;
+        while (*Format != 0 && SpecLength < sizeof(Spec) - 4 &&
+               (*Format == L'-' || *Format == L'0' || *Format == L' ' || *Format == L'+' ||
+                *Format == L'.' || (*Format >= L'1' && *Format <= L'9'))) {
+            Spec[SpecLength++] = (CHAR8)*Format++;
+        }
+        if (*Format == L',') {
+            Format++;
+        }
+        Long = FALSE;
+        if (*Format == L'l' || *Format == L'L') {
+            Long = TRUE;
+            Format++;
+        }
+
+        switch (*Format) {
+            case L'd':
+            case L'i':
+                Spec[SpecLength++] = 'l';
+                Spec[SpecLength++] = 'l';
+                Spec[SpecLength++] = 'd';
+                Spec[SpecLength] = 0;
+                Count += printf(Spec, Long ? (long long)va_arg(Marker, INT64)
+                                           : (long long)va_arg(Marker, int));
+                break;
+            case L'u':
+            case L'x':
+            case L'X':
+                Spec[SpecLength++] = 'l';
+                Spec[SpecLength++] = 'l';
+                Spec[SpecLength++] = (*Format == L'u') ? 'u' : (*Format == L'x') ? 'x' : 'X';
+                Spec[SpecLength] = 0;
+                Count += printf(Spec, Long ? (unsigned long long)va_arg(Marker, UINT64)
+                                           : (unsigned long long)va_arg(Marker, unsigned int));
+                break;
+            case L'p':
+                Count += printf("%p", va_arg(Marker, VOID *));
+                break;
+            case L'c':
+                Text[0] = (CHAR8)va_arg(Marker, int);
+                Text[1] = 0;
+                Spec[SpecLength++] = 's';
+                Spec[SpecLength] = 0;
+                Count += printf(Spec, Text);
+                break;
+            case L's':
+            case L'S':
+                String16 = va_arg(Marker, CHAR16 *);
+                if (String16 == NULL) {
+                    String16 = L"<null string>";
+                }
+                for (; *String16 != 0; String16++) {
+                    putchar(*String16 < 0x80 ? (int)*String16 : '?');
+                    Count++;
+                }
+                break;
+            case L'a':
+                String8 = va_arg(Marker, CHAR8 *);
+                Spec[SpecLength++] = 's';
+                Spec[SpecLength] = 0;
+                Count += printf(Spec, String8 != NULL ? String8 : "<null string>");
+                break;
+            case L'r':
+                Spec[SpecLength++] = 's';
+                Spec[SpecLength] = 0;
+                Count += printf(Spec, StatusName(va_arg(Marker, EFI_STATUS)));
+                break;
+            case L'%':
+                putchar('%');
+                Count++;
+                break;
+            case 0:
+                Format--;
+                break;
+            default:
+                putchar('?');
+                Count++;
+                break;
+        }
+    }
+
+    va_end(Marker);
+
+    return Count;
+}
+
+
+//
+// TimerLib, counting in nanoseconds
+//
+UINT64 EFIAPI
+GetPerformanceCounter( VOID)
+{
+    struct timespec Now;
+
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (UINT64)Now.tv_sec * 1000000000ULL + (UINT64)Now.tv_nsec;
+}
+
+UINT64 EFIAPI
+GetTimeInNanoSecond( UINT64 Ticks)
+{
+    return Ticks;
+}
+
+
+//
+// ShellLib, on files held in memory while they are open
+//
+typedef struct {
+    CHAR8    *Path;              // NULL for HostOpenMemoryFile
+    UINT8    *Data;
+    UINT64    Size;
+    UINT64    Allocated;
+    UINT64    Position;
+    BOOLEAN   Dirty;             // to be written back on close
+} HOST_FILE;
+
+
+UINTN
+HostAsciiName( CONST CHAR16 *Name,
+               CHAR8 *Buffer,
+               UINTN BufferSize)
+{
+    UINTN i;
+
+    for (i = 0; Name[i] != 0 && i + 1 < BufferSize; i++) {
+        Buffer[i] = (Name[i] == L'\\') ? '/' : (CHAR8)Name[i];
+    }
+    Buffer[i] = 0;
+
+    return i;
+}
+
+
+static EFI_STATUS
+ReserveFile( HOST_FILE *File,
+             UINT64 Size)
+{
+    UINT8 *Data;
+    UINT64 Allocated;
+
+    if (Size <= File->Allocated) {
+        return EFI_SUCCESS;
+    }
+    Allocated = MAX(Size, File->Allocated * 2);
+    Data = realloc(File->Data, Allocated);
+    if (Data == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    File->Data = Data;
+    File->Allocated = Allocated;
+
+    return EFI_SUCCESS;
+}
+
+
+EFI_STATUS
+HostOpenMemoryFile( UINT8 *Data,
+                    UINTN Size,
+                    SHELL_FILE_HANDLE *FileHandle)
+{
+    HOST_FILE *File;
+
+    File = calloc(1, sizeof(HOST_FILE));
+    if (File == NULL || ReserveFile(File, MAX(Size, 1)) != EFI_SUCCESS) {
+        free(File);
+        return EFI_OUT_OF_RESOURCES;
+    }
+    memcpy(File->Data, Data, Size);
+    File->Size = Size;
+
+    *FileHandle = File;
+    return EFI_SUCCESS;
+}
+
+
+EFI_STATUS EFIAPI
+ShellOpenFileByName( CONST CHAR16 *FileName,
+                     SHELL_FILE_HANDLE *FileHandle,
+                     UINT64 OpenMode,
+                     UINT64 Attributes)
+{
+    CHAR8 Path[1024];
+    HOST_FILE *File;
+    FILE *Stream;
+    long Size;
+
+    HostAsciiName(FileName, Path, sizeof(Path));
+
+    Stream = fopen(Path, "rb");
+    if (Stream == NULL && !(OpenMode & EFI_FILE_MODE_CREATE)) {
+        return EFI_NOT_FOUND;
+    }
+
+    File = calloc(1, sizeof(HOST_FILE));
+    if (File == NULL || (File->Path = strdup(Path)) == NULL) {
+        free(File);
+        if (Stream != NULL) {
+            fclose(Stream);
+        }
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    if (Stream == NULL) {
+        File->Dirty = TRUE;
+    } else {
+        fseek(Stream, 0, SEEK_END);
+        Size = ftell(Stream);
+        fseek(Stream, 0, SEEK_SET);
+        if (Size < 0 || ReserveFile(File, MAX(Size, 1)) != EFI_SUCCESS ||
+            fread(File->Data, 1, Size, Stream) != (size_t)Size) {
+            fclose(Stream);
+            free(File->Data);
+            free(File->Path);
+            free(File);
+            return EFI_DEVICE_ERROR;
+        }
+        fclose(Stream);
+        File->Size = Size;
+    }
+
+    *FileHandle = File;
+    return EFI_SUCCESS;
+}
+
+
+EFI_STATUS EFIAPI
+ShellCloseFile( SHELL_FILE_HANDLE *FileHandle)
+{
+    HOST_FILE *File = *FileHandle;
+    EFI_STATUS Status = EFI_SUCCESS;
+    FILE *Stream;
+
+    if (File->Dirty && File->Path != NULL) {
+        Stream = fopen(File->Path, "wb");
+        if (Stream == NULL || fwrite(File->Data, 1, File->Size, Stream) != File->Size) {
+            Status = EFI_DEVICE_ERROR;
+        }
+        if (Stream != NULL && fclose(Stream) != 0) {
+            Status = EFI_DEVICE_ERROR;
+        }
+    }
+
+    free(File->Data);
+    free(File->Path);
+    free(File);
+    *FileHandle = NULL;
+
+    return Status;
+}
+
+
+EFI_STATUS EFIAPI
+ShellDeleteFile( SHELL_FILE_HANDLE *FileHandle)
+{
+    HOST_FILE *File = *FileHandle;
+
+    if (File->Path != NULL) {
+        unlink(File->Path);
+    }
+    File->Dirty = FALSE;
+
+    return ShellCloseFile(FileHandle);
+}
+
+
+EFI_STATUS EFIAPI
+ShellReadFile( SHELL_FILE_HANDLE FileHandle,
+               UINTN *ReadSize,
+               VOID *Buffer)
+{
+    HOST_FILE *File = FileHandle;
+
+    if (File->Position >= File->Size) {
+        *ReadSize = 0;
+        return EFI_SUCCESS;
+    }
+    *ReadSize = (UINTN)MIN(*ReadSize, File->Size - File->Position);
+    memcpy(Buffer, File->Data + File->Position, *ReadSize);
+    File->Position += *ReadSize;
+
+    return EFI_SUCCESS;
+}
+
+
+EFI_STATUS EFIAPI
+ShellWriteFile( SHELL_FILE_HANDLE FileHandle,
+                UINTN *BufferSize,
+                VOID *Buffer)
+{
+    HOST_FILE *File = FileHandle;
+    EFI_STATUS Status;
+
+    Status = ReserveFile(File, File->Position + *BufferSize);
+    if (EFI_ERROR(Status)) {
+        *BufferSize = 0;
+        return Status;
+    }
+    if (File->Position > File->Size) {
+        memset(File->Data + File->Size, 0, File->Position - File->Size);
+    }
+    memcpy(File->Data + File->Position, Buffer, *BufferSize);
+    File->Position += *BufferSize;
+    File->Size = MAX(File->Size, File->Position);
+    File->Dirty = TRUE;
+
+    return EFI_SUCCESS;
+}
+
+
+EFI_STATUS EFIAPI
+ShellSetFilePosition( SHELL_FILE_HANDLE FileHandle,
+                      UINT64 Position)
+{
+    ((HOST_FILE *)FileHandle)->Position = Position;
+    return EFI_SUCCESS;
+}
+
+
+EFI_STATUS EFIAPI
+ShellGetFileSize( SHELL_FILE_HANDLE FileHandle,
+                  UINT64 *Size)
+{
+    *Size = ((HOST_FILE *)FileHandle)->Size;
+    return EFI_SUCCESS;
+}
+
+
+EFI_FILE_INFO * EFIAPI
+ShellGetFileInfo( SHELL_FILE_HANDLE FileHandle)
+{
+    HOST_FILE *File = FileHandle;
+    EFI_FILE_INFO *FileInfo;
+
+    FileInfo = calloc(1, sizeof(EFI_FILE_INFO));
+    if (FileInfo != NULL) {
+        FileInfo->Size = sizeof(EFI_FILE_INFO);
+        FileInfo->FileSize = File->Size;
+        FileInfo->PhysicalSize = File->Size;
+    }
+
+    return FileInfo;
+}
+
+
+//
+// Only truncation, which is all the save paths ask for
+//
+EFI_STATUS EFIAPI
+ShellSetFileInfo( SHELL_FILE_HANDLE FileHandle,
+                  EFI_FILE_INFO *FileInfo)
+{
+    HOST_FILE *File = FileHandle;
+
+    if (FileInfo->FileSize > File->Size) {
+        return EFI_UNSUPPORTED;
+    }
+    if (FileInfo->FileSize != File->Size) {
+        File->Size = FileInfo->FileSize;
+        File->Dirty = TRUE;
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+EFI_STATUS EFIAPI
+ShellIsDirectory( CONST CHAR16 *DirName)
+{
+    return EFI_NOT_FOUND;
+}
+
+
+EFI_STATUS EFIAPI
+ShellFindFirstFile( SHELL_FILE_HANDLE DirHandle,
+                    EFI_FILE_INFO **Buffer)
+{
+    return EFI_UNSUPPORTED;
+}
+
+
+EFI_STATUS EFIAPI
+ShellFindNextFile( SHELL_FILE_HANDLE DirHandle,
+                   EFI_FILE_INFO *Buffer,
+                   BOOLEAN *NoFile)
+{
+    *NoFile = TRUE;
+    return EFI_UNSUPPORTED;
+}
+
+
+//
+// GopModeLib keeps its table in a UEFI variable; mode selection is
+// outside what the harness exercises
+//
+EFI_STATUS EFIAPI
+GopModeGetTable( EFI_HANDLE GopHandle,
+                 EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+                 BOOLEAN Refresh,
+                 GOP_MODE_TABLE **Table,
+                 BOOLEAN *Cached)
+{
+    return EFI_UNSUPPORTED;
+}
+
+VOID EFIAPI
+GopModeFreeTable( GOP_MODE_TABLE *Table)
+{
+}
+
+VOID EFIAPI
+GopModeRank( GOP_MODE_TABLE *Table,
+             UINT32 ImageWidth,
+             UINT32 ImageHeight)
+{
+}
+
+EFI_STATUS EFIAPI
+GopModeSet( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+            UINT32 Mode,
+            UINT64 *Nanoseconds)
+{
+    return Gop->SetMode(Gop, Mode);
+}
@@ -0,0 +1,24 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Host side library support for the image pipeline harness
+//
+//  License: BSD License
+//
+
+#ifndef __HOST_LIB_H__
+#define __HOST_LIB_H__
+
+#include <Uefi.h>
+
+EFI_STATUS
+HostOpenMemoryFile( UINT8 *Data,
+                    UINTN Size,
+                    SHELL_FILE_HANDLE *FileHandle);
+
+UINTN
+HostAsciiName( CONST CHAR16 *Name,
+               CHAR8 *Buffer,
+               UINTN BufferSize);
+
+#endif
@@ -0,0 +1,584 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Host harness for the DisplayBMP image pipeline.  Every test image
+//  is decoded, scaled and presented by the real DisplayImage onto a
+//  mock GOP, through Blt and through the frame buffer in BGR and RGB
+//  modes, and the screen is compared with a golden PPM image.  With
+//  -b it times each decoder on 1024x768 images instead.
+//
+//  License: BSD License
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/ShellLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/TimerLib.h>
+#include <Protocol/GraphicsOutput.h>
+
+#include <Library/BmpLib.h>
+
+#include "FrameBuffer.h"
+#include "Scale.h"
+#include "Cache.h"
+#include "HostLib.h"
+#include "MockGop.h"
+
+
+#define IMAGE_DIR            "Images/"
+#define GOLDEN_DIR           "Golden/"
+#define OUTPUT_DIR           "Output/"
+
+#define BENCH_WIDTH          1024
+#define BENCH_HEIGHT         768
+#define BENCH_RUNS           5
+
+
+EFI_STATUS
+DisplayImage( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+              FRAME_BUFFER *Fb,
+              IMAGE_CACHE *Cache,
+              SHELL_FILE_HANDLE FileHandle,
+              UINT64 FileSize,
+              UINTN Scaling,
+              BOOLEAN Bilinear,
+              BOOLEAN Blend);
+
+
+//
+// Each image of a case must put the same picture on the screen, the
+// one in Golden/<Name>.ppm
+//
+typedef struct {
+    CHAR8    *Name;
+    CHAR8    *Images[16];
+    UINT32    ScreenWidth;
+    UINT32    ScreenHeight;
+    UINTN     Scaling;
+    BOOLEAN   Bilinear;
+    BOOLEAN   Blend;
+} TEST_CASE;
+
+#define PIC16_IMAGES   { "pic16-4.bmp", "pic16-8.bmp", "pic16-rle4.bmp", "pic16-rle8.bmp", \
+                         "pic16-24.bmp", "pic16-24td.bmp", "pic16-32.bmp", \
+                         "pic16-pal4.png", "pic16-pal8.png", "pic16-rgb.png", \
+                         "pic16-rgb16.png", "pic16-rgba.png", NULL }
+#define ALPHA_IMAGES   { "alpha-rgb.bmp", "alpha-bf.bmp", "alpha-v5.bmp", NULL }
+
+static TEST_CASE TestCases[] = {
+    { "pic16-none",        PIC16_IMAGES,  64, 48, SCALE_NONE,    FALSE, FALSE },
+    { "pic16-crop",        PIC16_IMAGES,  32, 24, SCALE_NONE,    FALSE, FALSE },
+    { "pic16-fit",         PIC16_IMAGES, 100, 60, SCALE_FIT,     FALSE, FALSE },
+    { "pic16-fit-bilinear",PIC16_IMAGES, 100, 60, SCALE_FIT,     TRUE,  FALSE },
+    { "pic16-fill",        PIC16_IMAGES,  50, 50, SCALE_FILL,    FALSE, FALSE },
+    { "pic16-shrink",      PIC16_IMAGES,  20, 16, SCALE_STRETCH, TRUE,  FALSE },
+    { "mono-stretch",      { "mono.bmp", NULL }, 80, 40, SCALE_STRETCH, FALSE, FALSE },
+    { "alpha-none",        ALPHA_IMAGES,  48, 40, SCALE_NONE,    FALSE, FALSE },
+    { "alpha-blend",       ALPHA_IMAGES,  48, 40, SCALE_NONE,    FALSE, TRUE  },
+    { "alpha-blend-fit",   ALPHA_IMAGES,  96, 64, SCALE_FIT,     TRUE,  TRUE  },
+};
+
+//
+// The ways DisplayImage gets pixels onto the screen
+//
+typedef enum {
+    PresentBlt,                  // Blt, Fb is NULL
+    PresentBgr,                  // frame buffer in a BGR mode
+    PresentRgb,                  // frame buffer in an RGB mode
+    PresentCount
+} PRESENT_PATH;
+
+static CHAR8 *PresentNames[PresentCount] = { "blt", "bgr", "rgb" };
+
+
+//
+// A single mode GOP for the path, with padded scan lines so that rows
+// written past the visible width would show up on the screen
+//
+static EFI_GRAPHICS_OUTPUT_PROTOCOL *
+OpenScreen( UINT32 Width,
+            UINT32 Height,
+            PRESENT_PATH Path,
+            FRAME_BUFFER *Fb)
+{
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION Mode;
+    EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop;
+
+    ZeroMem(&Mode, sizeof(Mode));
+    Mode.HorizontalResolution = Width;
+    Mode.VerticalResolution = Height;
+    Mode.PixelsPerScanLine = (Width + 15) & ~15U;
+    Mode.PixelFormat = (Path == PresentRgb) ? PixelRedGreenBlueReserved8BitPerColor
+                                            : PixelBlueGreenRedReserved8BitPerColor;
+
+    Gop = MockGopCreate(&Mode, 1);
+    if (Gop == NULL) {
+        return NULL;
+    }
+    if (Path != PresentBlt && EFI_ERROR(FrameBufferOpen(Gop, Fb))) {
+        MockGopDestroy(Gop);
+        return NULL;
+    }
+
+    return Gop;
+}
+
+
+//
+// A checkerboard for blended images to be composited onto
+//
+static VOID
+DrawBackground( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop)
+{
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL Colour[2] = { { 0x40, 0x40, 0x40, 0 }, { 0xA0, 0xC0, 0xE0, 0 } };
+    UINT32 Width = Gop->Mode->Info->HorizontalResolution;
+    UINT32 Height = Gop->Mode->Info->VerticalResolution;
+
+    for (UINT32 y = 0; y < Height; y += 8) {
+        for (UINT32 x = 0; x < Width; x += 8) {
+            Gop->Blt( Gop, &Colour[((x ^ y) >> 3) & 1], EfiBltVideoFill, 0, 0,
+                      x, y, MIN(8, Width - x), MIN(8, Height - y), 0);
+        }
+    }
+}
+
+
+static UINT8 *
+ReadHostFile( CONST CHAR8 *Path,
+              UINTN *Size)
+{
+    FILE *Stream;
+    UINT8 *Data;
+    long Length;
+
+    Stream = fopen(Path, "rb");
+    if (Stream == NULL) {
+        return NULL;
+    }
+    fseek(Stream, 0, SEEK_END);
+    Length = ftell(Stream);
+    fseek(Stream, 0, SEEK_SET);
+    Data = (Length < 0) ? NULL : malloc(MAX(Length, 1));
+    if (Data != NULL && fread(Data, 1, Length, Stream) != (size_t)Length) {
+        free(Data);
+        Data = NULL;
+    }
+    fclose(Stream);
+
+    *Size = (UINTN)Length;
+    return Data;
+}
+
+
+static BOOLEAN
+WriteHostFile( CONST CHAR8 *Path,
+               UINT8 *Data,
+               UINTN Size)
+{
+    FILE *Stream;
+    BOOLEAN Written;
+
+    Stream = fopen(Path, "wb");
+    if (Stream == NULL) {
+        return FALSE;
+    }
+    Written = fwrite(Data, 1, Size, Stream) == Size;
+
+    return fclose(Stream) == 0 && Written;
+}
+
+
+//
+// Show one image file on Gop and return the screen as a PPM image
+//
+static EFI_STATUS
+RenderImage( TEST_CASE *Test,
+             CHAR8 *Image,
+             PRESENT_PATH Path,
+             UINT8 **Ppm,
+             UINTN *PpmSize)
+{
+    EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop;
+    SHELL_FILE_HANDLE FileHandle;
+    FRAME_BUFFER Fb;
+    EFI_STATUS Status;
+    CHAR16 Name[256];
+    CHAR8 Ascii[256];
+    UINT64 FileSize;
+    UINTN i;
+
+    snprintf(Ascii, sizeof(Ascii), IMAGE_DIR "%s", Image);
+    for (i = 0; Ascii[i] != 0; i++) {
+        Name[i] = Ascii[i];
+    }
+    Name[i] = 0;
+
+    Gop = OpenScreen(Test->ScreenWidth, Test->ScreenHeight, Path, &Fb);
+    if (Gop == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    DrawBackground(Gop);
+
+    Status = ShellOpenFileByName(Name, &FileHandle, EFI_FILE_MODE_READ, 0);
+    if (!EFI_ERROR(Status)) {
+        Status = ShellGetFileSize(FileHandle, &FileSize);
+        if (!EFI_ERROR(Status)) {
+            Status = DisplayImage( Gop, (Path == PresentBlt) ? NULL : &Fb, NULL, FileHandle,
+                                   FileSize, Test->Scaling, Test->Bilinear, Test->Blend);
+        }
+        ShellCloseFile(&FileHandle);
+    }
+    if (!EFI_ERROR(Status)) {
+        *Ppm = MockGopToPpm(Gop, PpmSize);
+        if (*Ppm == NULL) {
+            Status = EFI_OUT_OF_RESOURCES;
+        }
+    }
+
+    MockGopDestroy(Gop);
+    return Status;
+}
+
+
+//
+// Run every image of the case down every present path.  With Update
+// the first result becomes the golden image and the rest must match it.
+//
+static UINTN
+RunTestCase( TEST_CASE *Test,
+             BOOLEAN Update)
+{
+    EFI_STATUS Status;
+    CHAR8 Path[256];
+    CHAR8 Output[256];
+    UINT8 *Golden = NULL;
+    UINT8 *Ppm;
+    UINTN GoldenSize = 0;
+    UINTN PpmSize;
+    UINTN Failed = 0;
+
+    snprintf(Path, sizeof(Path), GOLDEN_DIR "%s.ppm", Test->Name);
+    if (!Update) {
+        Golden = ReadHostFile(Path, &GoldenSize);
+        if (Golden == NULL) {
+            printf("FAIL %s: no golden image %s, run with -u\n", Test->Name, Path);
+            return 1;
+        }
+    }
+
+    for (UINTN i = 0; Test->Images[i] != NULL; i++) {
+        for (PRESENT_PATH p = 0; p < PresentCount; p++) {
+            Status = RenderImage(Test, Test->Images[i], p, &Ppm, &PpmSize);
+            if (EFI_ERROR(Status)) {
+                printf("FAIL %s: %s via %s, DisplayImage returned %llx\n",
+                       Test->Name, Test->Images[i], PresentNames[p], (unsigned long long)Status);
+                Failed++;
+                continue;
+            }
+            if (Golden == NULL) {
+                if (!WriteHostFile(Path, Ppm, PpmSize)) {
+                    printf("FAIL %s: could not write %s\n", Test->Name, Path);
+                    free(Ppm);
+                    return Failed + 1;
+                }
+                Golden = Ppm;
+                GoldenSize = PpmSize;
+                continue;
+            }
+            if (PpmSize != GoldenSize || memcmp(Ppm, Golden, PpmSize) != 0) {
+                snprintf(Output, sizeof(Output), OUTPUT_DIR "%s-%s-%s.ppm",
+                         Test->Name, Test->Images[i], PresentNames[p]);
+                mkdir(OUTPUT_DIR, 0755);
+                WriteHostFile(Output, Ppm, PpmSize);
+                printf("FAIL %s: %s via %s differs from the golden image, see %s\n",
+                       Test->Name, Test->Images[i], PresentNames[p], Output);
+                Failed++;
+            }
+            free(Ppm);
+        }
+    }
+
+    if (Failed == 0) {
+        printf("ok   %s\n", Test->Name);
+    }
+    free(Golden);
+
+    return Failed;
+}
+
+
+//
+// Benchmark images.  The BMP ones are made here, in every layout the
+// BMP decoder has a path for; the PNG ones are checked in.
+//
+typedef struct {
+    CHAR8    *Name;
+    UINT16    BitPerPixel;
+    UINT32    Compression;
+    CHAR8    *File;              // PNG image in Images/, or NULL
+} BENCH_IMAGE;
+
+static BENCH_IMAGE BenchImages[] = {
+    { "bmp-1",      1,  BMP_RGB,  NULL },
+    { "bmp-4",      4,  BMP_RGB,  NULL },
+    { "bmp-8",      8,  BMP_RGB,  NULL },
+    { "bmp-rle4",   4,  BMP_RLE4, NULL },
+    { "bmp-rle8",   8,  BMP_RLE8, NULL },
+    { "bmp-24",     24, BMP_RGB,  NULL },
+    { "bmp-32",     32, BMP_RGB,  NULL },
+    { "png-pal8",   0,  0,        "bench-pal8.png" },
+    { "png-rgb",    0,  0,        "bench-rgb.png" },
+};
+
+
+static UINT8
+BenchIndex( UINTN x,
+            UINTN y)
+{
+    return (UINT8)(((x >> 3) ^ (y >> 4)) + (x * y >> 12));
+}
+
+
+//
+// Runs of one palette index, as RLE4 encoded pixel pairs
+//
+static UINTN
+Rle4EncodeRow( UINT8 *Src,
+               UINTN Width,
+               UINT8 *Dst)
+{
+    UINT8 *Out = Dst;
+    UINTN Count;
+
+    for (UINTN x = 0; x < Width; x += Count) {
+        for (Count = 1; x + Count < Width && Count < 255 && Src[x + Count] == Src[x]; Count++)
+            ;
+        *Out++ = (UINT8)Count;
+        *Out++ = (UINT8)(Src[x] << 4 | Src[x]);
+    }
+    *Out++ = 0;
+    *Out++ = 0;
+
+    return Out - Dst;
+}
+
+
+static UINT8 *
+MakeBenchBmp( BENCH_IMAGE *Bench,
+              UINTN *Size)
+{
+    UINTN Width = BENCH_WIDTH;
+    UINTN Height = BENCH_HEIGHT;
+    UINTN Colours = (Bench->BitPerPixel <= 8) ? (1U << Bench->BitPerPixel) : 0;
+    UINTN RowSize = BMP_ROW_SIZE(Width, Bench->BitPerPixel);
+    UINTN Offset = BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE + Colours * 4;
+    UINT8 *Indices;
+    UINT8 *Data;
+    UINT8 *Row;
+    UINT8 *Out;
+    UINT8 Index;
+
+    Data = calloc(1, Offset + MAX(RowSize, BMP_RLE8_ROW_MAX(Width)) * Height + 2);
+    Indices = malloc(Width);
+    if (Data == NULL || Indices == NULL) {
+        free(Data);
+        free(Indices);
+        return NULL;
+    }
+
+    for (UINTN i = 0; i < Colours; i++) {
+        Data[BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE + i * 4] = (UINT8)(i * 255 / (Colours - 1));
+        Data[BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE + i * 4 + 1] = (UINT8)(255 - i * 255 / (Colours - 1));
+        Data[BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE + i * 4 + 2] = (UINT8)(i * 97);
+    }
+
+    Out = Data + Offset;
+    for (UINTN y = Height; y-- > 0; ) {
+        for (UINTN x = 0; x < Width; x++) {
+            Indices[x] = BenchIndex(x, y) & (UINT8)(Colours - 1);
+        }
+        if (Bench->Compression == BMP_RLE8) {
+            Out += BmpRle8EncodeRow(Indices, Width, Out);
+            continue;
+        }
+        if (Bench->Compression == BMP_RLE4) {
+            Out += Rle4EncodeRow(Indices, Width, Out);
+            continue;
+        }
+        Row = Out;
+        for (UINTN x = 0; x < Width; x++) {
+            Index = BenchIndex(x, y);
+            switch (Bench->BitPerPixel) {
+                case 1:
+                    Row[x / 8] |= (Index & 1) << (7 - x % 8);
+                    break;
+                case 4:
+                    Row[x / 2] |= (Index & 15) << ((x & 1) ? 0 : 4);
+                    break;
+                case 8:
+                    Row[x] = Index;
+                    break;
+                default:
+                    Row[x * (Bench->BitPerPixel / 8)] = Index;
+                    Row[x * (Bench->BitPerPixel / 8) + 1] = (UINT8)(x >> 2);
+                    Row[x * (Bench->BitPerPixel / 8) + 2] = (UINT8)(y >> 2);
+                    break;
+            }
+        }
+        Out += RowSize;
+    }
+    if (Bench->Compression != BMP_RGB) {
+        *Out++ = 0;
+        *Out++ = 1;                     // end of bitmap
+    }
+    free(Indices);
+
+    *Size = Out - Data;
+    Data[0] = 'B';
+    Data[1] = 'M';
+    WriteUnaligned32((UINT32 *)(Data + 2), (UINT32)*Size);
+    WriteUnaligned32((UINT32 *)(Data + 10), (UINT32)Offset);
+    WriteUnaligned32((UINT32 *)(Data + 14), BMP_INFO_HEADER_SIZE);
+    WriteUnaligned32((UINT32 *)(Data + 18), (UINT32)Width);
+    WriteUnaligned32((UINT32 *)(Data + 22), (UINT32)Height);
+    WriteUnaligned16((UINT16 *)(Data + 26), 1);
+    WriteUnaligned16((UINT16 *)(Data + 28), Bench->BitPerPixel);
+    WriteUnaligned32((UINT32 *)(Data + 30), Bench->Compression);
+    WriteUnaligned32((UINT32 *)(Data + 34), (UINT32)(*Size - Offset));
+    WriteUnaligned32((UINT32 *)(Data + 46), (UINT32)Colours);
+
+    return Data;
+}
+
+
+//
+// Best of BENCH_RUNS displays of the image, in ns per image pixel
+//
+static double
+TimeDisplay( UINT8 *Data,
+             UINTN Size,
+             UINT32 ScreenWidth,
+             UINT32 ScreenHeight,
+             PRESENT_PATH Path,
+             UINTN Scaling,
+             BOOLEAN Bilinear)
+{
+    EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop;
+    SHELL_FILE_HANDLE FileHandle;
+    FRAME_BUFFER Fb;
+    EFI_STATUS Status = EFI_SUCCESS;
+    UINT64 Best = MAX_UINT64;
+    UINT64 Start;
+    UINT64 Time;
+
+    Gop = OpenScreen(ScreenWidth, ScreenHeight, Path, &Fb);
+    if (Gop == NULL) {
+        return -1;
+    }
+
+    for (UINTN Run = 0; Run < BENCH_RUNS && !EFI_ERROR(Status); Run++) {
+        Status = HostOpenMemoryFile(Data, Size, &FileHandle);
+        if (EFI_ERROR(Status)) {
+            break;
+        }
+        Start = GetPerformanceCounter();
+        Status = DisplayImage( Gop, (Path == PresentBlt) ? NULL : &Fb, NULL, FileHandle,
+                               Size, Scaling, Bilinear, FALSE);
+        Time = GetTimeInNanoSecond(GetPerformanceCounter() - Start);
+        Best = MIN(Best, Time);
+        ShellCloseFile(&FileHandle);
+    }
+
+    MockGopDestroy(Gop);
+    if (EFI_ERROR(Status)) {
+        return -1;
+    }
+
+    return (double)Best / (BENCH_WIDTH * BENCH_HEIGHT);
+}
+
+
+static UINTN
+RunBenchmarks( VOID)
+{
+    BENCH_IMAGE *Bench;
+    CHAR8 Path[256];
+    UINT8 *Data;
+    UINTN Size;
+    UINTN Failed = 0;
+    double Time[3];
+
+    printf("%ux%u images, best of %u runs, ns per image pixel\n\n",
+           BENCH_WIDTH, BENCH_HEIGHT, BENCH_RUNS);
+    printf("%-12s %10s %10s %14s\n", "decoder", "blt 1:1", "fb 1:1", "fit bilinear");
+
+    for (UINTN i = 0; i < ARRAY_SIZE(BenchImages); i++) {
+        Bench = &BenchImages[i];
+        if (Bench->File != NULL) {
+            snprintf(Path, sizeof(Path), IMAGE_DIR "%s", Bench->File);
+            Data = ReadHostFile(Path, &Size);
+        } else {
+            Data = MakeBenchBmp(Bench, &Size);
+        }
+        if (Data == NULL) {
+            printf("%-12s could not load the image\n", Bench->Name);
+            Failed++;
+            continue;
+        }
+
+        Time[0] = TimeDisplay(Data, Size, BENCH_WIDTH, BENCH_HEIGHT, PresentBlt, SCALE_NONE, FALSE);
+        Time[1] = TimeDisplay(Data, Size, BENCH_WIDTH, BENCH_HEIGHT, PresentBgr, SCALE_NONE, FALSE);
+        Time[2] = TimeDisplay(Data, Size, 1920, 1080, PresentBgr, SCALE_FIT, TRUE);
+        free(Data);
+
+        if (Time[0] < 0 || Time[1] < 0 || Time[2] < 0) {
+            printf("%-12s DisplayImage failed\n", Bench->Name);
+            Failed++;
+            continue;
+        }
+        printf("%-12s %10.2f %10.2f %14.2f\n", Bench->Name, Time[0], Time[1], Time[2]);
+    }
+
+    return Failed;
+}
+
+
+int
+main( int Argc,
+      char **Argv)
+{
+    BOOLEAN Update = FALSE;
+    BOOLEAN Bench = FALSE;
+    UINTN Failed = 0;
+
+    for (int i = 1; i < Argc; i++) {
+        if (strcmp(Argv[i], "-u") == 0) {
+            Update = TRUE;
+        } else if (strcmp(Argv[i], "-b") == 0) {
+            Bench = TRUE;
+        } else {
+            printf("Usage: ImageTest [-u | -b]\n"
+                   "  -u  write the golden images from this build\n"
+                   "  -b  time each decoder instead of testing\n");
+            return 2;
+        }
+    }
+
+    if (Bench) {
+        return RunBenchmarks() == 0 ? 0 : 1;
+    }
+
+    for (UINTN i = 0; i < ARRAY_SIZE(TestCases); i++) {
+        Failed += RunTestCase(&TestCases[i], Update);
+    }
+    printf("%s: %u failure%s\n", Failed ? "FAILED" : "PASSED", (unsigned)Failed, Failed == 1 ? "" : "s");
+
+    return Failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,319 @@
+#!/usr/bin/env python3
+#
+#  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+#
+#  Writes the test images for the host image pipeline harness
+#
+#  The pic16 images are one 16 colour picture in every BMP and PNG
+#  layout the decoders take, so each must display exactly as the
+#  others do.  mono is a 1-bit picture and alpha a 32-bit one with a
+#  real alpha channel, in each header layout that can carry it.  The
+#  images are checked in; run this only to change them, then rebuild
+#  the goldens with 'make golden'.  bench-*.png are the 1024x768 PNG
+#  images 'make bench' times; its BMP images are made in ImageTest.c.
+#
+#  License: BSD License
+#
+
+import struct
+import zlib
+
+WIDTH = 37                  # odd, so every row needs padding
+HEIGHT = 29
+
+PALETTE = [
+    (0x00, 0x00, 0x00), (0x80, 0x00, 0x00), (0x00, 0x80, 0x00), (0x80, 0x80, 0x00),
+    (0x00, 0x00, 0x80), (0x80, 0x00, 0x80), (0x00, 0x80, 0x80), (0xC0, 0xC0, 0xC0),
+    (0x80, 0x80, 0x80), (0xFF, 0x00, 0x00), (0x00, 0xFF, 0x00), (0xFF, 0xFF, 0x00),
+    (0x00, 0x00, 0xFF), (0xFF, 0x00, 0xFF), (0x00, 0xFF, 0xFF), (0xFF, 0xFF, 0xFF),
+]
+
+
+def pic16(x, y):
+    # runs for the RLE encoders, single pixels for their absolute mode
+    if y % 7 == 3:
+        return (x * 5 + y) % 16
+    return ((x // 4) ^ (y // 3)) % 16
+
+
+def mono(x, y):
+    return 1 if (x - 18) ** 2 + (y - 14) ** 2 < 120 or x == y else 0
+
+
+def alpha(x, y):
+    r = (x * 255) // (WIDTH - 1)
+    g = (y * 255) // (HEIGHT - 1)
+    b = 0x80
+    d2 = (x - 18) ** 2 + (y - 14) ** 2
+    if d2 < 36:
+        a = 255                                 # opaque centre
+    elif d2 > 200:
+        a = 0                                   # transparent corners
+    else:
+        a = 255 - (d2 - 36) * 255 // 164
+    return (r, g, b, a)
+
+
+#
+# BMP
+#
+def bmp_file(header_size, bpp, compression, height, palette, data, masks=b''):
+    info = struct.pack('<IiiHHIIiiII', header_size, WIDTH, height, 1, bpp, compression,
+                       len(data), 2835, 2835, len(palette), 0)
+    if header_size > 40:
+        info += masks[:header_size - 40]
+        info += b'\0' * (header_size - len(info))
+        masks = masks[header_size - 40:]
+    table = b''.join(struct.pack('<BBBB', b, g, r, 0) for (r, g, b) in palette)
+    offset = 14 + len(info) + len(masks) + len(table)
+    head = struct.pack('<2sIHHI', b'BM', offset + len(data), 0, 0, offset)
+    return head + info + masks + table + data
+
+
+def pad(row):
+    return row + b'\0' * (-len(row) % 4)
+
+
+def packed_rows(pixel, bpp, top_down=False):
+    rows = []
+    for y in range(HEIGHT):
+        bits = 0
+        count = 0
+        row = bytearray()
+        for x in range(WIDTH):
+            bits = (bits << bpp) | pixel(x, y)
+            count += bpp
+            if count == 8:
+                row.append(bits)
+                bits = count = 0
+        if count:
+            row.append(bits << (8 - count))
+        rows.append(pad(bytes(row)))
+    if not top_down:
+        rows.reverse()
+    return b''.join(rows)
+
+
+def bgr_rows(pixel, bytes_per_pixel, top_down=False):
+    rows = []
+    for y in range(HEIGHT):
+        row = bytearray()
+        for x in range(WIDTH):
+            p = pixel(x, y)
+            row += bytes((p[2], p[1], p[0]))
+            if bytes_per_pixel == 4:
+                row.append(p[3] if len(p) == 4 else 0)
+        rows.append(pad(bytes(row)))
+    if not top_down:
+        rows.reverse()
+    return b''.join(rows)
+
+
+def runs(row):
+    out = []
+    start = 0
+    while start < len(row):
+        end = start
+        while end < len(row) and row[end] == row[start]:
+            end += 1
+        out.append((row[start], end - start))
+        start = end
+    return out
+
+
+def rle8_row(row):
+    out = bytearray()
+    literal = []
+
+    def flush():
+        while literal:
+            chunk = literal[:255]
+            del literal[:255]
+            if len(chunk) < 3:
+                for v in chunk:
+                    out.extend((1, v))
+            else:
+                out.extend((0, len(chunk)))
+                out.extend(chunk)
+                if len(chunk) & 1:
+                    out.append(0)
+
+    for value, count in runs(row):
+        if count >= 3:
+            flush()
+            while count:
+                n = min(count, 255)
+                out.extend((n, value))
+                count -= n
+        else:
+            literal.extend([value] * count)
+    flush()
+    out.extend((0, 0))
+    return bytes(out)
+
+
+def rle4_row(row):
+    out = bytearray()
+    literal = []
+
+    def flush():
+        while literal:
+            chunk = literal[:252]
+            del literal[:252]
+            if len(chunk) < 3:
+                for v in chunk:
+                    out.extend((1, v << 4))
+            else:
+                out.extend((0, len(chunk)))
+                packed = bytearray()
+                for i in range(0, len(chunk), 2):
+                    hi = chunk[i]
+                    lo = chunk[i + 1] if i + 1 < len(chunk) else 0
+                    packed.append((hi << 4) | lo)
+                if len(packed) & 1:
+                    packed.append(0)
+                out.extend(packed)
+
+    for value, count in runs(row):
+        if count >= 3:
+            flush()
+            while count:
+                n = min(count, 255)
+                out.extend((n, (value << 4) | value))
+                count -= n
+        else:
+            literal.extend([value] * count)
+    flush()
+    out.extend((0, 0))
+    return bytes(out)
+
+
+def rle_data(pixel, encode):
+    data = b''.join(encode([pixel(x, y) for x in range(WIDTH)]) for y in reversed(range(HEIGHT)))
+    return data + b'\0\1'
+
+
+def rgb_of(index_pixel):
+    return lambda x, y: PALETTE[index_pixel(x, y)]
+
+
+BGRA_MASKS = struct.pack('<IIII', 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000)
+
+
+#
+# PNG, with the filter type changing from row to row
+#
+def paeth(a, b, c):
+    p = a + b - c
+    pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+    if pa <= pb and pa <= pc:
+        return a
+    return b if pb <= pc else c
+
+
+def png_filter(rows, bpp):
+    out = bytearray()
+    prior = bytes(len(rows[0]))
+    for y, row in enumerate(rows):
+        kind = y % 5
+        out.append(kind)
+        for i, v in enumerate(row):
+            a = row[i - bpp] if i >= bpp else 0
+            b = prior[i]
+            c = prior[i - bpp] if i >= bpp else 0
+            predictor = (0, a, b, (a + b) // 2, paeth(a, b, c))[kind]
+            out.append((v - predictor) & 0xFF)
+        prior = row
+    return bytes(out)
+
+
+def png_chunk(kind, data):
+    return struct.pack('>I', len(data)) + kind + data + struct.pack('>I', zlib.crc32(kind + data))
+
+
+def png_file(depth, color, rows, bpp, palette=None, width=WIDTH, height=HEIGHT):
+    idat = zlib.compress(png_filter(rows, bpp), 9)
+    half = len(idat) // 2
+    out = b'\x89PNG\r\n\x1a\n'
+    out += png_chunk(b'IHDR', struct.pack('>IIBBBBB', width, height, depth, color, 0, 0, 0))
+    if palette:
+        out += png_chunk(b'PLTE', b''.join(bytes(p) for p in palette))
+    # split, so a row straddles two IDAT chunks
+    out += png_chunk(b'IDAT', idat[:half]) + png_chunk(b'IDAT', idat[half:])
+    out += png_chunk(b'IEND', b'')
+    return out
+
+
+def png_rows(pixel, depth, channels, width=WIDTH, height=HEIGHT):
+    rows = []
+    for y in range(height):
+        row = bytearray()
+        if depth < 8:
+            bits = count = 0
+            for x in range(width):
+                bits = (bits << depth) | pixel(x, y)
+                count += depth
+                if count == 8:
+                    row.append(bits)
+                    bits = count = 0
+            if count:
+                row.append(bits << (8 - count))
+        else:
+            for x in range(width):
+                p = pixel(x, y)
+                p = p if isinstance(p, tuple) else (p,)
+                for v in p[:channels]:
+                    row += bytes((v, v)) if depth == 16 else bytes((v,))
+        rows.append(bytes(row))
+    return rows
+
+
+BENCH_WIDTH = 1024
+BENCH_HEIGHT = 768
+
+
+def bench_index(x, y):
+    return (((x >> 3) ^ (y >> 4)) + (x * y >> 12)) & 0xFF
+
+
+def bench_rgb(x, y):
+    return (bench_index(x, y), x >> 2, y >> 2)
+
+
+def bench_png(depth, color, pixel, channels, bpp, palette=None):
+    rows = png_rows(pixel, depth, channels, BENCH_WIDTH, BENCH_HEIGHT)
+    return png_file(depth, color, rows, bpp, palette, BENCH_WIDTH, BENCH_HEIGHT)
+
+
+def main():
+    rgb = rgb_of(pic16)
+    rgba = lambda x, y: rgb(x, y) + (255,)
+    images = {
+        'pic16-4.bmp': bmp_file(40, 4, 0, HEIGHT, PALETTE, packed_rows(pic16, 4)),
+        'pic16-8.bmp': bmp_file(40, 8, 0, HEIGHT, PALETTE, packed_rows(pic16, 8)),
+        'pic16-rle4.bmp': bmp_file(40, 4, 2, HEIGHT, PALETTE, rle_data(pic16, rle4_row)),
+        'pic16-rle8.bmp': bmp_file(40, 8, 1, HEIGHT, PALETTE, rle_data(pic16, rle8_row)),
+        'pic16-24.bmp': bmp_file(40, 24, 0, HEIGHT, [], bgr_rows(rgb, 3)),
+        'pic16-24td.bmp': bmp_file(40, 24, 0, -HEIGHT, [], bgr_rows(rgb, 3, True)),
+        'pic16-32.bmp': bmp_file(40, 32, 0, HEIGHT, [], bgr_rows(rgb, 4)),
+        'pic16-pal4.png': png_file(4, 3, png_rows(pic16, 4, 1), 1, PALETTE),
+        'pic16-pal8.png': png_file(8, 3, png_rows(pic16, 8, 1), 1, PALETTE),
+        'pic16-rgb.png': png_file(8, 2, png_rows(rgb, 8, 3), 3),
+        'pic16-rgb16.png': png_file(16, 2, png_rows(rgb, 16, 3), 6),
+        'pic16-rgba.png': png_file(8, 6, png_rows(rgba, 8, 4), 4),
+        'mono.bmp': bmp_file(40, 1, 0, HEIGHT, [(0x10, 0x20, 0x60), (0xF0, 0xE0, 0x40)],
+                             packed_rows(mono, 1)),
+        'alpha-rgb.bmp': bmp_file(40, 32, 0, HEIGHT, [], bgr_rows(alpha, 4)),
+        'alpha-bf.bmp': bmp_file(40, 32, 3, HEIGHT, [], bgr_rows(alpha, 4), BGRA_MASKS[:12]),
+        'alpha-v5.bmp': bmp_file(124, 32, 3, HEIGHT, [], bgr_rows(alpha, 4), BGRA_MASKS),
+        'bench-pal8.png': bench_png(8, 3, bench_index, 1, 1,
+                                    [(i, 255 - i, (i * 97) & 0xFF) for i in range(256)]),
+        'bench-rgb.png': bench_png(8, 2, bench_rgb, 3, 3),
+    }
+    for name, data in images.items():
+        with open(name, 'wb') as f:
+            f.write(data)
+
+
+if __name__ == '__main__':
+    main()
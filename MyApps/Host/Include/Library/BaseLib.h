@@ -0,0 +1,4 @@
+//
+// Host build: everything is declared in Uefi.h
+//
+#include <Uefi.h>
@@ -0,0 +1,298 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Minimal UEFI types for building the image pipeline on the host
+//
+//  Only what BmpLib, PngLib and DisplayBMP use is declared, with the
+//  same names and layouts as in MdePkg.  The library headers under
+//  Host/Include all come here; HostLib.c implements the functions.
+//
+//  License: BSD License
+//
+
+#ifndef __HOST_UEFI_H__
+#define __HOST_UEFI_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t     UINT8;
+typedef int8_t      INT8;
+typedef uint16_t    UINT16;
+typedef int16_t     INT16;
+typedef uint32_t    UINT32;
+typedef int32_t     INT32;
+typedef uint64_t    UINT64;
+typedef int64_t     INT64;
+typedef uint64_t    UINTN;
+typedef int64_t     INTN;
+typedef uint8_t     BOOLEAN;
+typedef char        CHAR8;
+typedef uint16_t    CHAR16;         // L"" literals need -fshort-wchar
+typedef void        VOID;
+
+typedef UINTN       EFI_STATUS;
+typedef UINTN       RETURN_STATUS;
+typedef VOID       *EFI_HANDLE;
+typedef VOID       *EFI_EVENT;
+typedef UINTN       EFI_TPL;
+typedef UINT64      EFI_PHYSICAL_ADDRESS;
+
+typedef struct {
+    UINT32  Data1;
+    UINT16  Data2;
+    UINT16  Data3;
+    UINT8   Data4[8];
+} EFI_GUID;
+
+#define EFIAPI
+#define IN
+#define OUT
+#define OPTIONAL
+#define CONST       const
+#define STATIC      static
+#define TRUE        ((BOOLEAN)1)
+#define FALSE       ((BOOLEAN)0)
+
+#define MAX(a, b)                ((a) > (b) ? (a) : (b))
+#define MIN(a, b)                ((a) < (b) ? (a) : (b))
+#define MAX_UINTN                ((UINTN)0xFFFFFFFFFFFFFFFFULL)
+#define MAX_UINT64               ((UINT64)0xFFFFFFFFFFFFFFFFULL)
+#define ARRAY_SIZE(Array)        (sizeof(Array) / sizeof((Array)[0]))
+#define OFFSET_OF(Type, Field)   offsetof(Type, Field)
+#define SIGNATURE_16(A, B)       ((A) | ((B) << 8))
+#define SIGNATURE_32(A, B, C, D) (SIGNATURE_16(A, B) | (SIGNATURE_16(C, D) << 16))
+
+#define BIT5        0x00000020
+#define BIT9        0x00000200
+#define BIT27       0x08000000
+#define BIT28       0x10000000
+
+#define MAX_BIT                  0x8000000000000000ULL
+#define ENCODE_ERROR(Code)       ((EFI_STATUS)(MAX_BIT | (Code)))
+#define EFI_ERROR(Status)        (((INTN)(EFI_STATUS)(Status)) < 0)
+
+#define EFI_SUCCESS              0
+#define EFI_LOAD_ERROR           ENCODE_ERROR(1)
+#define EFI_INVALID_PARAMETER    ENCODE_ERROR(2)
+#define EFI_UNSUPPORTED          ENCODE_ERROR(3)
+#define EFI_BAD_BUFFER_SIZE      ENCODE_ERROR(4)
+#define EFI_BUFFER_TOO_SMALL     ENCODE_ERROR(5)
+#define EFI_NOT_READY            ENCODE_ERROR(6)
+#define EFI_DEVICE_ERROR         ENCODE_ERROR(7)
+#define EFI_WRITE_PROTECTED      ENCODE_ERROR(8)
+#define EFI_OUT_OF_RESOURCES     ENCODE_ERROR(9)
+#define EFI_VOLUME_CORRUPTED     ENCODE_ERROR(10)
+#define EFI_NOT_FOUND            ENCODE_ERROR(14)
+#define EFI_ACCESS_DENIED        ENCODE_ERROR(15)
+#define EFI_END_OF_FILE          ENCODE_ERROR(31)
+
+//
+// Time, keys and the few boot services DisplayBMP calls
+//
+typedef struct {
+    UINT16  Year;
+    UINT8   Month;
+    UINT8   Day;
+    UINT8   Hour;
+    UINT8   Minute;
+    UINT8   Second;
+    UINT8   Pad1;
+    UINT32  Nanosecond;
+    INT16   TimeZone;
+    UINT8   Daylight;
+    UINT8   Pad2;
+} EFI_TIME;
+
+typedef struct {
+    UINT16  ScanCode;
+    CHAR16  UnicodeChar;
+} EFI_INPUT_KEY;
+
+typedef struct _EFI_SIMPLE_TEXT_INPUT_PROTOCOL EFI_SIMPLE_TEXT_INPUT_PROTOCOL;
+struct _EFI_SIMPLE_TEXT_INPUT_PROTOCOL {
+    EFI_STATUS (EFIAPI *Reset)(EFI_SIMPLE_TEXT_INPUT_PROTOCOL *This, BOOLEAN Extended);
+    EFI_STATUS (EFIAPI *ReadKeyStroke)(EFI_SIMPLE_TEXT_INPUT_PROTOCOL *This, EFI_INPUT_KEY *Key);
+    EFI_EVENT  WaitForKey;
+};
+
+typedef enum {
+    TimerCancel,
+    TimerPeriodic,
+    TimerRelative
+} EFI_TIMER_DELAY;
+
+typedef enum {
+    AllHandles,
+    ByRegisterNotify,
+    ByProtocol
+} EFI_LOCATE_SEARCH_TYPE;
+
+#define EVT_TIMER                              0x80000000
+#define EFI_OPEN_PROTOCOL_BY_HANDLE_PROTOCOL   0x00000001
+
+typedef VOID (EFIAPI *EFI_EVENT_NOTIFY)(EFI_EVENT Event, VOID *Context);
+
+typedef struct {
+    EFI_STATUS (EFIAPI *CreateEvent)(UINT32 Type, EFI_TPL NotifyTpl, EFI_EVENT_NOTIFY NotifyFunction,
+                                     VOID *NotifyContext, EFI_EVENT *Event);
+    EFI_STATUS (EFIAPI *SetTimer)(EFI_EVENT Event, EFI_TIMER_DELAY Type, UINT64 TriggerTime);
+    EFI_STATUS (EFIAPI *WaitForEvent)(UINTN NumberOfEvents, EFI_EVENT *Event, UINTN *Index);
+    EFI_STATUS (EFIAPI *CloseEvent)(EFI_EVENT Event);
+    EFI_STATUS (EFIAPI *CheckEvent)(EFI_EVENT Event);
+    EFI_STATUS (EFIAPI *HandleProtocol)(EFI_HANDLE Handle, EFI_GUID *Protocol, VOID **Interface);
+    EFI_STATUS (EFIAPI *OpenProtocol)(EFI_HANDLE Handle, EFI_GUID *Protocol, VOID **Interface,
+                                      EFI_HANDLE AgentHandle, EFI_HANDLE ControllerHandle, UINT32 Attributes);
+    EFI_STATUS (EFIAPI *LocateHandleBuffer)(EFI_LOCATE_SEARCH_TYPE SearchType, EFI_GUID *Protocol,
+                                            VOID *SearchKey, UINTN *NoHandles, EFI_HANDLE **Buffer);
+} EFI_BOOT_SERVICES;
+
+typedef struct {
+    EFI_HANDLE  ConsoleInHandle;
+    EFI_SIMPLE_TEXT_INPUT_PROTOCOL *ConIn;
+    EFI_HANDLE  ConsoleOutHandle;
+} EFI_SYSTEM_TABLE;
+
+extern EFI_BOOT_SERVICES  *gBS;
+extern EFI_SYSTEM_TABLE   *gST;
+extern EFI_HANDLE          gImageHandle;
+
+//
+// Files, which the shell library reads from memory on the host
+//
+#define EFI_FILE_MODE_READ       0x0000000000000001ULL
+#define EFI_FILE_MODE_WRITE      0x0000000000000002ULL
+#define EFI_FILE_MODE_CREATE     0x8000000000000000ULL
+#define EFI_FILE_DIRECTORY       0x0000000000000010ULL
+
+typedef struct {
+    UINT64    Size;
+    UINT64    FileSize;
+    UINT64    PhysicalSize;
+    EFI_TIME  CreateTime;
+    EFI_TIME  LastAccessTime;
+    EFI_TIME  ModificationTime;
+    UINT64    Attribute;
+    CHAR16    FileName[1];
+} EFI_FILE_INFO;
+
+typedef VOID *SHELL_FILE_HANDLE;
+
+//
+// Graphics output
+//
+typedef struct {
+    UINT32  RedMask;
+    UINT32  GreenMask;
+    UINT32  BlueMask;
+    UINT32  ReservedMask;
+} EFI_PIXEL_BITMASK;
+
+typedef enum {
+    PixelRedGreenBlueReserved8BitPerColor,
+    PixelBlueGreenRedReserved8BitPerColor,
+    PixelBitMask,
+    PixelBltOnly,
+    PixelFormatMax
+} EFI_GRAPHICS_PIXEL_FORMAT;
+
+typedef struct {
+    UINT32  Version;
+    UINT32  HorizontalResolution;
+    UINT32  VerticalResolution;
+    EFI_GRAPHICS_PIXEL_FORMAT PixelFormat;
+    EFI_PIXEL_BITMASK PixelInformation;
+    UINT32  PixelsPerScanLine;
+} EFI_GRAPHICS_OUTPUT_MODE_INFORMATION;
+
+typedef struct {
+    UINT8   Blue;
+    UINT8   Green;
+    UINT8   Red;
+    UINT8   Reserved;
+} EFI_GRAPHICS_OUTPUT_BLT_PIXEL;
+
+typedef enum {
+    EfiBltVideoFill,
+    EfiBltVideoToBltBuffer,
+    EfiBltBufferToVideo,
+    EfiBltVideoToVideo,
+    EfiGraphicsOutputBltOperationMax
+} EFI_GRAPHICS_OUTPUT_BLT_OPERATION;
+
+typedef struct {
+    UINT32  MaxMode;
+    UINT32  Mode;
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Info;
+    UINTN   SizeOfInfo;
+    EFI_PHYSICAL_ADDRESS FrameBufferBase;
+    UINTN   FrameBufferSize;
+} EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE;
+
+typedef struct _EFI_GRAPHICS_OUTPUT_PROTOCOL EFI_GRAPHICS_OUTPUT_PROTOCOL;
+struct _EFI_GRAPHICS_OUTPUT_PROTOCOL {
+    EFI_STATUS (EFIAPI *QueryMode)(EFI_GRAPHICS_OUTPUT_PROTOCOL *This, UINT32 ModeNumber,
+                                   UINTN *SizeOfInfo, EFI_GRAPHICS_OUTPUT_MODE_INFORMATION **Info);
+    EFI_STATUS (EFIAPI *SetMode)(EFI_GRAPHICS_OUTPUT_PROTOCOL *This, UINT32 ModeNumber);
+    EFI_STATUS (EFIAPI *Blt)(EFI_GRAPHICS_OUTPUT_PROTOCOL *This, EFI_GRAPHICS_OUTPUT_BLT_PIXEL *BltBuffer,
+                             EFI_GRAPHICS_OUTPUT_BLT_OPERATION BltOperation,
+                             UINTN SourceX, UINTN SourceY, UINTN DestinationX, UINTN DestinationY,
+                             UINTN Width, UINTN Height, UINTN Delta);
+    EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE *Mode;
+};
+
+extern EFI_GUID gEfiGraphicsOutputProtocolGuid;
+
+//
+// BaseLib, BaseMemoryLib, MemoryAllocationLib
+//
+UINTN  EFIAPI StrLen(CONST CHAR16 *String);
+UINTN  EFIAPI StrSize(CONST CHAR16 *String);
+INTN   EFIAPI StrCmp(CONST CHAR16 *FirstString, CONST CHAR16 *SecondString);
+EFI_STATUS EFIAPI StrCpyS(CHAR16 *Destination, UINTN DestMax, CONST CHAR16 *Source);
+EFI_STATUS EFIAPI StrCatS(CHAR16 *Destination, UINTN DestMax, CONST CHAR16 *Source);
+UINTN  EFIAPI StrDecimalToUintn(CONST CHAR16 *String);
+UINT64 EFIAPI LShiftU64(UINT64 Operand, UINTN Count);
+UINT64 EFIAPI MultU64x32(UINT64 Multiplicand, UINT32 Multiplier);
+UINT64 EFIAPI DivU64x64Remainder(UINT64 Dividend, UINT64 Divisor, UINT64 *Remainder);
+UINT32 EFIAPI SwapBytes32(UINT32 Value);
+UINT16 EFIAPI ReadUnaligned16(CONST UINT16 *Buffer);
+UINT32 EFIAPI ReadUnaligned32(CONST UINT32 *Buffer);
+UINT16 EFIAPI WriteUnaligned16(UINT16 *Buffer, UINT16 Value);
+UINT32 EFIAPI WriteUnaligned32(UINT32 *Buffer, UINT32 Value);
+UINT32 EFIAPI AsmCpuid(UINT32 Index, UINT32 *Eax, UINT32 *Ebx, UINT32 *Ecx, UINT32 *Edx);
+UINT32 EFIAPI AsmCpuidEx(UINT32 Index, UINT32 SubIndex, UINT32 *Eax, UINT32 *Ebx, UINT32 *Ecx, UINT32 *Edx);
+
+VOID  *EFIAPI CopyMem(VOID *Destination, CONST VOID *Source, UINTN Length);
+VOID  *EFIAPI SetMem(VOID *Buffer, UINTN Length, UINT8 Value);
+VOID  *EFIAPI ZeroMem(VOID *Buffer, UINTN Length);
+INTN   EFIAPI CompareMem(CONST VOID *DestinationBuffer, CONST VOID *SourceBuffer, UINTN Length);
+
+VOID  *EFIAPI AllocatePool(UINTN AllocationSize);
+VOID  *EFIAPI AllocateZeroPool(UINTN AllocationSize);
+VOID  *EFIAPI ReallocatePool(UINTN OldSize, UINTN NewSize, VOID *OldBuffer);
+VOID   EFIAPI FreePool(VOID *Buffer);
+
+//
+// UefiLib, TimerLib and ShellLib
+//
+UINTN  EFIAPI Print(CONST CHAR16 *Format, ...);
+
+UINT64 EFIAPI GetPerformanceCounter(VOID);
+UINT64 EFIAPI GetTimeInNanoSecond(UINT64 Ticks);
+
+EFI_STATUS EFIAPI ShellOpenFileByName(CONST CHAR16 *FileName, SHELL_FILE_HANDLE *FileHandle,
+                                      UINT64 OpenMode, UINT64 Attributes);
+EFI_STATUS EFIAPI ShellCloseFile(SHELL_FILE_HANDLE *FileHandle);
+EFI_STATUS EFIAPI ShellDeleteFile(SHELL_FILE_HANDLE *FileHandle);
+EFI_STATUS EFIAPI ShellReadFile(SHELL_FILE_HANDLE FileHandle, UINTN *ReadSize, VOID *Buffer);
+EFI_STATUS EFIAPI ShellWriteFile(SHELL_FILE_HANDLE FileHandle, UINTN *BufferSize, VOID *Buffer);
+EFI_STATUS EFIAPI ShellSetFilePosition(SHELL_FILE_HANDLE FileHandle, UINT64 Position);
+EFI_STATUS EFIAPI ShellGetFileSize(SHELL_FILE_HANDLE FileHandle, UINT64 *Size);
+EFI_FILE_INFO *EFIAPI ShellGetFileInfo(SHELL_FILE_HANDLE FileHandle);
+EFI_STATUS EFIAPI ShellSetFileInfo(SHELL_FILE_HANDLE FileHandle, EFI_FILE_INFO *FileInfo);
+EFI_STATUS EFIAPI ShellIsDirectory(CONST CHAR16 *DirName);
+EFI_STATUS EFIAPI ShellFindFirstFile(SHELL_FILE_HANDLE DirHandle, EFI_FILE_INFO **Buffer);
+EFI_STATUS EFIAPI ShellFindNextFile(SHELL_FILE_HANDLE DirHandle, EFI_FILE_INFO *Buffer, BOOLEAN *NoFile);
+
+#endif
@@ -0,0 +1,316 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  In-memory EFI_GRAPHICS_OUTPUT_PROTOCOL for host tests and benchmarks
+//
+//  The mock has a table of modes given by the caller and a linear
+//  frame buffer allocated for the current one, which Blt and direct
+//  frame buffer writes both go to.  32-bit BGR and RGB modes are
+//  supported; a PixelBltOnly mode keeps its pixels in BGR order but
+//  reports no frame buffer.  Blt checks its arguments the way the
+//  UEFI specification asks, so a caller that strays off the screen
+//  gets EFI_INVALID_PARAMETER here rather than on real hardware.
+//  The visible screen can be taken out as a binary PPM image.
+//
+//  License: BSD License
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Uefi.h>
+
+#include "MockGop.h"
+
+
+typedef struct {
+    EFI_GRAPHICS_OUTPUT_PROTOCOL Gop;          // first, so the GOP is the mock
+    EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE Mode;
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION Info;
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Modes;
+    UINT32   ModeCount;
+    UINT32  *Pixels;                           // frame buffer, PixelsPerScanLine wide
+    UINT64   BltCalls;
+} MOCK_GOP;
+
+
+static UINT32
+ToScreen( MOCK_GOP *Mock,
+          EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Pixel)
+{
+    UINT32 Value;
+
+    memcpy(&Value, Pixel, sizeof(Value));
+    if (Mock->Info.PixelFormat == PixelRedGreenBlueReserved8BitPerColor) {
+        Value = (Value & 0xFF00FF00) | ((Value >> 16) & 0xFF) | ((Value & 0xFF) << 16);
+    }
+    return Value;
+}
+
+
+static VOID
+FromScreen( MOCK_GOP *Mock,
+            UINT32 Value,
+            EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Pixel)
+{
+    if (Mock->Info.PixelFormat == PixelRedGreenBlueReserved8BitPerColor) {
+        Value = (Value & 0xFF00FF00) | ((Value >> 16) & 0xFF) | ((Value & 0xFF) << 16);
+    }
+    memcpy(Pixel, &Value, sizeof(Value));
+}
+
+
+static EFI_STATUS EFIAPI
+MockQueryMode( EFI_GRAPHICS_OUTPUT_PROTOCOL *This,
+               UINT32 ModeNumber,
+               UINTN *SizeOfInfo,
+               EFI_GRAPHICS_OUTPUT_MODE_INFORMATION **Info)
+{
+    MOCK_GOP *Mock = (MOCK_GOP *)This;
+
+    if (SizeOfInfo == NULL || Info == NULL || ModeNumber >= Mock->ModeCount) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    // the caller frees the copy, as with a real GOP
+    *Info = malloc(sizeof(EFI_GRAPHICS_OUTPUT_MODE_INFORMATION));
+    if (*Info == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    memcpy(*Info, &Mock->Modes[ModeNumber], sizeof(EFI_GRAPHICS_OUTPUT_MODE_INFORMATION));
+    *SizeOfInfo = sizeof(EFI_GRAPHICS_OUTPUT_MODE_INFORMATION);
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Switch mode and clear the new frame buffer to black
+//
+static EFI_STATUS EFIAPI
+MockSetMode( EFI_GRAPHICS_OUTPUT_PROTOCOL *This,
+             UINT32 ModeNumber)
+{
+    MOCK_GOP *Mock = (MOCK_GOP *)This;
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Info;
+    UINTN Size;
+    VOID *Pixels;
+
+    if (ModeNumber >= Mock->ModeCount) {
+        return EFI_UNSUPPORTED;
+    }
+    Info = &Mock->Modes[ModeNumber];
+    if (Info->PixelFormat != PixelRedGreenBlueReserved8BitPerColor &&
+        Info->PixelFormat != PixelBlueGreenRedReserved8BitPerColor &&
+        Info->PixelFormat != PixelBltOnly) {
+        return EFI_UNSUPPORTED;
+    }
+
+    // aligned as video memory is, for the non-temporal stores
+    Size = (UINTN)Info->PixelsPerScanLine * Info->VerticalResolution * sizeof(UINT32);
+    if (posix_memalign(&Pixels, 64, Size) != 0) {
+        return EFI_DEVICE_ERROR;
+    }
+    memset(Pixels, 0, Size);
+
+    free(Mock->Pixels);
+    Mock->Pixels = Pixels;
+    memcpy(&Mock->Info, Info, sizeof(EFI_GRAPHICS_OUTPUT_MODE_INFORMATION));
+    Mock->Mode.Mode = ModeNumber;
+    if (Info->PixelFormat == PixelBltOnly) {
+        Mock->Mode.FrameBufferBase = 0;
+        Mock->Mode.FrameBufferSize = 0;
+    } else {
+        Mock->Mode.FrameBufferBase = (EFI_PHYSICAL_ADDRESS)(UINTN)Pixels;
+        Mock->Mode.FrameBufferSize = Size;
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+static EFI_STATUS EFIAPI
+MockBlt( EFI_GRAPHICS_OUTPUT_PROTOCOL *This,
+         EFI_GRAPHICS_OUTPUT_BLT_PIXEL *BltBuffer,
+         EFI_GRAPHICS_OUTPUT_BLT_OPERATION BltOperation,
+         UINTN SourceX,
+         UINTN SourceY,
+         UINTN DestinationX,
+         UINTN DestinationY,
+         UINTN Width,
+         UINTN Height,
+         UINTN Delta)
+{
+    MOCK_GOP *Mock = (MOCK_GOP *)This;
+    UINTN ScreenWidth = Mock->Info.HorizontalResolution;
+    UINTN ScreenHeight = Mock->Info.VerticalResolution;
+    UINTN Pitch = Mock->Info.PixelsPerScanLine;
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Buffer;
+    UINT32 *Screen;
+    UINT32 Fill;
+
+    Mock->BltCalls++;
+
+    if (Width == 0 || Height == 0 || (BltOperation != EfiBltVideoToVideo && BltBuffer == NULL)) {
+        return EFI_INVALID_PARAMETER;
+    }
+    if (Delta == 0) {
+        Delta = Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL);
+    }
+
+    // the video rectangles must be on the screen
+    if (BltOperation == EfiBltVideoToBltBuffer || BltOperation == EfiBltVideoToVideo) {
+        if (SourceX > ScreenWidth || Width > ScreenWidth - SourceX ||
+            SourceY > ScreenHeight || Height > ScreenHeight - SourceY) {
+            return EFI_INVALID_PARAMETER;
+        }
+    }
+    if (BltOperation != EfiBltVideoToBltBuffer) {
+        if (DestinationX > ScreenWidth || Width > ScreenWidth - DestinationX ||
+            DestinationY > ScreenHeight || Height > ScreenHeight - DestinationY) {
+            return EFI_INVALID_PARAMETER;
+        }
+    }
+
+    switch (BltOperation) {
+        case EfiBltVideoFill:
+            Fill = ToScreen(Mock, BltBuffer);
+            for (UINTN y = 0; y < Height; y++) {
+                Screen = Mock->Pixels + (DestinationY + y) * Pitch + DestinationX;
+                for (UINTN x = 0; x < Width; x++) {
+                    Screen[x] = Fill;
+                }
+            }
+            break;
+
+        case EfiBltVideoToBltBuffer:
+            for (UINTN y = 0; y < Height; y++) {
+                Screen = Mock->Pixels + (SourceY + y) * Pitch + SourceX;
+                Buffer = (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)((UINT8 *)BltBuffer + (DestinationY + y) * Delta) + DestinationX;
+                for (UINTN x = 0; x < Width; x++) {
+                    FromScreen(Mock, Screen[x], &Buffer[x]);
+                }
+            }
+            break;
+
+        case EfiBltBufferToVideo:
+            for (UINTN y = 0; y < Height; y++) {
+                Screen = Mock->Pixels + (DestinationY + y) * Pitch + DestinationX;
+                Buffer = (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)((UINT8 *)BltBuffer + (SourceY + y) * Delta) + SourceX;
+                for (UINTN x = 0; x < Width; x++) {
+                    Screen[x] = ToScreen(Mock, &Buffer[x]);
+                }
+            }
+            break;
+
+        case EfiBltVideoToVideo:
+            // rows in the order that leaves an overlapping source intact
+            for (UINTN i = 0; i < Height; i++) {
+                UINTN y = (DestinationY > SourceY) ? Height - 1 - i : i;
+                memmove( Mock->Pixels + (DestinationY + y) * Pitch + DestinationX,
+                         Mock->Pixels + (SourceY + y) * Pitch + SourceX,
+                         Width * sizeof(UINT32));
+            }
+            break;
+
+        default:
+            return EFI_INVALID_PARAMETER;
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// A GOP with ModeCount modes, in the first of them
+//
+EFI_GRAPHICS_OUTPUT_PROTOCOL *
+MockGopCreate( CONST EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Modes,
+               UINT32 ModeCount)
+{
+    MOCK_GOP *Mock;
+
+    Mock = calloc(1, sizeof(MOCK_GOP));
+    if (Mock == NULL) {
+        return NULL;
+    }
+    Mock->Modes = malloc(ModeCount * sizeof(EFI_GRAPHICS_OUTPUT_MODE_INFORMATION));
+    if (Mock->Modes == NULL) {
+        free(Mock);
+        return NULL;
+    }
+    memcpy(Mock->Modes, Modes, ModeCount * sizeof(EFI_GRAPHICS_OUTPUT_MODE_INFORMATION));
+    Mock->ModeCount = ModeCount;
+
+    Mock->Gop.QueryMode = MockQueryMode;
+    Mock->Gop.SetMode = MockSetMode;
+    Mock->Gop.Blt = MockBlt;
+    Mock->Gop.Mode = &Mock->Mode;
+    Mock->Mode.MaxMode = ModeCount;
+    Mock->Mode.Info = &Mock->Info;
+    Mock->Mode.SizeOfInfo = sizeof(EFI_GRAPHICS_OUTPUT_MODE_INFORMATION);
+
+    if (EFI_ERROR(MockSetMode(&Mock->Gop, 0))) {
+        MockGopDestroy(&Mock->Gop);
+        return NULL;
+    }
+
+    return &Mock->Gop;
+}
+
+
+VOID
+MockGopDestroy( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop)
+{
+    MOCK_GOP *Mock = (MOCK_GOP *)Gop;
+
+    free(Mock->Pixels);
+    free(Mock->Modes);
+    free(Mock);
+}
+
+
+//
+// The visible screen as a binary PPM image, in a buffer for FreePool
+//
+UINT8 *
+MockGopToPpm( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+              UINTN *Size)
+{
+    MOCK_GOP *Mock = (MOCK_GOP *)Gop;
+    UINTN Width = Mock->Info.HorizontalResolution;
+    UINTN Height = Mock->Info.VerticalResolution;
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL Pixel;
+    CHAR8 Header[32];
+    UINTN HeaderSize;
+    UINT8 *Ppm;
+    UINT8 *Rgb;
+
+    HeaderSize = snprintf(Header, sizeof(Header), "P6\n%u %u\n255\n", (unsigned)Width, (unsigned)Height);
+    *Size = HeaderSize + Width * Height * 3;
+    Ppm = malloc(*Size);
+    if (Ppm == NULL) {
+        return NULL;
+    }
+    memcpy(Ppm, Header, HeaderSize);
+
+    Rgb = Ppm + HeaderSize;
+    for (UINTN y = 0; y < Height; y++) {
+        for (UINTN x = 0; x < Width; x++) {
+            FromScreen(Mock, Mock->Pixels[y * Mock->Info.PixelsPerScanLine + x], &Pixel);
+            *Rgb++ = Pixel.Red;
+            *Rgb++ = Pixel.Green;
+            *Rgb++ = Pixel.Blue;
+        }
+    }
+
+    return Ppm;
+}
+
+
+UINT64
+MockGopBltCalls( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop)
+{
+    return ((MOCK_GOP *)Gop)->BltCalls;
+}
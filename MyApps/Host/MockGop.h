@@ -0,0 +1,28 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  In-memory EFI_GRAPHICS_OUTPUT_PROTOCOL for host tests and benchmarks
+//
+//  License: BSD License
+//
+
+#ifndef __MOCK_GOP_H__
+#define __MOCK_GOP_H__
+
+#include <Uefi.h>
+
+EFI_GRAPHICS_OUTPUT_PROTOCOL *
+MockGopCreate( CONST EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Modes,
+               UINT32 ModeCount);
+
+VOID
+MockGopDestroy( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop);
+
+UINT8 *
+MockGopToPpm( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+              UINTN *Size);
+
+UINT64
+MockGopBltCalls( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop);
+
+#endif
@@ -0,0 +1,132 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  BMP image decoding to GOP BLT pixels, and RLE8 encoding
+//
+//  License: BSD License
+//
+
+#ifndef __BMP_LIB_H__
+#define __BMP_LIB_H__
+
+#include <Protocol/GraphicsOutput.h>
+
+typedef struct {
+    CHAR8   CharB;
+    CHAR8   CharM;
+    UINT32  Size;
+    UINT16  Reserved[2];
+    UINT32  ImageOffset;
+    UINT32  HeaderSize;
+    UINT32  PixelWidth;
+    UINT32  PixelHeight;
+    UINT16  Planes;
+    UINT16  BitPerPixel;
+    UINT32  CompressionType;
+    UINT32  ImageSize;
+    UINT32  XPixelsPerMeter;
+    UINT32  YPixelsPerMeter;
+    UINT32  NumberOfColors;
+    UINT32  ImportantColors;
+} __attribute__((__packed__)) BMP_IMAGE_HEADER;
+
+#define BMP_RGB                  0           // CompressionType
+#define BMP_RLE8                 1
+#define BMP_RLE4                 2
+#define BMP_BITFIELDS            3
+
+// BGRA channel masks, the only BMP_BITFIELDS layout decoded
+#define BMP_RED_MASK             0x00FF0000
+#define BMP_GREEN_MASK           0x0000FF00
+#define BMP_BLUE_MASK            0x000000FF
+#define BMP_ALPHA_MASK           0xFF000000
+
+#define BMP_FILE_HEADER_SIZE     14          // BM, Size, Reserved, ImageOffset
+#define BMP_INFO_HEADER_SIZE     40          // BITMAPINFOHEADER, the smallest supported
+#define BMP_V2_HEADER_SIZE       52          // adds the red, green and blue masks
+#define BMP_V3_HEADER_SIZE       56          // adds the alpha mask
+#define BMP_LUT_ENTRIES          256
+
+// worst case RLE8 encoding of a row, two bytes a pixel plus end of line
+#define BMP_RLE8_ROW_MAX(Width)  ((UINTN)(Width) * 2 + 2)
+
+// bytes per row, rows are padded to a multiple of 4 bytes
+#define BMP_ROW_SIZE(Width, Bpp) ((((UINTN)(Width) * (Bpp) + 31) / 32) * 4)
+
+//
+// A BMP image as described by its header, after BmpParse has checked
+// every size and offset against the buffer holding the header and the
+// size of the file.  Decoders take it as it is.
+//
+typedef struct {
+    UINTN     Width;
+    UINTN     Height;
+    UINT16    BitPerPixel;       // 1, 4, 8, 24 or 32
+    UINT32    CompressionType;   // BMP_RGB, or BMP_RLE8/BMP_RLE4 to match BitPerPixel;
+                                 // BMP_BITFIELDS images are BMP_RGB with these masks
+    UINT32    RedMask;           // 32-bit images only
+    UINT32    GreenMask;
+    UINT32    BlueMask;
+    UINT32    AlphaMask;         // 0 if the header gives no alpha channel
+    BOOLEAN   TopDown;           // rows stored top row first
+    UINTN     RowSize;           // bytes per stored row, uncompressed images only
+    UINTN     ImageOffset;       // start of the pixel data in the file
+    UINTN     ImageSize;         // bytes of pixel data in the file
+    UINT32   *Palette;           // in the header buffer, NULL if there is none
+    UINTN     PaletteEntries;
+} BMP_IMAGE_INFO;
+
+//
+// RLE4/RLE8 decoder state.  Rows come out one at a time in the order
+// they are stored in the file, which is bottom up.
+//
+typedef struct {
+    UINT8    *Data;              // next code byte
+    UINT8    *End;               // end of the compressed data
+    UINTN     Width;
+    UINT16    BitPerPixel;       // 4 or 8
+    UINTN     SkipRows;          // blank rows left by a delta escape
+    UINTN     StartX;            // column the next row starts at
+    BOOLEAN   EndOfBitmap;
+} BMP_RLE_DECODER;
+
+
+EFI_STATUS
+EFIAPI
+BmpParse( VOID *Buffer,
+          UINTN BufferSize,
+          UINT64 FileSize,
+          BMP_IMAGE_INFO *Info);
+
+UINTN
+EFIAPI
+BmpBuildLut( BMP_IMAGE_INFO *Info,
+             EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Lut);
+
+VOID
+EFIAPI
+BmpConvertRow( UINT8 *Src,
+               UINTN Width,
+               UINT16 BitPerPixel,
+               EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Lut,
+               EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Dst);
+
+EFI_STATUS
+EFIAPI
+BmpRleInit( BMP_IMAGE_INFO *Info,
+            UINT8 *Data,
+            BMP_RLE_DECODER *Decoder);
+
+EFI_STATUS
+EFIAPI
+BmpRleDecodeRow( BMP_RLE_DECODER *Decoder,
+                 EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Lut,
+                 EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Dst);
+
+UINTN
+EFIAPI
+BmpRle8EncodeRow( UINT8 *Src,
+                  UINTN Width,
+                  UINT8 *Dst);
+
+#endif
@@ -0,0 +1,28 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Fast text output on GOP consoles
+//
+//  GlyphConsoleOpen takes over ConOut text output so that Print and
+//  friends draw from a pre-rendered glyph atlas straight into the
+//  frame buffer, until GlyphConsoleClose hands the console back.
+//
+//  License: BSD License
+//
+
+#ifndef __GLYPH_CONSOLE_LIB_H__
+#define __GLYPH_CONSOLE_LIB_H__
+
+EFI_STATUS
+EFIAPI
+GlyphConsoleOpen( VOID);
+
+VOID
+EFIAPI
+GlyphConsoleFlush( VOID);
+
+VOID
+EFIAPI
+GlyphConsoleClose( VOID);
+
+#endif
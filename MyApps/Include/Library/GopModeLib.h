@@ -0,0 +1,65 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  GOP mode table, ranking and switching
+//
+//  License: BSD License
+//
+
+#ifndef __GOP_MODE_LIB_H__
+#define __GOP_MODE_LIB_H__
+
+#include <Protocol/GraphicsOutput.h>
+
+#define GOP_MODE_TABLE_SIGNATURE   SIGNATURE_32('G', 'M', 'T', 'B')
+#define GOP_MODE_VARIABLE_PREFIX   L"GopModes"
+
+typedef struct {
+    UINT32    Mode;
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION Info;
+} GOP_MODE_ENTRY;
+
+//
+// What QueryMode returned for every mode of one GOP.  The table is
+// kept as is in a volatile variable, so later runs in the same boot
+// can skip the queries.
+//
+typedef struct {
+    UINT32    Signature;
+    UINT32    MaxMode;
+    UINT64    Handle;            // GOP handle the table is for
+    UINT32    NativeWidth;       // EDID preferred timing, 0 if unknown
+    UINT32    NativeHeight;
+    UINT32    Count;             // entries in Modes[]
+    UINT32    Reserved;
+    GOP_MODE_ENTRY Modes[1];
+} GOP_MODE_TABLE;
+
+#define GOP_MODE_TABLE_SIZE(Count)  (OFFSET_OF(GOP_MODE_TABLE, Modes) + (UINTN)(Count) * sizeof(GOP_MODE_ENTRY))
+
+
+EFI_STATUS
+EFIAPI
+GopModeGetTable( EFI_HANDLE GopHandle,
+                 EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+                 BOOLEAN Refresh,
+                 GOP_MODE_TABLE **Table,
+                 BOOLEAN *Cached);
+
+VOID
+EFIAPI
+GopModeFreeTable( GOP_MODE_TABLE *Table);
+
+VOID
+EFIAPI
+GopModeRank( GOP_MODE_TABLE *Table,
+             UINT32 ImageWidth,
+             UINT32 ImageHeight);
+
+EFI_STATUS
+EFIAPI
+GopModeSet( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+            UINT32 Mode,
+            UINT64 *Nanoseconds);
+
+#endif
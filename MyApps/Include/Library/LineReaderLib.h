@@ -0,0 +1,127 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Buffered line reader for text files (ASCII, UTF-8 and UTF-16)
+//
+//  License: BSD License
+//
+
+#ifndef __LINE_READER_LIB_H__
+#define __LINE_READER_LIB_H__
+
+#include <Library/ShellLib.h>
+#include <Protocol/SimpleFileSystem.h>
+
+#define LINE_READER_BLOCK_SIZE   (256 * 1024)
+
+#define LINE_INDEX_SIGNATURE     SIGNATURE_32('L', 'I', 'D', 'X')
+#define LINE_INDEX_STRIDE        64
+
+typedef struct {
+    SHELL_FILE_HANDLE FileHandle;
+    UINT8    *Buffer;            // block buffer, grows for very long lines
+    UINTN     BufferSize;
+    UINTN     DataSize;          // valid bytes in Buffer
+    UINTN     Position;          // start of next line within Buffer
+    UINT64    BufferOffset;      // file offset of Buffer[0]
+    UINTN     BlockSize;         // bytes requested per file read
+    UINTN     BomSize;           // byte order mark at start of file
+    BOOLEAN   Unicode;           // UTF-16 file (BOM seen)
+    BOOLEAN   BigEndian;         // UTF-16BE, swapped to LE on read
+    BOOLEAN   FileEof;           // no more data in the file
+    CHAR16   *Line;              // UCS-2 line for ASCII files
+    UINTN     LineSize;          // size of Line in bytes
+    UINT64    BytesRead;         // total bytes read from the file
+    // ReadEx streaming (UEFI 2.3.1 and later file protocols)
+    EFI_FILE_PROTOCOL *File;     // own handle on the file, NULL until streaming
+    BOOLEAN   Streaming;         // next block is read with ReadEx
+    BOOLEAN   InFlight;          // Token is outstanding
+    EFI_FILE_IO_TOKEN Token;
+    UINT8    *Pending;           // block being filled by ReadEx
+} LINE_READER;
+
+//
+// Sparse line index: the byte offset of every Stride'th line.  The
+// header and offsets are laid out so the whole thing can be written
+// to and read back from a file as is.
+//
+typedef struct {
+    UINT32    Signature;
+    UINT32    Stride;            // lines between checkpoints
+    UINT64    FileSize;          // size of the indexed file
+    EFI_TIME  ModificationTime;  // of the indexed file
+    UINT64    LineCount;
+    UINT64    Count;             // entries in Offset[]
+    UINT64    Offset[1];         // Offset[i] is the start of line i * Stride
+} LINE_INDEX;
+
+#define LINE_INDEX_SIZE(Count)   (OFFSET_OF(LINE_INDEX, Offset) + (UINTN)(Count) * sizeof(UINT64))
+
+
+EFI_STATUS
+EFIAPI
+LineReaderOpen( SHELL_FILE_HANDLE FileHandle,
+                UINTN BlockSize,
+                LINE_READER **Reader);
+
+VOID
+EFIAPI
+LineReaderClose( LINE_READER *Reader);
+
+EFI_STATUS
+EFIAPI
+LineReaderEnableStreaming( LINE_READER *Reader,
+                           CONST CHAR16 *FileName);
+
+EFI_STATUS
+EFIAPI
+LineReaderSeek( LINE_READER *Reader,
+                UINT64 Offset);
+
+EFI_STATUS
+EFIAPI
+LineReaderReadAsciiLine( LINE_READER *Reader,
+                         CHAR8 **Line,
+                         UINTN *Length);
+
+EFI_STATUS
+EFIAPI
+LineReaderReadLine( LINE_READER *Reader,
+                    CHAR16 **Line,
+                    UINTN *Length);
+
+EFI_STATUS
+EFIAPI
+LineReaderReadBlock( LINE_READER *Reader,
+                     UINT8 **Data,
+                     UINTN *Size);
+
+EFI_STATUS
+EFIAPI
+LineReaderSkipLines( LINE_READER *Reader,
+                     UINT64 Lines);
+
+UINT64
+EFIAPI
+LineReaderTell( LINE_READER *Reader);
+
+EFI_STATUS
+EFIAPI
+LineReaderFindTail( LINE_READER *Reader,
+                    UINT64 FileSize,
+                    UINT64 Lines,
+                    UINT64 *Offset);
+
+EFI_STATUS
+EFIAPI
+LineIndexBuild( LINE_READER *Reader,
+                UINT32 Stride,
+                LINE_INDEX **Index);
+
+EFI_STATUS
+EFIAPI
+LineIndexSeek( LINE_READER *Reader,
+               LINE_INDEX *Index,
+               UINT64 Line);
+
+#endif
@@ -0,0 +1,109 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Streaming PNG image decoding to GOP BLT pixels
+//
+//  License: BSD License
+//
+
+#ifndef __PNG_LIB_H__
+#define __PNG_LIB_H__
+
+#include <Protocol/GraphicsOutput.h>
+
+#define PNG_SIGNATURE_SIZE     8
+
+#define PNG_COLOR_GRAY         0
+#define PNG_COLOR_RGB          2
+#define PNG_COLOR_PALETTE      3
+#define PNG_COLOR_GRAY_ALPHA   4
+#define PNG_COLOR_RGBA         6
+
+#define PNG_INPUT_SIZE         (64 * 1024)   // file data per read
+#define PNG_WINDOW_SIZE        32768         // deflate history
+#define PNG_FAST_BITS          10            // Huffman codes decoded by one lookup
+
+//
+// Reads up to *Size bytes of the PNG file into Buffer, setting *Size
+// to the number read (0 at the end of the file)
+//
+typedef
+EFI_STATUS
+(EFIAPI *PNG_READ_FUNCTION)( VOID *Context,
+                             VOID *Buffer,
+                             UINTN *Size);
+
+//
+// Canonical Huffman code.  Fast[] holds (Symbol << 4) | Length for
+// codes of up to PNG_FAST_BITS bits, indexed by the next input bits;
+// longer codes are decoded from Count[] and Symbol[].
+//
+typedef struct {
+    UINT16   Fast[1 << PNG_FAST_BITS];
+    UINT16   Count[16];          // codes of each length
+    UINT16   Symbol[288];        // symbols in code order
+} PNG_HUFFMAN;
+
+typedef struct {
+    // image
+    UINT32   Width;
+    UINT32   Height;
+    UINT8    BitDepth;
+    UINT8    ColorType;
+    UINT8    Interlace;
+    UINTN    Channels;
+    UINTN    PixelSize;          // bytes per complete pixel, at least 1
+    UINTN    RowSize;            // bytes per row, without the filter byte
+    UINTN    NextRow;            // rows decoded so far
+    UINTN    PaletteSize;
+    BOOLEAN  HasTransparent;     // tRNS colour for grey and RGB images
+    UINT16   Transparent[3];
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL Lut[256];    // palette or grey levels
+    // file data
+    PNG_READ_FUNCTION Read;
+    VOID    *Context;
+    UINT8   *In;
+    UINTN    InPos;
+    UINTN    InEnd;
+    UINT32   IdatLeft;           // bytes left in the current IDAT chunk
+    BOOLEAN  IdatDone;           // no more IDAT chunks
+    // inflate
+    UINT64   BitBuf;
+    UINTN    BitCount;
+    UINTN    Overrun;            // zero bytes added past the end of the data
+    UINTN    State;
+    BOOLEAN  Final;              // current block is the last one
+    UINTN    StoredLeft;
+    UINTN    CopyLeft;           // match still to be copied
+    UINTN    CopyDistance;
+    UINT8   *Window;
+    UINTN    WindowPos;          // bytes inflated so far
+    PNG_HUFFMAN Lit;
+    PNG_HUFFMAN Dist;
+    // rows, each with its filter type byte first
+    UINT8   *Current;
+    UINT8   *Prior;
+} PNG_DECODER;
+
+
+BOOLEAN
+EFIAPI
+PngIsImage( VOID *Data,
+            UINTN Size);
+
+EFI_STATUS
+EFIAPI
+PngOpen( PNG_READ_FUNCTION Read,
+         VOID *Context,
+         PNG_DECODER **Png);
+
+EFI_STATUS
+EFIAPI
+PngDecodeRow( PNG_DECODER *Png,
+              EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Row);
+
+VOID
+EFIAPI
+PngClose( PNG_DECODER *Png);
+
+#endif
@@ -0,0 +1,618 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  BMP image decoding to GOP BLT pixels, and RLE8 encoding
+//
+//  BmpParse checks a header once and describes the image in a
+//  BMP_IMAGE_INFO: the dimensions and row order, the row size, and
+//  where the palette and pixel data are and how big they are, all
+//  bounded by the buffer and the file.  The decoders below work from
+//  that description and do not look at the header again.
+//
+//  Palette images are converted through a lookup table built once per
+//  image.  A BMP palette entry (RGBQUAD) has the same byte order as an
+//  EFI_GRAPHICS_OUTPUT_BLT_PIXEL, so the table is the palette itself
+//  with the reserved byte cleared, and each pixel becomes a single
+//  32-bit load from the table.
+//
+//  RLE8 and RLE4 images are decoded a row at a time so the caller can
+//  write each row straight to its place in a BLT or band buffer.
+//  Every escape is checked against the compressed data and the row;
+//  pixels that would fall outside the image are dropped.  The encoder
+//  goes the other way for one row of palette indices at a time.
+//
+//  24-bit rows are widened to BLT pixels with SSSE3 or AVX2 byte
+//  shuffles, chosen once from CPUID.  32-bit rows are already in BLT
+//  pixel order and are copied; BI_BITFIELDS images are accepted only
+//  when their masks say so.
+//
+//  License: BSD License
+//
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/BmpLib.h>
+
+#include <immintrin.h>
+
+
+#define CPU_NONE    0
+#define CPU_SSSE3   1
+#define CPU_AVX2    2
+
+static INTN mCpuLevel = -1;
+
+// B G R from each 3 byte pixel, 0 for the reserved byte
+#define BGR_SHUFFLE  0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128
+
+
+//
+// Check the BMP header at the start of Buffer and describe the image
+// in Info.  Buffer holds the first BufferSize bytes of a file of
+// FileSize bytes; the palette is taken from what Buffer holds of it.
+// Returns EFI_UNSUPPORTED for a valid image this library does not
+// decode and EFI_INVALID_PARAMETER for one that is corrupt or
+// truncated.
+//
+EFI_STATUS
+EFIAPI
+BmpParse( VOID *Buffer,
+          UINTN BufferSize,
+          UINT64 FileSize,
+          BMP_IMAGE_INFO *Info)
+{
+    BMP_IMAGE_HEADER *BmpHeader = (BMP_IMAGE_HEADER *)Buffer;
+    UINT32 *Masks;
+    UINT32 Compression;
+    UINT64 DataSize;
+    UINT64 PaletteOffset;
+    UINT64 PaletteEnd;
+    UINTN  Colors;
+    INT32  Height;
+
+    ZeroMem(Info, sizeof(BMP_IMAGE_INFO));
+
+    if (BufferSize < sizeof(BMP_IMAGE_HEADER) || BufferSize > FileSize ||
+        BmpHeader->CharB != 'B' || BmpHeader->CharM != 'M') {
+        return EFI_UNSUPPORTED;
+    }
+    // OS/2 headers are smaller, later Windows ones larger
+    if (BmpHeader->HeaderSize < BMP_INFO_HEADER_SIZE) {
+        return EFI_UNSUPPORTED;
+    }
+
+    switch (BmpHeader->BitPerPixel) {
+        case 1:
+        case 4:
+        case 8:
+        case 24:
+        case 32:
+            break;
+        default:
+            return EFI_UNSUPPORTED;
+    }
+    Compression = BmpHeader->CompressionType;
+    if (Compression != BMP_RGB &&
+        !(Compression == BMP_RLE8 && BmpHeader->BitPerPixel == 8) &&
+        !(Compression == BMP_RLE4 && BmpHeader->BitPerPixel == 4) &&
+        !(Compression == BMP_BITFIELDS && BmpHeader->BitPerPixel == 32)) {
+        return EFI_UNSUPPORTED;
+    }
+
+    // the palette and the pixel data both lie after the headers
+    PaletteOffset = (UINT64)BMP_FILE_HEADER_SIZE + BmpHeader->HeaderSize;
+
+    // the masks follow a BITMAPINFOHEADER, later headers include them
+    if (Compression == BMP_BITFIELDS) {
+        if (BmpHeader->HeaderSize < BMP_V2_HEADER_SIZE) {
+            PaletteOffset += 3 * sizeof(UINT32);
+        }
+        if (BufferSize < sizeof(BMP_IMAGE_HEADER) + 3 * sizeof(UINT32) ||
+            (BmpHeader->HeaderSize >= BMP_V3_HEADER_SIZE &&
+             BufferSize < sizeof(BMP_IMAGE_HEADER) + 4 * sizeof(UINT32))) {
+            return EFI_INVALID_PARAMETER;
+        }
+        Masks = (UINT32 *)((UINT8 *)Buffer + sizeof(BMP_IMAGE_HEADER));
+        Info->RedMask = Masks[0];
+        Info->GreenMask = Masks[1];
+        Info->BlueMask = Masks[2];
+        if (BmpHeader->HeaderSize >= BMP_V3_HEADER_SIZE) {
+            Info->AlphaMask = Masks[3];
+        }
+        if (Info->RedMask != BMP_RED_MASK || Info->GreenMask != BMP_GREEN_MASK ||
+            Info->BlueMask != BMP_BLUE_MASK ||
+            (Info->AlphaMask != 0 && Info->AlphaMask != BMP_ALPHA_MASK)) {
+            return EFI_UNSUPPORTED;
+        }
+        // laid out as a BMP_RGB image, so decoded as one
+        Compression = BMP_RGB;
+    } else if (BmpHeader->BitPerPixel == 32) {
+        Info->RedMask = BMP_RED_MASK;
+        Info->GreenMask = BMP_GREEN_MASK;
+        Info->BlueMask = BMP_BLUE_MASK;
+    }
+
+    if (BmpHeader->ImageOffset < PaletteOffset || BmpHeader->ImageOffset > FileSize) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    // a negative height means the rows are stored top down
+    Height = (INT32)BmpHeader->PixelHeight;
+    if ((INT32)BmpHeader->PixelWidth <= 0 || Height == 0) {
+        return EFI_INVALID_PARAMETER;
+    }
+    if (Height < 0 && Compression != BMP_RGB) {
+        return EFI_INVALID_PARAMETER;
+    }
+    Info->Width = BmpHeader->PixelWidth;
+    Info->Height = (Height < 0) ? (UINTN)(-(INT64)Height) : (UINTN)Height;
+    Info->TopDown = (Height < 0);
+    Info->BitPerPixel = BmpHeader->BitPerPixel;
+    Info->CompressionType = Compression;
+    Info->ImageOffset = BmpHeader->ImageOffset;
+
+    DataSize = FileSize - BmpHeader->ImageOffset;
+    if (Compression == BMP_RGB) {
+        Info->RowSize = BMP_ROW_SIZE(Info->Width, Info->BitPerPixel);
+        if (Info->RowSize > DivU64x64Remainder(DataSize, Info->Height, NULL)) {
+            return EFI_INVALID_PARAMETER;
+        }
+        Info->ImageSize = Info->RowSize * Info->Height;
+    } else {
+        if (BmpHeader->ImageSize != 0 && BmpHeader->ImageSize < DataSize) {
+            DataSize = BmpHeader->ImageSize;
+        }
+        Info->ImageSize = (UINTN)DataSize;
+    }
+
+    // as many palette entries as the header asks for, up to what is there
+    if (Info->BitPerPixel <= 8) {
+        Colors = BmpHeader->NumberOfColors;
+        if (Colors == 0 || Colors > ((UINTN)1 << Info->BitPerPixel)) {
+            Colors = (UINTN)1 << Info->BitPerPixel;
+        }
+        PaletteEnd = MIN(BmpHeader->ImageOffset, BufferSize);
+        if (PaletteEnd > PaletteOffset) {
+            Colors = (UINTN)MIN(Colors, (PaletteEnd - PaletteOffset) / sizeof(UINT32));
+        } else {
+            Colors = 0;
+        }
+        if (Colors > 0) {
+            Info->Palette = (UINT32 *)((UINT8 *)Buffer + PaletteOffset);
+            Info->PaletteEntries = Colors;
+        }
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Fill Lut from the image palette.  Entries the palette does not define
+// are black.  Returns the number of palette entries used.
+//
+UINTN
+EFIAPI
+BmpBuildLut( BMP_IMAGE_INFO *Info,
+             EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Lut)
+{
+    UINT32 *Table = (UINT32 *)Lut;
+
+    ZeroMem(Lut, BMP_LUT_ENTRIES * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+
+    for (UINTN i = 0; i < Info->PaletteEntries; i++) {
+        Table[i] = Info->Palette[i] & 0x00FFFFFF;
+    }
+
+    return Info->PaletteEntries;
+}
+
+
+static VOID
+Unpack8( UINT8 *Src,
+         UINTN Width,
+         UINT32 *Lut,
+         UINT32 *Dst)
+{
+    UINTN i = 0;
+
+    for (; i + 4 <= Width; i += 4) {
+        Dst[i]     = Lut[Src[i]];
+        Dst[i + 1] = Lut[Src[i + 1]];
+        Dst[i + 2] = Lut[Src[i + 2]];
+        Dst[i + 3] = Lut[Src[i + 3]];
+    }
+    for (; i < Width; i++) {
+        Dst[i] = Lut[Src[i]];
+    }
+}
+
+
+static VOID
+Unpack4( UINT8 *Src,
+         UINTN Width,
+         UINT32 *Lut,
+         UINT32 *Dst)
+{
+    UINTN i = 0;
+
+    for (; i + 2 <= Width; i += 2, Src++) {
+        Dst[i]     = Lut[*Src >> 4];
+        Dst[i + 1] = Lut[*Src & 0x0F];
+    }
+    if (i < Width) {
+        Dst[i] = Lut[*Src >> 4];
+    }
+}
+
+
+static VOID
+Unpack1( UINT8 *Src,
+         UINTN Width,
+         UINT32 *Lut,
+         UINT32 *Dst)
+{
+    UINT32 Color[2] = { Lut[0], Lut[1] };
+    UINTN i = 0;
+    UINT8 Bits;
+
+    for (; i + 8 <= Width; i += 8, Src++) {
+        Bits = *Src;
+        Dst[i]     = Color[(Bits >> 7) & 1];
+        Dst[i + 1] = Color[(Bits >> 6) & 1];
+        Dst[i + 2] = Color[(Bits >> 5) & 1];
+        Dst[i + 3] = Color[(Bits >> 4) & 1];
+        Dst[i + 4] = Color[(Bits >> 3) & 1];
+        Dst[i + 5] = Color[(Bits >> 2) & 1];
+        Dst[i + 6] = Color[(Bits >> 1) & 1];
+        Dst[i + 7] = Color[Bits & 1];
+    }
+    if (i < Width) {
+        for (Bits = *Src; i < Width; i++, Bits <<= 1) {
+            Dst[i] = Color[(Bits >> 7) & 1];
+        }
+    }
+}
+
+
+static VOID
+Widen24( UINT8 *Src,
+         UINTN Width,
+         UINT32 *Dst)
+{
+    for (UINTN i = 0; i < Width; i++, Src += 3) {
+        Dst[i] = Src[0] | (Src[1] << 8) | ((UINT32)Src[2] << 16);
+    }
+}
+
+
+//
+// 16 pixels per step.  Each 16 byte load holds 4 pixels and 4 bytes of
+// the next pixel, so the loop stops while the last load is still inside
+// the row.
+//
+static __attribute__((target("ssse3"))) VOID
+Widen24Ssse3( UINT8 *Src,
+              UINTN Width,
+              UINT32 *Dst)
+{
+    __m128i Shuffle = _mm_setr_epi8(BGR_SHUFFLE);
+    UINTN i = 0;
+
+    for (; i + 18 <= Width; i += 16, Src += 48) {
+        _mm_storeu_si128((__m128i *)(Dst + i),
+            _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)Src), Shuffle));
+        _mm_storeu_si128((__m128i *)(Dst + i + 4),
+            _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)(Src + 12)), Shuffle));
+        _mm_storeu_si128((__m128i *)(Dst + i + 8),
+            _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)(Src + 24)), Shuffle));
+        _mm_storeu_si128((__m128i *)(Dst + i + 12),
+            _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)(Src + 36)), Shuffle));
+    }
+
+    Widen24(Src, Width - i, Dst + i);
+}
+
+
+//
+// AVX2 shuffles stay within each 128-bit lane, so every lane is loaded
+// with its own 4 pixels.
+//
+static __attribute__((target("avx2"))) VOID
+Widen24Avx2( UINT8 *Src,
+             UINTN Width,
+             UINT32 *Dst)
+{
+    __m256i Shuffle = _mm256_setr_epi8(BGR_SHUFFLE, BGR_SHUFFLE);
+    __m256i Pixels;
+    UINTN i = 0;
+
+    for (; i + 34 <= Width; i += 32, Src += 96) {
+        for (UINTN j = 0; j < 4; j++) {
+            Pixels = _mm256_inserti128_si256(
+                         _mm256_castsi128_si256(_mm_loadu_si128((__m128i *)(Src + j * 24))),
+                         _mm_loadu_si128((__m128i *)(Src + j * 24 + 12)), 1);
+            _mm256_storeu_si256((__m256i *)(Dst + i + j * 8), _mm256_shuffle_epi8(Pixels, Shuffle));
+        }
+    }
+
+    Widen24Ssse3(Src, Width - i, Dst + i);
+}
+
+
+static UINT64
+ReadXcr0( VOID)
+{
+    UINT32 Eax;
+    UINT32 Edx;
+
+    __asm__ __volatile__ ("xgetbv" : "=a" (Eax), "=d" (Edx) : "c" (0));
+
+    return ((UINT64)Edx << 32) | Eax;
+}
+
+
+//
+// AVX2 needs the CPU feature and the OS saving YMM state
+//
+static INTN
+CpuLevel( VOID)
+{
+    UINT32 MaxLeaf;
+    UINT32 Ecx;
+    UINT32 Ebx;
+
+    if (mCpuLevel >= 0) {
+        return mCpuLevel;
+    }
+
+    mCpuLevel = CPU_NONE;
+    AsmCpuid(0, &MaxLeaf, NULL, NULL, NULL);
+    AsmCpuid(1, NULL, NULL, &Ecx, NULL);
+    if (Ecx & BIT9) {
+        mCpuLevel = CPU_SSSE3;
+    }
+    if (MaxLeaf >= 7 && (Ecx & BIT27) && (Ecx & BIT28) && (ReadXcr0() & 0x6) == 0x6) {
+        AsmCpuidEx(7, 0, NULL, &Ebx, NULL, NULL);
+        if (Ebx & BIT5) {
+            mCpuLevel = CPU_AVX2;
+        }
+    }
+
+    return mCpuLevel;
+}
+
+
+//
+// Convert one row of Width pixels.  Lut must have been filled in by
+// BmpBuildLut for palette images and is not used for 24 and 32-bit
+// images.
+//
+VOID
+EFIAPI
+BmpConvertRow( UINT8 *Src,
+               UINTN Width,
+               UINT16 BitPerPixel,
+               EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Lut,
+               EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Dst)
+{
+    switch (BitPerPixel) {
+        case 1:
+            Unpack1(Src, Width, (UINT32 *)Lut, (UINT32 *)Dst);
+            break;
+        case 4:
+            Unpack4(Src, Width, (UINT32 *)Lut, (UINT32 *)Dst);
+            break;
+        case 8:
+            Unpack8(Src, Width, (UINT32 *)Lut, (UINT32 *)Dst);
+            break;
+        case 24:
+            switch (CpuLevel()) {
+                case CPU_AVX2:
+                    Widen24Avx2(Src, Width, (UINT32 *)Dst);
+                    break;
+                case CPU_SSSE3:
+                    Widen24Ssse3(Src, Width, (UINT32 *)Dst);
+                    break;
+                default:
+                    Widen24(Src, Width, (UINT32 *)Dst);
+                    break;
+            }
+            break;
+        case 32:
+            CopyMem(Dst, Src, Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+            break;
+        default:
+            ZeroMem(Dst, Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+            break;
+    }
+}
+
+
+//
+// Set up Decoder for the compressed pixel data of an RLE8 or RLE4 image
+// described by Info.  Data holds all Info->ImageSize bytes of it, or is
+// NULL when the caller streams the data in through Decoder->Data and
+// Decoder->End.
+//
+EFI_STATUS
+EFIAPI
+BmpRleInit( BMP_IMAGE_INFO *Info,
+            UINT8 *Data,
+            BMP_RLE_DECODER *Decoder)
+{
+    if (Info->CompressionType != BMP_RLE8 && Info->CompressionType != BMP_RLE4) {
+        return EFI_UNSUPPORTED;
+    }
+
+    ZeroMem(Decoder, sizeof(BMP_RLE_DECODER));
+    if (Data != NULL) {
+        Decoder->Data = Data;
+        Decoder->End = Data + Info->ImageSize;
+    }
+    Decoder->Width = Info->Width;
+    Decoder->BitPerPixel = Info->BitPerPixel;
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Decode the next row into Dst.  Pixels the encoding skips over with a
+// delta escape, or never reaches, are left black.  If the data ends in
+// the middle of the row EFI_BUFFER_TOO_SMALL is returned and the
+// decoder is left as it was, so the row can be decoded again once more
+// data has been added.
+//
+EFI_STATUS
+EFIAPI
+BmpRleDecodeRow( BMP_RLE_DECODER *Decoder,
+                 EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Lut,
+                 EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Dst)
+{
+    UINT32 *Table = (UINT32 *)Lut;
+    UINT32 *Row = (UINT32 *)Dst;
+    UINT8  *Data = Decoder->Data;
+    UINT8  *End = Decoder->End;
+    UINTN   Width = Decoder->Width;
+    UINTN   StartX = Decoder->StartX;
+    UINTN   X = StartX;
+    UINTN   Count;
+    UINTN   Bytes;
+    UINT8   Value;
+
+    ZeroMem(Dst, Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+
+    if (Decoder->SkipRows > 0) {
+        Decoder->SkipRows--;
+        return EFI_SUCCESS;
+    }
+    if (Decoder->EndOfBitmap) {
+        return EFI_SUCCESS;
+    }
+    Decoder->StartX = 0;
+
+    for (;;) {
+        if (End - Data < 2) {
+            Decoder->StartX = StartX;
+            return EFI_BUFFER_TOO_SMALL;
+        }
+        Count = Data[0];
+        Value = Data[1];
+        Data += 2;
+
+        if (Count > 0) {
+            // encoded run of Count pixels
+            if (Decoder->BitPerPixel == 8) {
+                for (; Count > 0 && X < Width; Count--) {
+                    Row[X++] = Table[Value];
+                }
+            } else {
+                for (UINTN i = 0; i < Count && X < Width; i++) {
+                    Row[X++] = Table[(i & 1) ? (Value & 0x0F) : (Value >> 4)];
+                }
+            }
+            continue;
+        }
+
+        switch (Value) {
+            case 0:                     // end of line
+                Decoder->Data = Data;
+                return EFI_SUCCESS;
+            case 1:                     // end of bitmap
+                Decoder->Data = Data;
+                Decoder->EndOfBitmap = TRUE;
+                return EFI_SUCCESS;
+            case 2:                     // delta, move right and down
+                if (End - Data < 2) {
+                    Decoder->StartX = StartX;
+                    return EFI_BUFFER_TOO_SMALL;
+                }
+                X += Data[0];
+                if (Data[1] > 0) {
+                    Decoder->SkipRows = Data[1] - 1;
+                    Decoder->StartX = MIN(X, Width);
+                    Decoder->Data = Data + 2;
+                    return EFI_SUCCESS;
+                }
+                Data += 2;
+                break;
+            default:                    // Value literal pixels, word aligned
+                Count = Value;
+                Bytes = (Decoder->BitPerPixel == 8) ? Count : (Count + 1) / 2;
+                if ((UINTN)(End - Data) < ((Bytes + 1) & ~(UINTN)1)) {
+                    Decoder->StartX = StartX;
+                    return EFI_BUFFER_TOO_SMALL;
+                }
+                for (UINTN i = 0; i < Count && X < Width; i++) {
+                    if (Decoder->BitPerPixel == 8) {
+                        Row[X++] = Table[Data[i]];
+                    } else {
+                        Row[X++] = Table[(i & 1) ? (Data[i / 2] & 0x0F) : (Data[i / 2] >> 4)];
+                    }
+                }
+                Data += (Bytes + 1) & ~(UINTN)1;
+                break;
+        }
+    }
+}
+
+
+//
+// Encode one row of 8-bit palette indices as RLE8 into Dst, which must
+// hold BMP_RLE8_ROW_MAX(Width) bytes, and end it with an end of line
+// escape.  Repeats of two or more pixels become runs and the rest go
+// out as literals; a literal needs at least three pixels, so shorter
+// stretches are written as runs of one.  Returns the bytes written.
+//
+UINTN
+EFIAPI
+BmpRle8EncodeRow( UINT8 *Src,
+                  UINTN Width,
+                  UINT8 *Dst)
+{
+    UINT8  *Out = Dst;
+    UINTN   X = 0;
+    UINTN   Count;
+
+    while (X < Width) {
+        for (Count = 1; X + Count < Width && Count < 255 && Src[X + Count] == Src[X]; Count++)
+            ;
+        if (Count >= 2) {
+            *Out++ = (UINT8)Count;
+            *Out++ = Src[X];
+            X += Count;
+            continue;
+        }
+
+        // literal pixels, up to where a run of three or more starts
+        for (Count = 1; X + Count < Width && Count < 255; Count++) {
+            if (X + Count + 2 < Width &&
+                Src[X + Count] == Src[X + Count + 1] &&
+                Src[X + Count] == Src[X + Count + 2]) {
+                break;
+            }
+        }
+        if (Count < 3) {
+            for (UINTN i = 0; i < Count; i++) {
+                *Out++ = 1;
+                *Out++ = Src[X + i];
+            }
+        } else {
+            *Out++ = 0;
+            *Out++ = (UINT8)Count;
+            CopyMem(Out, Src + X, Count);
+            Out += Count;
+            if (Count & 1) {
+                *Out++ = 0;             // literals are word aligned
+            }
+        }
+        X += Count;
+    }
+
+    *Out++ = 0;                         // end of line
+    *Out++ = 0;
+
+    return Out - Dst;
+}
@@ -0,0 +1,608 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Fast text output on GOP consoles
+//
+//  The firmware graphics console looks every character up through the
+//  HII font protocol and draws it with its own Blt, and scrolls the
+//  whole screen for every line.  Here the printable ASCII glyphs are
+//  fetched from HII once, and each attribute in use gets an atlas of
+//  them rendered in its colours in the frame buffer pixel format, so
+//  drawing a cell is always a plain copy.  ConOut OutputString only
+//  updates a text buffer; at most every GLYPH_FLUSH_INTERVAL_NS the
+//  screen is brought up to date by one EfiBltVideoToVideo for all the
+//  lines scrolled since the last flush and a copy of the atlas cell
+//  for every cell that changed.
+//
+//  The text grid has the same size and position as the firmware
+//  console, so output carries on where it left off either side.
+//  While open, output no longer goes to any other ConOut device such
+//  as a serial port.
+//
+//  License: BSD License
+//
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/TimerLib.h>
+#include <Library/GlyphConsoleLib.h>
+
+#include <Protocol/GraphicsOutput.h>
+#include <Protocol/HiiFont.h>
+
+
+#define GLYPH_WIDTH              EFI_GLYPH_WIDTH
+#define GLYPH_HEIGHT             EFI_GLYPH_HEIGHT
+#define GLYPH_FIRST              0x20
+#define GLYPH_LAST               0x7E
+#define GLYPH_COUNT              (GLYPH_LAST - GLYPH_FIRST + 1)
+#define GLYPH_PIXELS             (GLYPH_WIDTH * GLYPH_HEIGHT)
+#define GLYPH_FLUSH_INTERVAL_NS  (20 * 1000 * 1000)
+#define GLYPH_ATTRIBUTES         0x80        // foreground and background
+#define GLYPH_ATLAS_SIZE         (GLYPH_COUNT * GLYPH_PIXELS * sizeof(UINT32))
+
+typedef struct {
+    CHAR16    Char;
+    UINT16    Attribute;
+} GLYPH_CELL;
+
+typedef struct {
+    EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *ConOut;
+    EFI_GRAPHICS_OUTPUT_PROTOCOL    *Gop;
+    EFI_TEXT_STRING         OutputString;      // the firmware's own
+    EFI_TEXT_SET_ATTRIBUTE  SetAttribute;
+    EFI_TEXT_CLEAR_SCREEN   ClearScreen;
+    EFI_TEXT_SET_CURSOR_POSITION SetCursorPosition;
+    BOOLEAN    CursorVisible;
+    UINTN      Columns;
+    UINTN      Rows;
+    UINTN      OriginX;                        // of the text grid, in pixels
+    UINTN      OriginY;
+    UINTN      CursorX;
+    UINTN      CursorY;
+    UINT16     Attribute;
+    GLYPH_CELL *Text;                          // what has been written
+    GLYPH_CELL *Screen;                        // what is on the screen
+    UINTN      ScrollPending;                  // lines Text is ahead of Screen
+    UINT8      Masks[GLYPH_COUNT][GLYPH_HEIGHT];
+    UINT32     *Atlas[GLYPH_ATTRIBUTES];       // GLYPH_COUNT cells of GLYPH_PIXELS each
+    UINT32     *Spare;                         // re-rendered if an atlas cannot be had
+    UINT16     SpareAttribute;
+    UINT8      *FrameBuffer;                   // NULL to draw with Blt
+    UINTN      Pitch;                          // frame buffer bytes per line
+    BOOLEAN    SwapRedBlue;
+    UINT32     *Line;                          // one row of cells for Blt
+    UINT64     LastFlush;
+} GLYPH_CONSOLE;
+
+static GLYPH_CONSOLE *mConsole = NULL;
+
+// the firmware console colours, as 0x00RRGGBB
+static CONST UINT32 mColors[16] = {
+    0x000000, 0x000098, 0x009800, 0x009898, 0x980000, 0x980098, 0x989800, 0x989898,
+    0x303030, 0x0000FF, 0x00FF00, 0x00FFFF, 0xFF0000, 0xFF00FF, 0xFFFF00, 0xFFFFFF
+};
+
+
+static UINT32
+NativeColor( UINT32 Color)
+{
+    if (mConsole->SwapRedBlue) {
+        return ((Color & 0xFF) << 16) | (Color & 0xFF00) | ((Color >> 16) & 0xFF);
+    }
+    return Color;
+}
+
+
+//
+// Render every glyph in the colours of Attribute
+//
+static VOID
+RenderAtlas( UINT32 *Dst,
+             UINT16 Attribute)
+{
+    UINT32 Fg = NativeColor(mColors[Attribute & 0x0F]);
+    UINT32 Bg = NativeColor(mColors[(Attribute >> 4) & 0x07]);
+    UINT8  Mask;
+
+    for (UINTN Glyph = 0; Glyph < GLYPH_COUNT; Glyph++) {
+        for (UINTN y = 0; y < GLYPH_HEIGHT; y++) {
+            Mask = mConsole->Masks[Glyph][y];
+            for (UINTN x = 0; x < GLYPH_WIDTH; x++) {
+                *Dst++ = (Mask & (0x80 >> x)) ? Fg : Bg;
+            }
+        }
+    }
+}
+
+
+//
+// Atlas for Attribute, rendered the first time the attribute is drawn.
+// Should there be no memory for it, the spare atlas is rendered again
+// for each change of attribute instead.
+//
+static UINT32 *
+AtlasFor( UINT16 Attribute)
+{
+    UINT32 *Atlas = mConsole->Atlas[Attribute];
+
+    if (Atlas != NULL) {
+        return Atlas;
+    }
+
+    Atlas = AllocatePool(GLYPH_ATLAS_SIZE);
+    if (Atlas != NULL) {
+        RenderAtlas(Atlas, Attribute);
+        mConsole->Atlas[Attribute] = Atlas;
+        return Atlas;
+    }
+
+    if (mConsole->SpareAttribute != Attribute) {
+        RenderAtlas(mConsole->Spare, Attribute);
+        mConsole->SpareAttribute = Attribute;
+    }
+    return mConsole->Spare;
+}
+
+
+//
+// One bit per pixel of each printable ASCII glyph of the system font
+//
+static EFI_STATUS
+LoadMasks( VOID)
+{
+    EFI_HII_FONT_PROTOCOL *HiiFont;
+    EFI_FONT_DISPLAY_INFO FontInfo;
+    EFI_IMAGE_OUTPUT *Image;
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Pixel;
+    EFI_STATUS Status;
+
+    Status = gBS->LocateProtocol(&gEfiHiiFontProtocolGuid, NULL, (VOID **)&HiiFont);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    // white on black, so any colour at all is foreground
+    ZeroMem(&FontInfo, sizeof(FontInfo));
+    SetMem(&FontInfo.ForegroundColor, sizeof(FontInfo.ForegroundColor), 0xFF);
+    FontInfo.FontInfoMask = EFI_FONT_INFO_SYS_FONT | EFI_FONT_INFO_SYS_SIZE | EFI_FONT_INFO_SYS_STYLE;
+
+    for (UINTN Glyph = 0; Glyph < GLYPH_COUNT; Glyph++) {
+        Image = NULL;
+        Status = HiiFont->GetGlyph(HiiFont, (CHAR16)(GLYPH_FIRST + Glyph), &FontInfo, &Image, NULL);
+        if (EFI_ERROR(Status) || Image == NULL) {
+            // a missing glyph is left blank
+            continue;
+        }
+        for (UINTN y = 0; y < MIN(Image->Height, GLYPH_HEIGHT); y++) {
+            Pixel = Image->Image.Bitmap + y * Image->Width;
+            for (UINTN x = 0; x < MIN(Image->Width, GLYPH_WIDTH); x++, Pixel++) {
+                if (Pixel->Red | Pixel->Green | Pixel->Blue) {
+                    mConsole->Masks[Glyph][y] |= (UINT8)(0x80 >> x);
+                }
+            }
+        }
+        FreePool(Image->Image.Bitmap);
+        FreePool(Image);
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Draw Count cells of screen row Row from column Column
+//
+static VOID
+DrawCells( UINTN Column,
+           UINTN Row,
+           UINTN Count)
+{
+    GLYPH_CELL *Cell = mConsole->Text + Row * mConsole->Columns + Column;
+    UINTN X = mConsole->OriginX + Column * GLYPH_WIDTH;
+    UINTN Y = mConsole->OriginY + Row * GLYPH_HEIGHT;
+    UINT32 *Atlas = NULL;
+    UINT32 *Glyph;
+    UINT16 Attribute = 0;
+    UINT8  *Dst;
+    UINTN  Index;
+
+    for (UINTN i = 0; i < Count; i++, Cell++) {
+        if (Atlas == NULL || Cell->Attribute != Attribute) {
+            Attribute = Cell->Attribute;
+            Atlas = AtlasFor(Attribute);
+        }
+        Index = (Cell->Char >= GLYPH_FIRST && Cell->Char <= GLYPH_LAST) ? Cell->Char - GLYPH_FIRST : '?' - GLYPH_FIRST;
+        Glyph = Atlas + Index * GLYPH_PIXELS;
+
+        if (mConsole->FrameBuffer != NULL) {
+            Dst = mConsole->FrameBuffer + Y * mConsole->Pitch + (X + i * GLYPH_WIDTH) * sizeof(UINT32);
+            for (UINTN y = 0; y < GLYPH_HEIGHT; y++) {
+                CopyMem(Dst, Glyph + y * GLYPH_WIDTH, GLYPH_WIDTH * sizeof(UINT32));
+                Dst += mConsole->Pitch;
+            }
+        } else {
+            for (UINTN y = 0; y < GLYPH_HEIGHT; y++) {
+                CopyMem( mConsole->Line + y * Count * GLYPH_WIDTH + i * GLYPH_WIDTH,
+                         Glyph + y * GLYPH_WIDTH,
+                         GLYPH_WIDTH * sizeof(UINT32));
+            }
+        }
+    }
+
+    // without a frame buffer the run goes out as one Blt
+    if (mConsole->FrameBuffer == NULL) {
+        mConsole->Gop->Blt( mConsole->Gop,
+                            (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)mConsole->Line,
+                            EfiBltBufferToVideo,
+                            0, 0, X, Y,
+                            Count * GLYPH_WIDTH, GLYPH_HEIGHT,
+                            0);
+    }
+}
+
+
+static VOID
+BlankCells( GLYPH_CELL *Cell,
+            UINTN Count,
+            UINT16 Attribute)
+{
+    for (UINTN i = 0; i < Count; i++) {
+        Cell[i].Char = L' ';
+        Cell[i].Attribute = Attribute;
+    }
+}
+
+
+//
+// Bring the screen up to date with the text buffer
+//
+VOID
+EFIAPI
+GlyphConsoleFlush( VOID)
+{
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL Fill;
+    UINTN Columns;
+    UINTN Rows;
+    UINTN Lines;
+    UINTN Start;
+    UINTN Row;
+    UINTN x;
+
+    if (mConsole == NULL) {
+        return;
+    }
+    Columns = mConsole->Columns;
+    Rows = mConsole->Rows;
+
+    if (mConsole->ScrollPending > 0) {
+        Lines = MIN(mConsole->ScrollPending, Rows);
+        if (Lines < Rows) {
+            mConsole->Gop->Blt( mConsole->Gop, NULL, EfiBltVideoToVideo,
+                                mConsole->OriginX, mConsole->OriginY + Lines * GLYPH_HEIGHT,
+                                mConsole->OriginX, mConsole->OriginY,
+                                Columns * GLYPH_WIDTH, (Rows - Lines) * GLYPH_HEIGHT,
+                                0);
+            CopyMem( mConsole->Screen,
+                     mConsole->Screen + Lines * Columns,
+                     (Rows - Lines) * Columns * sizeof(GLYPH_CELL));
+        }
+        *(UINT32 *)&Fill = mColors[(mConsole->Attribute >> 4) & 0x07];
+        mConsole->Gop->Blt( mConsole->Gop, &Fill, EfiBltVideoFill,
+                            0, 0,
+                            mConsole->OriginX, mConsole->OriginY + (Rows - Lines) * GLYPH_HEIGHT,
+                            Columns * GLYPH_WIDTH, Lines * GLYPH_HEIGHT,
+                            0);
+        BlankCells(mConsole->Screen + (Rows - Lines) * Columns, Lines * Columns, mConsole->Attribute & 0x70);
+        mConsole->ScrollPending = 0;
+    }
+
+    // redraw each run of changed cells; a blank only differs if its background does
+    for (Row = 0; Row < Rows; Row++) {
+        GLYPH_CELL *Text = mConsole->Text + Row * Columns;
+        GLYPH_CELL *Screen = mConsole->Screen + Row * Columns;
+
+        for (x = 0; x < Columns; ) {
+            if (Text[x].Char == Screen[x].Char &&
+                (Text[x].Attribute == Screen[x].Attribute ||
+                 (Text[x].Char == L' ' && ((Text[x].Attribute ^ Screen[x].Attribute) & 0x70) == 0))) {
+                x++;
+                continue;
+            }
+            Start = x;
+            while (x < Columns && (Text[x].Char != Screen[x].Char || Text[x].Attribute != Screen[x].Attribute)) {
+                x++;
+            }
+            DrawCells(Start, Row, x - Start);
+            CopyMem(Screen + Start, Text + Start, (x - Start) * sizeof(GLYPH_CELL));
+        }
+    }
+
+    mConsole->LastFlush = GetPerformanceCounter();
+}
+
+
+static VOID
+NewLine( VOID)
+{
+    UINTN Columns = mConsole->Columns;
+
+    if (mConsole->CursorY + 1 < mConsole->Rows) {
+        mConsole->CursorY++;
+        return;
+    }
+
+    CopyMem( mConsole->Text,
+             mConsole->Text + Columns,
+             (mConsole->Rows - 1) * Columns * sizeof(GLYPH_CELL));
+    BlankCells(mConsole->Text + (mConsole->Rows - 1) * Columns, Columns, mConsole->Attribute);
+    mConsole->ScrollPending++;
+}
+
+
+static EFI_STATUS
+EFIAPI
+GlyphOutputString( EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *This,
+                   CHAR16 *String)
+{
+    GLYPH_CELL *Cell;
+
+    if (mConsole == NULL || This != mConsole->ConOut) {
+        return EFI_UNSUPPORTED;
+    }
+
+    for (; *String != L'\0'; String++) {
+        switch (*String) {
+        case L'\n':
+            NewLine();
+            break;
+        case L'\r':
+            mConsole->CursorX = 0;
+            break;
+        case L'\b':
+            if (mConsole->CursorX > 0) {
+                mConsole->CursorX--;
+            }
+            break;
+        default:
+            Cell = mConsole->Text + mConsole->CursorY * mConsole->Columns + mConsole->CursorX;
+            Cell->Char = *String;
+            Cell->Attribute = mConsole->Attribute;
+            if (++mConsole->CursorX >= mConsole->Columns) {
+                mConsole->CursorX = 0;
+                NewLine();
+            }
+            break;
+        }
+    }
+
+    This->Mode->CursorColumn = (INT32)mConsole->CursorX;
+    This->Mode->CursorRow = (INT32)mConsole->CursorY;
+
+    if (GetTimeInNanoSecond(GetPerformanceCounter() - mConsole->LastFlush) >= GLYPH_FLUSH_INTERVAL_NS) {
+        GlyphConsoleFlush();
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+static EFI_STATUS
+EFIAPI
+GlyphSetAttribute( EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *This,
+                   UINTN Attribute)
+{
+    EFI_STATUS Status;
+
+    Status = mConsole->SetAttribute(This, Attribute);
+    if (!EFI_ERROR(Status)) {
+        mConsole->Attribute = (UINT16)(Attribute & 0x7F);
+    }
+
+    return Status;
+}
+
+
+static EFI_STATUS
+EFIAPI
+GlyphClearScreen( EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *This)
+{
+    EFI_STATUS Status;
+
+    Status = mConsole->ClearScreen(This);
+    if (!EFI_ERROR(Status)) {
+        BlankCells(mConsole->Text, mConsole->Columns * mConsole->Rows, mConsole->Attribute);
+        BlankCells(mConsole->Screen, mConsole->Columns * mConsole->Rows, mConsole->Attribute);
+        mConsole->ScrollPending = 0;
+        mConsole->CursorX = 0;
+        mConsole->CursorY = 0;
+    }
+
+    return Status;
+}
+
+
+static EFI_STATUS
+EFIAPI
+GlyphSetCursorPosition( EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *This,
+                        UINTN Column,
+                        UINTN Row)
+{
+    EFI_STATUS Status;
+
+    Status = mConsole->SetCursorPosition(This, Column, Row);
+    if (!EFI_ERROR(Status)) {
+        mConsole->CursorX = Column;
+        mConsole->CursorY = Row;
+    }
+
+    return Status;
+}
+
+
+static VOID
+FreeConsole( VOID)
+{
+    if (mConsole->Text != NULL) {
+        FreePool(mConsole->Text);
+    }
+    if (mConsole->Screen != NULL) {
+        FreePool(mConsole->Screen);
+    }
+    for (UINTN i = 0; i < GLYPH_ATTRIBUTES; i++) {
+        if (mConsole->Atlas[i] != NULL) {
+            FreePool(mConsole->Atlas[i]);
+        }
+    }
+    if (mConsole->Spare != NULL) {
+        FreePool(mConsole->Spare);
+    }
+    if (mConsole->Line != NULL) {
+        FreePool(mConsole->Line);
+    }
+    FreePool(mConsole);
+    mConsole = NULL;
+}
+
+
+//
+// Take over ConOut.  Fails, leaving ConOut alone, if there is no GOP
+// the console grid fits on or the system font is not available.
+//
+EFI_STATUS
+EFIAPI
+GlyphConsoleOpen( VOID)
+{
+    EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *ConOut = gST->ConOut;
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Info;
+    EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop;
+    UINTN Columns;
+    UINTN Rows;
+    UINTN Cells;
+    EFI_STATUS Status;
+
+    if (mConsole != NULL) {
+        return EFI_ALREADY_STARTED;
+    }
+
+    // under the shell ConsoleOutHandle is the shell's own, without a GOP
+    Status = gBS->HandleProtocol( gST->ConsoleOutHandle,
+                                  &gEfiGraphicsOutputProtocolGuid,
+                                  (VOID **)&Gop);
+    if (EFI_ERROR(Status)) {
+        Status = gBS->LocateProtocol( &gEfiGraphicsOutputProtocolGuid,
+                                      NULL,
+                                      (VOID **)&Gop);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+    }
+    Info = Gop->Mode->Info;
+
+    Status = ConOut->QueryMode(ConOut, ConOut->Mode->Mode, &Columns, &Rows);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    if (Columns * GLYPH_WIDTH > Info->HorizontalResolution ||
+        Rows * GLYPH_HEIGHT > Info->VerticalResolution) {
+        return EFI_UNSUPPORTED;
+    }
+
+    mConsole = AllocateZeroPool(sizeof(GLYPH_CONSOLE));
+    if (mConsole == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    Cells = Columns * Rows;
+    mConsole->ConOut = ConOut;
+    mConsole->Gop = Gop;
+    mConsole->Columns = Columns;
+    mConsole->Rows = Rows;
+    // centred, as the firmware graphics console does it
+    mConsole->OriginX = (Info->HorizontalResolution - Columns * GLYPH_WIDTH) / 2;
+    mConsole->OriginY = (Info->VerticalResolution - Rows * GLYPH_HEIGHT) / 2;
+    mConsole->CursorX = MIN((UINTN)ConOut->Mode->CursorColumn, Columns - 1);
+    mConsole->CursorY = MIN((UINTN)ConOut->Mode->CursorRow, Rows - 1);
+    mConsole->Attribute = (UINT16)(ConOut->Mode->Attribute & 0x7F);
+    mConsole->Text = AllocatePool(Cells * sizeof(GLYPH_CELL));
+    mConsole->Screen = AllocatePool(Cells * sizeof(GLYPH_CELL));
+    mConsole->Spare = AllocatePool(GLYPH_ATLAS_SIZE);
+    mConsole->SpareAttribute = GLYPH_ATTRIBUTES;   // nothing rendered yet
+    if (mConsole->Text == NULL || mConsole->Screen == NULL || mConsole->Spare == NULL) {
+        FreeConsole();
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    if ((Info->PixelFormat == PixelBlueGreenRedReserved8BitPerColor ||
+         Info->PixelFormat == PixelRedGreenBlueReserved8BitPerColor) &&
+        Gop->Mode->FrameBufferBase != 0) {
+        mConsole->FrameBuffer = (UINT8 *)(UINTN)Gop->Mode->FrameBufferBase;
+        mConsole->Pitch = Info->PixelsPerScanLine * sizeof(UINT32);
+        mConsole->SwapRedBlue = (Info->PixelFormat == PixelRedGreenBlueReserved8BitPerColor);
+    } else {
+        mConsole->Line = AllocatePool(Columns * GLYPH_PIXELS * sizeof(UINT32));
+        if (mConsole->Line == NULL) {
+            FreeConsole();
+            return EFI_OUT_OF_RESOURCES;
+        }
+    }
+
+    Status = LoadMasks();
+    if (EFI_ERROR(Status)) {
+        FreeConsole();
+        return Status;
+    }
+    AtlasFor(mConsole->Attribute);
+
+    // the screen already shows something, so the text so far is unknown;
+    // treat it as blank and only lines written from now on are drawn
+    BlankCells(mConsole->Text, Cells, mConsole->Attribute);
+    BlankCells(mConsole->Screen, Cells, mConsole->Attribute);
+
+    mConsole->CursorVisible = ConOut->Mode->CursorVisible;
+    ConOut->EnableCursor(ConOut, FALSE);
+
+    mConsole->OutputString = ConOut->OutputString;
+    mConsole->SetAttribute = ConOut->SetAttribute;
+    mConsole->ClearScreen = ConOut->ClearScreen;
+    mConsole->SetCursorPosition = ConOut->SetCursorPosition;
+    ConOut->OutputString = GlyphOutputString;
+    ConOut->SetAttribute = GlyphSetAttribute;
+    ConOut->ClearScreen = GlyphClearScreen;
+    ConOut->SetCursorPosition = GlyphSetCursorPosition;
+
+    mConsole->LastFlush = GetPerformanceCounter();
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Draw what is left and give ConOut back, with its cursor where the
+// output ended
+//
+VOID
+EFIAPI
+GlyphConsoleClose( VOID)
+{
+    EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *ConOut;
+
+    if (mConsole == NULL) {
+        return;
+    }
+
+    GlyphConsoleFlush();
+
+    ConOut = mConsole->ConOut;
+    ConOut->OutputString = mConsole->OutputString;
+    ConOut->SetAttribute = mConsole->SetAttribute;
+    ConOut->ClearScreen = mConsole->ClearScreen;
+    ConOut->SetCursorPosition = mConsole->SetCursorPosition;
+    ConOut->SetCursorPosition(ConOut, mConsole->CursorX, mConsole->CursorY);
+    ConOut->EnableCursor(ConOut, mConsole->CursorVisible);
+
+    FreeConsole();
+}
@@ -0,0 +1,345 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  GOP mode table, ranking and switching
+//
+//  QueryMode on every mode is slow on some firmware, so the table is
+//  saved in a volatile (boot services only) variable keyed by the GOP
+//  handle and reused by later runs until the next reset.  The EDID
+//  preferred timing is saved with it and used as the native mode when
+//  ranking modes for an image.
+//
+//  License: BSD License
+//
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiRuntimeServicesTableLib.h>
+#include <Library/PrintLib.h>
+#include <Library/TimerLib.h>
+#include <Library/GopModeLib.h>
+
+#include <Protocol/EdidActive.h>
+#include <Protocol/EdidDiscovered.h>
+
+#define EDID_MIN_SIZE          128
+#define EDID_DETAILED_TIMING   54
+
+extern EFI_GUID gGopModeTableGuid;
+
+
+static VOID
+VariableName( EFI_HANDLE GopHandle,
+              CHAR16 *Name,
+              UINTN Size)
+{
+    UnicodeSPrint(Name, Size, L"%s%016lx", GOP_MODE_VARIABLE_PREFIX, (UINT64)(UINTN)GopHandle);
+}
+
+
+//
+// Active size of the first detailed timing, which EDID 1.3 and later
+// says is the preferred (native) timing of the panel
+//
+static VOID
+NativeSize( EFI_HANDLE GopHandle,
+            UINT32 *Width,
+            UINT32 *Height)
+{
+    EFI_EDID_ACTIVE_PROTOCOL     *EdidActive = NULL;
+    EFI_EDID_DISCOVERED_PROTOCOL *EdidDiscovered = NULL;
+    UINT32 SizeOfEdid = 0;
+    UINT8  *Edid = NULL;
+    UINT8  *Timing;
+    EFI_STATUS Status;
+
+    *Width = 0;
+    *Height = 0;
+
+    Status = gBS->HandleProtocol( GopHandle,
+                                  &gEfiEdidActiveProtocolGuid,
+                                  (VOID **)&EdidActive);
+    if (!EFI_ERROR(Status) && EdidActive->SizeOfEdid >= EDID_MIN_SIZE) {
+        SizeOfEdid = EdidActive->SizeOfEdid;
+        Edid = EdidActive->Edid;
+    } else {
+        Status = gBS->HandleProtocol( GopHandle,
+                                      &gEfiEdidDiscoveredProtocolGuid,
+                                      (VOID **)&EdidDiscovered);
+        if (!EFI_ERROR(Status) && EdidDiscovered->SizeOfEdid >= EDID_MIN_SIZE) {
+            SizeOfEdid = EdidDiscovered->SizeOfEdid;
+            Edid = EdidDiscovered->Edid;
+        }
+    }
+    if (Edid == NULL || SizeOfEdid < EDID_MIN_SIZE) {
+        return;
+    }
+
+    Timing = Edid + EDID_DETAILED_TIMING;
+    if (Timing[0] == 0 && Timing[1] == 0) {
+        // no pixel clock, so a display descriptor rather than a timing
+        return;
+    }
+
+    *Width = Timing[2] | ((UINT32)(Timing[4] & 0xF0) << 4);
+    *Height = Timing[5] | ((UINT32)(Timing[7] & 0xF0) << 4);
+}
+
+
+static BOOLEAN
+TableIsCurrent( GOP_MODE_TABLE *Table,
+                UINTN Size,
+                EFI_HANDLE GopHandle,
+                EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop)
+{
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Info = Gop->Mode->Info;
+
+    if (Size < GOP_MODE_TABLE_SIZE(0) ||
+        Table->Signature != GOP_MODE_TABLE_SIGNATURE ||
+        Table->MaxMode != Gop->Mode->MaxMode ||
+        Table->Handle != (UINT64)(UINTN)GopHandle ||
+        Table->Count > Table->MaxMode ||
+        Size != GOP_MODE_TABLE_SIZE(Table->Count)) {
+        return FALSE;
+    }
+
+    // the current mode has to be there and match, else the driver changed
+    for (UINT32 i = 0; i < Table->Count; i++) {
+        if (Table->Modes[i].Mode == Gop->Mode->Mode) {
+            return Table->Modes[i].Info.HorizontalResolution == Info->HorizontalResolution &&
+                   Table->Modes[i].Info.VerticalResolution == Info->VerticalResolution &&
+                   Table->Modes[i].Info.PixelFormat == Info->PixelFormat;
+        }
+    }
+
+    return FALSE;
+}
+
+
+static EFI_STATUS
+QueryModes( EFI_HANDLE GopHandle,
+            EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+            GOP_MODE_TABLE **Table)
+{
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Info;
+    GOP_MODE_TABLE *NewTable;
+    UINTN SizeOfInfo;
+    EFI_STATUS Status;
+
+    NewTable = AllocateZeroPool(GOP_MODE_TABLE_SIZE(Gop->Mode->MaxMode));
+    if (NewTable == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    NewTable->Signature = GOP_MODE_TABLE_SIGNATURE;
+    NewTable->MaxMode = Gop->Mode->MaxMode;
+    NewTable->Handle = (UINT64)(UINTN)GopHandle;
+    NativeSize(GopHandle, &NewTable->NativeWidth, &NewTable->NativeHeight);
+
+    for (UINT32 Mode = 0; Mode < Gop->Mode->MaxMode; Mode++) {
+        Status = Gop->QueryMode(Gop, Mode, &SizeOfInfo, &Info);
+        if (Status == EFI_NOT_STARTED) {
+            Gop->SetMode(Gop, Gop->Mode->Mode);
+            Status = Gop->QueryMode(Gop, Mode, &SizeOfInfo, &Info);
+        }
+        if (EFI_ERROR(Status)) {
+            continue;
+        }
+        NewTable->Modes[NewTable->Count].Mode = Mode;
+        CopyMem( &NewTable->Modes[NewTable->Count].Info,
+                 Info,
+                 MIN(SizeOfInfo, sizeof(EFI_GRAPHICS_OUTPUT_MODE_INFORMATION)));
+        NewTable->Count++;
+        FreePool(Info);
+    }
+
+    if (NewTable->Count == 0) {
+        FreePool(NewTable);
+        return EFI_NOT_FOUND;
+    }
+
+    *Table = NewTable;
+    return EFI_SUCCESS;
+}
+
+
+//
+// Get the mode table for a GOP, from the variable if an earlier run in
+// this boot saved one for the same handle and it still matches, else by
+// querying every mode and saving the result.  Refresh forces the queries.
+//
+EFI_STATUS
+EFIAPI
+GopModeGetTable( EFI_HANDLE GopHandle,
+                 EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+                 BOOLEAN Refresh,
+                 GOP_MODE_TABLE **Table,
+                 BOOLEAN *Cached)
+{
+    GOP_MODE_TABLE *SavedTable = NULL;
+    CHAR16 Name[32];
+    UINTN Size = 0;
+    EFI_STATUS Status;
+
+    *Table = NULL;
+    if (Cached != NULL) {
+        *Cached = FALSE;
+    }
+
+    VariableName(GopHandle, Name, sizeof(Name));
+
+    if (!Refresh) {
+        Status = gRT->GetVariable(Name, &gGopModeTableGuid, NULL, &Size, NULL);
+        if (Status == EFI_BUFFER_TOO_SMALL) {
+            SavedTable = AllocatePool(Size);
+            if (SavedTable == NULL) {
+                return EFI_OUT_OF_RESOURCES;
+            }
+            Status = gRT->GetVariable(Name, &gGopModeTableGuid, NULL, &Size, SavedTable);
+            if (!EFI_ERROR(Status) && TableIsCurrent(SavedTable, Size, GopHandle, Gop)) {
+                *Table = SavedTable;
+                if (Cached != NULL) {
+                    *Cached = TRUE;
+                }
+                return EFI_SUCCESS;
+            }
+            FreePool(SavedTable);
+        }
+    }
+
+    Status = QueryModes(GopHandle, Gop, Table);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    // failing to save only costs the next run the queries
+    gRT->SetVariable( Name,
+                      &gGopModeTableGuid,
+                      EFI_VARIABLE_BOOTSERVICE_ACCESS,
+                      GOP_MODE_TABLE_SIZE((*Table)->Count),
+                      *Table);
+
+    return EFI_SUCCESS;
+}
+
+
+VOID
+EFIAPI
+GopModeFreeTable( GOP_MODE_TABLE *Table)
+{
+    if (Table != NULL) {
+        FreePool(Table);
+    }
+}
+
+
+//
+// Negative if mode A suits an image of Width x Height better than B.
+// In order: not bigger than the native timing, big enough for the
+// image, the native timing itself, closest in area (the biggest when
+// nothing fits or no image size is given), a linear frame buffer,
+// and finally the lower mode number.
+//
+static INTN
+CompareModes( GOP_MODE_TABLE *Table,
+              GOP_MODE_ENTRY *A,
+              GOP_MODE_ENTRY *B,
+              UINT32 Width,
+              UINT32 Height)
+{
+    UINT32 AWidth = A->Info.HorizontalResolution;
+    UINT32 AHeight = A->Info.VerticalResolution;
+    UINT32 BWidth = B->Info.HorizontalResolution;
+    UINT32 BHeight = B->Info.VerticalResolution;
+    UINT64 AArea = MultU64x32(AWidth, AHeight);
+    UINT64 BArea = MultU64x32(BWidth, BHeight);
+    BOOLEAN Native = Table->NativeWidth != 0 && Table->NativeHeight != 0;
+    BOOLEAN AFits = AWidth >= Width && AHeight >= Height;
+    BOOLEAN BFits = BWidth >= Width && BHeight >= Height;
+    BOOLEAN AFlag;
+    BOOLEAN BFlag;
+
+    if (Native) {
+        AFlag = AWidth <= Table->NativeWidth && AHeight <= Table->NativeHeight;
+        BFlag = BWidth <= Table->NativeWidth && BHeight <= Table->NativeHeight;
+        if (AFlag != BFlag) {
+            return AFlag ? -1 : 1;
+        }
+    }
+
+    if (AFits != BFits) {
+        return AFits ? -1 : 1;
+    }
+
+    if (Native) {
+        AFlag = AWidth == Table->NativeWidth && AHeight == Table->NativeHeight;
+        BFlag = BWidth == Table->NativeWidth && BHeight == Table->NativeHeight;
+        if (AFlag != BFlag) {
+            return AFlag ? -1 : 1;
+        }
+    }
+
+    if (AArea != BArea) {
+        if (AFits && (Width != 0 || Height != 0)) {
+            return AArea < BArea ? -1 : 1;
+        }
+        return AArea > BArea ? -1 : 1;
+    }
+
+    AFlag = A->Info.PixelFormat != PixelBltOnly;
+    BFlag = B->Info.PixelFormat != PixelBltOnly;
+    if (AFlag != BFlag) {
+        return AFlag ? -1 : 1;
+    }
+
+    return (A->Mode < B->Mode) ? -1 : 1;
+}
+
+
+//
+// Sort the table best first for an image of ImageWidth x ImageHeight,
+// or for the largest usable screen if both are zero
+//
+VOID
+EFIAPI
+GopModeRank( GOP_MODE_TABLE *Table,
+             UINT32 ImageWidth,
+             UINT32 ImageHeight)
+{
+    GOP_MODE_ENTRY Entry;
+    UINT32 j;
+
+    // a few dozen modes at most, so insertion sort will do
+    for (UINT32 i = 1; i < Table->Count; i++) {
+        CopyMem(&Entry, &Table->Modes[i], sizeof(Entry));
+        for (j = i; j > 0 && CompareModes(Table, &Entry, &Table->Modes[j - 1], ImageWidth, ImageHeight) < 0; j--) {
+            CopyMem(&Table->Modes[j], &Table->Modes[j - 1], sizeof(Entry));
+        }
+        CopyMem(&Table->Modes[j], &Entry, sizeof(Entry));
+    }
+}
+
+
+//
+// SetMode, returning how long the switch took if Nanoseconds is not NULL
+//
+EFI_STATUS
+EFIAPI
+GopModeSet( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+            UINT32 Mode,
+            UINT64 *Nanoseconds)
+{
+    UINT64 StartTime;
+    EFI_STATUS Status;
+
+    StartTime = GetPerformanceCounter();
+    Status = Gop->SetMode(Gop, Mode);
+    if (Nanoseconds != NULL) {
+        *Nanoseconds = GetTimeInNanoSecond(GetPerformanceCounter() - StartTime);
+    }
+
+    return Status;
+}
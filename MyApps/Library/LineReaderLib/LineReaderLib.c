@@ -0,0 +1,964 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Buffered line reader for text files.
+//
+//  Reads the file in large blocks and hands out lines in place.  ASCII
+//  (and UTF-8) lines are returned without any conversion; UTF-16 files
+//  are detected by their BOM.  Lines longer than a block grow the buffer
+//  instead of being truncated.
+//
+//  On UEFI 2.3.1 and later file protocols the reader can stream with
+//  ReadEx, keeping the next block in flight while the caller works on
+//  the current one.  Shell file handles are wrappers that do not pass
+//  ReadEx on to the file system driver, so for streaming the file is
+//  opened a second time straight through its EFI_SIMPLE_FILE_SYSTEM
+//  volume and all reads go through that handle from then on.
+//
+//  License: BSD License
+//
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/ShellLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/DevicePathLib.h>
+#include <Library/LineReaderLib.h>
+
+
+//
+// Swap UTF-16BE code units to little endian in place
+//
+static VOID
+SwapUtf16( UINT8 *Data,
+           UINTN Size)
+{
+    UINT8 Tmp;
+
+    for (UINTN i = 0; i + 1 < Size; i += 2) {
+        Tmp = Data[i];
+        Data[i] = Data[i + 1];
+        Data[i + 1] = Tmp;
+    }
+}
+
+
+//
+// Make room for at least Needed more bytes after the buffered data
+//
+static EFI_STATUS
+GrowBuffer( LINE_READER *Reader,
+            UINTN Needed)
+{
+    UINT8 *NewBuffer;
+    UINTN NewSize = Reader->BufferSize;
+
+    while (NewSize - Reader->DataSize < Needed) {
+        NewSize *= 2;
+    }
+    if (NewSize == Reader->BufferSize) {
+        return EFI_SUCCESS;
+    }
+
+    // keep room for a terminating NUL after the buffer proper
+    NewBuffer = ReallocatePool( Reader->BufferSize + sizeof(CHAR16),
+                                NewSize + sizeof(CHAR16),
+                                Reader->Buffer);
+    if (NewBuffer == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    Reader->Buffer = NewBuffer;
+    Reader->BufferSize = NewSize;
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Synchronous reads and seeks go to the reader's own file once it has
+// one, so its position always matches what has been buffered
+//
+static EFI_STATUS
+ReadFile( LINE_READER *Reader,
+          UINTN *Size,
+          VOID *Buffer)
+{
+    if (Reader->File != NULL) {
+        return Reader->File->Read(Reader->File, Size, Buffer);
+    }
+    return ShellReadFile(Reader->FileHandle, Size, Buffer);
+}
+
+
+static EFI_STATUS
+SetFilePosition( LINE_READER *Reader,
+                 UINT64 Offset)
+{
+    if (Reader->File != NULL) {
+        return Reader->File->SetPosition(Reader->File, Offset);
+    }
+    return ShellSetFilePosition(Reader->FileHandle, Offset);
+}
+
+
+//
+// Open FileName through the file system driver of its volume, giving a
+// genuine EFI_FILE_PROTOCOL rather than a shell wrapper
+//
+static EFI_STATUS
+OpenDirect( CONST CHAR16 *FileName,
+            EFI_FILE_PROTOCOL **File)
+{
+    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *FileSystem;
+    EFI_DEVICE_PATH_PROTOCOL *DevicePath;
+    EFI_DEVICE_PATH_PROTOCOL *Node;
+    EFI_FILE_PROTOCOL *Root;
+    EFI_HANDLE Handle;
+    EFI_STATUS Status;
+    CHAR16 *Path = NULL;
+    CHAR16 *Joined;
+    CHAR16 *Name;
+    UINTN Length;
+
+    DevicePath = gEfiShellProtocol->GetDevicePathFromFilePath(FileName);
+    if (DevicePath == NULL) {
+        return EFI_NOT_FOUND;
+    }
+
+    Node = DevicePath;
+    Status = gBS->LocateDevicePath(&gEfiSimpleFileSystemProtocolGuid, &Node, &Handle);
+    if (!EFI_ERROR(Status)) {
+        Status = gBS->HandleProtocol( Handle,
+                                      &gEfiSimpleFileSystemProtocolGuid,
+                                      (VOID **)&FileSystem);
+    }
+    if (EFI_ERROR(Status)) {
+        goto Done;
+    }
+
+    // what is left of the device path is the file path, maybe split
+    // over several nodes
+    for (; !IsDevicePathEnd(Node); Node = NextDevicePathNode(Node)) {
+        if (DevicePathType(Node) != MEDIA_DEVICE_PATH ||
+            DevicePathSubType(Node) != MEDIA_FILEPATH_DP) {
+            Status = EFI_UNSUPPORTED;
+            goto Done;
+        }
+        Name = ((FILEPATH_DEVICE_PATH *)Node)->PathName;
+        Length = (Path == NULL) ? 0 : StrLen(Path);
+        Joined = CatSPrint( NULL, L"%s%s%s",
+                            (Path == NULL) ? L"" : Path,
+                            (Length > 0 && Path[Length - 1] != L'\\' && Name[0] != L'\\') ? L"\\" : L"",
+                            Name);
+        if (Path != NULL) {
+            FreePool(Path);
+        }
+        Path = Joined;
+        if (Path == NULL) {
+            Status = EFI_OUT_OF_RESOURCES;
+            goto Done;
+        }
+    }
+    if (Path == NULL) {
+        Status = EFI_NOT_FOUND;
+        goto Done;
+    }
+
+    Status = FileSystem->OpenVolume(FileSystem, &Root);
+    if (EFI_ERROR(Status)) {
+        goto Done;
+    }
+    Status = Root->Open(Root, File, Path, EFI_FILE_MODE_READ, 0);
+    Root->Close(Root);
+
+Done:
+    if (Path != NULL) {
+        FreePool(Path);
+    }
+    FreePool(DevicePath);
+
+    return Status;
+}
+
+
+//
+// Queue a ReadEx of the next block into the pending buffer
+//
+static EFI_STATUS
+StartRead( LINE_READER *Reader)
+{
+    EFI_STATUS Status;
+
+    Reader->Token.Status = EFI_SUCCESS;
+    Reader->Token.BufferSize = Reader->BlockSize;
+    Reader->Token.Buffer = Reader->Pending;
+
+    Status = Reader->File->ReadEx(Reader->File, &Reader->Token);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    Reader->InFlight = TRUE;
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Wait for the outstanding ReadEx and return the number of bytes read
+//
+static EFI_STATUS
+FinishRead( LINE_READER *Reader,
+            UINTN *Size)
+{
+    EFI_STATUS Status;
+    UINTN Index;
+
+    *Size = 0;
+    if (!Reader->InFlight) {
+        return EFI_NOT_READY;
+    }
+
+    Status = gBS->WaitForEvent(1, &Reader->Token.Event, &Index);
+    Reader->InFlight = FALSE;
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    if (EFI_ERROR(Reader->Token.Status)) {
+        return Reader->Token.Status;
+    }
+    *Size = Reader->Token.BufferSize;
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Move the unconsumed tail to the start of the buffer and read more
+// data after it.  The buffer is doubled when a single line fills it.
+//
+static EFI_STATUS
+FillBuffer( LINE_READER *Reader)
+{
+    EFI_STATUS Status;
+    UINTN Size;
+
+    if (Reader->Position > 0) {
+        Reader->DataSize -= Reader->Position;
+        CopyMem(Reader->Buffer, Reader->Buffer + Reader->Position, Reader->DataSize);
+        Reader->BufferOffset += Reader->Position;
+        Reader->Position = 0;
+    }
+
+    if (Reader->Streaming && !Reader->InFlight) {
+        // firmware may refuse ReadEx on this file, use Read from now on
+        if (EFI_ERROR(StartRead(Reader))) {
+            Reader->Streaming = FALSE;
+        }
+    }
+
+    if (Reader->Streaming) {
+        Status = FinishRead(Reader, &Size);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+        Status = GrowBuffer(Reader, Size);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+        CopyMem(Reader->Buffer + Reader->DataSize, Reader->Pending, Size);
+
+        // keep the next block in flight while this one is consumed
+        if (Size > 0 && EFI_ERROR(StartRead(Reader))) {
+            Reader->Streaming = FALSE;
+        }
+    } else {
+        if (Reader->DataSize == Reader->BufferSize) {
+            Status = GrowBuffer(Reader, Reader->BlockSize);
+            if (EFI_ERROR(Status)) {
+                return Status;
+            }
+        }
+        Size = Reader->BufferSize - Reader->DataSize;
+        Status = ReadFile(Reader, &Size, Reader->Buffer + Reader->DataSize);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+    }
+
+    if (Size == 0) {
+        Reader->FileEof = TRUE;
+    } else if (Reader->BigEndian) {
+        SwapUtf16(Reader->Buffer + Reader->DataSize, Size);
+    }
+    Reader->DataSize += Size;
+    Reader->BytesRead += Size;
+
+    return EFI_SUCCESS;
+}
+
+
+EFI_STATUS
+EFIAPI
+LineReaderOpen( SHELL_FILE_HANDLE FileHandle,
+                UINTN BlockSize,
+                LINE_READER **Reader)
+{
+    EFI_STATUS Status;
+    LINE_READER *New;
+    UINT8 *Data;
+
+    if (BlockSize == 0) {
+        BlockSize = LINE_READER_BLOCK_SIZE;
+    }
+    BlockSize = ALIGN_VALUE(BlockSize, sizeof(CHAR16));
+
+    New = AllocateZeroPool(sizeof(LINE_READER));
+    if (New == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    New->Buffer = AllocatePool(BlockSize + sizeof(CHAR16));
+    if (New->Buffer == NULL) {
+        FreePool(New);
+        return EFI_OUT_OF_RESOURCES;
+    }
+    New->BufferSize = BlockSize;
+    New->BlockSize = BlockSize;
+    New->FileHandle = FileHandle;
+
+    Status = LineReaderSeek(New, 0);
+    if (!EFI_ERROR(Status)) {
+        Status = FillBuffer(New);
+    }
+    if (EFI_ERROR(Status)) {
+        LineReaderClose(New);
+        return Status;
+    }
+
+    // check for a byte order mark
+    Data = New->Buffer;
+    if (New->DataSize >= 2 && Data[0] == 0xFF && Data[1] == 0xFE) {
+        New->Unicode = TRUE;
+        New->BomSize = 2;
+    } else if (New->DataSize >= 2 && Data[0] == 0xFE && Data[1] == 0xFF) {
+        New->Unicode = TRUE;
+        New->BigEndian = TRUE;
+        New->BomSize = 2;
+        SwapUtf16(Data, New->DataSize);
+    } else if (New->DataSize >= 3 && Data[0] == 0xEF && Data[1] == 0xBB && Data[2] == 0xBF) {
+        New->BomSize = 3;
+    }
+    New->Position = New->BomSize;
+
+    *Reader = New;
+
+    return EFI_SUCCESS;
+}
+
+
+VOID
+EFIAPI
+LineReaderClose( LINE_READER *Reader)
+{
+    UINTN Size;
+
+    if (Reader == NULL) {
+        return;
+    }
+    if (Reader->InFlight) {
+        FinishRead(Reader, &Size);
+    }
+    if (Reader->File != NULL) {
+        Reader->File->Close(Reader->File);
+    }
+    if (Reader->Token.Event != NULL) {
+        gBS->CloseEvent(Reader->Token.Event);
+    }
+    if (Reader->Pending != NULL) {
+        FreePool(Reader->Pending);
+    }
+    if (Reader->Buffer != NULL) {
+        FreePool(Reader->Buffer);
+    }
+    if (Reader->Line != NULL) {
+        FreePool(Reader->Line);
+    }
+    FreePool(Reader);
+}
+
+
+//
+// Switch to ReadEx streaming.  FileName is the file the reader was
+// opened on; it is opened again through its file system driver, as
+// the shell handle cannot be used for ReadEx.  Returns EFI_UNSUPPORTED,
+// and leaves the reader using synchronous reads on the shell handle,
+// if that fails or the file protocol is revision 1.
+//
+EFI_STATUS
+EFIAPI
+LineReaderEnableStreaming( LINE_READER *Reader,
+                           CONST CHAR16 *FileName)
+{
+    EFI_FILE_PROTOCOL *File;
+    EFI_STATUS Status;
+
+    if (Reader->File == NULL) {
+        if (EFI_ERROR(OpenDirect(FileName, &File))) {
+            return EFI_UNSUPPORTED;
+        }
+        // carry on from where the shell handle has got to
+        if (File->Revision < EFI_FILE_PROTOCOL_REVISION2 ||
+            EFI_ERROR(File->SetPosition(File, Reader->BufferOffset + Reader->DataSize))) {
+            File->Close(File);
+            return EFI_UNSUPPORTED;
+        }
+        Reader->File = File;
+    }
+
+    if (Reader->Pending == NULL) {
+        Reader->Pending = AllocatePool(Reader->BlockSize);
+        if (Reader->Pending == NULL) {
+            return EFI_OUT_OF_RESOURCES;
+        }
+    }
+
+    if (Reader->Token.Event == NULL) {
+        Status = gBS->CreateEvent(0, TPL_CALLBACK, NULL, NULL, &Reader->Token.Event);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+    }
+
+    Reader->Streaming = TRUE;
+
+    // start the read-ahead now unless the whole file is already buffered
+    if (!Reader->FileEof && !Reader->InFlight) {
+        Status = StartRead(Reader);
+        if (EFI_ERROR(Status)) {
+            Reader->Streaming = FALSE;
+            return EFI_UNSUPPORTED;
+        }
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Position the reader at a byte offset in the file.  Forward seeks within
+// the data already buffered do not touch the file; anything before the
+// current position may have had its line ends overwritten.
+//
+EFI_STATUS
+EFIAPI
+LineReaderSeek( LINE_READER *Reader,
+                UINT64 Offset)
+{
+    EFI_STATUS Status;
+    UINTN Size;
+
+    if (Offset < Reader->BomSize) {
+        Offset = Reader->BomSize;
+    }
+
+    if (Reader->DataSize > 0 &&
+        Offset >= Reader->BufferOffset + Reader->Position &&
+        Offset <= Reader->BufferOffset + Reader->DataSize) {
+        Reader->Position = (UINTN)(Offset - Reader->BufferOffset);
+        return EFI_SUCCESS;
+    }
+
+    // a read-ahead cannot be cancelled, let it land and drop it
+    if (Reader->InFlight) {
+        FinishRead(Reader, &Size);
+    }
+
+    Status = SetFilePosition(Reader, Offset);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    Reader->BufferOffset = Offset;
+    Reader->DataSize = 0;
+    Reader->Position = 0;
+    Reader->FileEof = FALSE;
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Return the next line of an ASCII or UTF-8 file.  The line points into
+// the block buffer, is NUL terminated with the CR/LF removed, and stays
+// valid until the next call.  Returns EFI_END_OF_FILE after the last line.
+//
+EFI_STATUS
+EFIAPI
+LineReaderReadAsciiLine( LINE_READER *Reader,
+                         CHAR8 **Line,
+                         UINTN *Length)
+{
+    EFI_STATUS Status;
+    CHAR8 *Start;
+    CHAR8 *Nl;
+    UINTN Scanned = 0;
+    UINTN Len;
+
+    if (Reader->Unicode) {
+        return EFI_UNSUPPORTED;
+    }
+
+    for (;;) {
+        Start = (CHAR8 *)Reader->Buffer + Reader->Position;
+        Len = Reader->DataSize - Reader->Position;
+        Nl = ScanMem8(Start + Scanned, Len - Scanned, '\n');
+        if (Nl != NULL) {
+            Len = Nl - Start;
+            Reader->Position += Len + 1;
+            break;
+        }
+        if (Reader->FileEof) {
+            if (Len == 0) {
+                return EFI_END_OF_FILE;
+            }
+            Reader->Position += Len;
+            break;
+        }
+        Scanned = Len;
+        Status = FillBuffer(Reader);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+    }
+
+    if (Len > 0 && Start[Len - 1] == '\r') {
+        Len--;
+    }
+    Start[Len] = '\0';
+
+    *Line = Start;
+    *Length = Len;
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// UTF-16 files are handed out in place, the same as ASCII lines.
+//
+static EFI_STATUS
+ReadUnicodeLine( LINE_READER *Reader,
+                 CHAR16 **Line,
+                 UINTN *Length)
+{
+    EFI_STATUS Status;
+    CHAR16 *Start;
+    CHAR16 *Nl;
+    UINTN Scanned = 0;
+    UINTN Len;
+
+    for (;;) {
+        Start = (CHAR16 *)(Reader->Buffer + Reader->Position);
+        Len = (Reader->DataSize - Reader->Position) / sizeof(CHAR16);
+        Nl = ScanMem16(Start + Scanned, (Len - Scanned) * sizeof(CHAR16), L'\n');
+        if (Nl != NULL) {
+            Len = Nl - Start;
+            Reader->Position += (Len + 1) * sizeof(CHAR16);
+            break;
+        }
+        if (Reader->FileEof) {
+            if (Len == 0) {
+                return EFI_END_OF_FILE;
+            }
+            Reader->Position = Reader->DataSize;
+            break;
+        }
+        Scanned = Len;
+        Status = FillBuffer(Reader);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+    }
+
+    if (Len > 0 && Start[Len - 1] == L'\r') {
+        Len--;
+    }
+    Start[Len] = L'\0';
+
+    *Line = Start;
+    *Length = Len;
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Return the next line as a UCS-2 string regardless of the file encoding.
+//
+EFI_STATUS
+EFIAPI
+LineReaderReadLine( LINE_READER *Reader,
+                    CHAR16 **Line,
+                    UINTN *Length)
+{
+    EFI_STATUS Status;
+    CHAR8 *AsciiLine;
+    UINTN Len;
+    UINTN Size;
+
+    if (Reader->Unicode) {
+        return ReadUnicodeLine(Reader, Line, Length);
+    }
+
+    Status = LineReaderReadAsciiLine(Reader, &AsciiLine, &Len);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    Size = (Len + 1) * sizeof(CHAR16);
+    if (Size > Reader->LineSize) {
+        if (Reader->Line != NULL) {
+            FreePool(Reader->Line);
+        }
+        Reader->LineSize = MAX(Size, 256 * sizeof(CHAR16));
+        Reader->Line = AllocatePool(Reader->LineSize);
+        if (Reader->Line == NULL) {
+            Reader->LineSize = 0;
+            return EFI_OUT_OF_RESOURCES;
+        }
+    }
+
+    for (UINTN i = 0; i <= Len; i++) {
+        Reader->Line[i] = (CHAR16)(UINT8)AsciiLine[i];
+    }
+
+    *Line = Reader->Line;
+    *Length = Len;
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Return every complete line currently buffered as one raw block.  The
+// data is left untouched and, for UTF-16 files, ends on a code unit
+// boundary.  The last block of the file may end without a line end.
+//
+EFI_STATUS
+EFIAPI
+LineReaderReadBlock( LINE_READER *Reader,
+                     UINT8 **Data,
+                     UINTN *Size)
+{
+    EFI_STATUS Status;
+    UINT8 *Buffer;
+    UINTN End;
+
+    for (;;) {
+        Buffer = Reader->Buffer;
+        End = Reader->DataSize;
+        if (Reader->Unicode) {
+            End &= ~(UINTN)1;
+            while (End >= Reader->Position + 2 && *(CHAR16 *)(Buffer + End - 2) != L'\n') {
+                End -= 2;
+            }
+        } else {
+            while (End > Reader->Position && Buffer[End - 1] != '\n') {
+                End--;
+            }
+        }
+        if (End > Reader->Position) {
+            break;
+        }
+        if (Reader->FileEof) {
+            End = Reader->DataSize;
+            if (End == Reader->Position) {
+                return EFI_END_OF_FILE;
+            }
+            break;
+        }
+        Status = FillBuffer(Reader);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+    }
+
+    *Data = Buffer + Reader->Position;
+    *Size = End - Reader->Position;
+    Reader->Position = End;
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Skip lines without decoding them.  Partial lines are dropped as they
+// are passed so the buffer never has to grow.
+//
+EFI_STATUS
+EFIAPI
+LineReaderSkipLines( LINE_READER *Reader,
+                     UINT64 Lines)
+{
+    EFI_STATUS Status;
+    UINT8 *Start;
+    UINT8 *Nl;
+    UINTN Unit = Reader->Unicode ? sizeof(CHAR16) : 1;
+    UINTN Avail;
+
+    while (Lines > 0) {
+        Start = Reader->Buffer + Reader->Position;
+        Avail = (Reader->DataSize - Reader->Position) & ~(Unit - 1);
+        if (Reader->Unicode) {
+            Nl = ScanMem16(Start, Avail, L'\n');
+        } else {
+            Nl = ScanMem8(Start, Avail, '\n');
+        }
+        if (Nl != NULL) {
+            Reader->Position += (Nl - Start) + Unit;
+            Lines--;
+            continue;
+        }
+        if (Reader->FileEof) {
+            Reader->Position = Reader->DataSize;
+            return EFI_END_OF_FILE;
+        }
+        Reader->Position += Avail;
+        Status = FillBuffer(Reader);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// File offset of the next line
+//
+UINT64
+EFIAPI
+LineReaderTell( LINE_READER *Reader)
+{
+    return Reader->BufferOffset + Reader->Position;
+}
+
+
+//
+// Position the reader at the start of the last Lines lines of the file
+// by scanning backwards from the end, so the cost depends on the size
+// of the tail rather than the size of the file.
+//
+EFI_STATUS
+EFIAPI
+LineReaderFindTail( LINE_READER *Reader,
+                    UINT64 FileSize,
+                    UINT64 Lines,
+                    UINT64 *Offset)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    UINT8 *Chunk;
+    UINT64 Pos = FileSize;
+    UINT64 Found = 0;
+    UINTN Unit = Reader->Unicode ? sizeof(CHAR16) : 1;
+    UINTN Size;
+    UINTN i;
+
+    *Offset = Reader->BomSize;
+    if (Lines == 0) {
+        *Offset = FileSize;
+        goto Done;
+    }
+
+    Chunk = AllocatePool(Reader->BlockSize);
+    if (Chunk == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    if (Reader->InFlight) {
+        FinishRead(Reader, &Size);
+    }
+
+    if (Reader->Unicode) {
+        Pos &= ~(UINT64)1;
+    }
+
+    while (Pos > Reader->BomSize && Found < Lines) {
+        Size = (UINTN)MIN(Reader->BlockSize, Pos - Reader->BomSize);
+        Pos -= Size;
+        Status = SetFilePosition(Reader, Pos);
+        if (!EFI_ERROR(Status)) {
+            Status = ReadFile(Reader, &Size, Chunk);
+        }
+        if (EFI_ERROR(Status)) {
+            break;
+        }
+
+        for (i = Size; i >= Unit && Found < Lines; i -= Unit) {
+            if (Unit == 1) {
+                if (Chunk[i - 1] != '\n') {
+                    continue;
+                }
+            } else if (Reader->BigEndian) {
+                if (Chunk[i - 2] != 0 || Chunk[i - 1] != '\n') {
+                    continue;
+                }
+            } else if (Chunk[i - 2] != '\n' || Chunk[i - 1] != 0) {
+                continue;
+            }
+            // the line end of the final line does not start a new line
+            if (Pos + i == FileSize) {
+                continue;
+            }
+            if (++Found == Lines) {
+                *Offset = Pos + i;
+            }
+        }
+    }
+
+    FreePool(Chunk);
+
+Done:
+    // the file position has moved under the buffer, start afresh
+    Reader->DataSize = 0;
+    Reader->Position = 0;
+    if (!EFI_ERROR(Status)) {
+        Status = LineReaderSeek(Reader, *Offset);
+    }
+
+    return Status;
+}
+
+
+//
+// Build a sparse index of line start offsets in one pass over the file.
+// Only line ends are looked at; nothing is decoded.
+//
+EFI_STATUS
+EFIAPI
+LineIndexBuild( LINE_READER *Reader,
+                UINT32 Stride,
+                LINE_INDEX **Index)
+{
+    EFI_STATUS Status;
+    LINE_INDEX *New;
+    LINE_INDEX *Grown;
+    UINT64 Capacity = 1024;
+    UINT64 Base;
+    UINT8 *Data;
+    UINT8 *End;
+    UINT8 *Scan;
+    UINT8 *Nl;
+    UINTN Unit = Reader->Unicode ? sizeof(CHAR16) : 1;
+    UINTN Size;
+    BOOLEAN Partial = FALSE;
+
+    if (Stride == 0) {
+        Stride = LINE_INDEX_STRIDE;
+    }
+
+    New = AllocateZeroPool(LINE_INDEX_SIZE(Capacity));
+    if (New == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    New->Signature = LINE_INDEX_SIGNATURE;
+    New->Stride = Stride;
+
+    Status = LineReaderSeek(Reader, 0);
+    if (EFI_ERROR(Status)) {
+        FreePool(New);
+        return Status;
+    }
+    New->Offset[0] = LineReaderTell(Reader);
+    New->Count = 1;
+
+    for (;;) {
+        Status = LineReaderReadBlock(Reader, &Data, &Size);
+        if (Status == EFI_END_OF_FILE) {
+            Status = EFI_SUCCESS;
+            break;
+        }
+        if (EFI_ERROR(Status)) {
+            FreePool(New);
+            return Status;
+        }
+
+        Base = LineReaderTell(Reader) - Size;
+        End = Data + (Size & ~(Unit - 1));
+        for (Scan = Data; Scan < End; Scan = Nl + Unit) {
+            if (Unit == 1) {
+                Nl = ScanMem8(Scan, End - Scan, '\n');
+            } else {
+                Nl = ScanMem16(Scan, End - Scan, L'\n');
+            }
+            if (Nl == NULL) {
+                break;
+            }
+            New->LineCount++;
+            if (New->LineCount % Stride != 0) {
+                continue;
+            }
+            if (New->Count == Capacity) {
+                Grown = ReallocatePool( LINE_INDEX_SIZE(Capacity),
+                                        LINE_INDEX_SIZE(Capacity * 2),
+                                        New);
+                if (Grown == NULL) {
+                    FreePool(New);
+                    return EFI_OUT_OF_RESOURCES;
+                }
+                New = Grown;
+                Capacity *= 2;
+            }
+            New->Offset[New->Count++] = Base + (Nl + Unit - Data);
+        }
+        Partial = (Scan < Data + Size);
+    }
+
+    // a last line without a line end still counts
+    if (Partial) {
+        New->LineCount++;
+    }
+    // drop a checkpoint for the line after the last one
+    while (New->Count > 1 && (New->Count - 1) * Stride >= New->LineCount) {
+        New->Count--;
+    }
+    New->FileSize = LineReaderTell(Reader);
+
+    *Index = New;
+
+    return Status;
+}
+
+
+//
+// Position the reader at the start of a line (numbered from 0)
+//
+EFI_STATUS
+EFIAPI
+LineIndexSeek( LINE_READER *Reader,
+               LINE_INDEX *Index,
+               UINT64 Line)
+{
+    EFI_STATUS Status;
+    UINT64 Checkpoint;
+
+    if (Line >= Index->LineCount) {
+        return EFI_END_OF_FILE;
+    }
+
+    Checkpoint = Line / Index->Stride;
+    if (Checkpoint >= Index->Count) {
+        Checkpoint = Index->Count - 1;
+    }
+
+    Status = LineReaderSeek(Reader, Index->Offset[Checkpoint]);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    return LineReaderSkipLines(Reader, Line - Checkpoint * Index->Stride);
+}
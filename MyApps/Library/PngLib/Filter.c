@@ -0,0 +1,241 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  PNG row unfiltering for PngLib
+//
+//  Up has no dependency between bytes and is done 16 bytes at a time.
+//  Sub, Average and Paeth depend on the pixel to the left, so for 3
+//  and 4 byte pixels (RGB and RGBA, the common cases) each pixel is
+//  done as one SSE2 vector, with Paeth worked out in 16-bit lanes.
+//  Other pixel sizes use the plain byte loops.
+//
+//  License: BSD License
+//
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+
+#include <emmintrin.h>
+
+#include "PngLibInternal.h"
+
+
+#define SIMD __attribute__((target("sse2")))
+
+
+static SIMD __m128i
+LoadPixel( UINT8 *Src,
+           UINTN PixelSize)
+{
+    if (PixelSize == 4) {
+        return _mm_cvtsi32_si128((INT32)ReadUnaligned32((UINT32 *)Src));
+    }
+    return _mm_cvtsi32_si128((INT32)(ReadUnaligned16((UINT16 *)Src) | ((UINT32)Src[2] << 16)));
+}
+
+
+static SIMD VOID
+StorePixel( UINT8 *Dst,
+            __m128i Pixel,
+            UINTN PixelSize)
+{
+    UINT32 Value = (UINT32)_mm_cvtsi128_si32(Pixel);
+
+    if (PixelSize == 4) {
+        WriteUnaligned32((UINT32 *)Dst, Value);
+    } else {
+        WriteUnaligned16((UINT16 *)Dst, (UINT16)Value);
+        Dst[2] = (UINT8)(Value >> 16);
+    }
+}
+
+
+static SIMD VOID
+UnfilterUp( UINT8 *Row,
+            UINT8 *Prior,
+            UINTN Size)
+{
+    UINTN i = 0;
+
+    for (; i + 16 <= Size; i += 16) {
+        _mm_storeu_si128((__m128i *)(Row + i),
+            _mm_add_epi8(_mm_loadu_si128((__m128i *)(Row + i)),
+                         _mm_loadu_si128((__m128i *)(Prior + i))));
+    }
+    for (; i < Size; i++) {
+        Row[i] += Prior[i];
+    }
+}
+
+
+static SIMD VOID
+UnfilterSub( UINT8 *Row,
+             UINTN Size,
+             UINTN PixelSize)
+{
+    __m128i Left = _mm_setzero_si128();
+    __m128i Pixel;
+
+    for (UINTN i = 0; i < Size; i += PixelSize) {
+        Pixel = _mm_add_epi8(LoadPixel(Row + i, PixelSize), Left);
+        StorePixel(Row + i, Pixel, PixelSize);
+        Left = Pixel;
+    }
+}
+
+
+//
+// floor((a + b) / 2): pavgb rounds up, so take the carried bit back off
+//
+static SIMD VOID
+UnfilterAverage( UINT8 *Row,
+                 UINT8 *Prior,
+                 UINTN Size,
+                 UINTN PixelSize)
+{
+    __m128i One = _mm_set1_epi8(1);
+    __m128i Left = _mm_setzero_si128();
+    __m128i Up;
+    __m128i Average;
+    __m128i Pixel;
+
+    for (UINTN i = 0; i < Size; i += PixelSize) {
+        Up = LoadPixel(Prior + i, PixelSize);
+        Average = _mm_sub_epi8(_mm_avg_epu8(Left, Up),
+                               _mm_and_si128(_mm_xor_si128(Left, Up), One));
+        Pixel = _mm_add_epi8(LoadPixel(Row + i, PixelSize), Average);
+        StorePixel(Row + i, Pixel, PixelSize);
+        Left = Pixel;
+    }
+}
+
+
+static SIMD __m128i
+Abs16( __m128i Value)
+{
+    return _mm_max_epi16(Value, _mm_sub_epi16(_mm_setzero_si128(), Value));
+}
+
+
+static SIMD __m128i
+Select( __m128i Mask,
+        __m128i IfTrue,
+        __m128i IfFalse)
+{
+    return _mm_or_si128(_mm_and_si128(Mask, IfTrue), _mm_andnot_si128(Mask, IfFalse));
+}
+
+
+//
+// Predictor is whichever of left (a), up (b) and up left (c) is
+// nearest a + b - c, preferring a, then b
+//
+static SIMD VOID
+UnfilterPaeth( UINT8 *Row,
+               UINT8 *Prior,
+               UINTN Size,
+               UINTN PixelSize)
+{
+    __m128i Zero = _mm_setzero_si128();
+    __m128i A = Zero;
+    __m128i C = Zero;
+    __m128i B;
+    __m128i Pa;
+    __m128i Pb;
+    __m128i Pc;
+    __m128i Smallest;
+    __m128i Nearest;
+    __m128i Pixel;
+
+    for (UINTN i = 0; i < Size; i += PixelSize) {
+        B = _mm_unpacklo_epi8(LoadPixel(Prior + i, PixelSize), Zero);
+        Pa = _mm_sub_epi16(B, C);            // p - a
+        Pb = _mm_sub_epi16(A, C);            // p - b
+        Pc = Abs16(_mm_add_epi16(Pa, Pb));   // p - c
+        Pa = Abs16(Pa);
+        Pb = Abs16(Pb);
+        Smallest = _mm_min_epi16(Pc, _mm_min_epi16(Pa, Pb));
+        Nearest = Select(_mm_cmpeq_epi16(Smallest, Pb), B, C);
+        Nearest = Select(_mm_cmpeq_epi16(Smallest, Pa), A, Nearest);
+        Pixel = _mm_add_epi8(LoadPixel(Row + i, PixelSize), _mm_packus_epi16(Nearest, Zero));
+        StorePixel(Row + i, Pixel, PixelSize);
+        A = _mm_unpacklo_epi8(Pixel, Zero);
+        C = B;
+    }
+}
+
+
+static UINT8
+Paeth( UINT8 A,
+       UINT8 B,
+       UINT8 C)
+{
+    INTN P = (INTN)A + B - C;
+    INTN Pa = P > A ? P - A : A - P;
+    INTN Pb = P > B ? P - B : B - P;
+    INTN Pc = P > C ? P - C : C - P;
+
+    if (Pa <= Pb && Pa <= Pc) {
+        return A;
+    }
+    return (Pb <= Pc) ? B : C;
+}
+
+
+//
+// Undo the filter on one row in place.  Prior is the previous row
+// already unfiltered, all zero for the first row.
+//
+EFI_STATUS
+PngUnfilterRow( UINTN Filter,
+                UINT8 *Row,
+                UINT8 *Prior,
+                UINTN Size,
+                UINTN PixelSize)
+{
+    BOOLEAN Vector = (PixelSize == 3 || PixelSize == 4) && Size % PixelSize == 0;
+
+    switch (Filter) {
+    case PNG_FILTER_NONE:
+        break;
+    case PNG_FILTER_UP:
+        UnfilterUp(Row, Prior, Size);
+        break;
+    case PNG_FILTER_SUB:
+        if (Vector) {
+            UnfilterSub(Row, Size, PixelSize);
+            break;
+        }
+        for (UINTN i = PixelSize; i < Size; i++) {
+            Row[i] += Row[i - PixelSize];
+        }
+        break;
+    case PNG_FILTER_AVERAGE:
+        if (Vector) {
+            UnfilterAverage(Row, Prior, Size, PixelSize);
+            break;
+        }
+        for (UINTN i = 0; i < Size; i++) {
+            Row[i] += (UINT8)(((i >= PixelSize ? Row[i - PixelSize] : 0) + Prior[i]) >> 1);
+        }
+        break;
+    case PNG_FILTER_PAETH:
+        if (Vector) {
+            UnfilterPaeth(Row, Prior, Size, PixelSize);
+            break;
+        }
+        for (UINTN i = 0; i < Size; i++) {
+            if (i < PixelSize) {
+                Row[i] += Prior[i];
+            } else {
+                Row[i] += Paeth(Row[i - PixelSize], Prior[i], Prior[i - PixelSize]);
+            }
+        }
+        break;
+    default:
+        return EFI_VOLUME_CORRUPTED;
+    }
+
+    return EFI_SUCCESS;
+}
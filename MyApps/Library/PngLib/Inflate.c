@@ -0,0 +1,469 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Streaming inflate (RFC 1950 and RFC 1951) for PngLib
+//
+//  Output is produced on demand, a PNG row at a time, so the decoder
+//  can stop anywhere: inside a stored block, between Huffman symbols
+//  or part way through a match.  Input bits are kept in a 64-bit
+//  buffer that is topped up from the IDAT chunks before each symbol,
+//  so one symbol with its extra bits never needs a second refill.
+//  Codes of up to PNG_FAST_BITS bits are decoded with one table
+//  lookup and longer ones canonically, a bit at a time.
+//
+//  License: BSD License
+//
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+
+#include "PngLibInternal.h"
+
+
+#define INFLATE_HEADER     0         // next is a block header
+#define INFLATE_STORED     1
+#define INFLATE_CODES      2
+#define INFLATE_DONE       3
+
+#define WINDOW_MASK        (PNG_WINDOW_SIZE - 1)
+#define FAST_MASK          ((1 << PNG_FAST_BITS) - 1)
+#define MAX_CODE_BITS      15
+
+static CONST UINT16 mLengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static CONST UINT8 mLengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static CONST UINT16 mDistanceBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577 };
+static CONST UINT8 mDistanceExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// order code length code lengths are stored in
+static CONST UINT8 mLengthOrder[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+
+//
+// Top the bit buffer up to at least 57 bits.  Past the end of the
+// data zero bytes are added and counted, so a stream that is cut short
+// is caught by CheckOverrun rather than read out of bounds.
+//
+static VOID
+Refill( PNG_DECODER *Png)
+{
+    INTN Byte;
+
+    while (Png->BitCount <= 56) {
+        if (Png->IdatLeft > 0 && Png->InPos < Png->InEnd) {
+            Png->IdatLeft--;
+            Byte = Png->In[Png->InPos++];
+        } else {
+            Byte = PngStreamByte(Png);
+            if (Byte < 0) {
+                Png->Overrun++;
+                Byte = 0;
+            }
+        }
+        Png->BitBuf |= (UINT64)Byte << Png->BitCount;
+        Png->BitCount += 8;
+    }
+}
+
+
+static BOOLEAN
+CheckOverrun( PNG_DECODER *Png)
+{
+    return Png->Overrun > 0 && Png->BitCount < Png->Overrun * 8;
+}
+
+
+static UINTN
+GetBits( PNG_DECODER *Png,
+         UINTN Count)
+{
+    UINTN Bits;
+
+    if (Png->BitCount < Count) {
+        Refill(Png);
+    }
+    Bits = (UINTN)(Png->BitBuf & ((1ULL << Count) - 1));
+    Png->BitBuf >>= Count;
+    Png->BitCount -= Count;
+
+    return Bits;
+}
+
+
+//
+// Build the decoding tables from code lengths.  Incomplete codes are
+// allowed (a single distance code is legal); over subscribed ones are
+// not.
+//
+static EFI_STATUS
+BuildHuffman( PNG_HUFFMAN *Huffman,
+              CONST UINT8 *Lengths,
+              UINTN Count)
+{
+    UINT16 Offset[MAX_CODE_BITS + 1];
+    UINT16 NextCode[MAX_CODE_BITS + 1];
+    INTN   Left = 1;
+    UINTN  Code;
+    UINTN  Reversed;
+    UINTN  Length;
+
+    ZeroMem(Huffman->Count, sizeof(Huffman->Count));
+    for (UINTN i = 0; i < Count; i++) {
+        Huffman->Count[Lengths[i]]++;
+    }
+    Huffman->Count[0] = 0;
+
+    for (Length = 1; Length <= MAX_CODE_BITS; Length++) {
+        Left = (Left << 1) - Huffman->Count[Length];
+        if (Left < 0) {
+            return EFI_VOLUME_CORRUPTED;
+        }
+    }
+
+    Offset[1] = 0;
+    NextCode[1] = 0;
+    for (Length = 1; Length < MAX_CODE_BITS; Length++) {
+        Offset[Length + 1] = Offset[Length] + Huffman->Count[Length];
+        NextCode[Length + 1] = (NextCode[Length] + Huffman->Count[Length]) << 1;
+    }
+
+    ZeroMem(Huffman->Fast, sizeof(Huffman->Fast));
+    for (UINTN Symbol = 0; Symbol < Count; Symbol++) {
+        Length = Lengths[Symbol];
+        if (Length == 0) {
+            continue;
+        }
+        Huffman->Symbol[Offset[Length]++] = (UINT16)Symbol;
+        Code = NextCode[Length]++;
+        if (Length > PNG_FAST_BITS) {
+            continue;
+        }
+        // codes are sent most significant bit first
+        Reversed = 0;
+        for (UINTN i = 0; i < Length; i++) {
+            Reversed = (Reversed << 1) | ((Code >> i) & 1);
+        }
+        for (UINTN i = Reversed; i < (1 << PNG_FAST_BITS); i += (UINTN)1 << Length) {
+            Huffman->Fast[i] = (UINT16)((Symbol << 4) | Length);
+        }
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Next symbol, or -1 for a code that is not in the table.  The caller
+// has made sure there are at least MAX_CODE_BITS bits buffered.
+//
+static INTN
+DecodeSymbol( PNG_DECODER *Png,
+              PNG_HUFFMAN *Huffman)
+{
+    UINTN Entry = Huffman->Fast[Png->BitBuf & FAST_MASK];
+    UINTN Code = 0;
+    UINTN First = 0;
+    UINTN Index = 0;
+    UINTN Count;
+
+    if (Entry != 0) {
+        Png->BitBuf >>= Entry & 15;
+        Png->BitCount -= Entry & 15;
+        return Entry >> 4;
+    }
+
+    for (UINTN Length = 1; Length <= MAX_CODE_BITS; Length++) {
+        Code |= (UINTN)(Png->BitBuf >> (Length - 1)) & 1;
+        Count = Huffman->Count[Length];
+        if (Code < First + Count) {
+            Png->BitBuf >>= Length;
+            Png->BitCount -= Length;
+            return Huffman->Symbol[Index + Code - First];
+        }
+        Index += Count;
+        First = (First + Count) << 1;
+        Code <<= 1;
+    }
+
+    return -1;
+}
+
+
+static EFI_STATUS
+FixedTables( PNG_DECODER *Png)
+{
+    UINT8 Lengths[288];
+    EFI_STATUS Status;
+
+    SetMem(Lengths, 144, 8);
+    SetMem(Lengths + 144, 112, 9);
+    SetMem(Lengths + 256, 24, 7);
+    SetMem(Lengths + 280, 8, 8);
+    Status = BuildHuffman(&Png->Lit, Lengths, 288);
+    if (!EFI_ERROR(Status)) {
+        SetMem(Lengths, 30, 5);
+        Status = BuildHuffman(&Png->Dist, Lengths, 30);
+    }
+
+    return Status;
+}
+
+
+static EFI_STATUS
+DynamicTables( PNG_DECODER *Png)
+{
+    UINT8 Lengths[288 + 32];
+    EFI_STATUS Status;
+    UINTN LitCount;
+    UINTN DistCount;
+    UINTN CodeCount;
+    UINTN Repeat;
+    UINT8 Value;
+    INTN  Symbol;
+
+    LitCount = GetBits(Png, 5) + 257;
+    DistCount = GetBits(Png, 5) + 1;
+    CodeCount = GetBits(Png, 4) + 4;
+    if (LitCount > 286 || DistCount > 30) {
+        return EFI_VOLUME_CORRUPTED;
+    }
+
+    // the code length code, in the lit/len table for now
+    ZeroMem(Lengths, 19);
+    for (UINTN i = 0; i < CodeCount; i++) {
+        Lengths[mLengthOrder[i]] = (UINT8)GetBits(Png, 3);
+    }
+    Status = BuildHuffman(&Png->Lit, Lengths, 19);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    for (UINTN i = 0; i < LitCount + DistCount; ) {
+        Refill(Png);
+        Symbol = DecodeSymbol(Png, &Png->Lit);
+        if (Symbol < 0 || CheckOverrun(Png)) {
+            return EFI_VOLUME_CORRUPTED;
+        }
+        if (Symbol < 16) {
+            Lengths[i++] = (UINT8)Symbol;
+            continue;
+        }
+        if (Symbol == 16) {
+            if (i == 0) {
+                return EFI_VOLUME_CORRUPTED;
+            }
+            Value = Lengths[i - 1];
+            Repeat = 3 + GetBits(Png, 2);
+        } else if (Symbol == 17) {
+            Value = 0;
+            Repeat = 3 + GetBits(Png, 3);
+        } else {
+            Value = 0;
+            Repeat = 11 + GetBits(Png, 7);
+        }
+        if (i + Repeat > LitCount + DistCount) {
+            return EFI_VOLUME_CORRUPTED;
+        }
+        SetMem(Lengths + i, Repeat, Value);
+        i += Repeat;
+    }
+
+    // a block has to be able to end
+    if (Lengths[256] == 0) {
+        return EFI_VOLUME_CORRUPTED;
+    }
+
+    Status = BuildHuffman(&Png->Lit, Lengths, LitCount);
+    if (!EFI_ERROR(Status)) {
+        Status = BuildHuffman(&Png->Dist, Lengths + LitCount, DistCount);
+    }
+
+    return Status;
+}
+
+
+static EFI_STATUS
+BlockHeader( PNG_DECODER *Png)
+{
+    UINTN Length;
+    UINTN Type;
+
+    Png->Final = (BOOLEAN)GetBits(Png, 1);
+    Type = GetBits(Png, 2);
+
+    switch (Type) {
+    case 0:
+        // stored blocks start on a byte boundary
+        GetBits(Png, Png->BitCount & 7);
+        Length = GetBits(Png, 16);
+        if ((GetBits(Png, 16) ^ 0xFFFF) != Length) {
+            return EFI_VOLUME_CORRUPTED;
+        }
+        Png->StoredLeft = Length;
+        Png->State = INFLATE_STORED;
+        break;
+    case 1:
+        Png->State = INFLATE_CODES;
+        return FixedTables(Png);
+    case 2:
+        Png->State = INFLATE_CODES;
+        return DynamicTables(Png);
+    default:
+        return EFI_VOLUME_CORRUPTED;
+    }
+
+    return CheckOverrun(Png) ? EFI_VOLUME_CORRUPTED : EFI_SUCCESS;
+}
+
+
+//
+// Check the zlib header that starts the IDAT data
+//
+EFI_STATUS
+PngInflateInit( PNG_DECODER *Png)
+{
+    UINTN Cmf = GetBits(Png, 8);
+    UINTN Flg = GetBits(Png, 8);
+
+    // deflate, window of at most 32K, no preset dictionary
+    if ((Cmf & 0x0F) != 8 || (Cmf >> 4) > 7 ||
+        ((Cmf << 8) | Flg) % 31 != 0 || (Flg & 0x20) != 0 ||
+        CheckOverrun(Png)) {
+        return EFI_VOLUME_CORRUPTED;
+    }
+    Png->State = INFLATE_HEADER;
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Inflate exactly Size bytes into Out
+//
+EFI_STATUS
+PngInflate( PNG_DECODER *Png,
+            UINT8 *Out,
+            UINTN Size)
+{
+    EFI_STATUS Status;
+    UINT8 *Window = Png->Window;
+    UINTN Pos = Png->WindowPos;
+    UINTN Done = 0;
+    UINTN Count;
+    UINTN Length;
+    UINTN Distance;
+    INTN  Symbol;
+    UINT8 Byte;
+
+    while (Done < Size) {
+        // finish a match first
+        if (Png->CopyLeft > 0) {
+            Count = MIN(Png->CopyLeft, Size - Done);
+            Distance = Png->CopyDistance;
+            for (UINTN i = 0; i < Count; i++) {
+                Byte = Window[(Pos - Distance) & WINDOW_MASK];
+                Window[Pos++ & WINDOW_MASK] = Byte;
+                Out[Done++] = Byte;
+            }
+            Png->CopyLeft -= Count;
+            continue;
+        }
+
+        switch (Png->State) {
+        case INFLATE_HEADER:
+            if (Png->Final) {
+                Png->State = INFLATE_DONE;
+                break;
+            }
+            Status = BlockHeader(Png);
+            if (EFI_ERROR(Status)) {
+                Png->State = INFLATE_DONE;
+                Png->WindowPos = Pos;
+                return Status;
+            }
+            break;
+
+        case INFLATE_STORED:
+            Count = MIN(Png->StoredLeft, Size - Done);
+            for (UINTN i = 0; i < Count; i++) {
+                Byte = (UINT8)GetBits(Png, 8);
+                Window[Pos++ & WINDOW_MASK] = Byte;
+                Out[Done++] = Byte;
+            }
+            Png->StoredLeft -= Count;
+            if (Png->StoredLeft == 0) {
+                Png->State = INFLATE_HEADER;
+            }
+            if (CheckOverrun(Png)) {
+                Png->State = INFLATE_DONE;
+            }
+            break;
+
+        case INFLATE_CODES:
+            while (Done < Size) {
+                if (Png->BitCount < 48) {
+                    Refill(Png);
+                }
+                if (CheckOverrun(Png)) {
+                    Png->State = INFLATE_DONE;
+                    break;
+                }
+                Symbol = DecodeSymbol(Png, &Png->Lit);
+                if (Symbol < 256) {
+                    if (Symbol < 0) {
+                        Png->State = INFLATE_DONE;
+                        break;
+                    }
+                    Window[Pos++ & WINDOW_MASK] = (UINT8)Symbol;
+                    Out[Done++] = (UINT8)Symbol;
+                    continue;
+                }
+                if (Symbol == 256) {
+                    Png->State = INFLATE_HEADER;
+                    break;
+                }
+
+                // a match: at most 48 bits with its extra bits
+                Symbol -= 257;
+                if (Symbol >= 29) {
+                    Png->State = INFLATE_DONE;
+                    break;
+                }
+                Length = mLengthBase[Symbol] + GetBits(Png, mLengthExtra[Symbol]);
+                Symbol = DecodeSymbol(Png, &Png->Dist);
+                if (Symbol < 0 || Symbol >= 30) {
+                    Png->State = INFLATE_DONE;
+                    break;
+                }
+                Distance = mDistanceBase[Symbol] + GetBits(Png, mDistanceExtra[Symbol]);
+                if (Distance > Pos) {
+                    Png->State = INFLATE_DONE;
+                    break;
+                }
+                Png->CopyLeft = Length;
+                Png->CopyDistance = Distance;
+                break;
+            }
+            break;
+
+        default:
+            // data ended, or was corrupt, before the image was complete
+            Png->WindowPos = Pos;
+            return EFI_VOLUME_CORRUPTED;
+        }
+    }
+
+    Png->WindowPos = Pos;
+
+    return EFI_SUCCESS;
+}
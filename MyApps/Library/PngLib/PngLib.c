@@ -0,0 +1,582 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Streaming PNG image decoding to GOP BLT pixels
+//
+//  The file is read through a callback in PNG_INPUT_SIZE pieces and
+//  rows are decoded one at a time, top down, so memory use is the
+//  input buffer, the 32K inflate window and two rows whatever the
+//  size of the image.  Grey, RGB and palette images with or without
+//  alpha are supported at all bit depths; interlaced images are not.
+//  Alpha is applied against black, the colour of a cleared screen.
+//  Chunk CRCs and the zlib Adler-32 are not checked; damaged data is
+//  caught by the inflate checks instead.
+//
+//  License: BSD License
+//
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+#include "PngLibInternal.h"
+
+
+#define PNG_CHUNK_IHDR     SIGNATURE_32('I', 'H', 'D', 'R')
+#define PNG_CHUNK_PLTE     SIGNATURE_32('P', 'L', 'T', 'E')
+#define PNG_CHUNK_TRNS     SIGNATURE_32('t', 'R', 'N', 'S')
+#define PNG_CHUNK_IDAT     SIGNATURE_32('I', 'D', 'A', 'T')
+#define PNG_CHUNK_IEND     SIGNATURE_32('I', 'E', 'N', 'D')
+
+#define PNG_IHDR_SIZE      13
+#define PNG_MAX_CHUNK      0x7FFFFFFF
+
+static CONST UINT8 mPngSignature[PNG_SIGNATURE_SIZE] = {
+    0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+
+BOOLEAN
+EFIAPI
+PngIsImage( VOID *Data,
+            UINTN Size)
+{
+    return Size >= PNG_SIGNATURE_SIZE &&
+           CompareMem(Data, mPngSignature, PNG_SIGNATURE_SIZE) == 0;
+}
+
+
+static EFI_STATUS
+FillInput( PNG_DECODER *Png)
+{
+    EFI_STATUS Status;
+    UINTN Size = PNG_INPUT_SIZE;
+
+    Status = Png->Read(Png->Context, Png->In, &Size);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    if (Size == 0) {
+        return EFI_END_OF_FILE;
+    }
+    Png->InPos = 0;
+    Png->InEnd = Size;
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Copy the next Size bytes of the file to Buffer, or skip them if
+// Buffer is NULL
+//
+static EFI_STATUS
+ReadInput( PNG_DECODER *Png,
+           VOID *Buffer,
+           UINTN Size)
+{
+    EFI_STATUS Status;
+    UINTN Count;
+
+    while (Size > 0) {
+        if (Png->InPos == Png->InEnd) {
+            Status = FillInput(Png);
+            if (EFI_ERROR(Status)) {
+                return Status;
+            }
+        }
+        Count = MIN(Size, Png->InEnd - Png->InPos);
+        if (Buffer != NULL) {
+            CopyMem(Buffer, Png->In + Png->InPos, Count);
+            Buffer = (UINT8 *)Buffer + Count;
+        }
+        Png->InPos += Count;
+        Size -= Count;
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+static UINT32
+ReadBigEndian32( UINT8 *Data)
+{
+    return SwapBytes32(ReadUnaligned32((UINT32 *)Data));
+}
+
+
+static EFI_STATUS
+ReadChunkHeader( PNG_DECODER *Png,
+                 UINT32 *Length,
+                 UINT32 *Type)
+{
+    EFI_STATUS Status;
+    UINT8 Header[8];
+
+    Status = ReadInput(Png, Header, sizeof(Header));
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    *Length = ReadBigEndian32(Header);
+    *Type = ReadUnaligned32((UINT32 *)(Header + 4));
+
+    return (*Length > PNG_MAX_CHUNK) ? EFI_VOLUME_CORRUPTED : EFI_SUCCESS;
+}
+
+
+//
+// Move on to the next IDAT chunk, skipping the CRC of the current one
+//
+static EFI_STATUS
+NextIdat( PNG_DECODER *Png)
+{
+    EFI_STATUS Status;
+    UINT32 Length;
+    UINT32 Type;
+
+    Status = ReadInput(Png, NULL, 4);
+    if (!EFI_ERROR(Status)) {
+        Status = ReadChunkHeader(Png, &Length, &Type);
+    }
+    if (EFI_ERROR(Status) || Type != PNG_CHUNK_IDAT) {
+        return EFI_END_OF_FILE;
+    }
+    Png->IdatLeft = Length;
+
+    return EFI_SUCCESS;
+}
+
+
+INTN
+PngStreamByte( PNG_DECODER *Png)
+{
+    while (Png->IdatLeft == 0) {
+        if (Png->IdatDone || EFI_ERROR(NextIdat(Png))) {
+            Png->IdatDone = TRUE;
+            return -1;
+        }
+    }
+    if (Png->InPos == Png->InEnd && EFI_ERROR(FillInput(Png))) {
+        Png->IdatDone = TRUE;
+        Png->IdatLeft = 0;
+        return -1;
+    }
+    Png->IdatLeft--;
+
+    return Png->In[Png->InPos++];
+}
+
+
+static EFI_STATUS
+ParseHeader( PNG_DECODER *Png,
+             UINT8 *Ihdr)
+{
+    UINTN BitsPerPixel;
+
+    Png->Width = ReadBigEndian32(Ihdr);
+    Png->Height = ReadBigEndian32(Ihdr + 4);
+    Png->BitDepth = Ihdr[8];
+    Png->ColorType = Ihdr[9];
+    Png->Interlace = Ihdr[12];
+
+    // compression and filter methods 0 are the only ones defined
+    if (Png->Width == 0 || Png->Height == 0 || Png->Width > PNG_MAX_CHUNK ||
+        Png->Height > PNG_MAX_CHUNK || Ihdr[10] != 0 || Ihdr[11] != 0 ||
+        Png->Interlace > 1) {
+        return EFI_VOLUME_CORRUPTED;
+    }
+
+    switch (Png->ColorType) {
+    case PNG_COLOR_GRAY:
+        Png->Channels = 1;
+        if (Png->BitDepth != 1 && Png->BitDepth != 2 && Png->BitDepth != 4 &&
+            Png->BitDepth != 8 && Png->BitDepth != 16) {
+            return EFI_VOLUME_CORRUPTED;
+        }
+        break;
+    case PNG_COLOR_PALETTE:
+        Png->Channels = 1;
+        if (Png->BitDepth != 1 && Png->BitDepth != 2 && Png->BitDepth != 4 &&
+            Png->BitDepth != 8) {
+            return EFI_VOLUME_CORRUPTED;
+        }
+        break;
+    case PNG_COLOR_RGB:
+    case PNG_COLOR_GRAY_ALPHA:
+    case PNG_COLOR_RGBA:
+        Png->Channels = (Png->ColorType == PNG_COLOR_RGB) ? 3 :
+                        (Png->ColorType == PNG_COLOR_RGBA) ? 4 : 2;
+        if (Png->BitDepth != 8 && Png->BitDepth != 16) {
+            return EFI_VOLUME_CORRUPTED;
+        }
+        break;
+    default:
+        return EFI_VOLUME_CORRUPTED;
+    }
+
+    BitsPerPixel = Png->Channels * Png->BitDepth;
+    Png->PixelSize = MAX(BitsPerPixel / 8, 1);
+    Png->RowSize = (UINTN)(((UINT64)Png->Width * BitsPerPixel + 7) / 8);
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Grey levels for grey images of 8 bits or less, spread over 0 to 255
+//
+static VOID
+BuildGreyLut( PNG_DECODER *Png)
+{
+    UINTN Levels = (1 << Png->BitDepth) - 1;
+    UINT8 Grey;
+
+    for (UINTN i = 0; i <= Levels; i++) {
+        Grey = (UINT8)(i * 255 / Levels);
+        Png->Lut[i].Blue = Grey;
+        Png->Lut[i].Green = Grey;
+        Png->Lut[i].Red = Grey;
+        Png->Lut[i].Reserved = 0;
+    }
+    if (Png->HasTransparent && Png->Transparent[0] <= Levels) {
+        ZeroMem(&Png->Lut[Png->Transparent[0]], sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+    }
+}
+
+
+// Colour * Alpha / 255, rounded
+static UINT8
+MulAlpha( UINT32 Colour,
+          UINT32 Alpha)
+{
+    UINT32 Value = Colour * Alpha + 128;
+
+    return (UINT8)((Value + (Value >> 8)) >> 8);
+}
+
+
+static EFI_STATUS
+ReadPalette( PNG_DECODER *Png,
+             UINT32 Length)
+{
+    EFI_STATUS Status;
+    UINT8 Palette[256 * 3];
+
+    if (Length % 3 != 0 || Length > sizeof(Palette)) {
+        return EFI_VOLUME_CORRUPTED;
+    }
+    Status = ReadInput(Png, Palette, Length);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    Png->PaletteSize = Length / 3;
+    for (UINTN i = 0; i < Png->PaletteSize; i++) {
+        Png->Lut[i].Red = Palette[i * 3];
+        Png->Lut[i].Green = Palette[i * 3 + 1];
+        Png->Lut[i].Blue = Palette[i * 3 + 2];
+        Png->Lut[i].Reserved = 0;
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+static EFI_STATUS
+ReadTransparency( PNG_DECODER *Png,
+                  UINT32 Length)
+{
+    EFI_STATUS Status;
+    UINT8 Alpha[256];
+
+    if (Length > sizeof(Alpha)) {
+        return EFI_VOLUME_CORRUPTED;
+    }
+    Status = ReadInput(Png, Alpha, Length);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    if (Png->ColorType == PNG_COLOR_PALETTE) {
+        for (UINTN i = 0; i < Length && i < Png->PaletteSize; i++) {
+            Png->Lut[i].Red = MulAlpha(Png->Lut[i].Red, Alpha[i]);
+            Png->Lut[i].Green = MulAlpha(Png->Lut[i].Green, Alpha[i]);
+            Png->Lut[i].Blue = MulAlpha(Png->Lut[i].Blue, Alpha[i]);
+        }
+    } else if ((Png->ColorType == PNG_COLOR_GRAY && Length == 2) ||
+               (Png->ColorType == PNG_COLOR_RGB && Length == 6)) {
+        Png->HasTransparent = TRUE;
+        for (UINTN i = 0; i < Length / 2; i++) {
+            Png->Transparent[i] = (UINT16)((Alpha[i * 2] << 8) | Alpha[i * 2 + 1]);
+        }
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Read the chunks up to the first IDAT.  Everything but the image
+// header, palette and transparency is skipped.
+//
+EFI_STATUS
+EFIAPI
+PngOpen( PNG_READ_FUNCTION Read,
+         VOID *Context,
+         PNG_DECODER **Decoder)
+{
+    EFI_STATUS Status;
+    PNG_DECODER *Png;
+    UINT8 Header[PNG_IHDR_SIZE];
+    UINT32 Length;
+    UINT32 Type;
+    BOOLEAN SeenHeader = FALSE;
+
+    Png = AllocateZeroPool(sizeof(PNG_DECODER));
+    if (Png == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    Png->Read = Read;
+    Png->Context = Context;
+    Png->In = AllocatePool(PNG_INPUT_SIZE);
+    Png->Window = AllocatePool(PNG_WINDOW_SIZE);
+    if (Png->In == NULL || Png->Window == NULL) {
+        Status = EFI_OUT_OF_RESOURCES;
+        goto Error;
+    }
+
+    Status = ReadInput(Png, Header, PNG_SIGNATURE_SIZE);
+    if (EFI_ERROR(Status) || !PngIsImage(Header, PNG_SIGNATURE_SIZE)) {
+        Status = EFI_UNSUPPORTED;
+        goto Error;
+    }
+
+    for (;;) {
+        Status = ReadChunkHeader(Png, &Length, &Type);
+        if (EFI_ERROR(Status)) {
+            goto Error;
+        }
+        if (!SeenHeader && Type != PNG_CHUNK_IHDR) {
+            Status = EFI_VOLUME_CORRUPTED;
+            goto Error;
+        }
+        if (Type == PNG_CHUNK_IDAT) {
+            Png->IdatLeft = Length;
+            break;
+        }
+
+        if (Type == PNG_CHUNK_IHDR) {
+            if (SeenHeader || Length != PNG_IHDR_SIZE) {
+                Status = EFI_VOLUME_CORRUPTED;
+                goto Error;
+            }
+            Status = ReadInput(Png, Header, PNG_IHDR_SIZE);
+            if (!EFI_ERROR(Status)) {
+                Status = ParseHeader(Png, Header);
+            }
+            SeenHeader = TRUE;
+        } else if (Type == PNG_CHUNK_PLTE) {
+            Status = ReadPalette(Png, Length);
+        } else if (Type == PNG_CHUNK_TRNS) {
+            Status = ReadTransparency(Png, Length);
+        } else if (Type == PNG_CHUNK_IEND) {
+            Status = EFI_VOLUME_CORRUPTED;
+        } else {
+            Status = ReadInput(Png, NULL, Length);
+        }
+        // and the CRC
+        if (!EFI_ERROR(Status)) {
+            Status = ReadInput(Png, NULL, 4);
+        }
+        if (EFI_ERROR(Status)) {
+            goto Error;
+        }
+    }
+
+    if (Png->Interlace != 0) {
+        Status = EFI_UNSUPPORTED;
+        goto Error;
+    }
+    if (Png->ColorType == PNG_COLOR_PALETTE && Png->PaletteSize == 0) {
+        Status = EFI_VOLUME_CORRUPTED;
+        goto Error;
+    }
+    if (Png->ColorType == PNG_COLOR_GRAY && Png->BitDepth <= 8) {
+        BuildGreyLut(Png);
+    }
+
+    Png->Current = AllocatePool(Png->RowSize + 1);
+    Png->Prior = AllocateZeroPool(Png->RowSize + 1);
+    if (Png->Current == NULL || Png->Prior == NULL) {
+        Status = EFI_OUT_OF_RESOURCES;
+        goto Error;
+    }
+
+    Status = PngInflateInit(Png);
+    if (EFI_ERROR(Status)) {
+        goto Error;
+    }
+
+    *Decoder = Png;
+
+    return EFI_SUCCESS;
+
+Error:
+    PngClose(Png);
+    return Status;
+}
+
+
+VOID
+EFIAPI
+PngClose( PNG_DECODER *Png)
+{
+    if (Png == NULL) {
+        return;
+    }
+    if (Png->In != NULL) {
+        FreePool(Png->In);
+    }
+    if (Png->Window != NULL) {
+        FreePool(Png->Window);
+    }
+    if (Png->Current != NULL) {
+        FreePool(Png->Current);
+    }
+    if (Png->Prior != NULL) {
+        FreePool(Png->Prior);
+    }
+    FreePool(Png);
+}
+
+
+//
+// Palette indexes or grey levels of 1, 2, 4 or 8 bits
+//
+static VOID
+ConvertIndexed( PNG_DECODER *Png,
+                UINT8 *Src,
+                EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Dst)
+{
+    UINT32 *Lut = (UINT32 *)Png->Lut;
+    UINT32 *Out = (UINT32 *)Dst;
+    UINTN Depth = Png->BitDepth;
+    UINTN Mask = (1 << Depth) - 1;
+    UINTN Shift;
+
+    if (Depth == 8) {
+        for (UINTN x = 0; x < Png->Width; x++) {
+            Out[x] = Lut[Src[x]];
+        }
+        return;
+    }
+
+    // samples are packed from the most significant bit
+    for (UINTN x = 0; x < Png->Width; x++) {
+        Shift = 8 - Depth - (x * Depth) % 8;
+        Out[x] = Lut[(Src[(x * Depth) / 8] >> Shift) & Mask];
+    }
+}
+
+
+//
+// Grey or RGB, with or without alpha, 8 or 16 bits per sample.  Only
+// the high byte of 16-bit samples is used.
+//
+static VOID
+ConvertDirect( PNG_DECODER *Png,
+               UINT8 *Src,
+               EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Dst)
+{
+    UINTN Step = Png->BitDepth / 8;
+    UINTN Channels = Png->Channels;
+    BOOLEAN Colour = (Channels >= 3);
+    BOOLEAN Alpha = (Channels == 2 || Channels == 4);
+    UINT8 *Pixel;
+    UINT8 Red;
+    UINT8 Green;
+    UINT8 Blue;
+    UINT8 A;
+    UINT16 Sample;
+    BOOLEAN Match;
+
+    // the common case
+    if (Channels == 3 && Step == 1 && !Png->HasTransparent) {
+        for (UINTN x = 0; x < Png->Width; x++, Src += 3) {
+            Dst[x].Blue = Src[2];
+            Dst[x].Green = Src[1];
+            Dst[x].Red = Src[0];
+            Dst[x].Reserved = 0;
+        }
+        return;
+    }
+
+    for (UINTN x = 0; x < Png->Width; x++) {
+        Pixel = Src + x * Channels * Step;
+        Red = Pixel[0];
+        Green = Colour ? Pixel[Step] : Red;
+        Blue = Colour ? Pixel[2 * Step] : Red;
+        if (Alpha) {
+            A = Pixel[(Channels - 1) * Step];
+            Red = MulAlpha(Red, A);
+            Green = MulAlpha(Green, A);
+            Blue = MulAlpha(Blue, A);
+        } else if (Png->HasTransparent) {
+            Match = TRUE;
+            for (UINTN c = 0; c < Channels; c++) {
+                Sample = (Step == 2) ? (UINT16)((Pixel[c * 2] << 8) | Pixel[c * 2 + 1]) : Pixel[c];
+                Match = Match && (Sample == Png->Transparent[c]);
+            }
+            if (Match) {
+                Red = Green = Blue = 0;
+            }
+        }
+        Dst[x].Blue = Blue;
+        Dst[x].Green = Green;
+        Dst[x].Red = Red;
+        Dst[x].Reserved = 0;
+    }
+}
+
+
+//
+// Decode the next row, top down, into Width BLT pixels
+//
+EFI_STATUS
+EFIAPI
+PngDecodeRow( PNG_DECODER *Png,
+              EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Row)
+{
+    EFI_STATUS Status;
+    UINT8 *Swap;
+
+    if (Png->NextRow >= Png->Height) {
+        return EFI_END_OF_FILE;
+    }
+
+    Status = PngInflate(Png, Png->Current, Png->RowSize + 1);
+    if (!EFI_ERROR(Status)) {
+        Status = PngUnfilterRow( Png->Current[0],
+                                 Png->Current + 1,
+                                 Png->Prior + 1,
+                                 Png->RowSize,
+                                 Png->PixelSize);
+    }
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    if (Png->ColorType == PNG_COLOR_PALETTE ||
+        (Png->ColorType == PNG_COLOR_GRAY && Png->BitDepth <= 8)) {
+        ConvertIndexed(Png, Png->Current + 1, Row);
+    } else {
+        ConvertDirect(Png, Png->Current + 1, Row);
+    }
+
+    Swap = Png->Prior;
+    Png->Prior = Png->Current;
+    Png->Current = Swap;
+    Png->NextRow++;
+
+    return EFI_SUCCESS;
+}
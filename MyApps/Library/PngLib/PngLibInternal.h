@@ -0,0 +1,40 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Streaming PNG image decoding to GOP BLT pixels
+//
+//  License: BSD License
+//
+
+#ifndef __PNG_LIB_INTERNAL_H__
+#define __PNG_LIB_INTERNAL_H__
+
+#include <Uefi.h>
+#include <Library/PngLib.h>
+
+#define PNG_FILTER_NONE        0
+#define PNG_FILTER_SUB         1
+#define PNG_FILTER_UP          2
+#define PNG_FILTER_AVERAGE     3
+#define PNG_FILTER_PAETH       4
+
+// next byte of the zlib stream, or -1 at the end of the IDAT data
+INTN
+PngStreamByte( PNG_DECODER *Png);
+
+EFI_STATUS
+PngInflateInit( PNG_DECODER *Png);
+
+EFI_STATUS
+PngInflate( PNG_DECODER *Png,
+            UINT8 *Out,
+            UINTN Size);
+
+EFI_STATUS
+PngUnfilterRow( UINTN Filter,
+                UINT8 *Row,
+                UINT8 *Prior,
+                UINTN Size,
+                UINTN PixelSize);
+
+#endif
@@ -0,0 +1,98 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  TimerLib instance for shell applications based on the TSC.
+//
+//  The TSC frequency is measured against Boot Services Stall() the first
+//  time it is needed, so applications that never ask for a time pay
+//  nothing at load time.
+//
+//  License: BSD License
+//
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/TimerLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+
+#define CALIBRATE_STALL_US   10000
+
+static UINT64 mTscFrequency = 0;
+
+
+static UINT64
+TscFrequency( VOID)
+{
+    UINT64 Start;
+
+    if (mTscFrequency == 0) {
+        Start = AsmReadTsc();
+        gBS->Stall(CALIBRATE_STALL_US);
+        mTscFrequency = MultU64x32(AsmReadTsc() - Start, 1000000 / CALIBRATE_STALL_US);
+        if (mTscFrequency == 0) {
+            mTscFrequency = 1;
+        }
+    }
+
+    return mTscFrequency;
+}
+
+
+UINTN
+EFIAPI
+MicroSecondDelay( UINTN MicroSeconds)
+{
+    gBS->Stall(MicroSeconds);
+
+    return MicroSeconds;
+}
+
+
+UINTN
+EFIAPI
+NanoSecondDelay( UINTN NanoSeconds)
+{
+    gBS->Stall((NanoSeconds + 999) / 1000);
+
+    return NanoSeconds;
+}
+
+
+UINT64
+EFIAPI
+GetPerformanceCounter( VOID)
+{
+    return AsmReadTsc();
+}
+
+
+UINT64
+EFIAPI
+GetPerformanceCounterProperties( UINT64 *StartValue,
+                                 UINT64 *EndValue)
+{
+    if (StartValue != NULL) {
+        *StartValue = 0;
+    }
+    if (EndValue != NULL) {
+        *EndValue = (UINT64)-1;
+    }
+
+    return TscFrequency();
+}
+
+
+UINT64
+EFIAPI
+GetTimeInNanoSecond( UINT64 Ticks)
+{
+    UINT64 Frequency = TscFrequency();
+    UINT64 Remainder;
+    UINT64 NanoSeconds;
+
+    // split to avoid overflowing Ticks * 10^9
+    NanoSeconds = MultU64x32(DivU64x64Remainder(Ticks, Frequency, &Remainder), 1000000000);
+    NanoSeconds += DivU64x64Remainder(MultU64x32(Remainder, 1000000000), Frequency, NULL);
+
+    return NanoSeconds;
+}
@@ -0,0 +1,527 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Line search for ReadDemo1.
+//
+//  ASCII and UTF-8 files are searched a block at a time directly in the
+//  reader's buffer.  The longest piece of literal text in the pattern is
+//  located with SSE2 compares of its first and last bytes, and only the
+//  lines containing a hit are cut out, checked against the full pattern
+//  and handed to the caller.  UTF-16 files are matched line by line.
+//
+//  Patterns are a fixed string or a small regular expression subset:
+//      .      any character
+//      *      zero or more of the previous item
+//      ^ $    start and end of line
+//      [a-z]  character class, [^...] negated
+//      \c     the character c
+//
+//  License: BSD License
+//
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/LineReaderLib.h>
+
+#include <emmintrin.h>
+
+#include "Grep.h"
+
+
+#define SIMD __attribute__((target("sse2")))
+
+
+static UINTN
+CountBits( UINT32 Value)
+{
+    Value = Value - ((Value >> 1) & 0x55555555);
+    Value = (Value & 0x33333333) + ((Value >> 2) & 0x33333333);
+    return (((Value + (Value >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+
+//
+// SSE2 memchr
+//
+static SIMD CHAR8 *
+FindByte( CHAR8 *Data,
+          UINTN Size,
+          CHAR8 Value)
+{
+    __m128i Needle = _mm_set1_epi8(Value);
+    UINT32 Mask;
+    UINTN i = 0;
+
+    for (; i + 16 <= Size; i += 16) {
+        Mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(Data + i)), Needle));
+        if (Mask != 0) {
+            return Data + i + __builtin_ctz(Mask);
+        }
+    }
+    for (; i < Size; i++) {
+        if (Data[i] == Value) {
+            return Data + i;
+        }
+    }
+
+    return NULL;
+}
+
+
+//
+// Count line ends 16 bytes at a time
+//
+static SIMD UINT64
+CountLines( CHAR8 *Data,
+            UINTN Size)
+{
+    __m128i Nl = _mm_set1_epi8('\n');
+    UINT64 Count = 0;
+    UINTN i = 0;
+
+    for (; i + 16 <= Size; i += 16) {
+        Count += CountBits(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(Data + i)), Nl)));
+    }
+    for (; i < Size; i++) {
+        Count += (Data[i] == '\n');
+    }
+
+    return Count;
+}
+
+
+//
+// Substring search.  Candidate positions are those where both the first
+// and the last byte of the literal match, sixteen positions per step;
+// only those are compared in full.
+//
+static SIMD CHAR8 *
+FindLiteral( CHAR8 *Data,
+             UINTN Size,
+             CHAR8 *Literal,
+             UINTN Length)
+{
+    __m128i First;
+    __m128i Last;
+    __m128i Eq;
+    UINT32 Mask;
+    UINTN Bit;
+    UINTN i = 0;
+
+    if (Length == 1) {
+        return FindByte(Data, Size, Literal[0]);
+    }
+    if (Length == 0 || Length > Size) {
+        return (Length == 0) ? Data : NULL;
+    }
+
+    First = _mm_set1_epi8(Literal[0]);
+    Last = _mm_set1_epi8(Literal[Length - 1]);
+
+    for (; i + Length - 1 + 16 <= Size; i += 16) {
+        Eq = _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(Data + i)), First),
+                           _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(Data + i + Length - 1)), Last));
+        Mask = _mm_movemask_epi8(Eq);
+        while (Mask != 0) {
+            Bit = __builtin_ctz(Mask);
+            if (CompareMem(Data + i + Bit + 1, Literal + 1, Length - 2) == 0) {
+                return Data + i + Bit;
+            }
+            Mask &= Mask - 1;
+        }
+    }
+    for (; i + Length <= Size; i++) {
+        if (Data[i] == Literal[0] && CompareMem(Data + i + 1, Literal + 1, Length - 1) == 0) {
+            return Data + i;
+        }
+    }
+
+    return NULL;
+}
+
+
+//
+// Length of the pattern item at Re: a character, an escape or a class
+//
+static UINTN
+AtomLength( CHAR8 *Re,
+            CHAR8 *ReEnd)
+{
+    CHAR8 *p;
+
+    if (*Re == '\\' && Re + 1 < ReEnd) {
+        return 2;
+    }
+    if (*Re == '[') {
+        p = Re + 1;
+        if (p < ReEnd && *p == '^') {
+            p++;
+        }
+        if (p < ReEnd && *p == ']') {
+            p++;
+        }
+        while (p < ReEnd && *p != ']') {
+            p++;
+        }
+        if (p < ReEnd) {
+            return p - Re + 1;
+        }
+    }
+
+    return 1;
+}
+
+
+static BOOLEAN
+AtomMatches( CHAR8 *Re,
+             UINTN Length,
+             CHAR8 c)
+{
+    CHAR8 *p;
+    CHAR8 *End;
+    BOOLEAN Negate = FALSE;
+    BOOLEAN Found = FALSE;
+
+    if (Length == 2) {
+        return Re[1] == c;
+    }
+    if (Length == 1) {
+        return *Re == '.' || *Re == c;
+    }
+
+    // character class
+    p = Re + 1;
+    End = Re + Length - 1;
+    if (*p == '^') {
+        Negate = TRUE;
+        p++;
+    }
+    for (; p < End; p++) {
+        if (p + 2 < End && p[1] == '-') {
+            if (c >= p[0] && c <= p[2]) {
+                Found = TRUE;
+            }
+            p += 2;
+        } else if (*p == c) {
+            Found = TRUE;
+        }
+    }
+
+    return Found != Negate;
+}
+
+
+static BOOLEAN MatchHere(CHAR8 *Re, CHAR8 *ReEnd, CHAR8 *Text, CHAR8 *TextEnd);
+
+static BOOLEAN
+MatchStar( CHAR8 *Atom,
+           UINTN AtomLen,
+           CHAR8 *Re,
+           CHAR8 *ReEnd,
+           CHAR8 *Text,
+           CHAR8 *TextEnd)
+{
+    do {
+        if (MatchHere(Re, ReEnd, Text, TextEnd)) {
+            return TRUE;
+        }
+    } while (Text < TextEnd && AtomMatches(Atom, AtomLen, *Text++));
+
+    return FALSE;
+}
+
+
+static BOOLEAN
+MatchHere( CHAR8 *Re,
+           CHAR8 *ReEnd,
+           CHAR8 *Text,
+           CHAR8 *TextEnd)
+{
+    UINTN Len;
+
+    for (;;) {
+        if (Re == ReEnd) {
+            return TRUE;
+        }
+        if (*Re == '$' && Re + 1 == ReEnd) {
+            return Text == TextEnd;
+        }
+        Len = AtomLength(Re, ReEnd);
+        if (Re + Len < ReEnd && Re[Len] == '*') {
+            return MatchStar(Re, Len, Re + Len + 1, ReEnd, Text, TextEnd);
+        }
+        if (Text == TextEnd || !AtomMatches(Re, Len, *Text)) {
+            return FALSE;
+        }
+        Re += Len;
+        Text++;
+    }
+}
+
+
+static BOOLEAN
+MatchLine( GREP_PATTERN *Pattern,
+           CHAR8 *Line,
+           UINTN Length)
+{
+    CHAR8 *Re = Pattern->Pattern;
+    CHAR8 *ReEnd = Re + Pattern->Length;
+    CHAR8 *Text = Line;
+    CHAR8 *TextEnd = Line + Length;
+
+    if (!Pattern->Regex) {
+        return FindLiteral(Line, Length, Pattern->Literal, Pattern->LiteralLength) != NULL;
+    }
+
+    if (*Re == '^') {
+        return MatchHere(Re + 1, ReEnd, Text, TextEnd);
+    }
+    do {
+        if (MatchHere(Re, ReEnd, Text, TextEnd)) {
+            return TRUE;
+        }
+    } while (Text++ < TextEnd);
+
+    return FALSE;
+}
+
+
+EFI_STATUS
+GrepCompile( CHAR16 *Pattern,
+             GREP_PATTERN *Compiled)
+{
+    CHAR8 *Re;
+    CHAR8 *ReEnd;
+    CHAR8 Run[GREP_PATTERN_MAX];
+    UINTN RunLength = 0;
+    UINTN Len;
+    UINTN i;
+
+    ZeroMem(Compiled, sizeof(GREP_PATTERN));
+
+    for (i = 0; Pattern[i] != L'\0'; i++) {
+        if (i == GREP_PATTERN_MAX - 1 || Pattern[i] > 0xFF) {
+            return EFI_INVALID_PARAMETER;
+        }
+        Compiled->Pattern[i] = (CHAR8)Pattern[i];
+        if (ScanMem8(".*^$[\\", 6, (UINT8)Pattern[i]) != NULL) {
+            Compiled->Regex = TRUE;
+        }
+    }
+    if (i == 0) {
+        return EFI_INVALID_PARAMETER;
+    }
+    Compiled->Length = i;
+
+    if (!Compiled->Regex) {
+        CopyMem(Compiled->Literal, Compiled->Pattern, i);
+        Compiled->LiteralLength = i;
+        return EFI_SUCCESS;
+    }
+
+    // find the longest run of plain characters every match must contain
+    Re = Compiled->Pattern;
+    ReEnd = Re + Compiled->Length;
+    if (*Re == '^') {
+        Re++;
+    }
+    while (Re <= ReEnd) {
+        Len = (Re < ReEnd) ? AtomLength(Re, ReEnd) : 0;
+        if (Len == 0 || (Re + Len < ReEnd && Re[Len] == '*') ||
+            (Len == 1 && (*Re == '.' || (*Re == '$' && Re + 1 == ReEnd))) ||
+            Len > 2) {
+            if (RunLength > Compiled->LiteralLength) {
+                CopyMem(Compiled->Literal, Run, RunLength);
+                Compiled->LiteralLength = RunLength;
+            }
+            RunLength = 0;
+            if (Len == 0) {
+                break;
+            }
+            if (Re + Len < ReEnd && Re[Len] == '*') {
+                Len++;
+            }
+        } else {
+            Run[RunLength++] = Re[Len - 1];
+        }
+        Re += Len;
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// A comment line starts with '#', possibly after blanks
+//
+BOOLEAN
+GrepIsComment( CHAR8 *Line,
+               UINTN Length)
+{
+    UINTN i = 0;
+
+    while (i < Length && (Line[i] == ' ' || Line[i] == '\t')) {
+        i++;
+    }
+
+    return (i < Length && Line[i] == '#');
+}
+
+
+//
+// Check one line and report it if it is selected
+//
+static BOOLEAN
+SelectLine( GREP_PATTERN *Pattern,
+            BOOLEAN Invert,
+            BOOLEAN NoComment,
+            CHAR8 *Line,
+            UINTN Length)
+{
+    if (NoComment && GrepIsComment(Line, Length)) {
+        return FALSE;
+    }
+
+    return MatchLine(Pattern, Line, Length) != Invert;
+}
+
+
+static EFI_STATUS
+GrepUnicode( LINE_READER *Reader,
+             GREP_PATTERN *Pattern,
+             BOOLEAN Invert,
+             BOOLEAN NoComment,
+             GREP_LINE_CALLBACK Callback,
+             UINT64 *Matches)
+{
+    EFI_STATUS Status;
+    CHAR16 *Line;
+    CHAR8 *Narrow = NULL;
+    UINTN NarrowSize = 0;
+    UINTN Length;
+    UINT64 LineNo = 0;
+
+    for (;;) {
+        Status = LineReaderReadLine(Reader, &Line, &Length);
+        if (Status == EFI_END_OF_FILE) {
+            Status = EFI_SUCCESS;
+            break;
+        }
+        if (EFI_ERROR(Status)) {
+            break;
+        }
+        LineNo++;
+
+        if (Length + 1 > NarrowSize) {
+            if (Narrow != NULL) {
+                FreePool(Narrow);
+            }
+            NarrowSize = MAX(Length + 1, 256);
+            Narrow = AllocatePool(NarrowSize);
+            if (Narrow == NULL) {
+                return EFI_OUT_OF_RESOURCES;
+            }
+        }
+        for (UINTN i = 0; i < Length; i++) {
+            Narrow[i] = (Line[i] > 0xFF) ? '?' : (CHAR8)Line[i];
+        }
+
+        if (SelectLine(Pattern, Invert, NoComment, Narrow, Length)) {
+            (*Matches)++;
+            if (Callback != NULL) {
+                Callback(LineNo, NULL, Line, Length);
+            }
+        }
+    }
+
+    if (Narrow != NULL) {
+        FreePool(Narrow);
+    }
+
+    return Status;
+}
+
+
+//
+// Search the file from the current reader position.  Callback may be
+// NULL when only the number of selected lines is wanted.
+//
+EFI_STATUS
+GrepFile( LINE_READER *Reader,
+          GREP_PATTERN *Pattern,
+          BOOLEAN Invert,
+          BOOLEAN NoComment,
+          GREP_LINE_CALLBACK Callback,
+          UINT64 *Matches)
+{
+    EFI_STATUS Status;
+    CHAR8 *Data;
+    CHAR8 *Ptr;
+    CHAR8 *End;
+    CHAR8 *Hit;
+    CHAR8 *LineStart;
+    CHAR8 *LineEnd;
+    UINTN Size;
+    UINTN Length;
+    UINT64 LineNo = 0;       // lines before Ptr
+
+    *Matches = 0;
+
+    if (Reader->Unicode) {
+        return GrepUnicode(Reader, Pattern, Invert, NoComment, Callback, Matches);
+    }
+
+    for (;;) {
+        Status = LineReaderReadBlock(Reader, (UINT8 **)&Data, &Size);
+        if (Status == EFI_END_OF_FILE) {
+            Status = EFI_SUCCESS;
+            break;
+        }
+        if (EFI_ERROR(Status)) {
+            break;
+        }
+
+        Ptr = Data;
+        End = Data + Size;
+        while (Ptr < End) {
+            if (!Invert && Pattern->LiteralLength > 0) {
+                // jump straight to the next line holding the literal
+                Hit = FindLiteral(Ptr, End - Ptr, Pattern->Literal, Pattern->LiteralLength);
+                if (Hit == NULL) {
+                    LineNo += CountLines(Ptr, End - Ptr);
+                    break;
+                }
+                LineStart = Hit;
+                while (LineStart > Ptr && LineStart[-1] != '\n') {
+                    LineStart--;
+                }
+                LineNo += CountLines(Ptr, LineStart - Ptr);
+            } else {
+                LineStart = Ptr;
+            }
+
+            LineEnd = FindByte(LineStart, End - LineStart, '\n');
+            if (LineEnd == NULL) {
+                LineEnd = End;
+            }
+            Length = LineEnd - LineStart;
+            if (Length > 0 && LineStart[Length - 1] == '\r') {
+                Length--;
+            }
+
+            LineNo++;
+            if (SelectLine(Pattern, Invert, NoComment, LineStart, Length)) {
+                (*Matches)++;
+                if (Callback != NULL) {
+                    Callback(LineNo, LineStart, NULL, Length);
+                }
+            }
+            Ptr = LineEnd + 1;
+        }
+    }
+
+    return Status;
+}
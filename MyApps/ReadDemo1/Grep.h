@@ -0,0 +1,51 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Line search for ReadDemo1
+//
+//  License: BSD License
+//
+
+#ifndef __GREP_H__
+#define __GREP_H__
+
+#include <Library/LineReaderLib.h>
+
+#define GREP_PATTERN_MAX  256
+
+typedef struct {
+    CHAR8    Pattern[GREP_PATTERN_MAX];
+    UINTN    Length;
+    BOOLEAN  Regex;              // pattern uses . * ^ $ [] or escapes
+    CHAR8    Literal[GREP_PATTERN_MAX];
+    UINTN    LiteralLength;      // text every match must contain, may be 0
+} GREP_PATTERN;
+
+//
+// Called for each selected line.  Exactly one of AsciiLine and
+// UnicodeLine is set; neither is NUL terminated.
+//
+typedef
+VOID
+(*GREP_LINE_CALLBACK) ( UINT64 LineNo,
+                        CHAR8 *AsciiLine,
+                        CHAR16 *UnicodeLine,
+                        UINTN Length);
+
+EFI_STATUS
+GrepCompile( CHAR16 *Pattern,
+             GREP_PATTERN *Compiled);
+
+BOOLEAN
+GrepIsComment( CHAR8 *Line,
+               UINTN Length);
+
+EFI_STATUS
+GrepFile( LINE_READER *Reader,
+          GREP_PATTERN *Pattern,
+          BOOLEAN Invert,
+          BOOLEAN NoComment,
+          GREP_LINE_CALLBACK Callback,
+          UINT64 *Matches);
+
+#endif
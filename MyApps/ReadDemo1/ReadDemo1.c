@@ -19,6 +19,10 @@
 #include <Library/MemoryAllocationLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/PrintLib.h>
+#include <Library/TimerLib.h>
+#include <Library/LineReaderLib.h>
+
+#include "Grep.h"
 
 #include <Protocol/EfiShell.h>
 #include <Protocol/LoadedImage.h>
@@ -28,15 +32,471 @@
 #include <IndustryStandard/Pci.h>
 #include <IndustryStandard/Acpi.h>
 
-#define UTILITY_VERSION L"0.8"
-#define LINE_MAX  1024
+#define UTILITY_VERSION L"0.9"
+#define OUT_BUFFER_CHARS  16384
+
+#define INDEX_SUFFIX      L".idx"
+
+// console output is collected here and written in large chunks
+static CHAR16 mOutBuffer[OUT_BUFFER_CHARS + 1];
+static UINTN  mOutCount = 0;
+
+static BOOLEAN NoComment = FALSE;
+static BOOLEAN LineNumber = FALSE;
+static BOOLEAN Unbuffered = FALSE;
 
 
 VOID
 Usage(CHAR16 *Str)
 {
     Print(L"Usage: %s [--version | --help ]\n", Str);
-    Print(L"       %s [--number] [--nocomment] filename\n", Str);
+    Print(L"       %s [--number] [--nocomment] [--stream] [--stats] [--unbuffered]\n", Str);
+    Print(L"          [--index] [--lines A-B | --tail N | --pager] filename\n");
+    Print(L"       %s [--number] [--nocomment] [--stats] [--invert] [-c | --count]\n", Str);
+    Print(L"          --grep PATTERN filename\n");
+}
+
+
+static VOID
+OutFlush( VOID)
+{
+    if (mOutCount > 0) {
+        mOutBuffer[mOutCount] = L'\0';
+        gST->ConOut->OutputString(gST->ConOut, mOutBuffer);
+        mOutCount = 0;
+    }
+}
+
+
+static VOID
+OutUnicode( CHAR16 *Str,
+            UINTN Length)
+{
+    UINTN Count;
+
+    while (Length > 0) {
+        if (mOutCount == OUT_BUFFER_CHARS) {
+            OutFlush();
+        }
+        Count = MIN(Length, OUT_BUFFER_CHARS - mOutCount);
+        CopyMem(mOutBuffer + mOutCount, Str, Count * sizeof(CHAR16));
+        mOutCount += Count;
+        Str += Count;
+        Length -= Count;
+    }
+}
+
+
+//
+// Widen ASCII straight into the output buffer
+//
+static VOID
+OutAscii( CHAR8 *Str,
+          UINTN Length)
+{
+    CHAR16 *Dst;
+    UINTN Count;
+
+    while (Length > 0) {
+        if (mOutCount == OUT_BUFFER_CHARS) {
+            OutFlush();
+        }
+        Count = MIN(Length, OUT_BUFFER_CHARS - mOutCount);
+        Dst = mOutBuffer + mOutCount;
+        for (UINTN i = 0; i < Count; i++) {
+            Dst[i] = (CHAR16)(UINT8)Str[i];
+        }
+        mOutCount += Count;
+        Str += Count;
+        Length -= Count;
+    }
+}
+
+
+//
+// Same output as Print(L"%0.4d  ", LineNo)
+//
+static VOID
+OutLineNumber( UINT64 LineNo)
+{
+    CHAR16 Digits[24];
+    UINTN  Count = 0;
+
+    do {
+        Digits[Count++] = (CHAR16)(L'0' + LineNo % 10);
+        LineNo /= 10;
+    } while (LineNo > 0);
+    while (Count < 4) {
+        Digits[Count++] = L'0';
+    }
+
+    if (OUT_BUFFER_CHARS - mOutCount < Count + 2) {
+        OutFlush();
+    }
+    while (Count > 0) {
+        mOutBuffer[mOutCount++] = Digits[--Count];
+    }
+    mOutBuffer[mOutCount++] = L' ';
+    mOutBuffer[mOutCount++] = L' ';
+}
+
+
+//
+// Print elapsed time and read throughput
+//
+VOID
+PrintStats( LINE_READER *Reader,
+            UINT64 Lines,
+            UINT64 ElapsedNs)
+{
+    UINT64 Ms = DivU64x32(ElapsedNs, 1000000);
+    UINT64 KBps = 0;
+
+    if (ElapsedNs > 0) {
+        KBps = DivU64x64Remainder(MultU64x32(Reader->BytesRead, 1000000), ElapsedNs / 1000 + 1, NULL) / 1024;
+    }
+
+    Print(L"\n");
+    Print(L"Lines      : %ld\n", Lines);
+    Print(L"Bytes      : %ld\n", Reader->BytesRead);
+    Print(L"Time       : %ld.%03ld s\n", Ms / 1000, Ms % 1000);
+    Print(L"Throughput : %ld.%02ld MB/s\n", KBps / 1024, (KBps % 1024) * 100 / 1024);
+    if (ElapsedNs > 0) {
+        Print(L"Lines/s    : %ld\n", DivU64x64Remainder(MultU64x32(Lines, 1000000), ElapsedNs / 1000 + 1, NULL));
+    }
+    Print(L"Read mode  : %s\n", Reader->Streaming ? L"ReadEx streaming" : L"Synchronous Read");
+}
+
+
+//
+// Comment lines start with '#', possibly after blanks
+//
+static BOOLEAN
+IsComment( CHAR16 *Line,
+           UINTN Length)
+{
+    UINTN i = 0;
+
+    while (i < Length && (Line[i] == L' ' || Line[i] == L'\t')) {
+        i++;
+    }
+
+    return (i < Length && Line[i] == L'#');
+}
+
+
+//
+// Output up to MaxLines lines (0 for all) from the current reader
+// position.  LineNo is the number of the first line.  Lines are cut
+// at MaxWidth characters when MaxWidth is not 0.
+//
+EFI_STATUS
+ShowLines( LINE_READER *Reader,
+           UINT64 LineNo,
+           UINT64 MaxLines,
+           UINTN MaxWidth,
+           UINT64 *LinesRead)
+{
+    EFI_STATUS Status;
+    CHAR16  *ReadLine = NULL;
+    CHAR8   *AsciiLine = NULL;
+    UINTN   Length;
+    UINT64  Count = 0;
+
+    for (; MaxLines == 0 || Count < MaxLines; LineNo++) {
+         if (Reader->Unicode || Unbuffered) {
+             Status = LineReaderReadLine(Reader, &ReadLine, &Length);
+         } else {
+             Status = LineReaderReadAsciiLine(Reader, &AsciiLine, &Length);
+         }
+         if (Status == EFI_END_OF_FILE) {
+             Status = EFI_SUCCESS;
+             break;
+         }
+         if (EFI_ERROR(Status)) {
+             break;
+         }
+
+         Count++;
+
+         if (Unbuffered) {
+             if (NoComment && IsComment(ReadLine, Length)) {
+                 continue;
+             }
+             if (LineNumber) {
+                Print(L"%0.4d  ", LineNo);
+             }
+             Print(L"%s\n", ReadLine);
+             continue;
+         }
+
+         // Skip comment lines
+         if (NoComment && (Reader->Unicode ? IsComment(ReadLine, Length) : GrepIsComment(AsciiLine, Length))) {
+             continue;
+         }
+
+         if (LineNumber) {
+            OutLineNumber(LineNo);
+         }
+         if (MaxWidth > 0 && Length > MaxWidth) {
+            Length = MaxWidth;
+         }
+         if (Reader->Unicode) {
+            OutUnicode(ReadLine, Length);
+         } else {
+            OutAscii(AsciiLine, Length);
+         }
+         OutUnicode(L"\r\n", 2);
+    }
+    OutFlush();
+
+    *LinesRead = Count;
+
+    return Status;
+}
+
+
+//
+// Output one line selected by --grep
+//
+static VOID
+GrepLine( UINT64 LineNo,
+          CHAR8 *AsciiLine,
+          CHAR16 *UnicodeLine,
+          UINTN Length)
+{
+    if (LineNumber) {
+        OutLineNumber(LineNo);
+    }
+    if (AsciiLine != NULL) {
+        OutAscii(AsciiLine, Length);
+    } else {
+        OutUnicode(UnicodeLine, Length);
+    }
+    OutUnicode(L"\r\n", 2);
+}
+
+
+//
+// Load the index sidecar file if it matches the file being viewed
+//
+EFI_STATUS
+LoadIndex( CHAR16 *IndexName,
+           EFI_FILE_INFO *FileInfo,
+           LINE_INDEX **Index)
+{
+    EFI_STATUS Status;
+    SHELL_FILE_HANDLE FileHandle;
+    LINE_INDEX Header;
+    LINE_INDEX *New;
+    UINT64 FileSize;
+    UINTN Size;
+
+    Status = ShellOpenFileByName(IndexName, &FileHandle, EFI_FILE_MODE_READ, 0);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    Size = OFFSET_OF(LINE_INDEX, Offset);
+    Status = ShellGetFileSize(FileHandle, &FileSize);
+    if (!EFI_ERROR(Status)) {
+        Status = ShellReadFile(FileHandle, &Size, &Header);
+    }
+    if (EFI_ERROR(Status) ||
+        Size != OFFSET_OF(LINE_INDEX, Offset) ||
+        Header.Signature != LINE_INDEX_SIGNATURE ||
+        Header.Stride == 0 ||
+        Header.Count == 0 ||
+        Header.Count > (FileSize - OFFSET_OF(LINE_INDEX, Offset)) / sizeof(UINT64) ||
+        FileSize != LINE_INDEX_SIZE(Header.Count) ||
+        Header.LineCount > Header.FileSize + 1 ||
+        Header.Count > Header.LineCount / Header.Stride + 1 ||
+        Header.FileSize != FileInfo->FileSize ||
+        CompareMem(&Header.ModificationTime, &FileInfo->ModificationTime, sizeof(EFI_TIME)) != 0) {
+        ShellCloseFile(&FileHandle);
+        return EFI_NOT_FOUND;
+    }
+
+    New = AllocatePool((UINTN)FileSize);
+    if (New == NULL) {
+        ShellCloseFile(&FileHandle);
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    Size = (UINTN)FileSize;
+    Status = ShellSetFilePosition(FileHandle, 0);
+    if (!EFI_ERROR(Status)) {
+        Status = ShellReadFile(FileHandle, &Size, New);
+    }
+    ShellCloseFile(&FileHandle);
+    if (EFI_ERROR(Status) || Size != FileSize) {
+        FreePool(New);
+        return EFI_NOT_FOUND;
+    }
+
+    // checkpoints must be in order and inside the file
+    for (UINTN i = 0; i < New->Count; i++) {
+        if (New->Offset[i] > New->FileSize ||
+            (i > 0 && New->Offset[i] <= New->Offset[i - 1])) {
+            FreePool(New);
+            return EFI_NOT_FOUND;
+        }
+    }
+
+    *Index = New;
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Write the index to its sidecar file, replacing any stale one
+//
+EFI_STATUS
+SaveIndex( CHAR16 *IndexName,
+           LINE_INDEX *Index)
+{
+    EFI_STATUS Status;
+    SHELL_FILE_HANDLE FileHandle;
+    EFI_FILE_INFO *FileInfo;
+    UINTN Size;
+
+    Status = ShellOpenFileByName(IndexName, &FileHandle,
+                                 EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE, 0);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    // a stale index is truncated, not overwritten at the start
+    FileInfo = ShellGetFileInfo(FileHandle);
+    if (FileInfo == NULL) {
+        Status = EFI_DEVICE_ERROR;
+    } else {
+        if (FileInfo->FileSize != 0) {
+            FileInfo->FileSize = 0;
+            Status = ShellSetFileInfo(FileHandle, FileInfo);
+        }
+        FreePool(FileInfo);
+    }
+
+    if (!EFI_ERROR(Status)) {
+        Size = LINE_INDEX_SIZE(Index->Count);
+        Status = ShellWriteFile(FileHandle, &Size, Index);
+        if (!EFI_ERROR(Status) && Size != LINE_INDEX_SIZE(Index->Count)) {
+            Status = EFI_DEVICE_ERROR;
+        }
+    }
+
+    if (EFI_ERROR(Status)) {
+        ShellDeleteFile(&FileHandle);
+    } else {
+        ShellCloseFile(&FileHandle);
+    }
+
+    return Status;
+}
+
+
+//
+// Interactive pager.  Each page seeks straight to its first line
+// through the index, so paging backwards or jumping to the end costs
+// one screenful of reading.
+//
+EFI_STATUS
+Pager( LINE_READER *Reader,
+       LINE_INDEX *Index)
+{
+    EFI_STATUS Status;
+    EFI_INPUT_KEY Key;
+    UINTN Columns;
+    UINTN Rows;
+    UINTN Width;
+    UINTN EventIndex;
+    UINT64 Page;
+    UINT64 Top = 0;
+    UINT64 Last;
+    UINT64 LinesRead;
+
+    Status = gST->ConOut->QueryMode(gST->ConOut, gST->ConOut->Mode->Mode, &Columns, &Rows);
+    if (EFI_ERROR(Status) || Rows < 2 || Columns < 16) {
+        Columns = 80;
+        Rows = 25;
+    }
+    Page = Rows - 1;
+    Width = Columns - 1 - (LineNumber ? 6 : 0);
+    Last = (Index->LineCount > Page) ? Index->LineCount - Page : 0;
+
+    for (;;) {
+        gST->ConOut->ClearScreen(gST->ConOut);
+
+        LinesRead = 0;
+        Status = LineIndexSeek(Reader, Index, Top);
+        if (!EFI_ERROR(Status)) {
+            Status = ShowLines(Reader, Top + 1, Page, Width, &LinesRead);
+        }
+        if (EFI_ERROR(Status) && Status != EFI_END_OF_FILE) {
+            Print(L"ERROR: Reading file [%r]\n", Status);
+            return Status;
+        }
+
+        Print(L"-- %ld-%ld of %ld (%ld%%) -- Space/PgDn b/PgUp g/G q",
+              Top + 1, Top + LinesRead, Index->LineCount,
+              Index->LineCount ? (UINTN)DivU64x64Remainder((Top + LinesRead) * 100, Index->LineCount, NULL) : 100);
+
+        gBS->WaitForEvent(1, &gST->ConIn->WaitForKey, &EventIndex);
+        gST->ConIn->ReadKeyStroke(gST->ConIn, &Key);
+
+        if (Key.UnicodeChar == L'q' || Key.UnicodeChar == L'Q' || Key.ScanCode == SCAN_ESC) {
+            break;
+        } else if (Key.UnicodeChar == L' ' || Key.UnicodeChar == L'f' || Key.ScanCode == SCAN_PAGE_DOWN) {
+            Top += Page;
+        } else if (Key.UnicodeChar == L'b' || Key.ScanCode == SCAN_PAGE_UP) {
+            Top = (Top > Page) ? Top - Page : 0;
+        } else if (Key.UnicodeChar == L'j' || Key.UnicodeChar == CHAR_CARRIAGE_RETURN || Key.ScanCode == SCAN_DOWN) {
+            Top++;
+        } else if (Key.UnicodeChar == L'k' || Key.ScanCode == SCAN_UP) {
+            Top = (Top > 0) ? Top - 1 : 0;
+        } else if (Key.UnicodeChar == L'g' || Key.ScanCode == SCAN_HOME) {
+            Top = 0;
+        } else if (Key.UnicodeChar == L'G' || Key.ScanCode == SCAN_END) {
+            Top = Last;
+        }
+        if (Top > Last) {
+            Top = Last;
+        }
+    }
+
+    Print(L"\n");
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Parse "A-B", "A-" or "A" into a 1-based inclusive line range
+//
+BOOLEAN
+ParseRange( CHAR16 *Str,
+            UINT64 *First,
+            UINT64 *Last)
+{
+    CHAR16 *Dash;
+
+    if (*Str < L'0' || *Str > L'9') {
+        return FALSE;
+    }
+
+    *First = StrDecimalToUint64(Str);
+    Dash = StrStr(Str, L"-");
+    if (Dash == NULL) {
+        *Last = *First;
+    } else if (Dash[1] == L'\0') {
+        *Last = 0;
+    } else {
+        *Last = StrDecimalToUint64(Dash + 1);
+    }
+
+    return (*First > 0 && (*Last == 0 || *Last >= *First));
 }
 
 
@@ -45,19 +505,32 @@ EFIAPI
 ShellAppMain(UINTN Argc, CHAR16 **Argv)
 {
     EFI_STATUS Status = EFI_SUCCESS;
-    SHELL_FILE_HANDLE InFileHandle;
+    SHELL_FILE_HANDLE InFileHandle = NULL;
+    LINE_READER *Reader = NULL;
+    LINE_INDEX *Index = NULL;
+    EFI_FILE_INFO *FileInfo = NULL;
     CHAR16  *FileName;
-    CHAR16  *FullFileName;
-    CHAR16  *ReadLine;
+    CHAR16  *FullFileName = NULL;
+    CHAR16  *IndexName = NULL;
     CHAR16  *Walker;
-    BOOLEAN Ascii = TRUE;
-    BOOLEAN NoComment = FALSE;
-    BOOLEAN LineNumber = FALSE;
-    UINTN   Size = LINE_MAX;
-    UINTN   LineNo = 0;
+    BOOLEAN Stream = FALSE;
+    BOOLEAN Stats = FALSE;
+    BOOLEAN BuildIndex = FALSE;
+    BOOLEAN Paged = FALSE;
+    BOOLEAN Invert = FALSE;
+    BOOLEAN CountOnly = FALSE;
+    CHAR16  *GrepArg = NULL;
+    GREP_PATTERN Pattern;
+    UINT64  StartTime = 0;
+    UINT64  FirstLine = 1;
+    UINT64  LastLine = 0;
+    UINT64  TailLines = 0;
+    UINT64  Offset;
+    UINT64  LinesRead = 0;
+    UINTN   IndexNameSize;
     int     i;
  
-    if (Argc < 2 || Argc > 4) {
+    if (Argc < 2) {
         Usage(Argv[0]);
         return Status;
     }
@@ -77,6 +550,40 @@ ShellAppMain(UINTN Argc, CHAR16 **Argv)
             NoComment = TRUE;
         } else if (!StrCmp(Argv[i], L"--number")) { 
             LineNumber = TRUE;
+        } else if (!StrCmp(Argv[i], L"--stream")) { 
+            Stream = TRUE;
+        } else if (!StrCmp(Argv[i], L"--stats")) { 
+            Stats = TRUE;
+        } else if (!StrCmp(Argv[i], L"--unbuffered")) { 
+            Unbuffered = TRUE;
+        } else if (!StrCmp(Argv[i], L"--index")) { 
+            BuildIndex = TRUE;
+        } else if (!StrCmp(Argv[i], L"--pager")) { 
+            Paged = TRUE;
+        } else if (!StrCmp(Argv[i], L"--invert")) { 
+            Invert = TRUE;
+        } else if (!StrCmp(Argv[i], L"--count") ||
+            !StrCmp(Argv[i], L"-c")) { 
+            CountOnly = TRUE;
+        } else if (!StrCmp(Argv[i], L"--grep")) { 
+            if (++i >= Argc || EFI_ERROR(GrepCompile(Argv[i], &Pattern))) {
+                Print(L"ERROR: Invalid pattern.\n");
+                Usage(Argv[0]);
+                return Status;
+            }
+            GrepArg = Argv[i];
+        } else if (!StrCmp(Argv[i], L"--lines")) { 
+            if (++i >= Argc || !ParseRange(Argv[i], &FirstLine, &LastLine)) {
+                Print(L"ERROR: Invalid line range.\n");
+                Usage(Argv[0]);
+                return Status;
+            }
+        } else if (!StrCmp(Argv[i], L"--tail")) { 
+            if (++i >= Argc || (TailLines = StrDecimalToUint64(Argv[i])) == 0) {
+                Print(L"ERROR: Invalid line count.\n");
+                Usage(Argv[0]);
+                return Status;
+            }
         } else if (*Walker != L'-') {
             break;
         } else {
@@ -86,6 +593,14 @@ ShellAppMain(UINTN Argc, CHAR16 **Argv)
         }
     }
 
+    if (i >= Argc) {
+        Usage(Argv[0]);
+        return Status;
+    }
+
+    if (Stats) {
+        StartTime = GetPerformanceCounter();
+    }
 
     FileName = AllocateCopyPool(StrSize(Argv[i]), Argv[i]);
     if (FileName == NULL) {
@@ -107,36 +622,127 @@ ShellAppMain(UINTN Argc, CHAR16 **Argv)
         goto Error;
     }
 
-    // allocate a buffer to read lines into
-    ReadLine = AllocateZeroPool(Size);
-    if (ReadLine == NULL) {
+    FileInfo = ShellGetFileInfo(InFileHandle);
+    if (FileInfo == NULL) {
+        Print(L"ERROR: Could not get file information\n");
+        Status = EFI_DEVICE_ERROR;
+        goto Error;
+    }
+
+    Status = LineReaderOpen(InFileHandle, LINE_READER_BLOCK_SIZE, &Reader);
+    if (EFI_ERROR(Status)) {
+        Print(L"ERROR: Could not read file [%r]\n", Status);
+        goto Error;
+    }
+
+    // fall back to synchronous reads on revision 1 file protocols
+    if (Stream && EFI_ERROR(LineReaderEnableStreaming(Reader, FullFileName))) {
+        Print(L"WARNING: ReadEx not supported, using Read\n");
+    }
+
+    // use an up to date index sidecar file if there is one
+    IndexNameSize = StrSize(FullFileName) + StrSize(INDEX_SUFFIX);
+    IndexName = AllocateZeroPool(IndexNameSize);
+    if (IndexName == NULL) {
         Print(L"ERROR: Could not allocate memory\n");
         Status = EFI_OUT_OF_RESOURCES;
         goto Error;
     }
+    StrCpyS(IndexName, IndexNameSize / sizeof(CHAR16), FullFileName);
+    StrCatS(IndexName, IndexNameSize / sizeof(CHAR16), INDEX_SUFFIX);
 
-    // read file line by line
-    for (;!ShellFileHandleEof(InFileHandle); Size = 1024) {
+    if (!BuildIndex) {
+        LoadIndex(IndexName, FileInfo, &Index);
+    }
 
-         Status = ShellFileHandleReadLine(InFileHandle, ReadLine, &Size, TRUE, &Ascii);
-         if (Status == EFI_BUFFER_TOO_SMALL) {
-             Status = EFI_SUCCESS;
-         }
-         if (EFI_ERROR(Status)) {
-             break;
-         }
+    if (Index == NULL && (BuildIndex || Paged)) {
+        Status = LineIndexBuild(Reader, LINE_INDEX_STRIDE, &Index);
+        if (EFI_ERROR(Status)) {
+            Print(L"ERROR: Could not index file [%r]\n", Status);
+            goto Error;
+        }
+        Index->FileSize = FileInfo->FileSize;
+        CopyMem(&Index->ModificationTime, &FileInfo->ModificationTime, sizeof(EFI_TIME));
 
-         LineNo++;
+        // building the index read to the end of the file
+        Status = LineReaderSeek(Reader, 0);
+        if (EFI_ERROR(Status)) {
+            Print(L"ERROR: Could not rewind file [%r]\n", Status);
+            goto Error;
+        }
+    }
 
-         // Skip comment lines
-         if (ReadLine[0] == L'#' && NoComment) {
-             continue;
-         }
+    if (BuildIndex) {
+        Status = SaveIndex(IndexName, Index);
+        if (EFI_ERROR(Status)) {
+            Print(L"WARNING: Could not write %s [%r]\n", IndexName, Status);
+        } else {
+            Print(L"Indexed %ld lines, %ld entries, %ld bytes in %s\n",
+                  Index->LineCount, Index->Count, LINE_INDEX_SIZE(Index->Count), IndexName);
+        }
+        // only an index was asked for
+        if (GrepArg == NULL && !Paged && TailLines == 0 && FirstLine == 1 && LastLine == 0) {
+            goto Error;
+        }
+    }
 
-         if (LineNumber) {
-            Print(L"%0.4d  ", LineNo);
-         }
-         Print(L"%s\n", ReadLine);
+    if (GrepArg != NULL) {
+        // search the whole file, wherever the index left the reader
+        Status = LineReaderSeek(Reader, 0);
+        if (!EFI_ERROR(Status)) {
+            Status = GrepFile(Reader, &Pattern, Invert, NoComment, CountOnly ? NULL : GrepLine, &LinesRead);
+        }
+        OutFlush();
+        if (EFI_ERROR(Status)) {
+            Print(L"ERROR: Could not search file [%r]\n", Status);
+            goto Error;
+        }
+        if (CountOnly) {
+            Print(L"%ld\n", LinesRead);
+        }
+        if (Stats) {
+            PrintStats(Reader, LinesRead, GetTimeInNanoSecond(GetPerformanceCounter() - StartTime));
+        }
+        goto Error;
+    }
+
+    if (Paged) {
+        Status = Pager(Reader, Index);
+        goto Error;
+    }
+
+    if (TailLines > 0) {
+        Status = LineReaderFindTail(Reader, FileInfo->FileSize, TailLines, &Offset);
+        if (EFI_ERROR(Status)) {
+            Print(L"ERROR: Could not find end of file [%r]\n", Status);
+            goto Error;
+        }
+        if (Index != NULL) {
+            FirstLine = (Index->LineCount > TailLines) ? Index->LineCount - TailLines + 1 : 1;
+        } else {
+            // line numbers are not known without an index
+            LineNumber = FALSE;
+        }
+    } else if (FirstLine > 1) {
+        if (Index != NULL) {
+            Status = LineIndexSeek(Reader, Index, FirstLine - 1);
+        } else {
+            Status = LineReaderSkipLines(Reader, FirstLine - 1);
+        }
+        if (Status == EFI_END_OF_FILE) {
+            Status = EFI_SUCCESS;
+            goto Error;
+        }
+        if (EFI_ERROR(Status)) {
+            Print(L"ERROR: Could not find line %ld [%r]\n", FirstLine, Status);
+            goto Error;
+        }
+    }
+
+    Status = ShowLines(Reader, FirstLine, LastLine ? LastLine - FirstLine + 1 : 0, 0, &LinesRead);
+
+    if (Stats && !EFI_ERROR(Status)) {
+        PrintStats(Reader, LinesRead, GetTimeInNanoSecond(GetPerformanceCounter() - StartTime));
     }
 
 Error:
@@ -146,8 +752,17 @@ Error:
     if (FullFileName != NULL) {
        FreePool(FullFileName);
     }
-    if (ReadLine != NULL) {
-        FreePool(ReadLine);
+    if (IndexName != NULL) {
+       FreePool(IndexName);
+    }
+    if (Index != NULL) {
+       FreePool(Index);
+    }
+    if (FileInfo != NULL) {
+       FreePool(FileInfo);
+    }
+    if (Reader != NULL) {
+        LineReaderClose(Reader);
     }
     if (InFileHandle != NULL) {
         ShellCloseFile(&InFileHandle);
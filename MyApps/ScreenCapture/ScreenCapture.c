@@ -0,0 +1,442 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Capture the screen to a 24-bit BMP file
+//
+//  The screen is read back a strip of rows at a time with Blt, from the
+//  bottom up because that is the order BMP rows are stored in, so only
+//  one strip is ever held in memory whatever the resolution.  Each
+//  converted strip is written with WriteEx when the file system can do
+//  it asynchronously, so the next strip is read and converted while
+//  the previous one is still being written.
+//
+//  License: BSD License
+//
+
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/ShellCEntryLib.h>
+#include <Library/ShellLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/PrintLib.h>
+#include <Library/TimerLib.h>
+
+#include <Protocol/EfiShell.h>
+#include <Protocol/LoadedImage.h>
+#include <Protocol/SimpleFileSystem.h>
+#include <Protocol/GraphicsOutput.h>
+
+#include <Guid/FileInfo.h>
+
+#include <Library/BmpLib.h>
+
+
+#define CAPTURE_STRIP_SIZE   (256 * 1024)    // BLT pixels read back per strip
+#define CAPTURE_FILE_NAME    L"screen.bmp"
+#define CAPTURE_HEADER_SIZE  (sizeof(BMP_IMAGE_HEADER) - BMP_FILE_HEADER_SIZE)
+
+typedef struct {
+    EFI_FILE_HANDLE     FileHandle;
+    BOOLEAN             Async;           // WriteEx works on this file
+    BOOLEAN             Pending;         // Token is in flight
+    UINTN               Requested;       // bytes Token was asked to write
+    EFI_FILE_IO_TOKEN   Token;
+} CAPTURE_FILE;
+
+
+//
+// Cut an existing file down to nothing
+//
+static EFI_STATUS
+TruncateFile( EFI_FILE_HANDLE FileHandle)
+{
+    EFI_FILE_INFO *FileInfo;
+    EFI_STATUS Status;
+    UINTN Size = 0;
+
+    Status = FileHandle->GetInfo(FileHandle, &gEfiFileInfoGuid, &Size, NULL);
+    if (Status != EFI_BUFFER_TOO_SMALL) {
+        return EFI_ERROR(Status) ? Status : EFI_DEVICE_ERROR;
+    }
+    FileInfo = AllocatePool(Size);
+    if (FileInfo == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    Status = FileHandle->GetInfo(FileHandle, &gEfiFileInfoGuid, &Size, FileInfo);
+    if (!EFI_ERROR(Status) && FileInfo->FileSize != 0) {
+        FileInfo->FileSize = 0;
+        Status = FileHandle->SetInfo(FileHandle, &gEfiFileInfoGuid, Size, FileInfo);
+    }
+    FreePool(FileInfo);
+
+    return Status;
+}
+
+
+//
+// Create FileName on the first file system, as SaveBMP in ShowBGRT
+// does, replacing any file of that name
+//
+static EFI_STATUS
+CreateFile( CHAR16 *FileName,
+            CAPTURE_FILE *File)
+{
+    EFI_STATUS          Status;
+    EFI_FILE_PROTOCOL   *Root;
+    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *SimpleFileSystem;
+
+    ZeroMem(File, sizeof(CAPTURE_FILE));
+
+    Status = gBS->LocateProtocol( &gEfiSimpleFileSystemProtocolGuid,
+                                  NULL,
+                                  (VOID **)&SimpleFileSystem);
+    if (EFI_ERROR(Status)) {
+        Print(L"Cannot find EFI_SIMPLE_FILE_SYSTEM_PROTOCOL \r\n");
+        return Status;
+    }
+
+    Status = SimpleFileSystem->OpenVolume(SimpleFileSystem, &Root);
+    if (EFI_ERROR(Status)) {
+        Print(L"ERROR: Volume open\n");
+        return Status;
+    }
+
+    Status = Root->Open( Root,
+                         &File->FileHandle,
+                         FileName,
+                         EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE,
+                         0);
+    Root->Close(Root);
+    if (EFI_ERROR(Status)) {
+        Print(L"ERROR: File open\n");
+        return Status;
+    }
+
+    // an old, longer capture would otherwise leave its tail behind
+    Status = TruncateFile(File->FileHandle);
+    if (EFI_ERROR(Status)) {
+        Print(L"ERROR: File truncate [%r]\n", Status);
+        File->FileHandle->Close(File->FileHandle);
+        File->FileHandle = NULL;
+        return Status;
+    }
+
+    if (File->FileHandle->Revision >= EFI_FILE_PROTOCOL_REVISION2) {
+        Status = gBS->CreateEvent(0, 0, NULL, NULL, &File->Token.Event);
+        File->Async = !EFI_ERROR(Status);
+    }
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Wait for the write in flight, if any
+//
+static EFI_STATUS
+WaitFile( CAPTURE_FILE *File)
+{
+    UINTN EventIndex;
+
+    if (!File->Pending) {
+        return EFI_SUCCESS;
+    }
+
+    gBS->WaitForEvent(1, &File->Token.Event, &EventIndex);
+    File->Pending = FALSE;
+
+    if (!EFI_ERROR(File->Token.Status) && File->Token.BufferSize != File->Requested) {
+        return EFI_DEVICE_ERROR;
+    }
+    return File->Token.Status;
+}
+
+
+//
+// Start writing Buffer, which must stay untouched until WaitFile
+//
+static EFI_STATUS
+WriteFile( CAPTURE_FILE *File,
+           VOID *Buffer,
+           UINTN Size)
+{
+    EFI_STATUS Status;
+
+    Status = WaitFile(File);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    if (File->Async) {
+        File->Token.Status = EFI_SUCCESS;
+        File->Token.BufferSize = Size;
+        File->Token.Buffer = Buffer;
+        File->Requested = Size;
+        Status = File->FileHandle->WriteEx(File->FileHandle, &File->Token);
+        if (!EFI_ERROR(Status)) {
+            File->Pending = TRUE;
+            return EFI_SUCCESS;
+        }
+        if (Status != EFI_UNSUPPORTED) {
+            return Status;
+        }
+        // the driver only has the revision, not the support
+        File->Async = FALSE;
+    }
+
+    File->Requested = Size;
+    Status = File->FileHandle->Write(File->FileHandle, &Size, Buffer);
+    if (!EFI_ERROR(Status) && Size != File->Requested) {
+        Status = EFI_DEVICE_ERROR;
+    }
+
+    return Status;
+}
+
+
+//
+// Close the file, or delete it if Discard is set
+//
+static EFI_STATUS
+CloseFile( CAPTURE_FILE *File,
+           BOOLEAN Discard)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+
+    if (File->FileHandle != NULL) {
+        Status = WaitFile(File);
+        if (Discard) {
+            File->FileHandle->Delete(File->FileHandle);
+        } else {
+            File->FileHandle->Close(File->FileHandle);
+        }
+    }
+    if (File->Token.Event != NULL) {
+        gBS->CloseEvent(File->Token.Event);
+    }
+
+    return Status;
+}
+
+
+//
+// BLT pixels to bottom up 24-bit BMP rows, each padded to 4 bytes
+//
+static VOID
+ConvertStrip( EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Strip,
+              UINTN Width,
+              UINTN Rows,
+              UINT8 *Dst)
+{
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Src;
+    UINTN RowSize = BMP_ROW_SIZE(Width, 24);
+    UINT8 *Out;
+
+    for (UINTN y = Rows; y > 0; y--) {
+        Src = Strip + (y - 1) * Width;
+        Out = Dst;
+        for (UINTN x = 0; x < Width; x++, Src++) {
+            *Out++ = Src->Blue;
+            *Out++ = Src->Green;
+            *Out++ = Src->Red;
+        }
+        ZeroMem(Out, RowSize - Width * 3);
+        Dst += RowSize;
+    }
+}
+
+
+static EFI_STATUS
+CaptureScreen( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+               CHAR16 *FileName,
+               BOOLEAN Verbose)
+{
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Strip = NULL;
+    UINT8 *Out[2] = { NULL, NULL };
+    BMP_IMAGE_HEADER Header;
+    CAPTURE_FILE File;
+    UINTN Width = Gop->Mode->Info->HorizontalResolution;
+    UINTN Height = Gop->Mode->Info->VerticalResolution;
+    UINTN RowSize = BMP_ROW_SIZE(Width, 24);
+    UINTN StripRows;
+    UINTN Rows;
+    UINTN Y;
+    UINTN Size;
+    UINTN Count = 0;
+    UINT64 StartTime;
+    UINT64 Time;
+    EFI_STATUS Status;
+
+    StartTime = GetPerformanceCounter();
+
+    StripRows = MAX(CAPTURE_STRIP_SIZE / (Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL)), 1);
+    StripRows = MIN(StripRows, Height);
+    Strip = AllocatePool(StripRows * Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+    Out[0] = AllocatePool(StripRows * RowSize);
+    Out[1] = AllocatePool(StripRows * RowSize);
+    if (Strip == NULL || Out[0] == NULL || Out[1] == NULL) {
+        Print(L"ERROR: Could not allocate memory\n");
+        Status = EFI_OUT_OF_RESOURCES;
+        goto Done;
+    }
+
+    Status = CreateFile(FileName, &File);
+    if (EFI_ERROR(Status)) {
+        goto Done;
+    }
+
+    ZeroMem(&Header, sizeof(Header));
+    Header.CharB = 'B';
+    Header.CharM = 'M';
+    Header.ImageOffset = sizeof(BMP_IMAGE_HEADER);
+    Header.Size = (UINT32)(sizeof(BMP_IMAGE_HEADER) + RowSize * Height);
+    Header.HeaderSize = CAPTURE_HEADER_SIZE;
+    Header.PixelWidth = (UINT32)Width;
+    Header.PixelHeight = (UINT32)Height;
+    Header.Planes = 1;
+    Header.BitPerPixel = 24;
+    Header.CompressionType = BMP_RGB;
+    Header.ImageSize = (UINT32)(RowSize * Height);
+
+    Size = sizeof(Header);
+    Status = File.FileHandle->Write(File.FileHandle, &Size, &Header);
+    if (!EFI_ERROR(Status) && Size != sizeof(Header)) {
+        Status = EFI_DEVICE_ERROR;
+    }
+    if (EFI_ERROR(Status)) {
+        Print(L"ERROR: Writing %s [%r]\n", FileName, Status);
+        goto Close;
+    }
+
+    // strips from the bottom of the screen up
+    for (Y = Height; Y > 0; Y -= Rows) {
+        Rows = MIN(StripRows, Y);
+        Status = Gop->Blt( Gop,
+                           Strip,
+                           EfiBltVideoToBltBuffer,
+                           0, Y - Rows,
+                           0, 0,
+                           Width, Rows,
+                           0);
+        if (EFI_ERROR(Status)) {
+            Print(L"ERROR: Blt [%r]\n", Status);
+            goto Close;
+        }
+
+        // the other buffer may still be on its way to the disk
+        ConvertStrip(Strip, Width, Rows, Out[Count & 1]);
+        Status = WriteFile(&File, Out[Count & 1], Rows * RowSize);
+        if (EFI_ERROR(Status)) {
+            Print(L"ERROR: Writing %s [%r]\n", FileName, Status);
+            goto Close;
+        }
+        Count++;
+    }
+
+Close:
+    // the last strip may still be on its way to the disk
+    if (!EFI_ERROR(Status)) {
+        Status = WaitFile(&File);
+        if (EFI_ERROR(Status)) {
+            Print(L"ERROR: Writing %s [%r]\n", FileName, Status);
+        }
+    }
+
+    // a partly written capture is not left behind
+    CloseFile(&File, EFI_ERROR(Status));
+
+    if (!EFI_ERROR(Status)) {
+        Print(L"Saved %dx%d screen to %s\n", Width, Height, FileName);
+        if (Verbose) {
+            Time = GetTimeInNanoSecond(GetPerformanceCounter() - StartTime);
+            Print(L"Strips            : %d of %d rows\n", Count, StripRows);
+            Print(L"Writes            : %s\n", File.Async ? L"asynchronous" : L"synchronous");
+            Print(L"Capture time      : %ld us\n", Time / 1000);
+        }
+    }
+
+Done:
+    if (Strip != NULL) {
+        FreePool(Strip);
+    }
+    if (Out[0] != NULL) {
+        FreePool(Out[0]);
+    }
+    if (Out[1] != NULL) {
+        FreePool(Out[1]);
+    }
+
+    return Status;
+}
+
+
+static void
+Usage(void)
+{
+    Print(L"Usage: ScreenCapture [-v | --verbose] [-l | --lowest] [filename]\n");
+}
+
+
+INTN
+EFIAPI
+ShellAppMain(UINTN Argc, CHAR16 **Argv)
+{
+    EFI_STATUS Status = EFI_SUCCESS;
+    EFI_HANDLE *HandleBuffer = NULL;
+    UINTN HandleCount = 0;
+    EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop;
+    CHAR16 *FileName = CAPTURE_FILE_NAME;
+    BOOLEAN Verbose = FALSE;
+    BOOLEAN LowerHandle = FALSE;
+
+    for (int i = 1; i < Argc; i++) {
+        if (!StrCmp(Argv[i], L"--verbose") ||
+            !StrCmp(Argv[i], L"-v")) {
+            Verbose = TRUE;
+        } else if (!StrCmp(Argv[i], L"--help") ||
+            !StrCmp(Argv[i], L"-h") ||
+            !StrCmp(Argv[i], L"-?")) {
+            Usage();
+            return Status;
+        } else if (!StrCmp(Argv[i], L"--lowest") ||
+            !StrCmp(Argv[i], L"-l")) {
+            LowerHandle = TRUE;
+        } else if (Argv[i][0] != L'-' && i == Argc - 1) {
+            FileName = Argv[i];
+        } else {
+            Print(L"ERROR: Unknown option.\n");
+            Usage();
+            return Status;
+        }
+    }
+
+    // Try locating GOP by handle, the last one unless asked otherwise
+    Status = gBS->LocateHandleBuffer( ByProtocol,
+                      &gEfiGraphicsOutputProtocolGuid,
+                      NULL,
+                      &HandleCount,
+                      &HandleBuffer);
+    if (EFI_ERROR (Status)) {
+        Print(L"ERROR: No GOP handles found via LocateHandleBuffer\n");
+        return Status;
+    }
+
+    Status = gBS->OpenProtocol( HandleBuffer[LowerHandle ? 0 : HandleCount - 1],
+                                &gEfiGraphicsOutputProtocolGuid,
+                                (VOID **)&Gop,
+                                gImageHandle,
+                                NULL,
+                                EFI_OPEN_PROTOCOL_BY_HANDLE_PROTOCOL);
+    FreePool(HandleBuffer);
+    if (EFI_ERROR (Status)) {
+        Print(L"ERROR: OpenProtocol [%d]\n", Status);
+        return Status;
+    }
+
+    return CaptureScreen(Gop, FileName, Verbose);
+}
@@ -0,0 +1,287 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  GOP Blt and frame buffer throughput
+//
+//  Each Blt operation is repeated on a few rectangle sizes until it
+//  has run for BENCH_TIME_NS, so small rectangles show the per call
+//  overhead of the driver and the full screen the raw bandwidth.
+//  Direct writes to the frame buffer are plain CopyMem rows, the way
+//  a simple splash screen would draw, for comparison.
+//
+//  License: BSD License
+//
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/TimerLib.h>
+
+#include "Bench.h"
+
+
+#define BENCH_TIME_NS        (100 * 1000 * 1000)
+#define BENCH_MAX_FRAMES     100000
+
+static CONST UINT32 mRectSizes[BENCH_SIZES][2] = {
+    { 64, 64 },
+    { 256, 256 },
+    { 800, 600 },
+    { 0, 0 }                             // full screen
+};
+
+static CONST CHAR16 *mOpNames[BENCH_OPS] = {
+    L"VideoFill",
+    L"BufferToVideo",
+    L"VideoToBltBuffer",
+    L"VideoToVideo",
+    L"FrameBuffer"
+};
+
+
+static EFI_STATUS
+RunOp( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+       UINTN Op,
+       EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Buffer,
+       UINTN BytesPerPixel,
+       UINTN Width,
+       UINTN Height)
+{
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Info = Gop->Mode->Info;
+    UINT8 *Dst;
+    UINTN Pitch;
+
+    switch (Op) {
+    case BENCH_FILL:
+        return Gop->Blt(Gop, Buffer, EfiBltVideoFill, 0, 0, 0, 0, Width, Height, 0);
+    case BENCH_TO_VIDEO:
+        return Gop->Blt(Gop, Buffer, EfiBltBufferToVideo, 0, 0, 0, 0, Width, Height, 0);
+    case BENCH_TO_BUFFER:
+        return Gop->Blt(Gop, Buffer, EfiBltVideoToBltBuffer, 0, 0, 0, 0, Width, Height, 0);
+    case BENCH_VIDEO_TO_VIDEO:
+        // to the opposite corner, so only the full screen copy is in place
+        return Gop->Blt( Gop, NULL, EfiBltVideoToVideo, 0, 0,
+                         Info->HorizontalResolution - Width,
+                         Info->VerticalResolution - Height,
+                         Width, Height, 0);
+    case BENCH_FRAME_BUFFER:
+        Dst = (UINT8 *)(UINTN)Gop->Mode->FrameBufferBase;
+        Pitch = Info->PixelsPerScanLine * BytesPerPixel;
+        for (UINTN y = 0; y < Height; y++) {
+            CopyMem(Dst, (UINT8 *)Buffer + y * Width * BytesPerPixel, Width * BytesPerPixel);
+            Dst += Pitch;
+        }
+        return EFI_SUCCESS;
+    }
+
+    return EFI_UNSUPPORTED;
+}
+
+
+static EFI_STATUS
+TimeOp( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+        UINTN Op,
+        EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Buffer,
+        UINTN BytesPerPixel,
+        UINTN Width,
+        UINTN Height,
+        BENCH_RESULT *Result)
+{
+    UINT64 StartTime;
+    UINT64 Time = 0;
+    EFI_STATUS Status;
+
+    // once untimed, so first use costs in the driver are not counted
+    Status = RunOp(Gop, Op, Buffer, BytesPerPixel, Width, Height);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    StartTime = GetPerformanceCounter();
+    while (Time < BENCH_TIME_NS && Result->Frames < BENCH_MAX_FRAMES) {
+        Status = RunOp(Gop, Op, Buffer, BytesPerPixel, Width, Height);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+        Result->Frames++;
+        Time = GetTimeInNanoSecond(GetPerformanceCounter() - StartTime);
+    }
+
+    Result->Nanoseconds = MAX(Time, 1);
+    Result->Bytes = MultU64x64(Result->Frames, Width * Height * BytesPerPixel);
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Bytes per pixel of the linear frame buffer, 0 if there is none
+//
+static UINTN
+FrameBufferPixelSize( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop)
+{
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Info = Gop->Mode->Info;
+    EFI_PIXEL_BITMASK *Mask = &Info->PixelInformation;
+    UINTN BytesPerPixel = 4;
+
+    if (Info->PixelFormat >= PixelBltOnly || Gop->Mode->FrameBufferBase == 0) {
+        return 0;
+    }
+    if (Info->PixelFormat == PixelBitMask &&
+        ((Mask->RedMask | Mask->GreenMask | Mask->BlueMask | Mask->ReservedMask) & 0xFFFF0000) == 0) {
+        BytesPerPixel = 2;
+    }
+    if (Info->PixelsPerScanLine * Info->VerticalResolution * BytesPerPixel > Gop->Mode->FrameBufferSize) {
+        return 0;
+    }
+
+    return BytesPerPixel;
+}
+
+
+//
+// A full screen of test pixels, a gradient rather than one colour in
+// case anything compresses
+//
+static EFI_GRAPHICS_OUTPUT_BLT_PIXEL *
+AllocatePattern( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop)
+{
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Buffer;
+    UINTN Pixels;
+
+    Pixels = (UINTN)Gop->Mode->Info->HorizontalResolution * Gop->Mode->Info->VerticalResolution;
+    Buffer = AllocatePool(Pixels * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+    if (Buffer == NULL) {
+        return NULL;
+    }
+    for (UINTN i = 0; i < Pixels; i++) {
+        Buffer[i].Blue = (UINT8)i;
+        Buffer[i].Green = (UINT8)(i >> 4);
+        Buffer[i].Red = (UINT8)(i >> 8);
+        Buffer[i].Reserved = 0;
+    }
+
+    return Buffer;
+}
+
+
+//
+// Run every operation at every size in the current mode.  The screen
+// is overwritten, so the caller should restore it.
+//
+EFI_STATUS
+BenchMode( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+           BENCH_MODE *Bench)
+{
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Buffer;
+    UINTN BytesPerPixel;
+    EFI_STATUS Status;
+
+    Bench->Width = Gop->Mode->Info->HorizontalResolution;
+    Bench->Height = Gop->Mode->Info->VerticalResolution;
+    BytesPerPixel = FrameBufferPixelSize(Gop);
+
+    Buffer = AllocatePattern(Gop);
+    if (Buffer == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    for (UINTN Size = 0; Size < BENCH_SIZES; Size++) {
+        Bench->RectWidth[Size] = mRectSizes[Size][0] ? MIN(mRectSizes[Size][0], Bench->Width) : Bench->Width;
+        Bench->RectHeight[Size] = mRectSizes[Size][1] ? MIN(mRectSizes[Size][1], Bench->Height) : Bench->Height;
+        for (UINTN Op = 0; Op < BENCH_OPS; Op++) {
+            if (Op == BENCH_FRAME_BUFFER && BytesPerPixel == 0) {
+                continue;
+            }
+            Status = TimeOp( Gop, Op, Buffer,
+                             Op == BENCH_FRAME_BUFFER ? BytesPerPixel : sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL),
+                             Bench->RectWidth[Size], Bench->RectHeight[Size],
+                             &Bench->Results[Size][Op]);
+            if (EFI_ERROR(Status)) {
+                Bench->Results[Size][Op].Nanoseconds = 0;
+            }
+        }
+    }
+
+    FreePool(Buffer);
+    return EFI_SUCCESS;
+}
+
+
+//
+// Full screen writes straight to the frame buffer in the current mode
+//
+EFI_STATUS
+BenchFrameBuffer( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+                  BENCH_RESULT *Result)
+{
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Buffer;
+    UINTN BytesPerPixel;
+    EFI_STATUS Status;
+
+    ZeroMem(Result, sizeof(BENCH_RESULT));
+
+    BytesPerPixel = FrameBufferPixelSize(Gop);
+    if (BytesPerPixel == 0) {
+        return EFI_UNSUPPORTED;
+    }
+
+    Buffer = AllocatePattern(Gop);
+    if (Buffer == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    Status = TimeOp( Gop, BENCH_FRAME_BUFFER, Buffer, BytesPerPixel,
+                     Gop->Mode->Info->HorizontalResolution,
+                     Gop->Mode->Info->VerticalResolution,
+                     Result);
+
+    FreePool(Buffer);
+    return Status;
+}
+
+
+//
+// MB/s to one decimal place
+//
+VOID
+BenchPrintRate( BENCH_RESULT *Result)
+{
+    UINT64 Rate;
+
+    Rate = DivU64x64Remainder(MultU64x32(Result->Bytes, 10000), Result->Nanoseconds, NULL);
+    Print(L"%7ld.%ld", Rate / 10, Rate % 10);
+}
+
+
+VOID
+BenchPrint( BENCH_MODE *Bench)
+{
+    BENCH_RESULT *Result;
+    UINT64 Fps;
+
+    Print(L"Mode %d: %dx%d", Bench->Mode, Bench->Width, Bench->Height);
+    if (EFI_ERROR(Bench->Status)) {
+        Print(L" not tested [%r]\n", Bench->Status);
+        return;
+    }
+    Print(L", SetMode %ld us\n", Bench->SwitchTime / 1000);
+    Print(L"  Operation          Size         MB/s       frames/s\n");
+
+    for (UINTN Op = 0; Op < BENCH_OPS; Op++) {
+        for (UINTN Size = 0; Size < BENCH_SIZES; Size++) {
+            Result = &Bench->Results[Size][Op];
+            Print(L"  %-17s %4dx%-4d  ", mOpNames[Op], Bench->RectWidth[Size], Bench->RectHeight[Size]);
+            if (Result->Nanoseconds == 0) {
+                Print(L"  not available\n");
+                continue;
+            }
+            BenchPrintRate(Result);
+            Fps = DivU64x64Remainder(MultU64x32(Result->Frames, 1000000000), Result->Nanoseconds, NULL);
+            Print(L"  %10ld\n", Fps);
+        }
+    }
+    Print(L"\n");
+}
@@ -0,0 +1,55 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  GOP Blt and frame buffer throughput
+//
+//  License: BSD License
+//
+
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <Protocol/GraphicsOutput.h>
+
+#define BENCH_FILL           0
+#define BENCH_TO_VIDEO       1
+#define BENCH_TO_BUFFER      2
+#define BENCH_VIDEO_TO_VIDEO 3
+#define BENCH_FRAME_BUFFER   4
+#define BENCH_OPS            5
+
+#define BENCH_SIZES          4          // 64x64, 256x256, 800x600, full screen
+
+typedef struct {
+    UINT64    Bytes;
+    UINT64    Frames;
+    UINT64    Nanoseconds;               // 0 if not run
+} BENCH_RESULT;
+
+typedef struct {
+    UINT32    Mode;
+    UINT32    Width;
+    UINT32    Height;
+    UINT64    SwitchTime;                // SetMode, in nanoseconds
+    EFI_STATUS Status;
+    UINT32    RectWidth[BENCH_SIZES];
+    UINT32    RectHeight[BENCH_SIZES];
+    BENCH_RESULT Results[BENCH_SIZES][BENCH_OPS];
+} BENCH_MODE;
+
+
+EFI_STATUS
+BenchMode( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+           BENCH_MODE *Bench);
+
+EFI_STATUS
+BenchFrameBuffer( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+                  BENCH_RESULT *Result);
+
+VOID
+BenchPrintRate( BENCH_RESULT *Result);
+
+VOID
+BenchPrint( BENCH_MODE *Bench);
+
+#endif
@@ -0,0 +1,372 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Frame buffer memory type from the GCD, MTRRs and PAT
+//
+//  What the GCD says the frame buffer attributes are is only what was
+//  asked for.  What the CPU does comes from the variable MTRR (or the
+//  default type) covering the address, combined with the PAT entry
+//  the page table selects for it, so both are read back here and
+//  combined the way the SDM describes.  UEFI identity maps memory, so
+//  the page table can be walked directly from CR3.
+//
+//  License: BSD License
+//
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DxeServicesTableLib.h>
+
+#include "MemType.h"
+#include "Bench.h"
+
+
+#define MSR_MTRR_CAP             0xFE
+#define MSR_MTRR_PHYS_BASE0      0x200
+#define MSR_MTRR_PHYS_MASK0      0x201
+#define MSR_PAT                  0x277
+#define MSR_MTRR_DEF_TYPE        0x2FF
+
+#define MTRR_DEF_ENABLE          BIT11
+#define MTRR_MASK_VALID          BIT11
+
+#define CPUID_MTRR               BIT12
+#define CPUID_PAT                BIT16
+#define CPUID_EXT_MAX            0x80000000
+#define CPUID_ADDRESS_SIZE       0x80000008
+
+#define PAGE_PRESENT             BIT0
+#define PAGE_PWT                 BIT3
+#define PAGE_PCD                 BIT4
+#define PAGE_PS                  BIT7       // large page, or PAT in a 4K PTE
+#define PAGE_LARGE_PAT           BIT12
+#define PAGE_ADDRESS_MASK        0x000FFFFFFFFFF000ULL
+
+#define CR4_LA57                 BIT12
+
+#define MEMORY_CACHE_ATTRIBUTES  (EFI_MEMORY_UC | EFI_MEMORY_WC | EFI_MEMORY_WT | EFI_MEMORY_WB | EFI_MEMORY_UCE)
+
+
+static CONST CHAR16 *
+MemTypeName( UINT8 Type)
+{
+    switch (Type) {
+    case MEM_TYPE_UC:       return L"UC";
+    case MEM_TYPE_WC:       return L"WC";
+    case MEM_TYPE_WT:       return L"WT";
+    case MEM_TYPE_WP:       return L"WP";
+    case MEM_TYPE_WB:       return L"WB";
+    case MEM_TYPE_UC_MINUS: return L"UC-";
+    }
+    return L"unknown";
+}
+
+
+static VOID
+PrintAttributes( UINT64 Attributes)
+{
+    if (Attributes & EFI_MEMORY_UC)  Print(L" UC");
+    if (Attributes & EFI_MEMORY_WC)  Print(L" WC");
+    if (Attributes & EFI_MEMORY_WT)  Print(L" WT");
+    if (Attributes & EFI_MEMORY_WB)  Print(L" WB");
+    if (Attributes & EFI_MEMORY_UCE) Print(L" UCE");
+    if ((Attributes & MEMORY_CACHE_ATTRIBUTES) == 0) Print(L" none");
+}
+
+
+//
+// Type the MTRRs give an address above 1MB (the fixed range MTRRs
+// only cover the first megabyte)
+//
+static UINT8
+MtrrType( UINT64 Address,
+          UINT8 *DefaultType,
+          UINTN *VariableCount)
+{
+    UINT64 DefType;
+    UINT64 Base;
+    UINT64 Mask;
+    UINT8  Type = MEM_TYPE_UNKNOWN;
+    UINT32 Edx;
+
+    *DefaultType = MEM_TYPE_UNKNOWN;
+    *VariableCount = 0;
+
+    AsmCpuid(1, NULL, NULL, NULL, &Edx);
+    if ((Edx & CPUID_MTRR) == 0) {
+        return MEM_TYPE_UNKNOWN;
+    }
+
+    DefType = AsmReadMsr64(MSR_MTRR_DEF_TYPE);
+    if ((DefType & MTRR_DEF_ENABLE) == 0) {
+        *DefaultType = MEM_TYPE_UC;
+        return MEM_TYPE_UC;
+    }
+    *DefaultType = (UINT8)(DefType & 0xFF);
+    *VariableCount = (UINTN)(AsmReadMsr64(MSR_MTRR_CAP) & 0xFF);
+
+    for (UINTN i = 0; i < *VariableCount; i++) {
+        Mask = AsmReadMsr64(MSR_MTRR_PHYS_MASK0 + 2 * (UINT32)i);
+        if ((Mask & MTRR_MASK_VALID) == 0) {
+            continue;
+        }
+        Base = AsmReadMsr64(MSR_MTRR_PHYS_BASE0 + 2 * (UINT32)i);
+        Mask &= PAGE_ADDRESS_MASK;
+        if ((Address & Mask) != (Base & Mask)) {
+            continue;
+        }
+        // overlaps: UC wins, then WT over WB
+        if (Type == MEM_TYPE_UNKNOWN ||
+            (UINT8)(Base & 0xFF) == MEM_TYPE_UC ||
+            ((UINT8)(Base & 0xFF) == MEM_TYPE_WT && Type == MEM_TYPE_WB)) {
+            Type = (UINT8)(Base & 0xFF);
+        }
+    }
+
+    return (Type == MEM_TYPE_UNKNOWN) ? *DefaultType : Type;
+}
+
+
+//
+// Whether the MTRRs give any part of Start to End (inclusive) a type
+// other than Type, the type of Start.  The type can only change where
+// a variable MTRR region begins or ends, so the type is checked at
+// every such boundary inside the range.  Regions are taken to have
+// contiguous masks, as firmware sets them up.
+//
+static BOOLEAN
+MtrrRangeMixed( UINT64 Start,
+                UINT64 End,
+                UINT8 Type,
+                UINTN VariableCount)
+{
+    UINT64 PhysMask;
+    UINT64 Base;
+    UINT64 Mask;
+    UINT64 Limit;
+    UINT8  DefaultType;
+    UINTN  Count;
+    UINT32 Eax;
+    UINT32 PhysBits = 36;
+
+    AsmCpuid(CPUID_EXT_MAX, &Eax, NULL, NULL, NULL);
+    if (Eax >= CPUID_ADDRESS_SIZE) {
+        AsmCpuid(CPUID_ADDRESS_SIZE, &Eax, NULL, NULL, NULL);
+        PhysBits = Eax & 0xFF;
+    }
+    PhysMask = LShiftU64(1, PhysBits) - 1;
+
+    for (UINTN i = 0; i < VariableCount; i++) {
+        Mask = AsmReadMsr64(MSR_MTRR_PHYS_MASK0 + 2 * (UINT32)i);
+        if ((Mask & MTRR_MASK_VALID) == 0) {
+            continue;
+        }
+        Mask &= PAGE_ADDRESS_MASK;
+        Base = AsmReadMsr64(MSR_MTRR_PHYS_BASE0 + 2 * (UINT32)i) & Mask;
+        Limit = Base + (~Mask & PhysMask) + 1;
+
+        if (Base > Start && Base <= End &&
+            MtrrType(Base, &DefaultType, &Count) != Type) {
+            return TRUE;
+        }
+        if (Limit > Start && Limit <= End &&
+            MtrrType(Limit, &DefaultType, &Count) != Type) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+
+//
+// PAT entry the page tables select for an address, or -1 if it is not
+// mapped (or paging is not in 4 or 5 level long mode)
+//
+static INTN
+PatIndex( UINT64 Address)
+{
+    UINT64 *Table;
+    UINT64 Entry;
+    UINTN  Levels;
+    UINTN  Shift;
+
+    if ((AsmReadCr0() & BIT31) == 0) {
+        return -1;
+    }
+
+    Levels = (AsmReadCr4() & CR4_LA57) ? 5 : 4;
+    Shift = 12 + 9 * Levels;
+    Table = (UINT64 *)(UINTN)(AsmReadCr3() & PAGE_ADDRESS_MASK);
+
+    for (UINTN Level = Levels; Level > 0; Level--) {
+        Shift -= 9;
+        Entry = Table[(Address >> Shift) & 0x1FF];
+        if ((Entry & PAGE_PRESENT) == 0) {
+            return -1;
+        }
+        if (Level == 1) {
+            return ((Entry & PAGE_PS) ? 4 : 0) + ((Entry & PAGE_PCD) ? 2 : 0) + ((Entry & PAGE_PWT) ? 1 : 0);
+        }
+        if ((Level == 2 || Level == 3) && (Entry & PAGE_PS)) {
+            return ((Entry & PAGE_LARGE_PAT) ? 4 : 0) + ((Entry & PAGE_PCD) ? 2 : 0) + ((Entry & PAGE_PWT) ? 1 : 0);
+        }
+        Table = (UINT64 *)(UINTN)(Entry & PAGE_ADDRESS_MASK);
+    }
+
+    return -1;
+}
+
+
+//
+// Effective type of an MTRR type and a PAT type (SDM table 11-7)
+//
+static UINT8
+EffectiveType( UINT8 Mtrr,
+               UINT8 Pat)
+{
+    if (Mtrr == MEM_TYPE_UNKNOWN) {
+        return Pat;
+    }
+    if (Pat == MEM_TYPE_UNKNOWN) {
+        return Mtrr;
+    }
+    if (Pat == MEM_TYPE_WC) {
+        return MEM_TYPE_WC;
+    }
+    if (Pat == MEM_TYPE_UC) {
+        return MEM_TYPE_UC;
+    }
+    if (Pat == MEM_TYPE_UC_MINUS) {
+        return (Mtrr == MEM_TYPE_WC || Mtrr == MEM_TYPE_WP) ? MEM_TYPE_WC : MEM_TYPE_UC;
+    }
+    if (Mtrr == MEM_TYPE_UC) {
+        return MEM_TYPE_UC;
+    }
+    if (Mtrr == MEM_TYPE_WC) {
+        return (Pat == MEM_TYPE_WB) ? MEM_TYPE_WC : MEM_TYPE_UC;
+    }
+    if (Pat == MEM_TYPE_WB) {
+        return Mtrr;
+    }
+    return Pat;
+}
+
+
+static EFI_STATUS
+ReportMemType( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+               EFI_GCD_MEMORY_SPACE_DESCRIPTOR *Descriptor)
+{
+    EFI_PHYSICAL_ADDRESS Base = Gop->Mode->FrameBufferBase;
+    BENCH_RESULT Result;
+    UINT8 DefaultType;
+    UINT8 Mtrr;
+    UINT8 Pat = MEM_TYPE_UNKNOWN;
+    UINTN VariableCount;
+    INTN  Index;
+    UINT32 Edx;
+    EFI_STATUS Status;
+
+    Status = gDS->GetMemorySpaceDescriptor(Base, Descriptor);
+    if (EFI_ERROR(Status)) {
+        Print(L"ERROR: GetMemorySpaceDescriptor [%r]\n", Status);
+        return Status;
+    }
+    Print(L"GCD descriptor    : 0x%lx - 0x%lx\n", Descriptor->BaseAddress,
+          Descriptor->BaseAddress + Descriptor->Length - 1);
+    Print(L"GCD attributes    :");
+    PrintAttributes(Descriptor->Attributes);
+    Print(L"\nGCD capabilities  :");
+    PrintAttributes(Descriptor->Capabilities);
+    Print(L"\n");
+
+    Mtrr = MtrrType(Base, &DefaultType, &VariableCount);
+    if (Mtrr == MEM_TYPE_UNKNOWN) {
+        Print(L"MTRR type         : not supported\n");
+    } else {
+        Print(L"MTRR type         : %s%s (default %s, %d variable MTRRs)\n", MemTypeName(Mtrr),
+              MtrrRangeMixed(Base, Base + Gop->Mode->FrameBufferSize - 1, Mtrr, VariableCount) ? L", mixed" : L"",
+              MemTypeName(DefaultType), VariableCount);
+    }
+
+    AsmCpuid(1, NULL, NULL, NULL, &Edx);
+    Index = PatIndex(Base);
+    if ((Edx & CPUID_PAT) == 0) {
+        Print(L"PAT type          : not supported\n");
+    } else if (Index < 0) {
+        Print(L"PAT type          : not mapped\n");
+    } else {
+        Pat = (UINT8)(RShiftU64(AsmReadMsr64(MSR_PAT), 8 * Index) & 0x7);
+        Print(L"PAT type          : %s (entry %d)\n", MemTypeName(Pat), Index);
+    }
+
+    Print(L"Effective type    : %s\n", MemTypeName(EffectiveType(Mtrr, Pat)));
+
+    Status = BenchFrameBuffer(Gop, &Result);
+    if (EFI_ERROR(Status)) {
+        Print(L"Write bandwidth   : not available [%r]\n", Status);
+    } else {
+        Print(L"Write bandwidth   :");
+        BenchPrintRate(&Result);
+        Print(L" MB/s\n");
+    }
+    Print(L"\n");
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Report the memory type of the frame buffer and how fast it can be
+// written.  With TrialWC the frame buffer is switched to write combining
+// through the GCD, measured again, and put back as it was.
+//
+EFI_STATUS
+CheckMemType( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+              BOOLEAN TrialWC)
+{
+    EFI_GCD_MEMORY_SPACE_DESCRIPTOR Descriptor;
+    EFI_PHYSICAL_ADDRESS Base = Gop->Mode->FrameBufferBase;
+    UINT64 Length;
+    UINT64 Attributes;
+    EFI_STATUS Status;
+
+    if (Base == 0 || Gop->Mode->FrameBufferSize == 0 ||
+        Gop->Mode->Info->PixelFormat >= PixelBltOnly) {
+        Print(L"No linear frame buffer in mode %d\n", Gop->Mode->Mode);
+        return EFI_UNSUPPORTED;
+    }
+
+    Length = (Gop->Mode->FrameBufferSize + EFI_PAGE_MASK) & ~(UINT64)EFI_PAGE_MASK;
+    Print(L"Frame buffer      : 0x%lx, %ld bytes\n", Base, Gop->Mode->FrameBufferSize);
+
+    Status = ReportMemType(Gop, &Descriptor);
+    if (EFI_ERROR(Status) || !TrialWC) {
+        return Status;
+    }
+
+    if ((Descriptor.Capabilities & EFI_MEMORY_WC) == 0) {
+        Print(L"ERROR: Frame buffer cannot be write combining\n");
+        return EFI_UNSUPPORTED;
+    }
+
+    Attributes = Descriptor.Attributes;
+    Status = gDS->SetMemorySpaceAttributes( Base, Length,
+                                            (Attributes & ~MEMORY_CACHE_ATTRIBUTES) | EFI_MEMORY_WC);
+    if (EFI_ERROR(Status)) {
+        Print(L"ERROR: SetMemorySpaceAttributes WC [%r]\n", Status);
+        return Status;
+    }
+
+    Print(L"With WC set through the GCD:\n");
+    ReportMemType(Gop, &Descriptor);
+
+    Status = gDS->SetMemorySpaceAttributes(Base, Length, Attributes);
+    if (EFI_ERROR(Status)) {
+        Print(L"ERROR: Could not restore frame buffer attributes [%r]\n", Status);
+    }
+
+    return Status;
+}
@@ -0,0 +1,28 @@
+//
+//  Copyright (c) 2017  Finnbarr P. Murphy.   All rights reserved.
+//
+//  Frame buffer memory type from the GCD, MTRRs and PAT
+//
+//  License: BSD License
+//
+
+#ifndef __MEM_TYPE_H__
+#define __MEM_TYPE_H__
+
+#include <Protocol/GraphicsOutput.h>
+
+// IA32 memory type encodings, as used by the MTRRs and the PAT
+#define MEM_TYPE_UC          0
+#define MEM_TYPE_WC          1
+#define MEM_TYPE_WT          4
+#define MEM_TYPE_WP          5
+#define MEM_TYPE_WB          6
+#define MEM_TYPE_UC_MINUS    7
+#define MEM_TYPE_UNKNOWN     0xFF
+
+
+EFI_STATUS
+CheckMemType( EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop,
+              BOOLEAN TrialWC);
+
+#endif
@@ -16,6 +16,9 @@
 #include <Library/MemoryAllocationLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/PrintLib.h>
+#include <Library/TimerLib.h>
+#include <Library/GopModeLib.h>
+#include <Library/GlyphConsoleLib.h>
 
 #include <Protocol/EfiShell.h>
 #include <Protocol/LoadedImage.h>
@@ -23,6 +26,8 @@
 #include <Protocol/GraphicsOutput.h>
 #include "ConsoleControl.h"
 #include "UgaDraw.h"
+#include "Bench.h"
+#include "MemType.h"
 
 
 static int 
@@ -354,10 +359,251 @@ CheckCCP(BOOLEAN Verbose)
 
 
 
+//
+// The console GOP if there is one, else the first
+//
+static EFI_STATUS
+FindGOP( EFI_HANDLE *GopHandle,
+         EFI_GRAPHICS_OUTPUT_PROTOCOL **Gop)
+{
+    EFI_HANDLE *HandleBuffer = NULL;
+    UINTN HandleCount = 0;
+    EFI_STATUS Status;
+
+    *GopHandle = gST->ConsoleOutHandle;
+    Status = gBS->HandleProtocol( *GopHandle,
+                                  &gEfiGraphicsOutputProtocolGuid,
+                                  (VOID **) Gop);
+    if (!EFI_ERROR (Status)) {
+        return Status;
+    }
+
+    Status = gBS->LocateHandleBuffer( ByProtocol,
+                      &gEfiGraphicsOutputProtocolGuid,
+                      NULL,
+                      &HandleCount,
+                      &HandleBuffer);
+    if (EFI_ERROR (Status)) {
+        Print(L"ERROR: No GOP handles found\n");
+        return Status;
+    }
+    *GopHandle = HandleBuffer[0];
+    FreePool(HandleBuffer);
+
+    Status = gBS->HandleProtocol( *GopHandle,
+                                  &gEfiGraphicsOutputProtocolGuid,
+                                  (VOID **) Gop);
+    if (EFI_ERROR (Status)) {
+        Print(L"ERROR: HandleProtocol [%r]\n", Status);
+    }
+
+    return Status;
+}
+
+
+//
+// Print the GOP mode table best first, for an image of Width x Height
+// or for the largest screen, and optionally switch mode
+//
+static EFI_STATUS
+RankGOP( BOOLEAN Refresh,
+         UINTN Width,
+         UINTN Height,
+         BOOLEAN SetMode,
+         BOOLEAN SetBest,
+         UINT32 Mode)
+{
+    EFI_HANDLE GopHandle;
+    EFI_STATUS Status;
+    EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop;
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Info;
+    GOP_MODE_TABLE *Table;
+    BOOLEAN Cached;
+    UINT64 StartTime;
+    UINT64 Time;
+
+    Status = FindGOP(&GopHandle, &Gop);
+    if (EFI_ERROR (Status)) {
+        return Status;
+    }
+
+    StartTime = GetPerformanceCounter();
+    Status = GopModeGetTable(GopHandle, Gop, Refresh, &Table, &Cached);
+    Time = GetTimeInNanoSecond(GetPerformanceCounter() - StartTime);
+    if (EFI_ERROR (Status)) {
+        Print(L"ERROR: Could not get mode table [%r]\n", Status);
+        return Status;
+    }
+
+    Print(L"Mode table: %d of %d modes %s in %ld us\n", Table->Count, Table->MaxMode,
+          Cached ? L"read from variable" : L"queried", Time / 1000);
+    if (Table->NativeWidth != 0) {
+        Print(L"EDID native timing: %dx%d\n", Table->NativeWidth, Table->NativeHeight);
+    } else {
+        Print(L"EDID native timing: unknown\n");
+    }
+
+    GopModeRank(Table, (UINT32)Width, (UINT32)Height);
+    if (Width != 0 || Height != 0) {
+        Print(L"Best modes for a %dx%d image:\n", Width, Height);
+    } else {
+        Print(L"Best modes for the largest screen:\n");
+    }
+    for (UINT32 i = 0; i < Table->Count; i++) {
+        Info = &Table->Modes[i].Info;
+        Print(L"%c%d: %dx%d %s\n", Table->Modes[i].Mode == Gop->Mode->Mode ? '*' : ' ',
+              Table->Modes[i].Mode,
+              Info->HorizontalResolution,
+              Info->VerticalResolution,
+              Info->PixelFormat == PixelBltOnly ? L"(blt only)" : L"");
+    }
+    Print(L"\n");
+
+    if (SetMode) {
+        if (SetBest) {
+            Mode = Table->Modes[0].Mode;
+        }
+        Status = GopModeSet(Gop, Mode, &Time);
+        if (EFI_ERROR (Status)) {
+            Print(L"ERROR: SetMode %d [%r]\n", Mode, Status);
+        } else {
+            Print(L"Switched to mode %d in %ld us\n", Mode, Time / 1000);
+        }
+    }
+
+    GopModeFreeTable(Table);
+
+    return Status;
+}
+
+
+//
+// Blt and frame buffer throughput in every mode.  Each mode switch
+// clears the screen, so the results are kept until the original mode
+// is back and printed then.
+//
+static EFI_STATUS
+BenchGOP( VOID)
+{
+    EFI_HANDLE GopHandle;
+    EFI_STATUS Status;
+    EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop;
+    GOP_MODE_TABLE *Table;
+    BENCH_MODE *Bench;
+    UINT32 OrgMode;
+
+    Status = FindGOP(&GopHandle, &Gop);
+    if (EFI_ERROR (Status)) {
+        return Status;
+    }
+
+    Status = GopModeGetTable(GopHandle, Gop, FALSE, &Table, NULL);
+    if (EFI_ERROR (Status)) {
+        Print(L"ERROR: Could not get mode table [%r]\n", Status);
+        return Status;
+    }
+
+    Bench = AllocateZeroPool(Table->Count * sizeof(BENCH_MODE));
+    if (Bench == NULL) {
+        Print(L"ERROR: Could not allocate memory\n");
+        GopModeFreeTable(Table);
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    OrgMode = Gop->Mode->Mode;
+    for (UINT32 i = 0; i < Table->Count; i++) {
+        Bench[i].Mode = Table->Modes[i].Mode;
+        Bench[i].Width = Table->Modes[i].Info.HorizontalResolution;
+        Bench[i].Height = Table->Modes[i].Info.VerticalResolution;
+        Bench[i].Status = GopModeSet(Gop, Bench[i].Mode, &Bench[i].SwitchTime);
+        if (!EFI_ERROR (Bench[i].Status)) {
+            Bench[i].Status = BenchMode(Gop, &Bench[i]);
+        }
+    }
+    GopModeSet(Gop, OrgMode, NULL);
+
+    for (UINT32 i = 0; i < Table->Count; i++) {
+        BenchPrint(&Bench[i]);
+    }
+
+    FreePool(Bench);
+    GopModeFreeTable(Table);
+
+    return Status;
+}
+
+
+static EFI_STATUS
+MemTypeGOP( BOOLEAN TrialWC)
+{
+    EFI_HANDLE GopHandle;
+    EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop;
+    EFI_STATUS Status;
+
+    Status = FindGOP(&GopHandle, &Gop);
+    if (EFI_ERROR (Status)) {
+        return Status;
+    }
+
+    return CheckMemType(Gop, TrialWC);
+}
+
+
+//
+// Time Lines lines of text through ConOut and through the glyph console
+//
+static UINT64
+PrintLines( UINTN Lines)
+{
+    UINT64 StartTime;
+
+    StartTime = GetPerformanceCounter();
+    for (UINTN i = 0; i < Lines; i++) {
+        Print(L"%04d  %02x:%02x.%x  8086:%04x  The quick brown fox jumps over the lazy dog\n",
+              i, (UINT8)(i >> 5), (UINT8)(i & 0x1F), (UINT8)(i & 7), (UINT16)i);
+    }
+    GlyphConsoleClose();
+
+    return GetTimeInNanoSecond(GetPerformanceCounter() - StartTime);
+}
+
+
+static EFI_STATUS
+TextGOP( UINTN Lines)
+{
+    UINT64 ConOutTime;
+    UINT64 GlyphTime;
+    EFI_STATUS Status;
+
+    ConOutTime = PrintLines(Lines);
+
+    Status = GlyphConsoleOpen();
+    if (EFI_ERROR (Status)) {
+        Print(L"ERROR: Could not open glyph console [%r]\n", Status);
+        return Status;
+    }
+    GlyphTime = PrintLines(Lines);
+
+    Print(L"\n");
+    Print(L"Lines             : %d\n", Lines);
+    Print(L"ConOut            : %ld us  %ld lines/s\n", DivU64x32(ConOutTime, 1000),
+          DivU64x64Remainder(MultU64x32(Lines, 1000000000), MAX(ConOutTime, 1), NULL));
+    Print(L"Glyph console     : %ld us  %ld lines/s\n", DivU64x32(GlyphTime, 1000),
+          DivU64x64Remainder(MultU64x32(Lines, 1000000000), MAX(GlyphTime, 1), NULL));
+
+    return Status;
+}
+
+
 static void
 Usage(void)
 {
     Print(L"Usage: ScreenModes [-v|--verbose]\n");
+    Print(L"       ScreenModes [-t|--table] [-r|--refresh] [--rank width height]\n");
+    Print(L"                   [-s|--set mode|best]\n");
+    Print(L"       ScreenModes [-b|--bench]\n");
+    Print(L"       ScreenModes [-g|--text [lines]]\n");
+    Print(L"       ScreenModes [-a|--attributes] [--wc]\n");
 }
 
 
@@ -367,20 +613,92 @@ ShellAppMain(UINTN Argc, CHAR16 **Argv)
 {
     EFI_STATUS Status = EFI_SUCCESS;
     BOOLEAN Verbose = FALSE;
-
-    if (Argc == 2) {
-        if (!StrCmp(Argv[1], L"--verbose") ||
-            !StrCmp(Argv[1], L"-v")) {
+    BOOLEAN Table = FALSE;
+    BOOLEAN Refresh = FALSE;
+    BOOLEAN SetMode = FALSE;
+    BOOLEAN SetBest = FALSE;
+    UINTN Width = 0;
+    UINTN Height = 0;
+    UINT32 Mode = 0;
+    BOOLEAN Attributes = FALSE;
+    BOOLEAN TrialWC = FALSE;
+    UINTN Lines;
+
+    for (int i = 1; i < Argc; i++) {
+        if (!StrCmp(Argv[i], L"--verbose") ||
+            !StrCmp(Argv[i], L"-v")) {
             Verbose = TRUE;
-        }
-        if (!StrCmp(Argv[1], L"--help") ||
-            !StrCmp(Argv[1], L"-h") ||
-            !StrCmp(Argv[1], L"-?")) {
+        } else if (!StrCmp(Argv[i], L"--help") ||
+            !StrCmp(Argv[i], L"-h") ||
+            !StrCmp(Argv[i], L"-?")) {
+            Usage();
+            return Status;
+        } else if (!StrCmp(Argv[i], L"--bench") ||
+            !StrCmp(Argv[i], L"-b")) {
+            return BenchGOP();
+        } else if (!StrCmp(Argv[i], L"--text") ||
+            !StrCmp(Argv[i], L"-g")) {
+            Lines = 1000;
+            if (i + 1 < Argc) {
+                Lines = StrDecimalToUintn(Argv[++i]);
+            }
+            if (Lines == 0) {
+                Print(L"ERROR: Invalid line count.\n");
+                Usage();
+                return Status;
+            }
+            return TextGOP(Lines);
+        } else if (!StrCmp(Argv[i], L"--attributes") ||
+            !StrCmp(Argv[i], L"-a")) {
+            Attributes = TRUE;
+        } else if (!StrCmp(Argv[i], L"--wc")) {
+            Attributes = TRUE;
+            TrialWC = TRUE;
+        } else if (!StrCmp(Argv[i], L"--table") ||
+            !StrCmp(Argv[i], L"-t")) {
+            Table = TRUE;
+        } else if (!StrCmp(Argv[i], L"--refresh") ||
+            !StrCmp(Argv[i], L"-r")) {
+            Table = TRUE;
+            Refresh = TRUE;
+        } else if (!StrCmp(Argv[i], L"--rank")) {
+            if (i + 2 >= Argc) {
+                Print(L"ERROR: Invalid image size.\n");
+                Usage();
+                return Status;
+            }
+            Table = TRUE;
+            Width = StrDecimalToUintn(Argv[++i]);
+            Height = StrDecimalToUintn(Argv[++i]);
+        } else if (!StrCmp(Argv[i], L"--set") ||
+            !StrCmp(Argv[i], L"-s")) {
+            if (++i >= Argc) {
+                Print(L"ERROR: Invalid mode.\n");
+                Usage();
+                return Status;
+            }
+            Table = TRUE;
+            SetMode = TRUE;
+            if (!StrCmp(Argv[i], L"best")) {
+                SetBest = TRUE;
+            } else {
+                Mode = (UINT32)StrDecimalToUintn(Argv[i]);
+            }
+        } else {
+            Print(L"ERROR: Unknown option.\n");
             Usage();
             return Status;
         }
     }
 
+    if (Attributes) {
+        return MemTypeGOP(TrialWC);
+    }
+
+    if (Table) {
+        return RankGOP(Refresh, Width, Height, SetMode, SetBest, Mode);
+    }
+
 
     // First check for older EDK ConsoleControl protocol support
     CheckCCP(Verbose);
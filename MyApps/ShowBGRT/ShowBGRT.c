@@ -1,7 +1,10 @@
 //
 //  Copyright (c) 2015  Finnbarr P. Murphy.   All rights reserved.
 //
-//  Show BGRT info, save image to file if option selected
+//  Show BGRT info, save image to file or redisplay it if option selected
+//
+//  The image can be saved to any mapped volume, as it is or re-encoded
+//  as RLE8, and is streamed out in 64K chunks with a single flush.
 //
 //  License: BSD License
 //
@@ -16,6 +19,7 @@
 #include <Library/MemoryAllocationLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/PrintLib.h>
+#include <Library/DevicePathLib.h>
 
 #include <Protocol/EfiShell.h>
 #include <Protocol/LoadedImage.h>
@@ -23,6 +27,8 @@
 #include <Protocol/SimpleFileSystem.h>
 #include <Protocol/GraphicsOutput.h>
 
+#include <Library/BmpLib.h>
+
 
 #define EFI_ACPI_TABLE_GUID \
     { 0xeb9d2d30, 0x2d88, 0x11d3, {0x9a, 0x16, 0x0, 0x90, 0x27, 0x3f, 0xc1, 0x4d }}
@@ -49,28 +55,34 @@ typedef struct {
 #define EFI_ACPI_5_0_BGRT_STATUS_VALID         EFI_ACPI_5_0_BGRT_STATUS_DISPLAYED
 #define EFI_ACPI_5_0_BGRT_IMAGE_TYPE_BMP       0x00
 
+#define SAVE_CHUNK_SIZE      (64 * 1024)     // bytes per write
+#define PALETTE_HASH_SIZE    1024            // power of two, well over BMP_LUT_ENTRIES
+
 typedef struct {
-    CHAR8   CharB;
-    CHAR8   CharM;
-    UINT32  Size;
-    UINT16  Reserved[2];
-    UINT32  ImageOffset;    
-    UINT32  HeaderSize;      
-    UINT32  PixelWidth; 
-    UINT32  PixelHeight; 
-    UINT16  Planes; 
-    UINT16  BitPerPixel;  
-    UINT32  CompressionType;
-    UINT32  ImageSize; 
-    UINT32  XPixelsPerMeter;
-    UINT32  YPixelsPerMeter;
-    UINT32  NumberOfColors;
-    UINT32  ImportantColors;
-} __attribute__((__packed__)) BMP_IMAGE_HEADER;
+    SHELL_FILE_HANDLE FileHandle;
+    UINT8    *Buffer;            // one chunk
+    UINTN     Used;              // bytes waiting in Buffer
+    UINT64    Size;              // bytes written so far, including Buffer
+    EFI_STATUS WriteStatus;      // of the write that failed, if one did
+} SAVE_FILE;
 
+//
+// Colors seen so far when converting to RLE8, with a hash table from
+// color to palette index.
+//
+typedef struct {
+    UINT32    Color[PALETTE_HASH_SIZE];
+    UINT16    Slot[PALETTE_HASH_SIZE];  // palette index plus one, 0 if free
+    UINT32    Entry[BMP_LUT_ENTRIES];
+    UINTN     Count;
+} RLE_PALETTE;
 
 int Verbose = 0;
 int SaveImage = 0;
+int ShowImage = 0;
+int SaveRle = 0;
+CHAR16 *SaveName = L"bootlogo.bmp";
+CHAR16 *SaveVolume = NULL;
 
 
 static VOID
@@ -90,48 +102,402 @@ AsciiToUnicodeSize( CHAR8 *String,
 
 
 //
-// Save Boot Logo image as a BMP file
+// One write straight to the file.  A short write is an error too.
+//
+static EFI_STATUS
+WriteChunk( SAVE_FILE *File,
+            VOID *Data,
+            UINTN Size)
+{
+    EFI_STATUS Status;
+    UINTN Length = Size;
+
+    Status = ShellWriteFile(File->FileHandle, &Length, Data);
+    if (!EFI_ERROR(Status) && Length != Size) {
+        Status = EFI_DEVICE_ERROR;
+    }
+    if (EFI_ERROR(Status)) {
+        File->WriteStatus = Status;
+    }
+
+    return Status;
+}
+
+
+//
+// Write Size bytes to the file.  Data is gathered into chunk sized
+// writes so that every write but the last starts on a chunk boundary;
+// whole chunks are written straight from Data.
+//
+static EFI_STATUS
+SaveWrite( SAVE_FILE *File,
+           VOID *Data,
+           UINTN Size)
+{
+    UINT8 *Src = Data;
+    EFI_STATUS Status = EFI_SUCCESS;
+    UINTN Count;
+
+    while (Size > 0 && !EFI_ERROR(Status)) {
+        if (File->Used == 0 && Size >= SAVE_CHUNK_SIZE) {
+            Count = SAVE_CHUNK_SIZE;
+            Status = WriteChunk(File, Src, Count);
+        } else {
+            Count = MIN(Size, SAVE_CHUNK_SIZE - File->Used);
+            CopyMem(File->Buffer + File->Used, Src, Count);
+            File->Used += Count;
+            if (File->Used == SAVE_CHUNK_SIZE) {
+                Status = WriteChunk(File, File->Buffer, File->Used);
+                File->Used = 0;
+            }
+        }
+        Src += Count;
+        Size -= Count;
+        File->Size += Count;
+    }
+
+    return Status;
+}
+
+
+//
+// Map a pixel to its index in the RLE8 palette, adding the color if
+// it is new.  Fails once a 257th color turns up.
+//
+static EFI_STATUS
+PaletteIndex( RLE_PALETTE *Palette,
+              UINT32 Color,
+              UINT8 *Index)
+{
+    UINTN Slot;
+
+    Color &= 0x00FFFFFF;
+    Slot = ((UINT32)(Color * 2654435761U) >> 22) & (PALETTE_HASH_SIZE - 1);
+    while (Palette->Slot[Slot] != 0) {
+        if (Palette->Color[Slot] == Color) {
+            *Index = (UINT8)(Palette->Slot[Slot] - 1);
+            return EFI_SUCCESS;
+        }
+        Slot = (Slot + 1) & (PALETTE_HASH_SIZE - 1);
+    }
+
+    if (Palette->Count == BMP_LUT_ENTRIES) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    Palette->Color[Slot] = Color;
+    Palette->Slot[Slot] = (UINT16)(Palette->Count + 1);
+    Palette->Entry[Palette->Count] = Color;
+    *Index = (UINT8)Palette->Count++;
+
+    return EFI_SUCCESS;
+}
+
+
+//
+// Re-encode the boot logo as an 8-bit RLE8 BMP.  The first pass over
+// the rows collects the palette, the second encodes them with it and
+// streams the result out.  The sizes in Header are left for the caller
+// to fill in once everything has been written.
+//
+static EFI_STATUS
+SaveRle8( SAVE_FILE *File,
+          BMP_IMAGE_HEADER *BmpHeader,
+          BMP_IMAGE_INFO *Info,
+          BMP_IMAGE_HEADER *Header)
+{
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL Lut[BMP_LUT_ENTRIES];
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Row;
+    UINT32 *Pixel;
+    UINT8 *Data = (UINT8 *)BmpHeader + Info->ImageOffset;
+    UINT8 *Index;
+    UINT8 *Code;
+    UINT8 EndOfBitmap[2] = { 0, 1 };
+    RLE_PALETTE *Palette;
+    BMP_RLE_DECODER Rle;
+    EFI_STATUS Status = EFI_SUCCESS;
+
+    Row = AllocatePool(Info->Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+    Index = AllocatePool(Info->Width);
+    Code = AllocatePool(BMP_RLE8_ROW_MAX(Info->Width));
+    Palette = AllocateZeroPool(sizeof(RLE_PALETTE));
+    if (Row == NULL || Index == NULL || Code == NULL || Palette == NULL) {
+        Print(L"ERROR: Out of memory\n");
+        Status = EFI_OUT_OF_RESOURCES;
+        goto Done;
+    }
+
+    BmpBuildLut(Info, Lut);
+    Pixel = (UINT32 *)Row;
+
+    for (UINTN Pass = 0; Pass < 2 && !EFI_ERROR(Status); Pass++) {
+        if (Pass == 1) {
+            ZeroMem(Header, sizeof(BMP_IMAGE_HEADER));
+            Header->CharB = 'B';
+            Header->CharM = 'M';
+            Header->ImageOffset = (UINT32)(sizeof(BMP_IMAGE_HEADER) + Palette->Count * sizeof(UINT32));
+            Header->HeaderSize = BMP_INFO_HEADER_SIZE;
+            Header->PixelWidth = (UINT32)Info->Width;
+            Header->PixelHeight = (UINT32)Info->Height;
+            Header->Planes = 1;
+            Header->BitPerPixel = 8;
+            Header->CompressionType = BMP_RLE8;
+            Header->XPixelsPerMeter = BmpHeader->XPixelsPerMeter;
+            Header->YPixelsPerMeter = BmpHeader->YPixelsPerMeter;
+            Header->NumberOfColors = (UINT32)Palette->Count;
+
+            Status = SaveWrite(File, Header, sizeof(BMP_IMAGE_HEADER));
+            if (!EFI_ERROR(Status)) {
+                Status = SaveWrite(File, Palette->Entry, Palette->Count * sizeof(UINT32));
+            }
+        }
+        if (Info->CompressionType != BMP_RGB && !EFI_ERROR(Status)) {
+            Status = BmpRleInit(Info, Data, &Rle);
+            if (EFI_ERROR(Status)) {
+                Print(L"ERROR: Boot logo RLE data is corrupt, not saved\n");
+            }
+        }
+
+        // RLE8 rows go out bottom up, whatever order they are stored in
+        for (UINTN y = 0; y < Info->Height && !EFI_ERROR(Status); y++) {
+            if (Info->CompressionType != BMP_RGB) {
+                Status = BmpRleDecodeRow(&Rle, Lut, Row);
+                if (EFI_ERROR(Status)) {
+                    Print(L"ERROR: Boot logo RLE data is corrupt, not saved\n");
+                    break;
+                }
+            } else {
+                BmpConvertRow( Data + (Info->TopDown ? Info->Height - 1 - y : y) * Info->RowSize,
+                               Info->Width,
+                               Info->BitPerPixel,
+                               Lut,
+                               Row);
+            }
+            for (UINTN x = 0; x < Info->Width && !EFI_ERROR(Status); x++) {
+                if (x > 0 && Pixel[x] == Pixel[x - 1]) {
+                    Index[x] = Index[x - 1];
+                } else {
+                    Status = PaletteIndex(Palette, Pixel[x], &Index[x]);
+                }
+            }
+            if (EFI_ERROR(Status)) {
+                Print(L"ERROR: Boot logo has more than %d colors, cannot save as RLE8\n", BMP_LUT_ENTRIES);
+                break;
+            }
+            if (Pass == 1) {
+                Status = SaveWrite(File, Code, BmpRle8EncodeRow(Index, Info->Width, Code));
+            }
+        }
+    }
+
+    if (!EFI_ERROR(Status)) {
+        Status = SaveWrite(File, EndOfBitmap, sizeof(EndOfBitmap));
+    }
+
+Done:
+    if (Row != NULL) FreePool(Row);
+    if (Index != NULL) FreePool(Index);
+    if (Code != NULL) FreePool(Code);
+    if (Palette != NULL) FreePool(Palette);
+
+    return Status;
+}
+
+
+//
+// Save Boot Logo image as a BMP file, as it is or re-encoded as RLE8.
+// The file is written in chunks and flushed once at the end; if any
+// of it fails the partial file is deleted.
 //
-EFI_STATUS 
+static EFI_STATUS
 SaveBMP( CHAR16 *FileName,
-         UINT8 *FileData,
-         UINTN FileDataLength)
+         BMP_IMAGE_HEADER *BmpHeader,
+         BMP_IMAGE_INFO *Info)
 {
-    EFI_STATUS          Status;
-    EFI_FILE_HANDLE     FileHandle;
-    UINTN               BufferSize;
-    EFI_FILE_PROTOCOL   *Root;
-    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *SimpleFileSystem;
-    
-    Status = gBS->LocateProtocol( &gEfiSimpleFileSystemProtocolGuid, 
-                                  NULL,
-                                  (VOID **)&SimpleFileSystem);
+    BMP_IMAGE_HEADER Header;
+    SAVE_FILE File;
+    EFI_FILE_INFO *FileInfo;
+    EFI_STATUS Status;
+
+    ZeroMem(&File, sizeof(File));
+    File.Buffer = AllocatePool(SAVE_CHUNK_SIZE);
+    if (File.Buffer == NULL) {
+        Print(L"ERROR: Out of memory\n");
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    Status = ShellOpenFileByName(FileName, &File.FileHandle,
+                                 EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE, 0);
     if (EFI_ERROR(Status)) {
-        Print(L"Cannot find EFI_SIMPLE_FILE_SYSTEM_PROTOCOL \r\n");
-        return Status;    
+        Print(L"ERROR: Creating %s [%r]\n", FileName, Status);
+        FreePool(File.Buffer);
+        return Status;
     }
 
-    Status = SimpleFileSystem->OpenVolume(SimpleFileSystem, &Root);
+    // an existing file is truncated rather than overwritten at the start
+    FileInfo = ShellGetFileInfo(File.FileHandle);
+    if (FileInfo == NULL) {
+        Status = EFI_DEVICE_ERROR;
+    } else {
+        if (FileInfo->FileSize != 0) {
+            FileInfo->FileSize = 0;
+            Status = ShellSetFileInfo(File.FileHandle, FileInfo);
+        }
+        FreePool(FileInfo);
+    }
+    if (EFI_ERROR(Status)) {
+        Print(L"ERROR: Truncating %s [%r]\n", FileName, Status);
+        ShellCloseFile(&File.FileHandle);
+        FreePool(File.Buffer);
+        return Status;
+    }
+
+    if (SaveRle) {
+        Status = SaveRle8(&File, BmpHeader, Info, &Header);
+    } else {
+        Status = SaveWrite(&File, BmpHeader, BmpHeader->Size);
+    }
+
+    if (!EFI_ERROR(Status) && File.Used > 0) {
+        Status = WriteChunk(&File, File.Buffer, File.Used);
+    }
+
+    // the sizes are only known now the image data is written
+    if (!EFI_ERROR(Status) && SaveRle) {
+        Header.Size = (UINT32)File.Size;
+        Header.ImageSize = (UINT32)(File.Size - Header.ImageOffset);
+        Status = ShellSetFilePosition(File.FileHandle, 0);
+        if (EFI_ERROR(Status)) {
+            File.WriteStatus = Status;
+        } else {
+            Status = WriteChunk(&File, &Header, sizeof(Header));
+        }
+    }
+
+    if (!EFI_ERROR(Status)) {
+        Status = ShellFlushFile(File.FileHandle);
+        if (EFI_ERROR(Status)) {
+            File.WriteStatus = Status;
+        }
+    }
+
+    // decode and memory errors have been reported already
     if (EFI_ERROR(Status)) {
-        Print(L"ERROR: Volume open\n");
-        return Status;    
+        if (EFI_ERROR(File.WriteStatus)) {
+            Print(L"ERROR: Writing %s [%r]\n", FileName, File.WriteStatus);
+        }
+        ShellDeleteFile(&File.FileHandle);
+    } else {
+        ShellCloseFile(&File.FileHandle);
+        Print(L"Saved boot logo to %s (%ld bytes)\n", FileName, File.Size);
     }
 
-    Status = Root->Open( Root, 
-                         &FileHandle, 
-                         FileName,
-                         EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE, 
-                         0);
+    FreePool(File.Buffer);
+
+    return Status;
+}
+
+
+//
+// Build the path to save to.  The target volume can be given as a
+// mapping, with or without its colon, or as a device path in text
+// form, which is turned into the volume's mapping.
+//
+static CHAR16 *
+SavePath( CHAR16 *Volume,
+          CHAR16 *FileName)
+{
+    EFI_DEVICE_PATH_PROTOCOL *DevicePath;
+    EFI_DEVICE_PATH_PROTOCOL *Node;
+    CONST CHAR16 *MapList;
+    CHAR16 *Map;
+    CHAR16 *Path;
+    UINTN Length;
+
+    if (Volume == NULL) {
+        return CatSPrint(NULL, L"%s", FileName);
+    }
+
+    // strip the volume and leading separators the file name might have
+    for (CHAR16 *p = FileName; *p != L'\0'; p++) {
+        if (*p == L':') {
+            FileName = p + 1;
+            break;
+        }
+    }
+    while (*FileName == L'\\') {
+        FileName++;
+    }
+
+    Map = CatSPrint(NULL, L"%s", Volume);
+    if (Map == NULL) {
+        return NULL;
+    }
+    Length = StrLen(Map);
+    if (Length > 0 && Map[Length - 1] == L':') {
+        Map[--Length] = L'\0';
+    }
+
+    if (gEfiShellProtocol->GetDevicePathFromMap(Map) == NULL) {
+        FreePool(Map);
+        Map = NULL;
+
+        DevicePath = ConvertTextToDevicePath(Volume);
+        if (DevicePath != NULL) {
+            Node = DevicePath;
+            MapList = gEfiShellProtocol->GetMapFromDevicePath(&Node);
+            if (MapList != NULL) {
+                // mappings come as a ; separated list, use the first
+                Map = CatSPrint(NULL, L"%s", MapList);
+                for (CHAR16 *p = Map; p != NULL && *p != L'\0'; p++) {
+                    if (*p == L';' || *p == L':') {
+                        *p = L'\0';
+                        break;
+                    }
+                }
+            }
+            FreePool(DevicePath);
+        }
+        if (Map == NULL) {
+            Print(L"ERROR: No file system mapped for %s\n", Volume);
+            return NULL;
+        }
+    }
+
+    Path = CatSPrint(NULL, L"%s:\\%s", Map, FileName);
+    FreePool(Map);
+
+    return Path;
+}
+
+
+//
+// Decode every row of an RLE compressed image to check the data
+//
+static EFI_STATUS
+CheckRle( BMP_IMAGE_INFO *Info,
+          UINT8 *Image)
+{
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL Lut[BMP_LUT_ENTRIES];
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Row;
+    BMP_RLE_DECODER Rle;
+    EFI_STATUS Status;
+
+    Status = BmpRleInit(Info, Image + Info->ImageOffset, &Rle);
     if (EFI_ERROR(Status)) {
-        Print(L"ERROR: File open\n");
         return Status;
-    }    
-    
-    BufferSize = FileDataLength;
-    Status = FileHandle->Write(FileHandle, &BufferSize, FileData);
-    FileHandle->Close(FileHandle);
-    
-    Print(L"Successfully saved bootlogo.bmp\n");
+    }
+
+    Row = AllocatePool(Info->Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+    if (Row == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    BmpBuildLut(Info, Lut);
+    for (UINTN y = 0; y < Info->Height && !EFI_ERROR(Status); y++) {
+        Status = BmpRleDecodeRow(&Rle, Lut, Row);
+    }
+
+    FreePool(Row);
 
     return Status;
 }
@@ -144,38 +510,21 @@ EFI_STATUS
 ParseBMP(UINT64 BmpImage)
 {
     BMP_IMAGE_HEADER *BmpHeader = (BMP_IMAGE_HEADER *)BmpImage;
+    BMP_IMAGE_INFO Info;
     EFI_STATUS Status = EFI_SUCCESS;
     CHAR16 Buffer[100];
+    CHAR16 *Path;
 
-    if (Verbose) {
-        // not BMP format
-        if (BmpHeader->CharB != 'B' || BmpHeader->CharM != 'M') {
-            Print(L"ERROR: Unsupported image format\n"); 
-            return EFI_UNSUPPORTED;
-        }
-
-        // BITMAPINFOHEADER format unsupported
-        if (BmpHeader->HeaderSize != sizeof (BMP_IMAGE_HEADER) \
-            - ((UINTN) &(((BMP_IMAGE_HEADER *)0)->HeaderSize))) {
-            Print(L"ERROR: Unsupported BITMAPFILEHEADER\n");
-            return EFI_UNSUPPORTED;
-        }
-
-        // compression type not 0
-        if (BmpHeader->CompressionType != 0) {
-            Print(L"ERROR: Compression Type not 0\n");
-            return EFI_UNSUPPORTED;
-        }
+    // not BMP format
+    if (BmpHeader == NULL || BmpHeader->CharB != 'B' || BmpHeader->CharM != 'M') {
+        Print(L"ERROR: Unsupported image format\n"); 
+        return EFI_UNSUPPORTED;
+    }
 
-        // unsupported bits per pixel
-        if (BmpHeader->BitPerPixel != 4 &&
-            BmpHeader->BitPerPixel != 8 &&
-            BmpHeader->BitPerPixel != 12 &&
-            BmpHeader->BitPerPixel != 24) {
-            Print(L"ERROR: Bits per pixel is not one of 4, 8, 12 or 24\n");
-            return EFI_UNSUPPORTED;
-        }
+    // the image is in memory, and its own size is all there is to go by
+    Status = BmpParse(BmpHeader, BmpHeader->Size, BmpHeader->Size, &Info);
 
+    if (Verbose) {
         Print(L"\n");
         AsciiToUnicodeSize((CHAR8 *)BmpHeader, 2, Buffer);
         Print(L"BMP Signature     : %s\n", Buffer);
@@ -186,19 +535,44 @@ ParseBMP(UINT64 BmpImage)
         Print(L"Image Height      : %d\n", BmpHeader->PixelHeight);
         Print(L"Planes            : %d\n", BmpHeader->Planes);
         Print(L"Bit Per Pixel     : %d\n", BmpHeader->BitPerPixel);
-        Print(L"Compression Type  : %d\n", BmpHeader->CompressionType);
+        Print(L"Compression Type  : %d", BmpHeader->CompressionType);
+        if (BmpHeader->CompressionType == BMP_RLE8)
+            Print(L" (RLE8)");
+        if (BmpHeader->CompressionType == BMP_RLE4)
+            Print(L" (RLE4)");
+        Print(L"\n"); 
         Print(L"Image Size        : %d\n", BmpHeader->ImageSize);
         Print(L"X Pixels Per Meter: %d\n", BmpHeader->XPixelsPerMeter);
         Print(L"Y Pixels Per Meter: %d\n", BmpHeader->YPixelsPerMeter);
         Print(L"Number of Colors  : %d\n", BmpHeader->NumberOfColors);
         Print(L"Important Colors  : %d\n", BmpHeader->ImportantColors);
+        if (Status == EFI_UNSUPPORTED) {
+            Print(L"Image Data        : Not supported\n");
+        } else if (EFI_ERROR(Status)) {
+            Print(L"Image Data        : Corrupt or truncated\n");
+        } else {
+            Print(L"Row Order         : %s\n", Info.TopDown ? L"Top down" : L"Bottom up");
+            if (Info.CompressionType == BMP_RGB) {
+                Print(L"Row Size          : %d\n", Info.RowSize);
+            }
+            Print(L"Palette Entries   : %d\n", Info.PaletteEntries);
+            if (Info.CompressionType != BMP_RGB) {
+                Print(L"RLE Data          : %s\n",
+                      EFI_ERROR(CheckRle(&Info, (UINT8 *)BmpHeader)) ? L"Corrupt" : L"OK");
+            }
+        }
     } // Verbose
     
-    // save the boot logo to a file
-    if (SaveImage) {
-        Status = SaveBMP(L"bootlogo.bmp", (UINT8 *)BmpImage, BmpHeader->Size);
-        if (EFI_ERROR(Status)) {
-            Print(L"ERROR: Saving boot logo file: %x\n", Status);
+    // save the boot logo to a file, unless its size cannot be trusted
+    if (SaveImage && Status == EFI_INVALID_PARAMETER) {
+        Print(L"ERROR: Boot logo is corrupt, not saved\n");
+    } else if (SaveImage && SaveRle && EFI_ERROR(Status)) {
+        Print(L"ERROR: Boot logo cannot be decoded, not saved as RLE8\n");
+    } else if (SaveImage) {
+        Path = SavePath(SaveVolume, SaveName);
+        if (Path != NULL) {
+            SaveBMP(Path, BmpHeader, &Info);
+            FreePool(Path);
         }
     }
 
@@ -206,6 +580,119 @@ ParseBMP(UINT64 BmpImage)
 }
 
 
+//
+// Redraw the boot logo where the firmware put it, decoding straight
+// from the image in memory that BGRT points at
+//
+static EFI_STATUS
+ShowLogo( EFI_ACPI_BGRT *Bgrt)
+{
+    EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop;
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Mode;
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL Lut[BMP_LUT_ENTRIES];
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *Blt;
+    BMP_IMAGE_HEADER *BmpHeader = (BMP_IMAGE_HEADER *)(UINTN)Bgrt->ImageAddress;
+    BMP_IMAGE_INFO Info;
+    BMP_RLE_DECODER Rle;
+    EFI_INPUT_KEY Key;
+    EFI_STATUS Status;
+    UINTN EventIndex;
+    UINTN Row;
+    UINT8 *Data;
+
+    if (Bgrt->ImageType != EFI_ACPI_5_0_BGRT_IMAGE_TYPE_BMP || BmpHeader == NULL ||
+        BmpHeader->CharB != 'B' || BmpHeader->CharM != 'M') {
+        Print(L"ERROR: Boot logo is not a BMP image\n");
+        return EFI_UNSUPPORTED;
+    }
+
+    Status = BmpParse(BmpHeader, BmpHeader->Size, BmpHeader->Size, &Info);
+    if (EFI_ERROR(Status)) {
+        Print(L"ERROR: Boot logo cannot be displayed [%r]\n", Status);
+        return Status;
+    }
+
+    // the logo was drawn on the console, so prefer the console's GOP
+    Status = gBS->HandleProtocol( gST->ConsoleOutHandle,
+                                  &gEfiGraphicsOutputProtocolGuid,
+                                  (VOID **)&Gop);
+    if (EFI_ERROR(Status)) {
+        Status = gBS->LocateProtocol( &gEfiGraphicsOutputProtocolGuid,
+                                      NULL,
+                                      (VOID **)&Gop);
+        if (EFI_ERROR(Status)) {
+            Print(L"ERROR: Could not locate GOP\n");
+            return Status;
+        }
+    }
+
+    // the offsets are only meaningful in the mode the firmware booted in
+    Mode = Gop->Mode->Info;
+    if (Bgrt->ImageOffsetX > Mode->HorizontalResolution ||
+        Bgrt->ImageOffsetY > Mode->VerticalResolution ||
+        Info.Width > Mode->HorizontalResolution - Bgrt->ImageOffsetX ||
+        Info.Height > Mode->VerticalResolution - Bgrt->ImageOffsetY) {
+        Print(L"ERROR: %dx%d boot logo at %d,%d does not fit the current %dx%d mode\n",
+              Info.Width, Info.Height, Bgrt->ImageOffsetX, Bgrt->ImageOffsetY,
+              Mode->HorizontalResolution, Mode->VerticalResolution);
+        return EFI_BAD_BUFFER_SIZE;
+    }
+
+    // it fits on screen, so the product cannot overflow
+    Blt = AllocatePool(Info.Width * Info.Height * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+    if (Blt == NULL) {
+        Print(L"ERROR: Out of memory\n");
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    BmpBuildLut(&Info, Lut);
+    Data = (UINT8 *)BmpHeader + Info.ImageOffset;
+    if (Info.CompressionType != BMP_RGB) {
+        Status = BmpRleInit(&Info, Data, &Rle);
+    }
+
+    // rows are stored bottom up unless the height was negative
+    for (UINTN y = 0; y < Info.Height && !EFI_ERROR(Status); y++) {
+        Row = Info.TopDown ? y : Info.Height - 1 - y;
+        if (Info.CompressionType == BMP_RGB) {
+            BmpConvertRow( Data + y * Info.RowSize,
+                           Info.Width,
+                           Info.BitPerPixel,
+                           Lut,
+                           Blt + Row * Info.Width);
+        } else {
+            Status = BmpRleDecodeRow(&Rle, Lut, Blt + Row * Info.Width);
+        }
+    }
+    if (EFI_ERROR(Status)) {
+        Print(L"ERROR: Boot logo RLE data is corrupt\n");
+        goto Done;
+    }
+
+    gST->ConOut->ClearScreen(gST->ConOut);
+    Status = Gop->Blt( Gop,
+                       Blt,
+                       EfiBltBufferToVideo,
+                       0, 0,
+                       Bgrt->ImageOffsetX, Bgrt->ImageOffsetY,
+                       Info.Width, Info.Height,
+                       0);
+    if (EFI_ERROR(Status)) {
+        Print(L"ERROR: Blt [%r]\n", Status);
+        goto Done;
+    }
+
+    gBS->WaitForEvent(1, &gST->ConIn->WaitForKey, &EventIndex);
+    gST->ConIn->ReadKeyStroke(gST->ConIn, &Key);
+    gST->ConOut->ClearScreen(gST->ConOut);
+
+Done:
+    FreePool(Blt);
+
+    return Status;
+}
+
+
 //
 // Parse Boot Graphic Resource Table
 //
@@ -249,6 +736,10 @@ ParseBGRT(EFI_ACPI_BGRT *Bgrt)
     ParseBMP(Bgrt->ImageAddress);
  
     Print(L"\n");
+
+    if (ShowImage) {
+        ShowLogo(Bgrt);
+    }
 }
 
 
@@ -289,7 +780,9 @@ ParseRSDP( EFI_ACPI_2_0_ROOT_SYSTEM_DESCRIPTION_POINTER *Rsdp, CHAR16* GuidStr)
 static void
 Usage(void)
 {
-    Print(L"Usage: ShowBGRT [-v|--verbose] [-s|--save]\n");
+    Print(L"Usage: ShowBGRT [-v|--verbose] [-s|--save] [-o|--output file] [-t|--target volume]\n");
+    Print(L"                [-r|--rle] [-d|--show]\n");
+    Print(L"  volume is a mapping such as fs1: or a device path in text form\n");
 }
 
 
@@ -315,8 +808,23 @@ ShellAppMain(UINTN Argc, CHAR16 **Argv)
             Usage();
             return Status;
         } else if (!StrCmp(Argv[i], L"--save") ||
-            !StrCmp(Argv[1], L"-s")) {
+            !StrCmp(Argv[i], L"-s")) {
+            SaveImage = 1;
+        } else if ((!StrCmp(Argv[i], L"--output") ||
+            !StrCmp(Argv[i], L"-o")) && i + 1 < Argc) {
+            SaveName = Argv[++i];
+            SaveImage = 1;
+        } else if ((!StrCmp(Argv[i], L"--target") ||
+            !StrCmp(Argv[i], L"-t")) && i + 1 < Argc) {
+            SaveVolume = Argv[++i];
+            SaveImage = 1;
+        } else if (!StrCmp(Argv[i], L"--rle") ||
+            !StrCmp(Argv[i], L"-r")) {
+            SaveRle = 1;
             SaveImage = 1;
+        } else if (!StrCmp(Argv[i], L"--show") ||
+            !StrCmp(Argv[i], L"-d")) {
+            ShowImage = 1;
         } else {
             Print(L"ERROR: Unknown option.\n");
             Usage();
@@ -18,6 +18,8 @@
 #include <Library/MemoryAllocationLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/PrintLib.h>
+#include <Library/LineReaderLib.h>
+#include <Library/GlyphConsoleLib.h>
 
 #include <Protocol/EfiShell.h>
 #include <Protocol/PciEnumerationComplete.h>
@@ -92,8 +94,8 @@ typedef struct {
 } PCI_CONFIG_SPACE;
 #pragma pack()
 
-#define UTILITY_VERSION L"0.8"
-#define LINE_MAX  1024
+#define UTILITY_VERSION L"0.9"
+#define DESC_MAX  256
 
 #define EFI_PCI_EMUMERATION_COMPLETE_GUID \
     { 0x30cfe3e7, 0x3de1, 0x4586, {0xbe, 0x20, 0xde, 0xab, 0xa1, 0xb3, 0xb7, 0x93}}
@@ -103,8 +105,9 @@ CHAR16 *
 GetDeviceDesc( CHAR16 *Line)
 {
     CHAR16 *s = Line;
-    static CHAR16 DeviceDesc[LINE_MAX];
+    static CHAR16 DeviceDesc[DESC_MAX];
     CHAR16 *d = DeviceDesc;
+    CHAR16 *e = DeviceDesc + DESC_MAX - 1;
 
     s++;
     while (*s++) {
@@ -117,7 +120,7 @@ GetDeviceDesc( CHAR16 *Line)
            break;
     }
 
-    while (*s) {
+    while (*s && d < e) {
         *(d++) = *(s++);
     }
     *d = 0;
@@ -130,8 +133,9 @@ CHAR16 *
 GetVendorDesc( CHAR16 *Line)
 {
     CHAR16 *s = Line;
-    static CHAR16 VendorDesc[LINE_MAX];
+    static CHAR16 VendorDesc[DESC_MAX];
     CHAR16 *d = VendorDesc;
+    CHAR16 *e = VendorDesc + DESC_MAX - 1;
 
     while (*s++) {
         if (*s == L' ' || *s == L'\t')
@@ -143,7 +147,7 @@ GetVendorDesc( CHAR16 *Line)
             break;
     }
 
-    while (*s) {
+    while (*s && d < e) {
         *(d++) = *(s++);
     }
     *d = 0;
@@ -227,8 +231,7 @@ LowerCaseStr( CHAR16 *Str)
 
 
 BOOLEAN
-SearchPciData( SHELL_FILE_HANDLE FileHandle,
-               CHAR16 *ReadLine,
+SearchPciData( LINE_READER *Reader,
                UINTN VendorID, 
                UINTN DeviceID)
 {
@@ -236,8 +239,8 @@ SearchPciData( SHELL_FILE_HANDLE FileHandle,
     EFI_STATUS Status = EFI_SUCCESS;
     BOOLEAN Found = FALSE;
     BOOLEAN VendorFound = FALSE;
-    BOOLEAN Ascii = TRUE;
-    UINTN   Size = LINE_MAX;
+    CHAR16  *ReadLine;
+    UINTN   Length;
     CHAR16  Vendor[5];
     CHAR16  Device[5];
 
@@ -246,20 +249,20 @@ SearchPciData( SHELL_FILE_HANDLE FileHandle,
     UnicodeSPrint(Device, sizeof(Device), L"%04x", DeviceID);
     LowerCaseStr(Device);
 
-    ShellSetFilePosition(FileHandle, 0);
+    Status = LineReaderSeek(Reader, 0);
+    if (EFI_ERROR(Status)) {
+        return Found;
+    }
 
     // read file line by line
-    for (;!ShellFileHandleEof(FileHandle); Size = 1024) {
-        Status = ShellFileHandleReadLine(FileHandle, ReadLine, &Size, TRUE, &Ascii);
-        if (Status == EFI_BUFFER_TOO_SMALL) {
-            Status = EFI_SUCCESS;
-        } else if (EFI_ERROR(Status)) {
+    for (;;) {
+        Status = LineReaderReadLine(Reader, &ReadLine, &Length);
+        if (EFI_ERROR(Status)) {
             break;
         }
 
         // Skip comment and empty lines
-        if (ReadLine[0] == L'#' || ReadLine[0] == L' ' || 
-            ReadLine[0] == L'\n' || ReadLine[0] == L'\r') {
+        if (ReadLine[0] == L'#' || ReadLine[0] == L' ' || ReadLine[0] == L'\0') {
             continue;
         }
  
@@ -283,7 +286,7 @@ SearchPciData( SHELL_FILE_HANDLE FileHandle,
 VOID
 Usage( CHAR16 *Str)
 {
-    Print(L"Usage: %s [ -v | --verbose ]\n", Str);
+    Print(L"Usage: %s [ -v | --verbose ] [ -g | --glyph ]\n", Str);
     Print(L"       %s [ -h | --help | -V | --version ]\n", Str);
 }
 
@@ -302,16 +305,16 @@ ShellAppMain(UINTN Argc, CHAR16 **Argv)
     PCI_DEVICE_HEADER *DeviceHeader;
     CHAR16 FileName[] = L"pci.ids";
     CHAR16 *FullFileName = (CHAR16 *)NULL;
-    CHAR16 *ReadLine = (CHAR16 *)NULL;
+    LINE_READER *Reader = (LINE_READER *)NULL;
     VOID *Interface;
     EFI_HANDLE *HandleBuf;
     UINTN HandleBufSize;
     UINTN HandleCount;
-    UINTN Size = LINE_MAX;
     UINT16 MinBus, MaxBus;
     UINT64 Address;
     BOOLEAN IsEnd; 
     BOOLEAN Verbose = FALSE;
+    BOOLEAN Glyph = FALSE;
   
     for (int i = 1; i < Argc; i++) {
         if (!StrCmp(Argv[i], L"--version") ||
@@ -321,6 +324,9 @@ ShellAppMain(UINTN Argc, CHAR16 **Argv)
         } else if (!StrCmp(Argv[i], L"--verbose") ||
             !StrCmp(Argv[i], L"-v")) {
             Verbose = TRUE;
+        } else if (!StrCmp(Argv[i], L"--glyph") ||
+            !StrCmp(Argv[i], L"-g")) {
+            Glyph = TRUE;
         } else if (!StrCmp(Argv[i], L"--help") ||
             !StrCmp(Argv[i], L"-h") ||
             !StrCmp(Argv[i], L"-?")) {
@@ -389,15 +395,18 @@ ShellAppMain(UINTN Argc, CHAR16 **Argv)
             goto Done;
         }
 
-        // allocate a buffer to read lines into
-        ReadLine = AllocateZeroPool(Size);
-        if (ReadLine == NULL) {
-            Print(L"ERROR: Could not allocate memory\n");
-            Status = EFI_OUT_OF_RESOURCES;
+        Status = LineReaderOpen(InFileHandle, LINE_READER_BLOCK_SIZE, &Reader);
+        if (EFI_ERROR(Status)) {
+            Print(L"ERROR: Could not read %s [%r]\n", FileName, Status);
             goto Done;
         }
     }
 
+    // the device list can run to thousands of lines
+    if (Glyph && EFI_ERROR(GlyphConsoleOpen())) {
+        Print(L"WARNING: Glyph console not available, using ConOut\n");
+    }
+
     HandleCount = HandleBufSize / sizeof (EFI_HANDLE);
 
     for (UINT16 Index = 0; Index < HandleCount; Index++) {
@@ -459,8 +468,7 @@ ShellAppMain(UINTN Argc, CHAR16 **Argv)
                                    DeviceHeader->SubVendorId, DeviceHeader->SubSystemId);
 
                              if (Verbose) {
-                                 SearchPciData( InFileHandle, 
-                                                ReadLine, 
+                                 SearchPciData( Reader,
                                                 PciHeader.VendorId, 
                                                 PciHeader.DeviceId);
                              }
@@ -485,12 +493,13 @@ ShellAppMain(UINTN Argc, CHAR16 **Argv)
     Print(L"\n");
 
 Done:
+    GlyphConsoleClose();
     if (HandleBuf != NULL) {
         FreePool(HandleBuf);
     }
     if (Verbose) {
-        if (ReadLine != NULL) {
-            FreePool(ReadLine);
+        if (Reader != NULL) {
+            LineReaderClose(Reader);
         }
         if (FullFileName != NULL) {
             FreePool(FullFileName);
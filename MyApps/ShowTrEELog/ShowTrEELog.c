@@ -13,6 +13,7 @@
 #include <Library/ShellLib.h>
 #include <Library/BaseMemoryLib.h>
 #include <Library/UefiBootServicesTableLib.h>
+#include <Library/GlyphConsoleLib.h>
 
 #include <Protocol/EfiShell.h>
 #include <Protocol/LoadedImage.h>
@@ -125,7 +126,7 @@ PrintLog(TCG_PCR_EVENT *Event, BOOLEAN Verbose)
 VOID
 Usage(CHAR16 *Str)
 {
-    Print(L"Usage: %s [-v|--verbose]\n", Str);
+    Print(L"Usage: %s [-v|--verbose] [-g|--glyph]\n", Str);
 }
 
 
@@ -141,15 +142,22 @@ ShellAppMain(UINTN Argc, CHAR16 **Argv)
     TCG_PCR_EVENT *Event = NULL;
     BOOLEAN LogTruncated;
     BOOLEAN Verbose = FALSE;
+    BOOLEAN Glyph = FALSE;
 
-    if (Argc == 2) {
-        if (!StrCmp(Argv[1], L"--verbose") ||
-            !StrCmp(Argv[1], L"-v")) {
+    for (int i = 1; i < Argc; i++) {
+        if (!StrCmp(Argv[i], L"--verbose") ||
+            !StrCmp(Argv[i], L"-v")) {
             Verbose = TRUE;
-        }
-        if (!StrCmp(Argv[1], L"--help") ||
-            !StrCmp(Argv[1], L"-h") ||
-            !StrCmp(Argv[1], L"-?")) {
+        } else if (!StrCmp(Argv[i], L"--glyph") ||
+            !StrCmp(Argv[i], L"-g")) {
+            Glyph = TRUE;
+        } else if (!StrCmp(Argv[i], L"--help") ||
+            !StrCmp(Argv[i], L"-h") ||
+            !StrCmp(Argv[i], L"-?")) {
+            Usage(Argv[0]);
+            return Status;
+        } else {
+            Print(L"ERROR: Unknown option.\n");
             Usage(Argv[0]);
             return Status;
         }
@@ -173,6 +181,10 @@ ShellAppMain(UINTN Argc, CHAR16 **Argv)
         return Status;
     }  
 
+    if (Glyph && EFI_ERROR(GlyphConsoleOpen())) {
+        Print(L"WARNING: Glyph console not available, using ConOut\n");
+    }
+
     LogAddress = LogLocation;
     if (LogLocation != LogLastEntry) {
         do {
@@ -183,5 +195,7 @@ ShellAppMain(UINTN Argc, CHAR16 **Argv)
     }
     PrintLog((TCG_PCR_EVENT *)LogAddress, Verbose);
 
+    GlyphConsoleClose();
+
     return Status;
 }